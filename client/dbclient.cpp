@@ -778,6 +778,8 @@ namespace mongo {
             ss << f.fieldName() << "_";
             if( f.isNumber() )
                 ss << f.numberInt();
+            else if ( f.type() == String )
+                ss << f.valuestr(); // plugin indexes, e.g. x_hashed
         }
         return ss.str();
     }
@@ -23,6 +23,7 @@
 #include "../db/dbmessage.h"
 #include "../s/util.h"
 #include "../s/shard.h"
+#include "../util/concurrency/thread_pool.h"
 
 namespace mongo {
     
@@ -76,8 +77,25 @@ namespace mongo {
         }
         
         auto_ptr<DBClientCursor> cursor = 
-            conn->query( _ns , q , num , 0 , ( _fields.isEmpty() ? 0 : &_fields ) , _options , _batchSize == 0 ? 0 : _batchSize + skipLeft );
+            conn->query( _ns , q , num , 0 , ( _fields.isEmpty() ? 0 : &_fields ) , _options , _shardBatchSize( skipLeft ) );
         
+        _checkCursor( conn , cursor.get() );
+        return cursor;
+    }
+
+    int ClusteredCursor::_shardBatchSize( int skipLeft ) const {
+        if ( _batchSize == 0 )
+            return 0;
+        
+        // a negative batch size is a hard limit: each server needs at most skip+limit and can 
+        // close its cursor after that
+        if ( _batchSize < 0 )
+            return _batchSize - skipLeft;
+        
+        return _batchSize + skipLeft;
+    }
+
+    void ClusteredCursor::_checkCursor( ShardConnection& conn , DBClientCursor * cursor ){
         if ( cursor->hasResultFlag( ResultFlag_ShardConfigStale ) ){
             conn.done();
             throw StaleConfigException( _ns , "ClusteredCursor::query" );
@@ -93,7 +111,6 @@ namespace mongo {
         cursor->attach( &conn );
 
         conn.done();
-        return cursor;
     }
 
     BSONObj ClusteredCursor::explain( const string& server , BSONObj extra ){
@@ -181,20 +198,48 @@ namespace mongo {
     }
     
     // --------  FilteringClientCursor -----------
+
+    /* a getMore running on the prefetch pool for one FilteringClientCursor.  the pool also 
+       runs ParallelSortClusteredCursor's first queries to the shards */
+    struct FilteringClientCursor::Prefetch : boost::noncopyable {
+        enum State { Queued , Running , Cancelled , Done };
+
+        Prefetch() : m( "FilteringClientCursor::Prefetch" ) , state( Queued ){}
+
+        mongo::mutex m;
+        boost::condition c;
+        State state;
+        string error;
+    };
+
+    static mongo::mutex prefetchPoolMutex( "prefetchPool" );
+    static ThreadPool * prefetchPool = 0;
+
+    static ThreadPool& getPrefetchPool(){
+        scoped_lock lk( prefetchPoolMutex );
+        if ( ! prefetchPool )
+            prefetchPool = new ThreadPool( 16 );
+        return *prefetchPool;
+    }
+
     FilteringClientCursor::FilteringClientCursor( const BSONObj filter )
-        : _matcher( filter ) , _done( true ){
+        : _matcher( filter ) , _done( true ) , _prefetch( false ) , _refetchAt( 0 ){
     }
 
     FilteringClientCursor::FilteringClientCursor( auto_ptr<DBClientCursor> cursor , const BSONObj filter )
-        : _matcher( filter ) , _cursor( cursor ) , _done( cursor.get() == 0 ){
+        : _matcher( filter ) , _cursor( cursor ) , _done( _cursor.get() == 0 ) , _prefetch( false ) , _refetchAt( 0 ){
     }
     
     FilteringClientCursor::~FilteringClientCursor(){
+        // the pool may still be using _cursor
+        DESTRUCTOR_GUARD( _finishPrefetch(); );
     }
         
     void FilteringClientCursor::reset( auto_ptr<DBClientCursor> cursor ){
+        _finishPrefetch();
         _cursor = cursor;
         _next = BSONObj();
+        _buffer.clear();
         _done = _cursor.get() == 0;
     }
 
@@ -213,9 +258,10 @@ namespace mongo {
         assert( ! _next.isEmpty() );
         assert( ! _done );
 
+        // advancing is left to the next more() or peek() so a caller that is done doesn't wait
+        // on a batch it won't use
         BSONObj ret = _next;
         _next = BSONObj();
-        _advance();
         return ret;
     }
 
@@ -229,6 +275,29 @@ namespace mongo {
         assert( _next.isEmpty() );
         if ( ! _cursor.get() || _done )
             return;
+
+        if ( _prefetch ){
+            while ( true ){
+                if ( _buffer.empty() ){
+                    _fill();
+                    if ( _buffer.empty() )
+                        break;
+                }
+                
+                BSONObj o = _buffer.front();
+                _buffer.pop_front();
+                
+                if ( ! _pending && _buffer.size() <= _refetchAt && ! _cursor->isDead() )
+                    _startPrefetch();
+
+                if ( _matcher.matches( o ) ){
+                    _next = o;
+                    return;
+                }
+            }
+            _done = true;
+            return;
+        }
         
         while ( _cursor->more() ){
             _next = _cursor->next();
@@ -241,6 +310,70 @@ namespace mongo {
         }
         _done = true;
     }
+
+    /* copies what is left of the cursor's current batch into _buffer, fetching a batch if needed */
+    void FilteringClientCursor::_fill(){
+        _finishPrefetch();
+        
+        while ( _buffer.empty() && _cursor->more() ){
+            while ( _cursor->moreInCurrentBatch() && _cursor->more() )
+                _buffer.push_back( _cursor->next().getOwned() );
+        }
+        
+        _refetchAt = _buffer.size() / 2;
+    }
+
+    void FilteringClientCursor::_startPrefetch(){
+        assert( ! _pending );
+        _pending.reset( new Prefetch() );
+        getPrefetchPool().schedule( FilteringClientCursor::_runPrefetch , _pending , _cursor.get() );
+    }
+
+    void FilteringClientCursor::_runPrefetch( shared_ptr<Prefetch> p , DBClientCursor * cursor ){
+        {
+            scoped_lock lk( p->m );
+            if ( p->state == Prefetch::Cancelled )
+                return;
+            p->state = Prefetch::Running;
+        }
+
+        string error;
+        try {
+            cursor->more();
+        }
+        catch ( std::exception& e ){
+            error = e.what();
+        }
+        catch ( ... ){
+            error = "unknown exception";
+        }
+        
+        scoped_lock lk( p->m );
+        p->error = error;
+        p->state = Prefetch::Done;
+        p->c.notify_all();
+    }
+
+    void FilteringClientCursor::_finishPrefetch(){
+        if ( ! _pending )
+            return;
+        
+        shared_ptr<Prefetch> p = _pending;
+        _pending.reset();
+        
+        {
+            scoped_lock lk( p->m );
+            if ( p->state == Prefetch::Queued ){
+                // the pool is busy, quicker to fetch it ourselves than to wait our turn
+                p->state = Prefetch::Cancelled;
+                return;
+            }
+            while ( p->state != Prefetch::Done )
+                p->c.wait( lk.boost() );
+        }
+
+        uassert( 13442 , (string)"getMore from shard failed: " + p->error , p->error.empty() );
+    }
     
     // --------  SerialServerClusteredCursor -----------
     
@@ -295,6 +428,99 @@ namespace mongo {
     }
 
     // --------  ParallelSortClusteredCursor -----------
+
+    /* one server's first batch, requested on its own thread */
+    class ShardInitialQuery : boost::noncopyable {
+    public:
+        ShardInitialQuery( const string& server , const string& ns , const BSONObj& q , 
+                           const BSONObj& fields , int options , int batchSize )
+            : _server( server ) , _ns( ns ) , _q( q ) , _fields( fields ) , _options( options ) , 
+              _batchSize( batchSize ) , conn( server , ns ) , 
+              _m( "ShardInitialQuery" ) , _state( Queued ){
+        }
+
+        /* the connection's version must already have been set */
+        void run(){
+            try {
+                cursor = conn.get()->query( _ns , _q , 0 , 0 , ( _fields.isEmpty() ? 0 : &_fields ) , _options , _batchSize );
+                if ( ! cursor.get() )
+                    error = "no cursor";
+            }
+            catch ( std::exception& e ){
+                error = e.what();
+            }
+            catch ( ... ){
+                error = "unknown exception";
+            }
+        }
+
+        /* run() for the prefetch pool, unless finish() got to it first */
+        static void runQueued( shared_ptr<ShardInitialQuery> q ){
+            {
+                scoped_lock lk( q->_m );
+                if ( q->_state == Cancelled )
+                    return;
+                q->_state = Running;
+            }
+            
+            q->run();
+            
+            scoped_lock lk( q->_m );
+            q->_state = Done;
+            q->_c.notify_all();
+        }
+
+        /* waits for runQueued(), or runs the query here if the pool hasn't started it */
+        void finish(){
+            {
+                scoped_lock lk( _m );
+                if ( _state != Queued ){
+                    while ( _state != Done )
+                        _c.wait( lk.boost() );
+                    return;
+                }
+                _state = Cancelled;
+            }
+            run();
+        }
+
+        string _server;
+        string _ns;
+        BSONObj _q;
+        BSONObj _fields;
+        int _options;
+        int _batchSize;
+
+        ShardConnection conn;
+        auto_ptr<DBClientCursor> cursor; // after conn so it goes first
+        string error;
+
+    private:
+        enum State { Queued , Running , Cancelled , Done };
+        
+        mongo::mutex _m;
+        boost::condition _c;
+        State _state;
+    };
+
+    /* max heap order, so the cursor whose next object sorts first is on top */
+    class ParallelSortClusteredCursor::HeapCmp {
+    public:
+        HeapCmp( FilteringClientCursor * cursors , const BSONObj& sortKey ) 
+            : _cursors( cursors ) , _sortKey( sortKey ){
+        }
+
+        bool operator()( int a , int b ) const {
+            int comp = _cursors[a].peek().woSortOrder( _cursors[b].peek() , _sortKey , true );
+            if ( comp )
+                return comp > 0;
+            return a > b;
+        }
+
+    private:
+        FilteringClientCursor * _cursors;
+        const BSONObj& _sortKey;
+    };
     
     ParallelSortClusteredCursor::ParallelSortClusteredCursor( const set<ServerAndQuery>& servers , QueryMessage& q , 
                                                               const BSONObj& sortKey ) 
@@ -316,14 +542,59 @@ namespace mongo {
     void ParallelSortClusteredCursor::_init(){
         _numServers = _servers.size();
         _cursors = new FilteringClientCursor[_numServers];
-            
-        // TODO: parellize
-        int num = 0;
+        _heapInit = false;
+        _lastFrom = -1;
+        
+        if ( _numServers == 1 ){
+            const ServerAndQuery& sq = *_servers.begin();
+            _cursors[0].reset( query( sq._server , 0 , sq._extra , _needToSkip ) );
+            _cursors[0].prefetch( true );
+            return;
+        }
+
+        uassert( 13459 ,  "cursor already done" , ! _done );
+        
+        vector< shared_ptr<ShardInitialQuery> > queries;
         for ( set<ServerAndQuery>::iterator i = _servers.begin(); i!=_servers.end(); i++ ){
             const ServerAndQuery& sq = *i;
-            _cursors[num++].reset( query( sq._server , 0 , sq._extra , _needToSkip ) );
+            BSONObj q = _query;
+            if ( ! sq._extra.isEmpty() )
+                q = concatQuery( q , sq._extra );
+            queries.push_back( shared_ptr<ShardInitialQuery>( 
+                new ShardInitialQuery( sq._server , _ns , q , _fields , _options , _shardBatchSize( _needToSkip ) ) ) );
         }
+
+        // versions are set here, as ShardConnection's bookkeeping is per thread
+        for ( unsigned i=0; i<queries.size(); i++ ){
+            if ( queries[i]->conn.setVersion() ){
+                for ( unsigned j=0; j<queries.size(); j++ )
+                    queries[j]->conn.done();
+                throw StaleConfigException( _ns , "ParallelSortClusteredCursor::_init ShardConnection had to change" , true );
+            }
+        }
+        
+        // the first one runs here while the pool runs the others
+        for ( unsigned i=1; i<queries.size(); i++ )
+            getPrefetchPool().schedule( ShardInitialQuery::runQueued , queries[i] );
+        if ( queries.size() )
+            queries[0]->run();
+        for ( unsigned i=1; i<queries.size(); i++ )
+            queries[i]->finish();
+
+        for ( unsigned i=0; i<queries.size(); i++ ){
+            ShardInitialQuery& iq = *queries[i];
+            if ( iq.error.size() ){
+                iq.conn.kill();
+                uasserted( 13443 , (string)"query to shard " + iq._server + " failed: " + iq.error );
+            }
             
+            log(5) << "ParallelSortClusteredCursor::_init server:" << iq._server << " ns:" << _ns 
+                   << " query:" << iq._q << " batchSize:" << iq._batchSize << endl;
+
+            _checkCursor( iq.conn , iq.cursor.get() );
+            _cursors[i].reset( iq.cursor );
+            _cursors[i].prefetch( true );
+        }
     }
     
     ParallelSortClusteredCursor::~ParallelSortClusteredCursor(){
@@ -344,41 +615,39 @@ namespace mongo {
             _needToSkip = n;
         }
         
-        for ( int i=0; i<_numServers; i++ ){
-            if ( _cursors[i].more() )
-                return true;
-        }
-        return false;
+        _fillHeap();
+        return ! _heap.empty();
     }
         
     BSONObj ParallelSortClusteredCursor::next(){
-        BSONObj best = BSONObj();
-        int bestFrom = -1;
-            
-        for ( int i=0; i<_numServers; i++){
-            if ( ! _cursors[i].more() )
-                continue;
-            
-            BSONObj me = _cursors[i].peek();
+        _fillHeap();
+        uassert( 10019 ,  "no more elements" , ! _heap.empty() );
 
-            if ( best.isEmpty() ){
-                best = me;
-                bestFrom = i;
-                continue;
+        pop_heap( _heap.begin() , _heap.end() , HeapCmp( _cursors , _sortKey ) );
+        _lastFrom = _heap.back();
+        _heap.pop_back();
+        
+        return _cursors[_lastFrom].next();
+    }
+
+    /* puts back the cursor last taken from, which is only advanced when the next object is wanted */
+    void ParallelSortClusteredCursor::_fillHeap(){
+        if ( ! _heapInit ){
+            for ( int i=0; i<_numServers; i++ ){
+                if ( _cursors[i].more() )
+                    _heap.push_back( i );
             }
-                
-            int comp = best.woSortOrder( me , _sortKey , true );
-            if ( comp < 0 )
-                continue;
-                
-            best = me;
-            bestFrom = i;
+            make_heap( _heap.begin() , _heap.end() , HeapCmp( _cursors , _sortKey ) );
+            _heapInit = true;
+        }
+
+        if ( _lastFrom >= 0 ){
+            if ( _cursors[_lastFrom].more() ){
+                _heap.push_back( _lastFrom );
+                push_heap( _heap.begin() , _heap.end() , HeapCmp( _cursors , _sortKey ) );
+            }
+            _lastFrom = -1;
         }
-        
-        uassert( 10019 ,  "no more elements" , ! best.isEmpty() );
-        _cursors[bestFrom].next();
-            
-        return best;
     }
 
     void ParallelSortClusteredCursor::_explain( map< string,list<BSONObj> >& out ){
@@ -27,6 +27,8 @@
 
 namespace mongo {
 
+    class ShardConnection;
+
     /**
      * holder for a server address and a query to run
      */
@@ -84,6 +86,12 @@ namespace mongo {
     protected:
         auto_ptr<DBClientCursor> query( const string& server , int num = 0 , BSONObj extraFilter = BSONObj() , int skipLeft = 0 );
         BSONObj explain( const string& server , BSONObj extraFilter = BSONObj() );
+
+        /** the batch size to ask each server for when skipLeft documents may still be skipped here */
+        int _shardBatchSize( int skipLeft ) const;
+
+        /** throws if the server's reply was an error, otherwise hands the connection back */
+        void _checkCursor( ShardConnection& conn , DBClientCursor * cursor );
         
         static BSONObj _concatFilter( const BSONObj& filter , const BSONObj& extraFilter );
         
@@ -108,17 +116,38 @@ namespace mongo {
         void reset( auto_ptr<DBClientCursor> cursor );
         
         bool more();
+
+        /** the object returned is only valid until the next call to more(), next() or peek() */
         BSONObj next();
         
         BSONObj peek();
+
+        /**
+         * copy each batch out of the cursor and fetch the next one on a background thread while
+         * the copy is consumed.  the cursor must not be using a connection of this thread, 
+         * i.e. it came from ClusteredCursor::query which attaches it to the pool.
+         */
+        void prefetch( bool p ){ _prefetch = p; }
+
     private:
+        struct Prefetch;
+
         void _advance();
+        void _fill();
+        void _startPrefetch();
+        void _finishPrefetch();
+        static void _runPrefetch( shared_ptr<Prefetch> p , DBClientCursor * cursor );
         
         Matcher _matcher;
         auto_ptr<DBClientCursor> _cursor;
         
         BSONObj _next;
         bool _done;
+
+        bool _prefetch;
+        deque<BSONObj> _buffer; // owned copies of the current batch
+        unsigned _refetchAt;    // start fetching the next batch once _buffer is down to this
+        shared_ptr<Prefetch> _pending;
     };
 
 
@@ -201,7 +230,7 @@ namespace mongo {
 
     /**
      * runs a query in parellel across N servers
-     * sots
+     * sorts by merging the servers' sorted results through a heap
      */        
     class ParallelSortClusteredCursor : public ClusteredCursor {
     public:
@@ -213,7 +242,10 @@ namespace mongo {
         virtual BSONObj next();
         virtual string type() const { return "ParallelSort"; }
     private:
+        class HeapCmp;
+
         void _init();
+        void _fillHeap();
 
         virtual void _explain( map< string,list<BSONObj> >& out );
 
@@ -223,6 +255,10 @@ namespace mongo {
         
         FilteringClientCursor * _cursors;
         int _needToSkip;
+
+        vector<int> _heap;  // cursors with more, the one whose next object sorts first on top
+        bool _heapInit;
+        int _lastFrom;      // cursor next() last took from, not yet back in _heap
     };
 
     /**
@@ -0,0 +1,319 @@
+// aggregate.h
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../pch.h"
+#include "jsobj.h"
+
+namespace mongo {
+
+    /* native group by for the aggregate command, so simple sums and counts don't need a js scope:
+
+         { aggregate : <collection> , key : { a : 1 } , query : { ... } ,
+           fields : { total : { $sum : "x" } , n : { $count : 1 } , ... } }
+
+       with partial : true each group's state is returned in a form that can be merged (an $avg
+       as { sum , n }).  mongos runs that on each shard and merges the results here.
+       shared by mongod and mongos, so header only.
+    */
+
+    /* one output field: { <name> : { <$op> : "<field>" } } */
+    class Accumulator {
+    public:
+        enum Op { Sum , Avg , Min , Max , Count , First , Last , Push };
+
+        Accumulator( const BSONElement& e ) : name( e.fieldName() ) {
+            uassert( 13428 , (string)"aggregate field " + name + " must be { $op : <field> }" ,
+                     e.type() == Object && e.embeddedObject().nFields() == 1 );
+            BSONElement spec = e.embeddedObject().firstElement();
+            string opName = spec.fieldName();
+            if ( opName == "$sum" ) op = Sum;
+            else if ( opName == "$avg" ) op = Avg;
+            else if ( opName == "$min" ) op = Min;
+            else if ( opName == "$max" ) op = Max;
+            else if ( opName == "$count" ) op = Count;
+            else if ( opName == "$first" ) op = First;
+            else if ( opName == "$last" ) op = Last;
+            else if ( opName == "$push" ) op = Push;
+            else uassert( 13429 , (string)"unknown aggregate accumulator: " + opName , false );
+
+            if ( op != Count ) {
+                uassert( 13430 , (string)"argument of " + opName + " must be a field name" , spec.type() == String );
+                field = spec.valuestr();
+            }
+        }
+
+        string name;
+        Op op;
+        string field; // dotted path, unused by $count
+    };
+
+    /* the running value of one Accumulator for one group */
+    class AccumulatorState {
+    public:
+        AccumulatorState() : _n(0) , _longSum(0) , _doubleSum(0) , _sawDouble(false) {}
+
+        void add( const Accumulator& a , const BSONObj& doc ) {
+            if ( a.op == Accumulator::Count ) {
+                _n++;
+                return;
+            }
+
+            BSONElement e = doc.getFieldDotted( a.field.c_str() );
+            switch ( a.op ) {
+            case Accumulator::Sum:
+                addNumber( e );
+                break;
+            case Accumulator::Avg:
+                if ( e.isNumber() ) {
+                    addNumber( e );
+                    _n++;
+                }
+                break;
+            case Accumulator::Min:
+                if ( ! e.eoo() && ( _value.isEmpty() || e.woCompare( _value.firstElement() , false ) < 0 ) )
+                    _value = wrap( e );
+                break;
+            case Accumulator::Max:
+                if ( ! e.eoo() && ( _value.isEmpty() || e.woCompare( _value.firstElement() , false ) > 0 ) )
+                    _value = wrap( e );
+                break;
+            case Accumulator::First:
+                if ( _value.isEmpty() )
+                    _value = wrap( e );
+                break;
+            case Accumulator::Last:
+                _value = wrap( e );
+                break;
+            case Accumulator::Push:
+                if ( ! e.eoo() )
+                    _values.push_back( wrap( e ) );
+                break;
+            default:
+                assert( false );
+            }
+        }
+
+        /* e is this accumulator's field of a row produced by append( ... , true ) */
+        void merge( const Accumulator& a , const BSONElement& e ) {
+            switch ( a.op ) {
+            case Accumulator::Count:
+                _n += e.numberLong();
+                break;
+            case Accumulator::Sum:
+                addNumber( e );
+                break;
+            case Accumulator::Avg:
+                addNumber( e.embeddedObject()["sum"] );
+                _n += e.embeddedObject()["n"].numberLong();
+                break;
+            case Accumulator::Min:
+                if ( _value.isEmpty() || e.woCompare( _value.firstElement() , false ) < 0 )
+                    _value = wrap( e );
+                break;
+            case Accumulator::Max:
+                if ( _value.isEmpty() || e.woCompare( _value.firstElement() , false ) > 0 )
+                    _value = wrap( e );
+                break;
+            case Accumulator::First:
+                if ( _value.isEmpty() )
+                    _value = wrap( e );
+                break;
+            case Accumulator::Last:
+                _value = wrap( e );
+                break;
+            case Accumulator::Push: {
+                BSONObjIterator i( e.embeddedObject() );
+                while ( i.more() )
+                    _values.push_back( wrap( i.next() ) );
+                break;
+            }
+            default:
+                assert( false );
+            }
+        }
+
+        /* partial leaves out a $min/$max that saw no values, so merging doesn't mistake it for null */
+        void append( const Accumulator& a , BSONObjBuilder& b , bool partial ) const {
+            const char * name = a.name.c_str();
+            switch ( a.op ) {
+            case Accumulator::Count:
+                b.appendNumber( name , _n );
+                break;
+            case Accumulator::Sum:
+                appendSum( b , name );
+                break;
+            case Accumulator::Avg:
+                if ( partial ) {
+                    BSONObjBuilder avg( b.subobjStart( name ) );
+                    appendSum( avg , "sum" );
+                    avg.appendNumber( "n" , _n );
+                    avg.done();
+                }
+                else if ( _n ) {
+                    b.append( name , ( _doubleSum + _longSum ) / _n );
+                }
+                else {
+                    b.appendNull( name );
+                }
+                break;
+            case Accumulator::Min:
+            case Accumulator::Max:
+            case Accumulator::First:
+            case Accumulator::Last:
+                if ( ! _value.isEmpty() )
+                    b.appendAs( _value.firstElement() , name );
+                else if ( ! partial )
+                    b.appendNull( name );
+                break;
+            case Accumulator::Push: {
+                BSONArrayBuilder arr( b.subarrayStart( name ) );
+                for ( vector<BSONObj>::const_iterator i = _values.begin(); i != _values.end(); ++i )
+                    arr.append( i->firstElement() );
+                arr.done();
+                break;
+            }
+            default:
+                assert( false );
+            }
+        }
+
+    private:
+        void addNumber( const BSONElement& e ) {
+            if ( e.type() == NumberDouble ) {
+                _doubleSum += e.number();
+                _sawDouble = true;
+            }
+            else if ( e.isNumber() ) {
+                _longSum += e.numberLong();
+            }
+        }
+
+        void appendSum( BSONObjBuilder& b , const char * name ) const {
+            if ( _sawDouble )
+                b.append( name , _doubleSum + _longSum );
+            else
+                b.appendNumber( name , _longSum );
+        }
+
+        /* missing fields become null, as for a missing group key field */
+        static BSONObj wrap( const BSONElement& e ) {
+            BSONObjBuilder b( e.size() + 8 );
+            if ( e.eoo() )
+                b.appendNull( "" );
+            else
+                b.appendAs( e , "" );
+            return b.obj();
+        }
+
+        long long _n;             // documents for $count, values for $avg
+        long long _longSum;
+        double _doubleSum;
+        bool _sawDouble;
+        BSONObj _value;           // { "" : value } for $min $max $first $last
+        vector<BSONObj> _values;  // $push
+    };
+
+    class Aggregator {
+    public:
+        enum { MaxGroups = 100000 };
+
+        /* cmd is the aggregate command object; uasserts if it is malformed */
+        Aggregator( const BSONObj& cmd ) : _count(0) {
+            if ( cmd["key"].isABSONObj() )
+                _key = cmd["key"].embeddedObject().getOwned();
+
+            BSONElement fields = cmd["fields"];
+            uassert( 13427 , "aggregate fields must be an object" , fields.eoo() || fields.type() == Object );
+            if ( fields.type() == Object ) {
+                BSONObjIterator i( fields.embeddedObject() );
+                while ( i.more() ) {
+                    Accumulator a( i.next() );
+                    uassert( 13431 , (string)"aggregate field " + a.name + " is also a key field" ,
+                             _key[ a.name.c_str() ].eoo() );
+                    _accumulators.push_back( a );
+                }
+            }
+        }
+
+        /* doc matched the query */
+        void add( const BSONObj& doc ) {
+            vector<AccumulatorState>& g = group( doc.extractFields( _key , true ) );
+            for ( unsigned i = 0; i < _accumulators.size(); i++ )
+                g[i].add( _accumulators[i] , doc );
+            _count++;
+        }
+
+        /* res is the result of the same command run with partial : true */
+        void merge( const BSONObj& res ) {
+            int nKey = _key.nFields();
+            BSONObjIterator rows( res["retval"].embeddedObject() );
+            while ( rows.more() ) {
+                BSONObj row = rows.next().embeddedObject();
+
+                // key fields come first; they may be dotted so take them by position
+                BSONObjBuilder kb;
+                BSONObjIterator i( row );
+                for ( int k = 0; k < nKey && i.more(); k++ )
+                    kb.append( i.next() );
+
+                vector<AccumulatorState>& g = group( kb.obj() );
+                for ( unsigned j = 0; j < _accumulators.size(); j++ ) {
+                    BSONElement e = row[ _accumulators[j].name.c_str() ];
+                    if ( ! e.eoo() )
+                        g[j].merge( _accumulators[j] , e );
+                }
+            }
+            _count += res["count"].numberLong();
+        }
+
+        /* appends retval, count and keys as group does */
+        void append( BSONObjBuilder& result , bool partial ) const {
+            BSONArrayBuilder arr( result.subarrayStart( "retval" ) );
+            for ( Groups::const_iterator i = _groups.begin(); i != _groups.end(); ++i ) {
+                BSONObjBuilder b( arr.subobjStart() );
+                b.appendElements( i->first );
+                for ( unsigned j = 0; j < _accumulators.size(); j++ )
+                    i->second[j].append( _accumulators[j] , b , partial );
+                b.done();
+            }
+            BSONObj res = arr.done();
+            uassert( 13432 , "aggregate result too big, 4mb cap" , res.objsize() + 1024 < 4 * 1024 * 1024 );
+            result.appendNumber( "count" , _count );
+            result.append( "keys" , (int) _groups.size() );
+        }
+
+    private:
+        typedef map< BSONObj , vector<AccumulatorState> , BSONObjCmp > Groups;
+
+        vector<AccumulatorState>& group( const BSONObj& key ) {
+            Groups::iterator i = _groups.find( key );
+            if ( i != _groups.end() )
+                return i->second;
+            uassert( 13433 , "aggregate can't handle more than 100000 unique keys" , _groups.size() < MaxGroups );
+            return _groups[ key.getOwned() ] = vector<AccumulatorState>( _accumulators.size() );
+        }
+
+        BSONObj _key;
+        vector<Accumulator> _accumulators;
+        Groups _groups;
+        long long _count; // documents aggregated
+    };
+
+}
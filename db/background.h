@@ -48,6 +48,7 @@ namespace mongo {
 
     private:
         NamespaceString _ns;
+        static mongo::mutex m; // the write lock may only cover one database
         static map<string, unsigned> dbsInProg;
         static set<string> nsInProg;
     };
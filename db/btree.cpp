@@ -572,6 +572,7 @@ found:
         modified(thisLoc);
 #else
         //defensive:
+        modified(thisLoc);
         n = -1;
         parent.Null();
         string ns = id.indexNamespace();
@@ -753,7 +754,7 @@ found:
                 p->pushBack(splitkey.recordLoc, splitkey.key, order, thisLoc);
                 p->nextChild = rLoc;
                 p->assertValid( order );
-                parent = idx.head = L;
+                parent = *dur::writing( &idx.head ) = L;
                 if ( split_debug )
                     out() << "    we were root, making new root:" << hex << parent.getOfs() << dec << endl;
                 rLoc.btreemod()->parent = parent;
@@ -1029,6 +1030,7 @@ found:
                 log(4) << "btree _insert: reusing unused key" << endl;
                 massert( 10285 , "_insert: reuse key but lchild is not null", lChild.isNull());
                 massert( 10286 , "_insert: reuse key but rchild is not null", rChild.isNull());
+                modified(thisLoc);
                 kn.setUsed();
                 return 0;
             }
@@ -1222,7 +1224,7 @@ namespace mongo {
         while( 1 ) { 
             if( loc.btree()->tempNext().isNull() ) { 
                 // only 1 bucket at this level. we are done.
-                idx.head = loc;
+                *dur::writing( &idx.head ) = loc;
                 break;
             }
             levels++;
@@ -287,6 +287,7 @@ namespace mongo {
         virtual void checkLocation();
         virtual bool supportGetMore() { return true; }
         virtual bool supportYields() { return true; }
+        virtual Record* recordToFetch();
 
         /* used for multikey index traversal to avoid sending back dups. see Matcher::matches().
            if a multikey index traversal:
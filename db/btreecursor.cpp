@@ -186,6 +186,13 @@ namespace mongo {
         return ok();
     }
 
+    Record* BtreeCursor::recordToFetch() {
+        if ( !ok() )
+            return 0;
+        Record *r = _current();
+        return r->likelyInPhysicalMemory() ? 0 : r;
+    }
+
     void BtreeCursor::noteLocation() {
         if ( !eof() ) {
             BSONObj o = bucket.btree()->keyAt(keyOfs).copy();
@@ -55,6 +55,7 @@ namespace mongo {
     */
     void NamespaceDetails::compact() {
         assert(capped);
+        dur::writing( this );
 
         list<DiskLoc> drecs;
 
@@ -62,7 +63,7 @@ namespace mongo {
         DiskLoc i = cappedFirstDeletedInCurExtent();
         for (; !i.isNull() && inCapExtent( i ); i = i.drec()->nextDeleted )
             drecs.push_back( i );
-        cappedFirstDeletedInCurExtent() = i;
+        *dur::writing( &cappedFirstDeletedInCurExtent() ) = i;
 
         // This is the O(n^2) part.
         drecs.sort();
@@ -80,7 +81,7 @@ namespace mongo {
             DiskLoc b = *j;
             while ( a.a() == b.a() && a.getOfs() + a.drec()->lengthWithHeaders == b.getOfs() ) {
                 // a & b are adjacent.  merge.
-                a.drec()->lengthWithHeaders += b.drec()->lengthWithHeaders;
+                dur::writing( a.drec() )->lengthWithHeaders += b.drec()->lengthWithHeaders;
                 j++;
                 if ( j == drecs.end() ) {
                     DEBUGGING out() << "temp: compact adddelrec2\n";
@@ -106,6 +107,7 @@ namespace mongo {
         // migrate old NamespaceDetails format
         assert( capped );
         if ( capExtent.a() == 0 && capExtent.getOfs() == 0 ) {
+            dur::writing( this );
             capFirstNewRecord = DiskLoc();
             capFirstNewRecord.setInvalid();
             // put all the DeletedRecords in cappedListOfAllDeletedRecords()
@@ -115,7 +117,7 @@ namespace mongo {
                     continue;
                 DiskLoc last = first;
                 for (; !last.drec()->nextDeleted.isNull(); last = last.drec()->nextDeleted );
-                last.drec()->nextDeleted = cappedListOfAllDeletedRecords();
+                dur::writing( last.drec() )->nextDeleted = cappedListOfAllDeletedRecords();
                 cappedListOfAllDeletedRecords() = first;
                 deletedList[ i ] = DiskLoc();
             }
@@ -143,6 +145,7 @@ namespace mongo {
     void NamespaceDetails::advanceCapExtent( const char *ns ) {
         // We want cappedLastDelRecLastExtent() to be the last DeletedRecord of the prev cap extent
         // (or DiskLoc() if new capExtent == firstExtent)
+        dur::writing( this );
         if ( capExtent == lastExtent )
             cappedLastDelRecLastExtent() = DiskLoc();
         else {
@@ -176,10 +179,10 @@ namespace mongo {
         /* unlink ourself from the deleted list */
         if ( !ret.isNull() ) {
             if ( prev.isNull() )
-                cappedListOfAllDeletedRecords() = ret.drec()->nextDeleted;
+                *dur::writing( &cappedListOfAllDeletedRecords() ) = ret.drec()->nextDeleted;
             else
-                prev.drec()->nextDeleted = ret.drec()->nextDeleted;
-            ret.drec()->nextDeleted.setInvalid(); // defensive.
+                dur::writing( prev.drec() )->nextDeleted = ret.drec()->nextDeleted;
+            dur::writing( ret.drec() )->nextDeleted.setInvalid(); // defensive.
             assert( ret.drec()->extentOfs < ret.getOfs() );
         }
 
@@ -187,6 +190,7 @@ namespace mongo {
     }
 
     DiskLoc NamespaceDetails::cappedAlloc(const char *ns, int len) { 
+        dur::writing( this );
         // signal done allocating new extents.
         if ( !cappedLastDelRecLastExtent().isValid() )
             cappedLastDelRecLastExtent() = DiskLoc();
@@ -284,6 +288,7 @@ namespace mongo {
     void NamespaceDetails::cappedTruncateAfter(const char *ns, DiskLoc end, bool inclusive) {
         DEV assert( this == nsdetails(ns) );
         assert( cappedLastDelRecLastExtent().isValid() );
+        dur::writing( this );
         
         bool foundLast = false;
         while( 1 ) {
@@ -43,6 +43,7 @@ namespace mongo {
       _shutdown(false),
       _desc(desc),
       _god(0),
+      _replWriter(false),
       _lastOp(0)
     {
         _curOp = new CurOp( this );
@@ -149,6 +150,7 @@ namespace mongo {
     void Client::Context::_finishInit( bool doauth ){
         int lockState = dbMutex.getState();
         assert( lockState );
+        dbMutex.assertCovers( _ns );
         
         _db = dbHolder.get( _ns , _path );
         if ( _db ){
@@ -258,6 +260,52 @@ namespace mongo {
         }
     }
 
+    static void appendLockStats( BSONObjBuilder& b , IntentLock& m , MutexInfo& info ){
+        b.appendNumber( "timeLockedMicros" , (long long) info.getTimeLocked() );
+        BSONObjBuilder w( b.subobjStart( "waits" ) );
+        for ( int i=0; i<IntentLock::NModes; i++ ){
+            IntentLock::Mode mode = (IntentLock::Mode) i;
+            unsigned long long n, micros;
+            m.waitStats( mode , n , micros );
+            if ( n )
+                w.append( IntentLock::modeName( mode ) , BSON( "n" << (long long) n << "micros" << (long long) micros ) );
+        }
+        w.done();
+    }
+
+    void MongoMutex::appendStats( BSONObjBuilder& b ){
+        {
+            BSONObjBuilder g( b.subobjStart( "global" ) );
+            appendLockStats( g , _m , _minfo );
+            g.done();
+        }
+
+        vector<NSLock*> dbs;
+        {
+            scoped_lock lk( _dbLocksMutex );
+            for ( map<string,NSLock*>::iterator i = _dbLocks.begin(); i != _dbLocks.end(); ++i )
+                dbs.push_back( i->second );
+        }
+
+        BSONObjBuilder d( b.subobjStart( "dbs" ) );
+        for ( unsigned i=0; i<dbs.size(); i++ ){
+            BSONObjBuilder x( d.subobjStart( dbs[i]->name.c_str() ) );
+            appendLockStats( x , dbs[i]->m , dbs[i]->info );
+
+            vector<NSLock*> colls;
+            dbs[i]->children( colls );
+            BSONObjBuilder c( x.subobjStart( "collections" ) );
+            for ( unsigned j=0; j<colls.size(); j++ ){
+                BSONObjBuilder y( c.subobjStart( colls[j]->name.c_str() + dbs[i]->name.size() + 1 ) );
+                appendLockStats( y , colls[j]->m , colls[j]->info );
+                y.done();
+            }
+            c.done();
+            x.done();
+        }
+        d.done();
+    }
+
     BSONObj CurOp::infoNoauth() {
         BSONObjBuilder b;
         b.append("opid", _opNum);
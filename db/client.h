@@ -157,6 +157,7 @@ namespace mongo {
         set<string> _tempCollections;
         const char *_desc;
         bool _god;
+        bool _replWriter;
         AuthenticationInfo _ai;
         ReplTime _lastOp;
         BSONObj _handshake;
@@ -216,6 +217,13 @@ namespace mongo {
 
         bool isGod() const { return _god; }
 
+        /* set on threads that apply ops fetched from a replica set primary.  those ops are 
+           written to our oplog afterwards by the sync thread, not by the thread applying them, 
+           so these threads may lock below the global level. see syncApplyBatch() 
+        */
+        void setReplWriter() { _replWriter = true; }
+        bool isReplWriter() const { return _replWriter; }
+
         friend class CurOp;
 
         string toString() const;
@@ -264,8 +272,10 @@ namespace mongo {
 #endif
 
             _writelock = true;
+            NSLock * scope = dbMutex.scope();
+            string ns = scope ? scope->name : "";
             dbMutex.unlock_shared();
-            dbMutex.lock();
+            dbMutex.lock( ns );
 
             if ( cc().getContext() )
                 cc().getContext()->unlocked();
@@ -29,6 +29,7 @@
 #include "db.h"
 #include "commands.h"
 #include "repl_block.h"
+#include "stats/counters.h"
 
 namespace mongo {
 
@@ -221,16 +222,22 @@ namespace mongo {
         return ( micros > 0 ) ? yield( micros ) : true;
     }
 
-    void ClientCursor::staticYield( int micros ) {
+    void ClientCursor::staticYield( int micros , Record *rec ) {
         {
             dbtempreleasecond unlock;
             if ( unlock.unlocked() ){
+                if ( rec ){
+                    rec->touch();
+                    globalRecordFaultCounters.faultWithoutLock();
+                }
                 if ( micros == -1 )
                     micros = Client::recommendedYieldMicros();
                 if ( micros > 0 )
                     sleepmicros( micros ); 
             }
             else {
+                if ( rec )
+                    globalRecordFaultCounters.faultWithLock();
                 log( LL_WARNING ) << "ClientCursor::yield can't unlock b/c of recursive lock" << endl;
             }
         }        
@@ -145,12 +145,13 @@ namespace mongo {
         BSONObj query;
         int _queryOptions;        // see enum QueryOptions dbclient.h
         OpTime _slaveReadTill;
+        bool indexOnly;           // results are built from the index key, the record isn't read
 
         ClientCursor(int queryOptions, shared_ptr<Cursor>& _c, const string& _ns) :
             _idleAgeMillis(0), _pinValue(0), 
             _doingDeletes(false), _yieldSometimesTracker(128,10),
             ns(_ns), c(_c), 
-            pos(0), _queryOptions(queryOptions)
+            pos(0), _queryOptions(queryOptions), indexOnly(false)
         {
             if( queryOptions & QueryOption_NoCursorTimeout )
                 noTimeout();
@@ -192,7 +193,12 @@ namespace mongo {
         bool yieldSometimes();
         
         static int yieldSuggest();
-        static void staticYield( int micros );
+
+        /**
+         * @param rec - if non-null, a record we are about to read that isn't in ram.  it is paged
+         *              in while we are unlocked.
+         */
+        static void staticYield( int micros , Record *rec = 0 );
         
         struct YieldData { CursorId _id; bool _doingDeletes; };
         void prepareToYield( YieldData &data );
@@ -183,15 +183,30 @@ namespace mongo {
         }
         
         if ( storedForLater.size() ){
-            for ( list<BSONObj>::iterator i = storedForLater.begin(); i!=storedForLater.end(); i++ ){
-                BSONObj js = *i;
-                try { 
-                    theDataFileMgr.insertWithObjMod(to_collection, js);
-                    if ( logForRepl )
-                        logOp("i", to_collection, js);
+            // build each collection's indexes together, so the collection is scanned once
+            map< string , vector<BSONObj> > byCollection;
+            for ( list<BSONObj>::iterator i = storedForLater.begin(); i!=storedForLater.end(); i++ )
+                byCollection[ i->getStringField( "ns" ) ].push_back( *i );
+
+            for ( map< string , vector<BSONObj> >::iterator i = byCollection.begin(); i != byCollection.end(); i++ ){
+                try {
+                    buildIndexes( i->first , i->second , logForRepl );
+                    continue;
                 }
-                catch( UserException& e ) { 
-                    log() << "warning: exception cloning object in " << from_collection << ' ' << e.what() << " obj:" << js.toString() << '\n';
+                catch( UserException& e ) {
+                    log() << "warning: exception building indexes for " << i->first << ' ' << e.what() << ", trying them one at a time" << endl;
+                }
+
+                for ( vector<BSONObj>::iterator j = i->second.begin(); j != i->second.end(); j++ ){
+                    BSONObj js = *j;
+                    try { 
+                        theDataFileMgr.insertWithObjMod(to_collection, js);
+                        if ( logForRepl )
+                            logOp("i", to_collection, js);
+                    }
+                    catch( UserException& e ) { 
+                        log() << "warning: exception cloning object in " << from_collection << ' ' << e.what() << " obj:" << js.toString() << '\n';
+                    }
                 }
             }
         }
@@ -387,6 +402,7 @@ namespace mongo {
             return false;
         }
         virtual LockType locktype() const { return WRITE; }
+        virtual bool lockGlobally() const { return true; }
         virtual void help( stringstream &help ) const {
             help << "clone this database from an instance of the db on another host\n";
             help << "{ clone : \"host13\" }";
@@ -47,6 +47,11 @@ namespace mongo {
 
         int pretouch;          // --pretouch for replication application (experimental)
         bool moveParanoia;     // for move chunk paranoia 
+        bool dbLocks;          // --dblocks lock per database where possible
+        int sortMemMB;         // --sortMemMB memory for a sort without an index before it spills to disk
+        int migrateCloneBatch; // --migrateCloneBatch documents applied per write lock when receiving a chunk
+        bool journal;          // --journal write ahead journaling, see dur.h
+        int journalCommitInterval; // --journalCommitInterval ms between group commits
 
         enum { 
             DefaultDBPort = 27017,
@@ -56,7 +61,7 @@ namespace mongo {
 
         CmdLine() : 
             port(DefaultDBPort), rest(false), quiet(false), notablescan(false), prealloc(true), smallfiles(false),
-            quota(false), quotaFiles(8), cpu(false), oplogSize(0), defaultProfile(0), slowMS(100), pretouch(0), moveParanoia( true )
+            quota(false), quotaFiles(8), cpu(false), oplogSize(0), defaultProfile(0), slowMS(100), pretouch(0), moveParanoia( true ), dbLocks( false ), sortMemMB( 32 ), migrateCloneBatch( 1000 ), journal( false ), journalCommitInterval( 10 )
         { } 
         
 
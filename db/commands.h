@@ -59,6 +59,14 @@ namespace mongo {
             return false;
         }
 
+        /* Return true if the command works on databases other than the one it was invoked on,
+           or opens/closes databases.  With --dblocks such commands still lock the whole server;
+           others lock only their own database.
+        */
+        virtual bool lockGlobally() const {
+            return adminOnly();
+        }
+
         void htmlHelp(stringstream&) const;
 
         /* Like adminOnly, but even stricter: we must either be authenticated for admin db, 
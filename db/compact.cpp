@@ -0,0 +1,210 @@
+// compact.cpp
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "pdfile.h"
+#include "namespace.h"
+#include "commands.h"
+#include "curop.h"
+#include "clientcursor.h"
+#include "background.h"
+
+namespace mongo {
+
+    /* the records of an extent, copied to the end of the collection's new chain.  not indexed:
+       the indexes still describe the old chain until the copy is complete.
+    */
+    static void copyRecords( const char *ns , Extent *e , ProgressMeterHolder& pm ) {
+        if ( e->firstRecord.isNull() )
+            return;
+        int a = e->firstRecord.a();
+        for ( int ofs = e->firstRecord.getOfs(); ofs != DiskLoc::NullOfs; ) {
+            Record *r = DiskLoc( a , ofs ).rec();
+            BSONObj o( r );
+            theDataFileMgr.insert( ns , o.objdata() , o.objsize() , /*god*/true , BSONElement() , true , /*deferIndexing*/true );
+            ofs = r->nextOfs;
+            killCurrentOp.checkForInterrupt();
+            pm.hit();
+        }
+    }
+
+    /* what the collection looked like before the copy, so a failed copy can put it back */
+    struct OldChain {
+        DiskLoc firstExtent, lastExtent;
+        DiskLoc deletedList[Buckets];
+        long long datasize, nrecords;
+        int lastExtentSize;
+        double paddingFactor;
+        OldChain( NamespaceDetails *d ) :
+            firstExtent( d->firstExtent ) , lastExtent( d->lastExtent ) ,
+            datasize( d->datasize ) , nrecords( d->nrecords ) ,
+            lastExtentSize( d->lastExtentSize ) , paddingFactor( d->paddingFactor ) {
+            for ( int i = 0; i < Buckets; i++ )
+                deletedList[i] = d->deletedList[i];
+        }
+        /* drop the partial copy and go back to the old chain */
+        void restore( NamespaceDetails *d ) {
+            if ( ! d->firstExtent.isNull() )
+                freeExtents( d->firstExtent , d->lastExtent );
+            dur::writing( d );
+            d->firstExtent = firstExtent;
+            d->lastExtent = lastExtent;
+            for ( int i = 0; i < Buckets; i++ )
+                d->deletedList[i] = deletedList[i];
+            d->datasize = datasize;
+            d->nrecords = nrecords;
+            d->lastExtentSize = lastExtentSize;
+            d->paddingFactor = paddingFactor;
+        }
+    };
+
+    /* repairDatabase rewrites every collection of a database into new files.  this rewrites one
+       collection within its database: the records are copied to a new, densely packed chain of
+       extents, and only once all of them are there does the old chain go to the free list.  that
+       takes free space (or disk) for one more copy of the collection's data, but the old records
+       stay intact until the copy is complete, and if the copy fails - out of disk, say, or
+       killed - the collection is put back as it was.  indexes are then dropped and built again
+       from the sorted keys, which is faster than maintaining them, and leaves them packed too.
+
+       the collection is in pieces until it is done, so this holds the write lock throughout instead
+       of yielding.  only the collection's database is locked.
+    */
+    bool compactCollection( const char *ns , string &errmsg , BSONObjBuilder &result ) {
+        NamespaceDetails *d = nsdetails( ns );
+        if ( ! d ) {
+            errmsg = "ns not found";
+            return false;
+        }
+        if ( d->capped ) {
+            errmsg = "can't compact a capped collection";
+            return false;
+        }
+        if ( NamespaceString( ns ).isSystem() ) {
+            errmsg = "can't compact a system collection";
+            return false;
+        }
+        BackgroundOperation::assertNoBgOpInProgForNs( ns );
+        killCurrentOp.checkForInterrupt();
+
+        Timer t;
+        log() << "compact " << ns << " begin" << endl;
+
+        int extentsBefore;
+        long long storageBefore = d->storageSize( &extentsBefore );
+        long long nrecords = d->nrecords;
+
+        vector<BSONObj> indexes;
+        {
+            NamespaceDetails::IndexIterator i = d->ii();
+            while ( i.more() ) {
+                BSONObjBuilder b;
+                BSONObjIterator j( i.next().info.obj() );
+                while ( j.more() ) {
+                    BSONElement e = j.next();
+                    if ( strcmp( e.fieldName() , "background" ) != 0 ) // they're built in the foreground below
+                        b.append( e );
+                }
+                indexes.push_back( b.obj() );
+            }
+        }
+
+        ClientCursor::invalidate( ns );
+
+        // the records go to an empty chain at no more than their size.  size classes stay.  the old
+        // deleted lists point into the old extents, which must not be reused while they're copied.
+        long long size = d->datasize;
+        if ( ! d->usePowerOf2Sizes() && d->paddingFactor > 1.0 )
+            size = (long long) ( size / d->paddingFactor );
+        size += d->nrecords * Record::HeaderSize;
+        OldChain old( d );
+        dur::writing( d );
+        d->firstExtent.Null();
+        d->lastExtent.Null();
+        for ( int i = 0; i < Buckets; i++ )
+            d->deletedList[i].Null();
+        d->datasize = 0;
+        d->nrecords = 0;
+        d->lastExtentSize = 0;
+        d->paddingFactor = 1.0;
+
+        try {
+            // one extent for all of it if it fits, so the records end up in order
+            int max = MongoDataFile::maxSize() - DataFileHeader::HeaderSize;
+            size += size / 64 + 4096;
+            cc().database()->allocExtent( ns , (int) ( size > max ? max : size ) , false );
+
+            ProgressMeterHolder pm( cc().curop()->setMessage( "compact: (1/2) copying records" , nrecords ) );
+            for ( DiskLoc i = old.firstExtent; !i.isNull(); i = i.ext()->xnext )
+                copyRecords( ns , i.ext() , pm );
+            massert( 13457 , "compact: record count changed" , d->nrecords == nrecords );
+        }
+        catch ( ... ) {
+            log() << "compact " << ns << " failed, restoring the collection as it was" << endl;
+            old.restore( d );
+            throw;
+        }
+
+        // every record is in the new chain: from here on the old one is garbage
+        if ( d->nIndexes ) {
+            BSONObjBuilder dropped;
+            massert( 13456 , "compact: couldn't drop the indexes: " + errmsg ,
+                     dropIndexes( d , ns , "*" , errmsg , dropped , true ) );
+        }
+        freeExtents( old.firstExtent , old.lastExtent );
+
+        cc().curop()->setMessage( "compact: (2/2) building indexes" );
+        string system_indexes = cc().database()->name + ".system.indexes";
+        for ( unsigned i = 0; i < indexes.size(); i++ )
+            theDataFileMgr.insertWithObjMod( system_indexes.c_str() , indexes[i] );
+
+        int extentsAfter;
+        long long storageAfter = d->storageSize( &extentsAfter );
+        log() << "compact " << ns << " done, " << extentsBefore << " extents " << storageBefore / 1024 << "KB to "
+              << extentsAfter << " extents " << storageAfter / 1024 << "KB in " << t.millis() << "ms" << endl;
+
+        result.appendNumber( "records" , nrecords );
+        result.append( "numExtentsBefore" , extentsBefore );
+        result.append( "numExtentsAfter" , extentsAfter );
+        result.appendNumber( "storageSizeBefore" , storageBefore );
+        result.appendNumber( "storageSizeAfter" , storageAfter );
+        result.append( "nindexes" , (int) indexes.size() );
+        result.append( "millis" , t.millis() );
+        return true;
+    }
+
+    class CompactCmd : public Command {
+    public:
+        CompactCmd() : Command( "compact" ) {}
+        virtual bool slaveOk() const { return true; }
+        virtual LockType locktype() const { return WRITE; }
+        virtual void help( stringstream& h ) const {
+            h << "{ compact : <collection> }  rewrites a collection and its indexes densely in place.\n"
+                 "locks the database until done.  frees space for reuse within the database; the files don't shrink.";
+        }
+        bool run( const string& dbname , BSONObj& cmdObj , string& errmsg , BSONObjBuilder& result , bool fromRepl ) {
+            string coll = cmdObj.firstElement().valuestrsafe();
+            if ( coll.empty() ) {
+                errmsg = "no collection name specified";
+                return false;
+            }
+            string ns = dbname + "." + coll;
+            return compactCollection( ns.c_str() , errmsg , result );
+        }
+    } compactCmd;
+
+}
@@ -22,7 +22,18 @@
      name                   level
      Logstream::mutex       1
      ClientCursor::ccmutex  2
-     dblock                 3
+     NSLock (collection)    3
+     NSLock (database)      4
+     dblock                 5
+
+   With --dblocks, writelock/readlock on a namespace take dbMutex in intent mode (IX/IS),
+   then the database's NSLock, and for an existing collection the database lock in intent
+   mode and the collection's NSLock in X/S.  A lock with no namespace, or one the server
+   decides can't be scoped (database not open yet, local/admin, writes when an oplog is kept),
+   takes dbMutex in X/S mode - the whole server - as before.  Catalog changes (creating
+   collections or indexes, system.* writes, commands) lock the database.  While holding a
+   database or collection lock you may not lock anything it doesn't cover: locks are not
+   upgradeable.
 
      End func name with _inlock to indicate "caller must lock before calling".
 */
@@ -30,6 +41,7 @@
 #pragma once
 
 #include "../util/concurrency/rwlock.h"
+#include "../util/concurrency/intent_lock.h"
 #include "../util/mmap.h"
 
 namespace mongo {
@@ -73,17 +85,168 @@ namespace mongo {
         }
     };
 
+    /* a lock below dbMutex: one per database and, under that, one per collection.  used when
+       --dblocks is on.  never deleted once created.
+    */
+    struct NSLock : boost::noncopyable {
+        NSLock( const string& n , NSLock * p ) : name( n ) , parent( p ) , m( "dblock" ) , _childrenMutex( "nslock" ) { }
+
+        const string name;    // "db" or "db.collection"
+        NSLock * const parent; // for a collection, its database's lock; else 0
+        IntentLock m;
+        MutexInfo info;       // time held exclusively
+
+        /* does holding this lock cover ns?  a database lock covers its collections. */
+        bool covers( const string& ns ) const {
+            return ns.compare( 0 , name.size() , name ) == 0 &&
+                ( ns.size() == name.size() || ns[name.size()] == '.' ) &&
+                ( parent == 0 || ns.size() == name.size() || ns[name.size()+1] == '$' );
+        }
+
+        NSLock * child( const string& n ) {
+            scoped_lock lk( _childrenMutex );
+            NSLock *& l = _children[n];
+            if ( l == 0 )
+                l = new NSLock( n , this );
+            return l;
+        }
+
+        void children( vector<NSLock*>& all ) {
+            scoped_lock lk( _childrenMutex );
+            for ( map<string,NSLock*>::iterator i = _children.begin(); i != _children.end(); ++i )
+                all.push_back( i->second );
+        }
+
+    private:
+        mongo::mutex _childrenMutex;
+        map<string,NSLock*> _children;
+    };
+
+    /* how much of the server a lock request for a namespace has to lock */
+    enum LockScope { ScopeGlobal = 0 , ScopeDB = 1 , ScopeCollection = 2 };
+
+    /* decides the scope of a lock request for ns.  called with the global and database locks
+       held in intent mode.
+    */
+    typedef LockScope (*LockScopeCheck)( const string& ns , bool write );
+
     class MongoMutex {
         MutexInfo _minfo;
-        RWLock _m;
+        IntentLock _m;
         ThreadLocalValue<int> _state;
 
+        /* the innermost lock this thread holds; 0 if it holds the global lock (or nothing). */
+        ThreadLocalValue<NSLock*> _scope;
+
         /* we use a separate TLS value for releasedEarly - that is ok as 
            our normal/common code path, we never even touch it.
         */
         ThreadLocalValue<bool> _releasedEarly;
+
+        LockScopeCheck _scopeCheck; // 0 unless per database locking is enabled
+        mongo::mutex _dbLocksMutex;
+        map<string,NSLock*> _dbLocks;
+
+        /* the database lock for ns, and in coll the collection lock if ns names one that
+           can be locked on its own (not system.*, and index namespaces go with their collection)
+        */
+        NSLock * _dbLock( const string& ns , NSLock ** coll = 0 ) {
+            if ( _scopeCheck == 0 || ns.empty() )
+                return 0;
+            size_t dot = ns.find( '.' );
+            string db = ns.substr( 0 , dot );
+            if ( db.empty() )
+                return 0;
+            NSLock * l;
+            {
+                scoped_lock lk( _dbLocksMutex );
+                NSLock *& x = _dbLocks[db];
+                if ( x == 0 )
+                    x = new NSLock( db , 0 );
+                l = x;
+            }
+            if ( coll ) {
+                *coll = 0;
+                if ( dot != string::npos && dot + 1 < ns.size() && ns[dot+1] != '$' && 
+                     ns.compare( dot + 1 , 7 , "system." ) != 0 )
+                    *coll = l->child( ns.substr( 0 , ns.find( ".$" , dot ) ) );
+            }
+            return l;
+        }
+
+        LockScope _scopeFor( const string& ns , bool write ) {
+            try {
+                return _scopeCheck( ns , write );
+            }
+            catch ( ... ) {
+                return ScopeGlobal; // e.g. a bad db name - the caller will find out once locked
+            }
+        }
+
+        /* take the global lock, a database lock and maybe a collection lock for ns.  the
+           intent locks are taken first so the scope check sees a stable catalog.
+        */
+        void _lockNS( const string& ns , bool write , NSLock * db , NSLock * coll ) {
+            IntentLock::Mode intent = write ? IntentLock::IX : IntentLock::IS;
+            IntentLock::Mode full = write ? IntentLock::X : IntentLock::S;
+
+            curopWaitingForLock( write ? 1 : -1 );
+            _m.lock( intent );
+            db->m.lock( intent );
+
+            LockScope scope = _scopeFor( ns , write );
+            if ( scope == ScopeCollection && coll ) {
+                coll->m.lock( full );
+                if ( write ) coll->info.entered();
+                _scope.set( coll );
+                curopGotLock();
+                return;
+            }
+
+            db->m.unlock( intent );
+            if ( scope != ScopeGlobal ) {
+                db->m.lock( full );
+                // the db may have been closed while we weren't holding it
+                if ( _scopeFor( ns , write ) != ScopeGlobal ) {
+                    if ( write ) db->info.entered();
+                    _scope.set( db );
+                    curopGotLock();
+                    return;
+                }
+                db->m.unlock( full );
+            }
+
+            _m.unlock( intent );
+            _m.lock( full );
+            curopGotLock();
+            if ( write ) {
+                _minfo.entered();
+                MongoFile::lockAll();
+            }
+        }
+
+        void _unlockScope( NSLock * l , bool write ) {
+            _scope.set(0);
+            IntentLock::Mode intent = write ? IntentLock::IX : IntentLock::IS;
+            if ( write ) l->info.leaving();
+            l->m.unlock( write ? IntentLock::X : IntentLock::S );
+            for ( NSLock * p = l->parent; p; p = p->parent )
+                p->m.unlock( intent );
+            _m.unlock( intent );
+        }
+
     public:
-        MongoMutex(const char * name) : _m(name) { }
+        MongoMutex(const char * name) : _m(name) , _scopeCheck(0) , _dbLocksMutex("dbLocks") { }
+
+        /**
+         * turn on per database/collection locking.  a lock request for a namespace holds the
+         * global lock in intent mode plus locks on that database or collection, as far as
+         * check() allows.  otherwise, and for requests with no namespace, the whole server is
+         * locked as before.
+         * call at startup, before any locking (or with no locks held, in tests).  0 turns it off.
+         */
+        void enableDBLocks( LockScopeCheck check ) { _scopeCheck = check; }
+        bool dbLocksEnabled() const { return _scopeCheck != 0; }
 
         /**
          * @return
@@ -100,12 +263,39 @@ namespace mongo {
         bool atLeastReadLocked() { return _state.get() != 0; }
         void assertAtLeastReadLocked() { assert(atLeastReadLocked()); }
 
-        bool _checkWriteLockAlready(){
+        /** @return the database or collection lock held by this thread, 0 if the lock (if any) is global */
+        NSLock * scope() { return _scope.get(); }
+
+        /** write locked, and not just a single database or collection */
+        bool isWriteLockedGlobally() { return getState() > 0 && _scope.get() == 0; }
+        void assertWriteLockedGlobally() { 
+            massert( 13419 , "internal error: need the global write lock, have a database lock" , isWriteLockedGlobally() );
+        }
+
+        /** write locked, and at least all of db */
+        void assertWriteLockedDB( const string& db ) {
+            NSLock * l = _scope.get();
+            massert( 13423 , (string)"internal error: need a write lock on db " + db , 
+                     getState() > 0 && ( l == 0 || ( l->parent == 0 && l->covers( db ) ) ) );
+        }
+
+        /** asserts that the lock this thread holds covers ns */
+        void assertCovers( const string& ns ) {
+            NSLock * l = _scope.get();
+            if ( l == 0 )
+                return;
+            massert( 13420 , (string)"internal error: " + ns + " not covered by lock on " + l->name , l->covers( ns ) );
+        }
+
+        bool _checkWriteLockAlready( const string& ns = "" ){
             //DEV cout << "LOCK" << endl;
             DEV assert( haveClient() );
                 
             int s = _state.get();
             if( s > 0 ) {
+                NSLock * have = _scope.get();
+                massert( 13421 , (string)"internal error: can't lock another db or the server while holding a db lock: " + sayClientState() , 
+                         have == 0 || have->covers( ns ) );
                 _state.set(s+1);
                 return true;
             }
@@ -122,7 +312,7 @@ namespace mongo {
             _state.set(1);
 
             curopWaitingForLock( 1 );
-            _m.lock(); 
+            _m.lock( IntentLock::X ); 
             curopGotLock();
 
             _minfo.entered();
@@ -130,12 +320,27 @@ namespace mongo {
             MongoFile::lockAll();
         }
 
+        /** write lock ns's collection or database if possible, else the whole server */
+        void lock( const string& ns ) {
+            NSLock * coll;
+            NSLock * db = _dbLock( ns , &coll );
+            if ( db == 0 ) {
+                lock();
+                return;
+            }
+            if ( _checkWriteLockAlready( ns ) )
+                return;
+
+            _state.set(1);
+            _lockNS( ns , true , db , coll );
+        }
+
         bool lock_try( int millis ) { 
             if ( _checkWriteLockAlready() )
                 return true;
 
             curopWaitingForLock( 1 );
-            bool got = _m.lock_try( millis ); 
+            bool got = _m.lock( IntentLock::X , millis ); 
             curopGotLock();
             
             if ( got ){
@@ -163,11 +368,18 @@ namespace mongo {
                 massert( 12599, "internal error: attempt to unlock when wasn't in a write lock", false);
             }
 
+            _state.set(0);
+
+            NSLock * l = _scope.get();
+            if ( l ) {
+                _unlockScope( l , true );
+                return;
+            }
+
             MongoFile::unlockAll();
 
-            _state.set(0);
             _minfo.leaving();
-            _m.unlock(); 
+            _m.unlock( IntentLock::X ); 
         }
 
         /* unlock (write lock), and when unlock() is called later, 
@@ -180,36 +392,61 @@ namespace mongo {
             unlock();
         }
 
-        void lock_shared() { 
-            //DEV cout << " LOCKSHARED" << endl;
+        bool _checkReadLockAlready( const string& ns = "" ){
             int s = _state.get();
-            if( s ) {
-                if( s > 0 ) { 
-                    // already in write lock - just be recursive and stay write locked
-                    _state.set(s+1);
-                    return;
-                }
-                else { 
-                    // already in read lock - recurse
-                    _state.set(s-1);
-                    return;
-                }
+            if( s == 0 )
+                return false;
+
+            NSLock * have = _scope.get();
+            massert( 13422 , (string)"internal error: can't lock another db or the server while holding a db lock: " + sayClientState() , 
+                     have == 0 || have->covers( ns ) );
+
+            if( s > 0 ) { 
+                // already in write lock - just be recursive and stay write locked
+                _state.set(s+1);
+            }
+            else { 
+                // already in read lock - recurse
+                _state.set(s-1);
             }
+            return true;
+        }
+
+        void lock_shared() { 
+            //DEV cout << " LOCKSHARED" << endl;
+            if ( _checkReadLockAlready() )
+                return;
+
             _state.set(-1);
             curopWaitingForLock( -1 );
-            _m.lock_shared(); 
+            _m.lock( IntentLock::S ); 
             curopGotLock();
         }
+
+        /** read lock ns's collection or database if possible, else the whole server */
+        void lock_shared( const string& ns ) {
+            NSLock * coll;
+            NSLock * db = _dbLock( ns , &coll );
+            if ( db == 0 ) {
+                lock_shared();
+                return;
+            }
+            if ( _checkReadLockAlready( ns ) )
+                return;
+
+            _state.set(-1);
+            _lockNS( ns , false , db , coll );
+        }
         
         bool lock_shared_try( int millis ) {
             int s = _state.get();
             if ( s ){
                 // we already have a lock, so no need to try
-                lock_shared();
+                _state.set( s > 0 ? s+1 : s-1 );
                 return true;
             }
 
-            bool got = _m.lock_shared_try( millis );
+            bool got = _m.lock( IntentLock::S , millis );
             if ( got )
                 _state.set(-1);
             return got;
@@ -229,10 +466,20 @@ namespace mongo {
             }
             assert( s == -1 );
             _state.set(0);
-            _m.unlock_shared(); 
+
+            NSLock * l = _scope.get();
+            if ( l ) {
+                _unlockScope( l , false );
+                return;
+            }
+
+            _m.unlock( IntentLock::S ); 
         }
         
         MutexInfo& info() { return _minfo; }
+
+        /** lock hold and wait times per level: global, each database, each collection */
+        void appendStats( BSONObjBuilder& b );
     };
 
     extern MongoMutex &dbMutex;
@@ -242,7 +489,7 @@ namespace mongo {
 
     struct writelock {
         writelock(const string& ns) {
-            dbMutex.lock();
+            dbMutex.lock(ns);
         }
         ~writelock() { 
             DESTRUCTOR_GUARD(
@@ -254,7 +501,7 @@ namespace mongo {
     
     struct readlock {
         readlock(const string& ns) {
-            dbMutex.lock_shared();
+            dbMutex.lock_shared(ns);
         }
         ~readlock() { 
             DESTRUCTOR_GUARD(
@@ -308,7 +555,7 @@ namespace mongo {
         atleastreadlock( const string& ns ){
             _prev = dbMutex.getState();
             if ( _prev == 0 )
-                dbMutex.lock_shared();
+                dbMutex.lock_shared( ns );
         }
         ~atleastreadlock(){
             if ( _prev == 0 )
@@ -321,12 +568,13 @@ namespace mongo {
     class mongolock {
         bool _writelock;
     public:
-        mongolock(bool write) : _writelock(write) {
+        /* ns empty locks the whole server */
+        mongolock(bool write, const string& ns = "") : _writelock(write) {
             if( _writelock ) {
-                dbMutex.lock();
+                dbMutex.lock(ns);
             }
             else
-                dbMutex.lock_shared();
+                dbMutex.lock_shared(ns);
         }
         ~mongolock() { 
             DESTRUCTOR_GUARD(
@@ -35,6 +35,13 @@ namespace mongo {
         return ok();
     }
 
+    Record* BasicCursor::recordToFetch() {
+        if ( !ok() )
+            return 0;
+        Record *r = _current();
+        return r->likelyInPhysicalMemory() ? 0 : r;
+    }
+
     /* these will be used outside of mutexes - really functors - thus the const */
     class Forward : public AdvanceStrategy {
         virtual DiskLoc next( const DiskLoc &prev ) const {
@@ -79,6 +79,12 @@ namespace mongo {
         
         virtual bool supportGetMore() = 0;
         virtual bool supportYields() = 0;
+
+        /* the record at the current position if reading it would page fault, else 0.  lets a 
+           yielding caller page it in with the lock released instead of faulting while locked.
+           optional to implement: 0 means "don't know", and the record is read with the lock held.
+        */
+        virtual Record* recordToFetch() { return 0; }
         
         virtual string toString() { return "abstract?"; }
 
@@ -173,6 +179,7 @@ namespace mongo {
 
         virtual bool supportGetMore() { return true; }
         virtual bool supportYields() { return true; }
+        virtual Record* recordToFetch();
 
         virtual CoveredIndexMatcher *matcher() const { return _matcher.get(); }
         
@@ -26,7 +26,8 @@ namespace mongo {
     bool Database::_openAllFiles = false;
 
     Database::Database(const char *nm, bool& newDb, const string& _path )
-        : name(nm), path(_path), namespaceIndex( path, name ) {
+        : allocMutex("allocExtent"), name(nm), path(_path), namespaceIndex( path, name ) {
+        files.reserve( DiskLoc::MaxFiles );
         
         { // check db name is valid
             size_t L = strlen(nm);
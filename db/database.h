@@ -156,7 +156,11 @@ namespace mongo {
             return f;
         }
 
+        /* with --dblocks, writers on different collections of this db can get here at the
+           same time; the free list and file headers are protected by allocMutex.
+        */
         Extent* allocExtent( const char *ns, int size, bool capped ) { 
+            scoped_lock lk( allocMutex );
             Extent *e = DataFileMgr::allocFromFreeList( ns, size, capped );
             if( e ) return e;
             return suitableFile( size, !capped )->createExtent( ns, size, capped );
@@ -190,7 +194,8 @@ namespace mongo {
 
         void flushFiles( bool sync );
         
-        vector<MongoDataFile*> files;
+        vector<MongoDataFile*> files; // reserved up front so readers can index it while a file is added
+        mongo::mutex allocMutex;
         string name; // "alleyinsider"
         string path;
         NamespaceIndex namespaceIndex;
@@ -38,6 +38,7 @@
 #include "../util/version.h"
 #include "client.h"
 #include "dbwebserver.h"
+#include "dur.h"
 
 #if defined(_WIN32)
 # include "../util/ntservice.h"
@@ -463,10 +464,17 @@ sendmore:
     }
     
     /**
-     * does background async flushes of mmapped files
+     * does background flushes of mmapped files.  syncing everything at once every --syncdelay
+     * makes the os write all the dirty pages in one burst, which stalls other io for seconds 
+     * with a lot of mapped data.  so each pass syncs one region at a time, paced to finish 
+     * within --syncdelay: the writes happen at a steady rate, and data still reaches disk 
+     * within about --syncdelay.  with --journal, each completed pass lets the journal written 
+     * before it began be removed.
      */
     class DataFileSync : public BackgroundJob {
     public:
+        enum { RegionBytes = 8 * 1024 * 1024 };
+
         string name() { return "DataFileSync"; }
         void run(){
             if( _sleepsecs == 0 )
@@ -475,7 +483,6 @@ sendmore:
                 log() << "--syncdelay 1" << endl;
             else if( _sleepsecs != 60 )
                 log(1) << "--syncdelay " << _sleepsecs << endl;
-            int time_flushing = 0;
             while ( ! inShutdown() ){
                 if ( _sleepsecs == 0 ){
                     // in case at some point we add an option to change at runtime
@@ -483,26 +490,70 @@ sendmore:
                     continue;
                 }
 
-                sleepmillis( (long long) std::max(0.0, (_sleepsecs * 1000) - time_flushing) );
-                
+                Timer pass;
+                unsigned long long commit = dur::lastCommit(); // already in the shared views
+                long long period = (long long) ( _sleepsecs * 1000 );
+                long long total = MongoFile::totalMappedLength();
+                long long bytes = 0;
+                unsigned long long syncing = 0; // micros
+                MongoFile::FlushCursor pos;
+                while ( ! inShutdown() ){
+                    Timer t;
+                    long n;
+                    if ( ! MongoFile::flushNext( pos , RegionBytes , n ) )
+                        break;
+                    unsigned long long micros = t.micros();
+                    globalFlushCounters.flushedRegion( (int) std::min( micros , 0x7fffffffULL ) );
+                    syncing += micros;
+                    bytes += n;
+
+                    // where the pass should be to finish on time; files mapped since it began 
+                    // make us run a little late rather than sync in a burst
+                    long long due = total ? bytes * period / total : period;
+                    if ( due > pass.millis() )
+                        sleepmillis( due - pass.millis() );
+                }
+
                 if ( inShutdown() ){
                     // occasional issue trying to flush during shutdown when sleep interrupted
                     break;
                 }
-                
-                Date_t start = jsTime();
-                int numFiles = MemoryMappedFile::flushAll( true );
-                time_flushing = (int) (jsTime() - start);
 
-                globalFlushCounters.flushed(time_flushing);
+                int time_flushing = (int) ( syncing / 1000 );
+                globalFlushCounters.flushed( time_flushing , bytes );
+                dur::dataFilesSynced( commit );
+
+                log(1) << "flushing mmap took " << time_flushing << "ms for " << bytes / ( 1024 * 1024 ) << "MB in " << pass.millis() << "ms" << endl;
 
-                log(1) << "flushing mmap took " << time_flushing << "ms " << " for " << numFiles << " files" << endl;
+                // nothing or little mapped: wait out the rest of the period
+                if ( pass.millis() < period )
+                    sleepmillis( period - pass.millis() );
             }
         }
         
         double _sleepsecs; // default value controlled by program options
     } dataFileSync;
 
+    /** --dblocks policy: how much must a lock on ns cover? */
+    static LockScope dbLockScope( const string& ns , bool write ) {
+        string db = nsToDatabase( ns.c_str() );
+        if ( db == "local" || db == "admin" )
+            return ScopeGlobal;
+        // writes are logged to local.oplog.* under the same lock.  replica set secondaries 
+        // log what they apply separately, see syncApplyBatch()
+        if ( write && ( replSettings.master || replSettings.slave || replSet ) && 
+             ! ( currentClient.get() && cc().isReplWriter() ) )
+            return ScopeGlobal;
+        // opening a database changes dbHolder, which needs the global lock
+        Database * database = dbHolder.get( ns , dbpath );
+        if ( ! database )
+            return ScopeGlobal;
+        // creating a collection changes the catalog, which needs the database lock
+        if ( ! database->namespaceIndex.details( ns.c_str() ) )
+            return ScopeDB;
+        return ScopeCollection;
+    }
+
     void _initAndListen(int listenPort, const char *appserverLoc = NULL) {
 
         bool is32bit = sizeof(int*) == 4;
@@ -539,6 +590,8 @@ sendmore:
         acquirePathLock();
         remove_all( dbpath + "/_tmp/" );
 
+        dur::startup();
+
         theFileAllocator().start();
 
         BOOST_CHECK_EXCEPTION( clearTmpFiles() );
@@ -572,6 +625,11 @@ sendmore:
         if ( shouldRepairDatabases )
             return;
 
+        if ( cmdLine.dbLocks ){
+            log() << "--dblocks: per database locking enabled" << endl;
+            dbMutex.enableDBLocks( dbLockScope );
+        }
+
         /* this is for security on certain platforms (nonce generation) */
         srand((unsigned) (curTimeMicros() ^ startupSrandTimer.micros()));
 
@@ -690,7 +748,11 @@ int main(int argc, char* argv[], char *envp[] )
         ("upgrade", "upgrade db if needed")
         ("repair", "run repair on all dbs")
         ("notablescan", "do not allow table scans")
+        ("dblocks", "lock per database rather than per server where possible (experimental)")
+        ("sortMemMB", po::value<int>(&cmdLine.sortMemMB)->default_value(32), "memory (MB) a sort without an index may use before sorting on disk")
         ("syncdelay",po::value<double>(&dataFileSync._sleepsecs)->default_value(60), "seconds between disk syncs (0=never, but not recommended)")
+        ("journal", "enable write ahead journaling: writes are durable within --journalCommitInterval ms, and a restart after a crash replays them instead of needing --repair")
+        ("journalCommitInterval", po::value<int>(&cmdLine.journalCommitInterval)->default_value(10), "ms between journal group commits")
         ("profile",po::value<int>(), "0=off 1=slow, 2=all")
         ("slowms",po::value<int>(&cmdLine.slowMS)->default_value(100), "value of slow for profile and console log" )
         ("maxConns",po::value<int>(), "max number of simultaneous connections")
@@ -729,6 +791,7 @@ int main(int argc, char* argv[], char *envp[] )
 		("configsvr", "declare this is a config db of a cluster")
 		("shardsvr", "declare this is a shard db of a cluster")
         ("noMoveParanoia" , "turn off paranoid saving of data for moveChunk.  this is on by default for now, but default will switch" )
+        ("migrateCloneBatch" , po::value<int>(&cmdLine.migrateCloneBatch)->default_value(1000), "documents inserted per write lock while receiving a migrating chunk" )
 		;
 
     hidden_options.add_options()
@@ -916,6 +979,13 @@ int main(int argc, char* argv[], char *envp[] )
         if( params.count("pretouch") ) { 
             cmdLine.pretouch = params["pretouch"].as<int>();
         }
+        if (params.count("journal")) {
+            cmdLine.journal = true;
+        }
+        uassert( 13455 , "bad --journalCommitInterval arg" , cmdLine.journalCommitInterval >= 1 && cmdLine.journalCommitInterval <= 1000 );
+        if (params.count("dblocks")) {
+            cmdLine.dbLocks = true;
+        }
         if (params.count("replSet")) {
             /* seed list of hosts for the repl set */
             cmdLine.replSet = params["replSet"].as<string>().c_str();
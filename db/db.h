@@ -80,7 +80,7 @@ namespace mongo {
         }
         
         void put( const string& ns , const string& path , Database * db ){
-            dbMutex.assertWriteLocked();
+            dbMutex.assertWriteLockedGlobally();
             DBs& m = _paths[path];
             Database*& d = m[_todb(ns)];
             if ( ! d )
@@ -89,7 +89,7 @@ namespace mongo {
         }
         
         Database* getOrCreate( const string& ns , const string& path , bool& justCreated ){
-            dbMutex.assertWriteLocked();
+            dbMutex.assertWriteLockedGlobally();
             DBs& m = _paths[path];
             
             string dbname = _todb( ns );
@@ -110,7 +110,7 @@ namespace mongo {
 
 
         void erase( const string& ns , const string& path ){
-            dbMutex.assertWriteLocked();
+            dbMutex.assertWriteLockedGlobally();
             DBs& m = _paths[path];
             _size -= (int)m.erase( _todb( ns ) );
         }
@@ -167,10 +167,12 @@ namespace mongo {
     struct dbtemprelease {
         Client::Context * _context;
         int _locktype;
+        NSLock * _scope;
         
         dbtemprelease() {
             _context = cc().getContext();
             _locktype = dbMutex.getState();
+            _scope = dbMutex.scope();
             assert( _locktype );
             
             if ( _locktype > 0 ) {
@@ -186,10 +188,11 @@ namespace mongo {
 
         }
         ~dbtemprelease() {
+            string ns = _scope ? _scope->name : "";
             if ( _locktype > 0 )
-                dbMutex.lock();
+                dbMutex.lock( ns );
             else
-                dbMutex.lock_shared();
+                dbMutex.lock_shared( ns );
             
             if ( _context ) _context->relocked();
         }
@@ -36,10 +36,12 @@
 #include "lasterror.h"
 #include "security.h"
 #include "queryoptimizer.h"
+#include "aggregate.h"
 #include "../scripting/engine.h"
 #include "stats/counters.h"
 #include "background.h"
 #include "../util/version.h"
+#include "dur.h"
 
 namespace mongo {
 
@@ -102,6 +104,15 @@ namespace mongo {
                 log() << "fsync from getlasterror" << endl;
                 result.append( "fsyncFiles" , MemoryMappedFile::flushAll( true ) );
             }
+
+            if ( cmdObj["j"].trueValue() ){
+                // only the group commit has to happen, not a sync of the data files
+                Timer t;
+                if ( dur::awaitCommit() )
+                    result.appendNumber( "jtime" , t.millis() );
+                else
+                    result.append( "jnote" , "journaling not enabled on this server" );
+            }
             
             BSONElement e = cmdObj["w"];
             if ( e.isNumber() ){
@@ -110,22 +121,16 @@ namespace mongo {
 
                 int w = e.numberInt();
 
-                long long passes = 0;
-                char buf[32];
-                while ( 1 ){
-                    if ( opReplicatedEnough( c.getLastOp() , w ) )
-                        break;
-                    
-                    if ( timeout > 0 && t.millis() >= timeout ){
+                if ( ! opReplicatedEnough( c.getLastOp() , w ) ){
+                    c.curop()->setMessage( "waiting for replication" );
+                    bool ok = waitForReplication( c.getLastOp() , w , timeout );
+                    globalWriteConcernCounters.waited( t.millis() , ! ok );
+                    if ( ! ok ){
                         result.append( "wtimeout" , true );
                         errmsg = "timed out waiting for slaves";
                         result.append( "waited" , t.millis() );
                         return false;
                     }
-
-                    assert( sprintf( buf , "w block pass: %lld" , ++passes ) < 30 );
-                    c.curop()->setMessage( buf );
-                    sleepmillis(1);
                 }
                 result.appendNumber( "wtime" , t.millis() );
             }
@@ -197,6 +202,7 @@ namespace mongo {
             return false;
         }
         virtual LockType locktype() const { return WRITE; } 
+        virtual bool lockGlobally() const { return true; }
         CmdDropDatabase() : Command("dropDatabase") {}
         bool run(const string& dbnamne, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl) {
             BSONElement e = cmdObj.firstElement();
@@ -222,6 +228,7 @@ namespace mongo {
             help << "repair database.  also compacts. note: slow.";
         }
         virtual LockType locktype() const { return WRITE; } 
+        virtual bool lockGlobally() const { return true; }
         CmdRepairDatabase() : Command("repairDatabase") {}
         bool run(const string& dbname , BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl) {
             BSONElement e = cmdObj.firstElement();
@@ -326,6 +333,12 @@ namespace mongo {
 
                 result.append( "globalLock" , t.obj() );
             }
+
+            if ( dbMutex.dbLocksEnabled() ){
+                BSONObjBuilder t( result.subobjStart( "locks" ) );
+                dbMutex.appendStats( t );
+                t.done();
+            }
             timeBuilder.appendNumber( "after basic" , Listener::getElapsedTimeMillis() - start );
 
             if ( authed ){
@@ -382,6 +395,24 @@ namespace mongo {
                 bb.done();
             }
 
+            if ( cmdLine.journal ) {
+                BSONObjBuilder bb( result.subobjStart( "dur" ) );
+                dur::appendStats( bb );
+                bb.done();
+            }
+
+            {
+                BSONObjBuilder bb( result.subobjStart( "recordFaults" ) );
+                globalRecordFaultCounters.append( bb );
+                bb.done();
+            }
+
+            {
+                BSONObjBuilder bb( result.subobjStart( "writeConcern" ) );
+                globalWriteConcernCounters.append( bb );
+                bb.done();
+            }
+
             timeBuilder.appendNumber( "after counters" , Listener::getElapsedTimeMillis() - start );            
 
             if ( anyReplEnabled() ){
@@ -496,6 +527,7 @@ namespace mongo {
 
         BackgroundOperation::assertNoBgOpInProgForNs(ns);
 
+        dur::writing( d );
         d->aboutToDeleteAnIndex();
 
         /* there may be pointers pointing at keys in the btree(s).  kill them. */
@@ -547,7 +579,7 @@ namespace mongo {
                 d->multiKeyIndexBits = removeBit(d->multiKeyIndexBits, x);
                 d->nIndexes--;
                 for ( int i = x; i < d->nIndexes; i++ )
-                    d->idx(i) = d->idx(i+1);
+                    *dur::writing( &d->idx(i) ) = d->idx(i+1);
             } else {
                 int n = removeFromSysIndexes(ns, name); // just in case an orphaned listing there - i.e. should have been repaired but wasn't
                 if( n ) { 
@@ -708,6 +740,65 @@ namespace mongo {
         }
     } cmdDropIndexes;
 
+    /* { createIndexes : <collection> , indexes : [ { key : { ... } , name : ... , unique : ... } , ... ] }
+       builds all the (foreground) indexes with one scan of the collection, rather than one per index.
+       "ns" may be left out of the index specs.
+    */
+    class CmdCreateIndexes : public Command {
+    public:
+        virtual bool logTheOp() {
+            return true;
+        }
+        virtual bool slaveOk() const {
+            return false;
+        }
+        virtual LockType locktype() const { return WRITE; } 
+        virtual void help( stringstream& help ) const {
+            help << "create several indexes on a collection with a single scan of it\n"
+                    "{ createIndexes : <collection> , indexes : [ { key : { a : 1 } , name : \"a_1\" } , ... ] }";
+        }
+        CmdCreateIndexes() : Command("createIndexes") { }
+        bool run(const string& dbname, BSONObj& jsobj, string& errmsg, BSONObjBuilder& result, bool /*fromRepl*/) {
+            string ns = dbname + '.' + jsobj.firstElement().valuestr();
+            BSONElement indexes = jsobj["indexes"];
+            if ( indexes.type() != Array ) {
+                errmsg = "indexes must be an array";
+                return false;
+            }
+
+            vector<BSONObj> specs;
+            BSONObjIterator i( indexes.embeddedObject() );
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                if ( e.type() != Object ) {
+                    errmsg = "each index must be an object";
+                    return false;
+                }
+                BSONObj spec = e.embeddedObject();
+                if ( spec["ns"].eoo() ) {
+                    BSONObjBuilder b;
+                    b.append( "ns" , ns );
+                    b.appendElements( spec );
+                    spec = b.obj();
+                }
+                specs.push_back( spec );
+            }
+            if ( specs.empty() ) {
+                errmsg = "no indexes to create";
+                return false;
+            }
+
+            if ( !cmdLine.quiet )
+                tlog() << "CMD: createIndexes " << ns << ' ' << specs.size() << " indexes" << endl;
+            NamespaceDetails *d = nsdetails( ns.c_str() );
+            result.append( "numIndexesBefore" , d ? d->nIndexes : 0 );
+            int n = buildIndexes( ns , specs , false );
+            result.append( "created" , n );
+            result.append( "numIndexesAfter" , nsdetails( ns.c_str() )->nIndexes );
+            return true;
+        }
+    } cmdCreateIndexes;
+
     class CmdReIndex : public Command {
     public:
         virtual bool logTheOp() {
@@ -1034,7 +1125,7 @@ namespace mongo {
         virtual bool slaveOk() const { return true; }
         virtual LockType locktype() const { return READ; } 
         virtual void help( stringstream &help ) const {
-            help << "{ collStats:\"blog.posts\" } ";
+            help << "{ collStats:\"blog.posts\" [, scale:1024] [, verbose:true] }  verbose adds the free space of each extent";
         }
         bool run(const string& dbname, BSONObj& jsobj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
             string ns = dbname + "." + jsobj.firstElement().valuestr();
@@ -1079,6 +1170,8 @@ namespace mongo {
                 result.append( "max" , nsd->max );
             }
 
+            nsd->appendFreeSpaceStats( result , scale , jsobj["verbose"].trueValue() );
+
             return true;
         }
     } cmdCollectionStatis;
@@ -1426,6 +1519,97 @@ namespace mongo {
 
     } cmdGroup;
 
+    /* feeds the documents matching the query to an Aggregator.  run through a MultiPlanScanner
+       so the query picks its index (and $or clauses) the way a find would. */
+    class AggregateOp : public QueryOp {
+    public:
+        AggregateOp( const string& ns , const Aggregator& agg ) : _ns( ns ) , _agg( agg ) {}
+
+        virtual void _init() {
+            _c = qp().newCursor();
+        }
+
+        virtual void prepareToYield() {
+            if ( ! _cc ) {
+                _cc.reset( new ClientCursor( QueryOption_NoCursorTimeout , _c , _ns.c_str() ) );
+            }
+            _cc->prepareToYield( _yieldData );
+        }
+
+        virtual void recoverFromYield() {
+            if ( !ClientCursor::recoverFromYield( _yieldData ) ) {
+                _c.reset();
+                _cc.reset();
+                massert( 13434, "cursor dropped during aggregate", false );
+            }
+        }
+
+        virtual Record* recordToFetch() {
+            return _c->recordToFetch();
+        }
+
+        virtual void next() {
+            if ( !_c->ok() ) {
+                setComplete();
+                return;
+            }
+            if ( matcher()->matches( _c->currKey(), _c->currLoc() ) && !_c->getsetdup( _c->currLoc() ) ) {
+                _agg.add( _c->current() );
+            }
+            _c->advance();
+        }
+
+        virtual QueryOp *_createChild() const {
+            return new AggregateOp( _ns , _agg );
+        }
+
+        virtual bool mayRecordPlan() const { return true; }
+
+        const Aggregator& aggregator() const { return _agg; }
+
+    private:
+        string _ns;
+        Aggregator _agg;
+        shared_ptr<Cursor> _c;
+        ClientCursor::CleanupPointer _cc;
+        ClientCursor::YieldData _yieldData;
+    };
+
+    class AggregateCommand : public Command {
+    public:
+        AggregateCommand() : Command("aggregate"){}
+        virtual LockType locktype() const { return READ; }
+        virtual bool slaveOk() const { return true; }
+        virtual bool slaveOverrideOk() { return true; }
+        virtual void help( stringstream &help ) const {
+            help << "{ aggregate : 'collection name' , key : { a : 1 } , query : {} , fields : { total : { $sum : 'x' } , n : { $count : 1 } } }\n"
+                    "group by without javascript.  accumulators: $sum $avg $min $max $count $first $last $push";
+        }
+
+        bool run(const string& dbname, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
+            string ns = dbname + '.' + cmdObj.firstElement().valuestr();
+            BSONObj query = getQuery( cmdObj );
+            bool partial = cmdObj["partial"].trueValue();
+
+            Aggregator agg( cmdObj );
+            if ( ! nsdetails( ns.c_str() ) ) {
+                agg.append( result , partial );
+                return true;
+            }
+
+            MultiPlanScanner mps( ns.c_str(), query, BSONObj(), 0, true, BSONObj(), BSONObj(), false, true );
+            AggregateOp original( ns , agg );
+            shared_ptr< AggregateOp > res = mps.runOp( original );
+            if ( !res->complete() ) {
+                errmsg = res->exception().msg;
+                return false;
+            }
+            res->aggregator().append( result , partial );
+            return true;
+        }
+
+    } cmdAggregate;
+
 
     class DistinctCommand : public Command {
     public:
@@ -1809,7 +1993,7 @@ namespace mongo {
             assert( ! c->logTheOp() );
         }
 
-        mongolock lk( needWriteLock );
+        mongolock lk( needWriteLock , c->lockGlobally() ? "" : dbname );
         Client::Context ctx( dbname , dbpath , &lk , c->requiresAuth() );
         
         try {
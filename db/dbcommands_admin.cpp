@@ -31,6 +31,7 @@
 #include "btree.h"
 #include "curop.h"
 #include "../util/background.h"
+#include "dur.h"
 #include "../scripting/engine.h"
 
 namespace mongo {
@@ -298,6 +299,7 @@ namespace mongo {
                     lockedForWriting++;
                 }
                 readlock lk("");
+                dur::commitNow(); // the files only get what's journaled
                 MemoryMappedFile::flushAll(true);
                 log() << "db is now locked for snapshotting, no writes allowed. use db.$cmd.sys.unlock.findOne() to unlock" << endl;
                 _ready = true;
@@ -357,6 +359,7 @@ namespace mongo {
                 result.append("info", "now locked against writes, use db.$cmd.sys.unlock.findOne() to unlock");
             }
             else {
+                dur::commitNow();
                 result.append( "numFiles" , MemoryMappedFile::flushAll( sync ) );
             }
             return 1;
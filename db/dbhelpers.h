@@ -121,8 +121,9 @@ namespace mongo {
             virtual ~RemoveCallback(){}
             virtual void goingToDelete( const BSONObj& o ) = 0;
         };
-        /* removeRange: operation is oplog'd */
-        static long long removeRange( const string& ns , const BSONObj& min , const BSONObj& max , bool yield = false , bool maxInclusive = false , RemoveCallback * callback = 0 );
+        /* removeRange: operation is oplog'd
+           keyPattern picks the index when it isn't the ascending one on min's fields, e.g. a hashed one */
+        static long long removeRange( const string& ns , const BSONObj& min , const BSONObj& max , bool yield = false , bool maxInclusive = false , RemoveCallback * callback = 0 , const BSONObj& keyPattern = BSONObj() );
 
         /* Remove all objects from a collection.
         You do not need to set the database before calling.
@@ -0,0 +1,860 @@
+// @file dur.cpp write ahead journal for the mapped data files
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* a group commit is one section of the journal:
+
+     SectionHeader
+     Entry, file name, data     for each range written
+     ...
+     SectionFooter              md5 of the entries
+
+   sections are only appended, so a crash can only leave the last one partly written.  replay
+   checks each section before writing any of it back, and stops at the first that is not whole:
+   nothing after it was acknowledged.
+
+   with --journal every data file is mapped twice.  writers only see the private, copy on
+   write, view, so what they write stays in memory.  once a commit is fsynced to the journal
+   its bytes are copied to the shared view, from where the os and DataFileSync write them to
+   the file.  so the files never hold a byte the journal doesn't, and replaying the journal
+   brings them to the last commit: no --repair after a crash.  each data file sync lets the
+   private views be mapped again, which gives back the memory of the pages written.
+*/
+
+#include "pch.h"
+#include "dur.h"
+#include "concurrency.h"
+#include "client.h"
+#include "jsobj.h"
+#include "../util/mmap.h"
+#include "../util/file.h"
+#include "../util/md5.hpp"
+
+namespace mongo {
+
+    extern string dbpath;
+
+    namespace dur {
+
+#pragma pack(1)
+        struct SectionHeader {
+            unsigned magic;
+            unsigned long long len;    // of the whole section, header and footer included
+            unsigned long long commit;
+        };
+        struct Entry {
+            unsigned len;              // of the data
+            unsigned long long ofs;    // where the data goes in the file
+            /* then the file's name relative to dbpath, null terminated, or just the null if it's
+               the file of the previous entry.  then the data. */
+        };
+        struct SectionFooter {
+            md5digest hash;            // of everything between the header and the footer
+            unsigned long long commit;
+            unsigned magic;
+        };
+#pragma pack()
+
+        enum {
+            SectionMagic = 0x6c6e726a , // "jrnl"
+            FooterMagic = 0x646e656a ,  // "jend"
+            ChunkBytes = 8 * 1024 * 1024 ,       // a big section goes to the file this much at a time
+            MaxFileBytes = 1024 * 1024 * 1024    // start a new journal file past this
+        };
+
+        static boost::filesystem::path journalPath() {
+            return boost::filesystem::path( dbpath ) / "journal";
+        }
+
+        /* journal files are j._0, j._1, ...  @return their numbers, in order */
+        static vector<int> journalFiles() {
+            vector<int> v;
+            boost::filesystem::path dir = journalPath();
+            if ( ! boost::filesystem::exists( dir ) )
+                return v;
+            boost::filesystem::directory_iterator end;
+            for ( boost::filesystem::directory_iterator i( dir ); i != end; ++i ) {
+                string name = boost::filesystem::path( *i ).leaf();
+                if ( name.size() > 3 && name.compare( 0 , 3 , "j._" ) == 0 )
+                    v.push_back( atoi( name.c_str() + 3 ) );
+            }
+            sort( v.begin() , v.end() );
+            return v;
+        }
+
+        static string journalFile( int n ) {
+            stringstream ss;
+            ss << "j._" << n;
+            return ( journalPath() / ss.str() ).string();
+        }
+
+        static void removeJournalFile( const string& name ) {
+            try {
+                boost::filesystem::remove( name );
+            }
+            catch ( std::exception& e ) {
+                log() << "journal: couldn't remove " << name << ' ' << e.what() << endl;
+            }
+        }
+
+        /* data files are journaled by their name within dbpath, so dbpath can move */
+        static string relativeToDbpath( const string& name ) {
+            if ( name.compare( 0 , dbpath.size() , dbpath ) != 0 )
+                return name;
+            size_t i = dbpath.size();
+            if ( i < name.size() && name[i] != '/' && name[i] != '\\' &&
+                 i && dbpath[i-1] != '/' && dbpath[i-1] != '\\' )
+                return name; // dbpath is /data/db and this is /data/dbx/...
+            while ( i < name.size() && ( name[i] == '/' || name[i] == '\\' ) )
+                i++;
+            return name.substr( i );
+        }
+
+        /* the bytes a writer declared */
+        struct Intent {
+            Intent( char *p , unsigned len ) : start( p ) , end( p + len ) {}
+            char *start;
+            char *end;
+            bool operator<( const Intent& r ) const { return start < r.start; }
+        };
+
+        /* a journaled range, to be copied to its file's shared view once the journal is synced */
+        struct SharedWrite {
+            unsigned long long fileId;
+            long ofs;
+            unsigned len;
+            const char *src;           // in the private view
+            unsigned bufOfs;           // of the same bytes in the section buffer
+        };
+
+        /* reads a journal file a buffer at a time */
+        class JournalReader {
+        public:
+            enum { BufBytes = 1024 * 1024 };
+
+            JournalReader( const string& name ) : _buf( BufBytes ) , _pos(0) , _bufPos(0) , _bufLen(0) {
+                _f.open( name.c_str() , true );
+                _len = _f.is_open() ? _f.len() : 0;
+            }
+
+            fileofs pos() const { return _pos; }
+            fileofs left() const { return _len - _pos; }
+            void seek( fileofs pos ) { _pos = pos; }
+
+            /** @return false, having read nothing, if there aren't len bytes left */
+            bool read( void *p , unsigned len ) {
+                if ( len > left() )
+                    return false;
+                char *dst = (char *) p;
+                while ( len ) {
+                    if ( _pos < _bufPos || _pos >= _bufPos + _bufLen )
+                        _fill();
+                    unsigned n = (unsigned) std::min( (fileofs) len , _bufPos + _bufLen - _pos );
+                    memcpy( dst , &_buf[0] + ( _pos - _bufPos ) , n );
+                    dst += n;
+                    _pos += n;
+                    len -= n;
+                }
+                return ! _f.bad();
+            }
+
+            /** a null terminated string of at most maxLen chars */
+            bool readString( string& s , unsigned maxLen ) {
+                s.clear();
+                char c;
+                while ( read( &c , 1 ) ) {
+                    if ( c == 0 )
+                        return true;
+                    if ( s.size() >= maxLen )
+                        return false;
+                    s += c;
+                }
+                return false;
+            }
+
+        private:
+            void _fill() {
+                _bufPos = _pos;
+                _bufLen = (unsigned) std::min( (fileofs) BufBytes , _len - _pos );
+                _f.read( _bufPos , &_buf[0] , _bufLen );
+            }
+
+            File _f;
+            vector<char> _buf;
+            fileofs _len;
+            fileofs _pos;
+            fileofs _bufPos;
+            unsigned _bufLen;
+        };
+
+        /* the data files replay writes to, opened as the journal names them */
+        class ReplayFiles : boost::noncopyable {
+        public:
+            ReplayFiles() : _bytes(0) {}
+            ~ReplayFiles() {
+                for ( map<string,File*>::iterator i = _files.begin(); i != _files.end(); ++i )
+                    delete i->second;
+            }
+
+            /** copies len bytes from r to ofs in the file, or skips them if the file is gone */
+            void write( const string& name , unsigned long long ofs , JournalReader& r , unsigned len ) {
+                File *f = _get( name );
+                if ( ! f ) {
+                    r.seek( r.pos() + len );
+                    return;
+                }
+                char buf[ 64 * 1024 ];
+                while ( len ) {
+                    unsigned n = std::min( len , (unsigned) sizeof( buf ) );
+                    massert( 13450 , "journal: section shorter than its entries" , r.read( buf , n ) );
+                    f->write( ofs , buf , n );
+                    ofs += n;
+                    len -= n;
+                    _bytes += n;
+                }
+            }
+
+            /** @return false if a write failed */
+            bool sync() {
+                bool ok = true;
+                for ( map<string,File*>::iterator i = _files.begin(); i != _files.end(); ++i ) {
+                    if ( ! i->second )
+                        continue;
+                    i->second->fsync();
+                    if ( i->second->bad() ) {
+                        log() << "journal: error writing to " << i->first << endl;
+                        ok = false;
+                    }
+                }
+                return ok;
+            }
+
+            int files() const { return _files.size(); }
+            unsigned long long bytes() const { return _bytes; }
+
+        private:
+            File* _get( const string& name ) {
+                map<string,File*>::iterator i = _files.find( name );
+                if ( i != _files.end() )
+                    return i->second;
+
+                boost::filesystem::path p( name );
+                if ( ! p.is_complete() )
+                    p = boost::filesystem::path( dbpath ) / p;
+                File *f = 0;
+                if ( boost::filesystem::exists( p ) ) {
+                    f = new File();
+                    f->open( p.string().c_str() );
+                }
+                else {
+                    // dropped since; nothing to redo
+                    log() << "journal: " << p.string() << " doesn't exist, skipping its writes" << endl;
+                }
+                _files[ name ] = f;
+                return f;
+            }
+
+            map<string,File*> _files;
+            unsigned long long _bytes;
+        };
+
+        class Journal {
+        public:
+            Journal() : _m( "journal" ) ,
+                        _started(0) , _committed(0) , _allTaken(0) , _allDone(0) , _synced(0) ,
+                        _commitNow(false) , _remapDue(false) , _closed(false) ,
+                        _fileMutex( "journalFile" ) , _n(0) , _pos(0) , _lastInFile(0) , _rotatedFor(0) ,
+                        _commits(0) , _bytes(0) , _early(0) , _lockedMicros(0) , _writeMicros(0) {
+            }
+
+            void declare( char *p , unsigned len ) {
+                scoped_lock lk( _m );
+                if ( ! _intents.empty() ) {
+                    // writers tend to hit the same record or bucket, or append, several times in a row
+                    Intent& last = _intents.back();
+                    if ( p >= last.start && p + len <= last.end )
+                        return;
+                    if ( p == last.end ) {
+                        last.end += len;
+                        return;
+                    }
+                }
+                _intents.push_back( Intent( p , len ) );
+            }
+
+            bool awaitCommit() {
+                scoped_lock lk( _m );
+                // with nothing pending, what we declared was taken by the last commit that took
+                // everything, if not before.  one for a single database (closingFiles()) may
+                // have left our intents behind, so only those count.
+                unsigned long long want = _intents.empty() ? _allTaken : _started + 1;
+                if ( _allDone >= want || _closed )
+                    return true;
+                _commitNow = true;
+                _early++;
+                _wake.notify_one();
+                while ( _allDone < want && ! _closed )
+                    _done.wait( lk.boost() );
+                return true;
+            }
+
+            unsigned long long lastCommit() {
+                scoped_lock lk( _m );
+                return _committed;
+            }
+
+            void dataFilesSynced( unsigned long long commit ) {
+                scoped_lock lk( _m );
+                if ( commit > _synced )
+                    _synced = commit;
+                if ( MongoFile::privateViews() ) {
+                    _remapDue = true;
+                    _wake.notify_one();
+                }
+            }
+
+            void run() {
+                Client::initThread( "journal" );
+                while ( ! inShutdown() ) {
+                    bool remap;
+                    {
+                        scoped_lock lk( _m );
+                        if ( ! _commitNow ) {
+                            boost::system_time until = get_system_time() +
+                                boost::posix_time::milliseconds( cmdLine.journalCommitInterval );
+                            _wake.timed_wait( lk.boost() , until );
+                        }
+                        _commitNow = false;
+                        remap = _remapDue;
+                        _remapDue = false;
+                        if ( _intents.empty() && _synced <= _rotatedFor && ! remap )
+                            continue;
+                    }
+                    bool ok;
+                    if ( remap ) {
+                        // no one may be writing to a private view while it is mapped again, and
+                        // all that was written to it must be in the shared one first
+                        writelock lk( "" );
+                        ok = groupCommit() && MongoFile::remapPrivateViews();
+                    }
+                    else {
+                        ok = groupCommit();
+                    }
+                    if ( ! ok ) {
+                        dbexit( EXIT_FS , "journal write failed" );
+                        break;
+                    }
+                }
+                cc().shutdown();
+            }
+
+            /**
+             * journals the declared writes and copies them to the shared views.  takes the read
+             * lock unless this thread has a lock already.
+             * @param prefix only the writes to files whose names start with it, for a caller 
+             *               that has just that database locked
+             * @return false if the journal couldn't be written
+             */
+            bool groupCommit( const char *prefix = 0 ) {
+                vector<Intent> w;
+                unsigned long long commit;
+                bool all;
+                Timer t;
+
+                // the file mutex is taken under the read lock and held through the fsync and the
+                // copy to the shared views, which keeps commits in order.  shutdown and
+                // closingFiles() take it while they may hold the write lock, so it mustn't be
+                // held waiting for one.
+                scoped_ptr<readlock> rlk;
+                if ( ! dbMutex.atLeastReadLocked() )
+                    rlk.reset( new readlock( "" ) );
+                scoped_lock flk( _fileMutex );
+                if ( _closed )
+                    return true;
+                {
+                    scoped_lock lk( _m );
+                    if ( prefix )
+                        _take( prefix , w );
+                    else
+                        w.swap( _intents );
+                    all = _intents.empty();
+                    commit = ++_started;
+                    if ( all )
+                        _allTaken = commit;
+                }
+                _merge( w );
+                vector<SharedWrite> shared;
+                bool chunked = false;
+                if ( ! w.empty() && ! _write( commit , w , shared , chunked ) )
+                    return false;
+                _lockedMicros = t.micros();
+
+                // the copy is made from the section buffer, once it's in the journal, without the
+                // lock.  if parts of the section went out early only the private views still have
+                // all of it, and those can only be read while no one writes them.
+                bool fromBuf = rlk.get() && ! chunked;
+                if ( fromBuf )
+                    rlk.reset();
+
+                if ( ! w.empty() ) {
+                    _file->fsync();
+                    if ( _file->bad() )
+                        return false;
+                    _lastInFile = commit;
+                }
+                _writeShared( shared , fromBuf );
+                _writeMicros = t.micros() - _lockedMicros;
+
+                {
+                    scoped_lock lk( _m );
+                    _committed = commit;
+                    if ( all )
+                        _allDone = commit;
+                    _commits++;
+                }
+                _done.notify_all();
+
+                _removeSynced();
+                return true;
+            }
+
+            void open() {
+                scoped_lock flk( _fileMutex );
+                _open();
+            }
+
+            void shutdown() {
+                // what is only in the private views would be lost.  with just one database
+                // locked the others may be mid write, so those writes are left to the journal
+                // thread, if it still runs.
+                if ( dbMutex.atLeastReadLocked() && dbMutex.scope() )
+                    log() << "journal: shutting down with a database lock, writes since the last commit are lost" << endl;
+                else if ( ! groupCommit() )
+                    log() << "journal: last commit failed" << endl;
+
+                scoped_lock flk( _fileMutex );
+                if ( _closed )
+                    return;
+                log() << "journal: syncing data files..." << endl;
+                MongoFile::flushAll( true );
+                _file.reset();
+                _removeAll();
+                {
+                    scoped_lock lk( _m );
+                    _closed = true;
+                }
+                _done.notify_all();
+            }
+
+            void recover() {
+                scoped_lock flk( _fileMutex );
+                vector<int> files = journalFiles();
+                if ( files.empty() )
+                    return;
+
+                log() << "journal: recovering from " << journalPath().string() << endl;
+                Timer t;
+                ReplayFiles out;
+                int sections = 0;
+                for ( unsigned i = 0; i < files.size(); i++ ) {
+                    JournalReader r( journalFile( files[i] ) );
+                    while ( _replaySection( r , out ) )
+                        sections++;
+                    if ( r.left() ) {
+                        log() << "journal: " << journalFile( files[i] ) << " ends with an incomplete commit at "
+                              << r.pos() << ", that is the end of the journal" << endl;
+                        break;
+                    }
+                }
+                uassert( 13451 , "journal: couldn't write to the data files during recovery" , out.sync() );
+                log() << "journal: replayed " << sections << " commits, " << out.bytes() / 1024 << "KB into "
+                      << out.files() << " files in " << t.millis() << "ms" << endl;
+
+                _file.reset();
+                _removeAll();
+            }
+
+            void appendStats( BSONObjBuilder& b ) {
+                scoped_lock lk( _m );
+                b.appendNumber( "commits" , (long long) _commits );
+                b.appendNumber( "journaledMB" , (long long) ( _bytes / ( 1024 * 1024 ) ) );
+                b.appendNumber( "earlyCommits" , (long long) _early );
+                b.appendNumber( "pendingIntents" , (long long) _intents.size() );
+                b.appendNumber( "lastLockedMicros" , (long long) _lockedMicros );
+                b.appendNumber( "lastWriteMicros" , (long long) _writeMicros );
+                b.append( "journalFiles" , (int) _old.size() + 1 );
+            }
+
+        private:
+            /* sorts, and joins ranges that overlap or touch */
+            static void _merge( vector<Intent>& w ) {
+                if ( w.empty() )
+                    return;
+                sort( w.begin() , w.end() );
+                vector<Intent>::iterator out = w.begin();
+                for ( vector<Intent>::iterator i = w.begin() + 1; i != w.end(); ++i ) {
+                    if ( i->start <= out->end ) {
+                        if ( i->end > out->end )
+                            out->end = i->end;
+                    }
+                    else {
+                        *++out = *i;
+                    }
+                }
+                w.erase( out + 1 , w.end() );
+            }
+
+            /* moves the intents in files whose names start with prefix, or in no file any more,
+               from _intents to w.  called with _m. */
+            void _take( const char *prefix , vector<Intent>& w ) {
+                size_t len = strlen( prefix );
+                vector<Intent> rest;
+                string name;
+                const char *view;
+                long length;
+                unsigned long long fileId;
+                for ( vector<Intent>::iterator i = _intents.begin(); i != _intents.end(); ++i ) {
+                    if ( ! MongoFile::locate( i->start , name , view , length , fileId ) ||
+                         name.compare( 0 , len , prefix ) == 0 )
+                        w.push_back( *i );
+                    else
+                        rest.push_back( *i );
+                }
+                _intents.swap( rest );
+            }
+
+            /* copies the journaled ranges into the shared views, from the section buffer or else
+               from the private views */
+            void _writeShared( const vector<SharedWrite>& shared , bool fromBuf ) {
+                if ( ! MongoFile::privateViews() )
+                    return;
+                for ( vector<SharedWrite>::const_iterator i = shared.begin(); i != shared.end(); ++i ) {
+                    const char *src = fromBuf ? _buf.buf() + i->bufOfs : i->src;
+                    // false if the file was closed since, nothing to do then
+                    MongoFile::writeShared( i->fileId , i->ofs , src , i->len );
+                }
+            }
+
+            /* copies the ranges into a section of the journal.  called with the read lock, so
+               no one is writing them meanwhile.
+               @param shared where each range goes in the shared views
+               @param chunked set if the section buffer doesn't hold the whole section */
+            bool _write( unsigned long long commit , const vector<Intent>& w , 
+                         vector<SharedWrite>& shared , bool& chunked ) {
+                if ( ! _file.get() )
+                    _open();
+
+                fileofs start = _pos;
+                bool headerWritten = false;
+                _buf.reset();
+
+                SectionHeader h;
+                h.magic = SectionMagic;
+                h.len = 0;
+                h.commit = commit;
+                _buf.appendBuf( &h , sizeof( h ) );
+
+                md5_state_t st;
+                md5_init( &st );
+
+                string name;
+                string last;
+                const char *view = 0;
+                long length = 0;
+                unsigned long long fileId = 0;
+                for ( vector<Intent>::const_iterator i = w.begin(); i != w.end(); ++i ) {
+                    char *p = i->start;
+                    while ( p < i->end ) {
+                        if ( ! view || p < view || p >= view + length ) {
+                            if ( ! MongoFile::locate( p , name , view , length , fileId ) ) {
+                                // closed since it was written - a dropped database
+                                view = 0;
+                                break;
+                            }
+                        }
+                        char *end = std::min( i->end , (char *) view + length );
+                        if ( end - p > MaxFileBytes )
+                            end = p + MaxFileBytes;
+
+                        Entry e;
+                        e.len = end - p;
+                        e.ofs = p - view;
+                        string rel = name == last ? "" : relativeToDbpath( name );
+                        last = name;
+                        _append( &e , sizeof( e ) , st , headerWritten );
+                        _append( rel.c_str() , rel.size() + 1 , st , headerWritten );
+                        SharedWrite s;
+                        s.fileId = fileId;
+                        s.ofs = (long) e.ofs;
+                        s.len = e.len;
+                        s.src = p;
+                        s.bufOfs = _buf.len();
+                        shared.push_back( s );
+                        _append( p , e.len , st , headerWritten );
+                        p = end;
+                    }
+                }
+
+                SectionFooter f;
+                md5_finish( &st , f.hash );
+                f.commit = commit;
+                f.magic = FooterMagic;
+                _buf.appendBuf( &f , sizeof( f ) );
+
+                h.len = _pos - start + _buf.len();
+                chunked = headerWritten;
+                if ( headerWritten )
+                    _file->write( start , (const char *) &h , sizeof( h ) );
+                else
+                    memcpy( _buf.buf() , &h , sizeof( h ) );
+                // the buffer is kept until the next commit, to copy to the shared views from
+                _file->write( _pos , _buf.buf() , _buf.len() );
+                _pos += _buf.len();
+
+                _bytes += h.len;
+                return ! _file->bad();
+            }
+
+            void _append( const void *p , unsigned len , md5_state_t& st , bool& headerWritten ) {
+                const char *q = (const char *) p;
+                while ( len ) {
+                    unsigned n = std::min( len , (unsigned) ChunkBytes );
+                    md5_append( &st , (const md5_byte_t *) q , n );
+                    _buf.appendBuf( q , n );
+                    if ( _buf.len() >= ChunkBytes ) {
+                        // only after something like an index build, which held the write lock far longer
+                        _flush( headerWritten );
+                    }
+                    q += n;
+                    len -= n;
+                }
+            }
+
+            void _flush( bool& headerWritten ) {
+                _file->write( _pos , _buf.buf() , _buf.len() );
+                _pos += _buf.len();
+                _buf.reset( ChunkBytes * 2 );
+                headerWritten = true;
+            }
+
+            void _open() {
+                boost::filesystem::path dir = journalPath();
+                if ( ! boost::filesystem::exists( dir ) )
+                    boost::filesystem::create_directory( dir );
+                string name = journalFile( _n );
+                _file.reset( new File() );
+                _file->open( name.c_str() );
+                uassert( 13452 , "couldn't open journal file " + name , _file->is_open() );
+                _pos = 0;
+                _lastInFile = 0;
+            }
+
+            /* once a data file sync finishes, what was journaled before it started can go.
+               each sync starts a new journal file so the one before can be removed after the next. */
+            void _removeSynced() {
+                unsigned long long synced;
+                bool rotate;
+                {
+                    scoped_lock lk( _m );
+                    synced = _synced;
+                    rotate = _pos && ( synced > _rotatedFor || _pos >= MaxFileBytes );
+                    if ( rotate )
+                        _rotatedFor = std::max( _rotatedFor , synced );
+                }
+                while ( ! _old.empty() && _old.front().second <= synced ) {
+                    removeJournalFile( _old.front().first );
+                    _old.pop_front();
+                }
+                if ( ! rotate )
+                    return;
+
+                string name = journalFile( _n );
+                _file.reset();
+                if ( _lastInFile <= synced )
+                    removeJournalFile( name );
+                else
+                    _old.push_back( make_pair( name , _lastInFile ) );
+                _n++;
+                _open();
+            }
+
+            void _removeAll() {
+                vector<int> files = journalFiles();
+                for ( unsigned i = 0; i < files.size(); i++ )
+                    removeJournalFile( journalFile( files[i] ) );
+                _old.clear();
+                _n = 0;
+                _pos = 0;
+            }
+
+            /* @return false at the end of what was journaled: the end of the file, or a section
+               that didn't make it to disk whole */
+            static bool _replaySection( JournalReader& r , ReplayFiles& out ) {
+                fileofs start = r.pos();
+                SectionHeader h;
+                if ( ! r.read( &h , sizeof( h ) ) || h.magic != SectionMagic ||
+                     h.len < sizeof( h ) + sizeof( SectionFooter ) || h.len > r.left() + sizeof( h ) ) {
+                    r.seek( start );
+                    return false;
+                }
+
+                // check all of it before writing any of it
+                fileofs body = r.pos();
+                fileofs end = start + h.len;
+                fileofs bodyEnd = end - sizeof( SectionFooter );
+                md5_state_t st;
+                md5_init( &st );
+                char buf[ 64 * 1024 ];
+                while ( r.pos() < bodyEnd ) {
+                    unsigned n = (unsigned) std::min( (fileofs) sizeof( buf ) , bodyEnd - r.pos() );
+                    r.read( buf , n );
+                    md5_append( &st , (const md5_byte_t *) buf , n );
+                }
+                SectionFooter f;
+                md5digest d;
+                md5_finish( &st , d );
+                if ( ! r.read( &f , sizeof( f ) ) || f.magic != FooterMagic || f.commit != h.commit ||
+                     memcmp( d , f.hash , sizeof( d ) ) != 0 ) {
+                    r.seek( start );
+                    return false;
+                }
+
+                r.seek( body );
+                string name;
+                while ( r.pos() < bodyEnd ) {
+                    Entry e;
+                    string s;
+                    massert( 13453 , "journal: bad entry" , r.read( &e , sizeof( e ) ) && r.readString( s , 1024 ) );
+                    if ( ! s.empty() )
+                        name = s;
+                    massert( 13454 , "journal: entry without a file name" , ! name.empty() );
+                    out.write( name , e.ofs , r , e.len );
+                }
+                r.seek( end );
+                return true;
+            }
+
+            mongo::mutex _m;                     // intents, commit numbers, stats
+            boost::condition _wake;              // the commit thread, when someone waits on a commit
+            boost::condition _done;              // a commit finished
+            vector<Intent> _intents;
+            unsigned long long _started;         // last commit that took the intents
+            unsigned long long _committed;       // last commit in the journal and the shared views
+            unsigned long long _allTaken;        // last commit that took all the intents
+            unsigned long long _allDone;         // and the last of those done
+            unsigned long long _synced;          // commits up to this are in the synced data files
+            bool _commitNow;
+            bool _remapDue;                      // the private views can be mapped again
+            bool _closed;
+
+            mongo::mutex _fileMutex;             // the journal file: held by a commit, shutdown, recovery
+            scoped_ptr<File> _file;
+            int _n;                              // its number
+            fileofs _pos;                        // where the next section goes
+            unsigned long long _lastInFile;
+            unsigned long long _rotatedFor;      // the sync the current file was started after
+            deque< pair<string,unsigned long long> > _old; // earlier files and their last commit
+            BufBuilder _buf;
+
+            unsigned long long _commits;
+            unsigned long long _bytes;
+            unsigned long long _early;
+            unsigned long long _lockedMicros;
+            unsigned long long _writeMicros;
+        } journal;
+
+        void _declareWriteIntent( void *p , unsigned len ) {
+            journal.declare( (char *) p , len );
+        }
+
+        static void journalThread() {
+            journal.run();
+        }
+
+        void startup() {
+            journal.recover();
+            if ( ! cmdLine.journal ) {
+                // so that the directory being there means the last run journaled
+                try {
+                    boost::filesystem::remove( journalPath() );
+                }
+                catch ( std::exception& e ) {
+                    log() << "journal: couldn't remove " << journalPath().string() << ' ' << e.what() << endl;
+                }
+                return;
+            }
+            log() << "journal: group commit every " << cmdLine.journalCommitInterval << "ms to "
+                  << journalPath().string() << endl;
+            MongoFile::usePrivateViews();
+            journal.open();
+            boost::thread t( journalThread );
+        }
+
+        bool haveJournal() {
+            return boost::filesystem::exists( journalPath() );
+        }
+
+        void commitNow() {
+            if ( ! cmdLine.journal )
+                return;
+            if ( ! journal.groupCommit() )
+                dbexit( EXIT_FS , "journal write failed" );
+        }
+
+        void closingFiles( const string& prefix ) {
+            if ( ! cmdLine.journal )
+                return;
+            bool all = dbMutex.isWriteLockedGlobally();
+            if ( ! journal.groupCommit( all ? 0 : prefix.c_str() ) )
+                dbexit( EXIT_FS , "journal write failed" );
+        }
+
+        void shutdown() {
+            if ( cmdLine.journal )
+                journal.shutdown();
+        }
+
+        bool awaitCommit() {
+            if ( ! cmdLine.journal )
+                return false;
+            assert( ! dbMutex.atLeastReadLocked() );
+            return journal.awaitCommit();
+        }
+
+        unsigned long long lastCommit() {
+            return journal.lastCommit();
+        }
+
+        void dataFilesSynced( unsigned long long commit ) {
+            journal.dataFilesSynced( commit );
+        }
+
+        void appendStats( BSONObjBuilder& b ) {
+            journal.appendStats( b );
+        }
+
+        void _groupCommit() {
+            journal.groupCommit();
+        }
+
+        void _recover() {
+            journal.recover();
+        }
+
+    }
+
+}
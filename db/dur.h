@@ -0,0 +1,99 @@
+// @file dur.h write ahead journal for the mapped data files
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../pch.h"
+#include "cmdline.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /* --journal
+
+       code that changes a data or .ns file through its mapping declares the bytes it changes,
+       while it holds the write lock.  every --journalCommitInterval ms the group commit thread
+       takes a read lock, so no one is writing, copies the declared bytes into the journal
+       (dbpath/journal/j._<n>) and fsyncs it.  at startup whatever is in the journal is written
+       back into the data files before any of them is opened.
+
+       so a write is durable once its group commit is, and the data files themselves only need
+       syncing now and then (--syncdelay), after which the journal up to then is removed.
+
+       writers see a private, copy on write, mapping of each file (MongoFile::usePrivateViews),
+       and a commit's bytes are copied to the file's shared mapping only once the commit is in
+       the journal.  so the files never get ahead of the journal, and a restart after a crash
+       just replays it: no --repair.
+    */
+    namespace dur {
+
+        void _declareWriteIntent( void *p , unsigned len );
+
+        /** [p, p+len) of a mapped file is being written.  call with the write lock held, before
+            or after the write as long as the lock isn't released in between.  with --journal a
+            write not declared never reaches the file. */
+        inline void declareWriteIntent( void *p , unsigned len ) {
+            if ( cmdLine.journal )
+                _declareWriteIntent( p , len );
+        }
+
+        /** declares all of *x.  e.g. dur::writing( e )->xnext = loc; */
+        template< class T >
+        inline T* writing( T *x ) {
+            declareWriteIntent( x , sizeof( T ) );
+            return x;
+        }
+
+        /** replays the journal, if any, then starts journaling if --journal.  call before any
+            data file is opened. */
+        void startup();
+
+        /** clean shutdown: syncs the data files, the journal is then no longer needed */
+        void shutdown();
+
+        /** @return true if the last run journaled, so its journal can stand in for --repair */
+        bool haveJournal();
+
+        /** a group commit now, in this thread.  call with the global lock, or none. */
+        void commitNow();
+
+        /** commits what was written to the files whose names start with prefix, before they
+            are closed: after that only the private views have it.  call with the write lock. */
+        void closingFiles( const string& prefix );
+
+        /** waits until everything declared so far is in the journal, without waiting out the
+            commit interval.  must not hold a lock.
+            @return false if not journaling */
+        bool awaitCommit();
+
+        /** number of the last group commit; what it journaled is in the shared views */
+        unsigned long long lastCommit();
+
+        /** every mapped file has been synced since commit 'commit'; the journal up to it can go */
+        void dataFilesSynced( unsigned long long commit );
+
+        void appendStats( BSONObjBuilder& b );
+
+        /* for dbtests: a group commit in this thread, and a replay of the journal */
+        void _groupCommit();
+        void _recover();
+
+    }
+
+}
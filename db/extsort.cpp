@@ -28,11 +28,13 @@
 namespace mongo {
     
     BSONObj BSONObjExternalSorter::extSortOrder;
+    mongo::mutex BSONObjExternalSorter::_extSortMutex("extSortMutex");
     unsigned long long BSONObjExternalSorter::_compares = 0;
     
     BSONObjExternalSorter::BSONObjExternalSorter( const BSONObj & order , long maxFileSize )
         : _order( order.getOwned() ) , _maxFilesize( maxFileSize ) , 
-          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0){
+          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0),
+          _bgMutex("extSortBackground"), _bgPending(0), _bgMaxPending(0){
         
         stringstream rootpath;
         rootpath << dbpath;
@@ -48,6 +50,7 @@ namespace mongo {
     }
     
     BSONObjExternalSorter::~BSONObjExternalSorter(){
+        _pool.reset(); // waits for background sorts still writing files
         if ( _cur ){
             delete _cur;
             _cur = 0;
@@ -57,10 +60,19 @@ namespace mongo {
         wassert( removed == 1 + _files.size() );
     }
 
+    void BSONObjExternalSorter::sortInBackground( int nThreads ){
+        assert( _cur == 0 && nThreads > 0 );
+        _pool.reset( new ThreadPool( nThreads ) );
+        _bgMaxPending = nThreads;
+        // the batch being filled plus one per thread
+        _maxFilesize /= nThreads + 1;
+    }
+
     void BSONObjExternalSorter::_sortInMem(){
         // extSortComp needs to use glbals
         // qsort_r only seems available on bsd, which is what i really want to use
-        dblock l;
+        // not dblock: queries sort with only a read lock held
+        scoped_lock l( _extSortMutex );
         extSortOrder = _order;
         _cur->sort( BSONObjExternalSorter::extSortComp );
     }
@@ -79,6 +91,7 @@ namespace mongo {
         if ( _cur ){
             finishMap();
         }
+        _waitForBackgroundSorts();
         
         if ( _cur ){
             delete _cur;
@@ -118,51 +131,117 @@ namespace mongo {
         if ( _cur->size() == 0 )
             return;
         
-        _sortInMem();
-        
         stringstream ss;
         ss << _root.string() << "/file." << _files.size();
         string file = ss.str();
         
+        if ( _pool.get() ){
+            {
+                scoped_lock lk( _bgMutex );
+                while ( _bgPending >= _bgMaxPending )
+                    _bgChanged.wait( lk.boost() );
+                uassert( 13437 , "external sort failed: " + _bgError , _bgError.empty() );
+                _bgPending++;
+            }
+            InMemory * full = _cur;
+            _cur = new InMemory( _arraySize );
+            _files.push_back( file );
+            _pool->schedule( &BSONObjExternalSorter::_sortAndWrite , this , full , file );
+            return;
+        }
+
+        _sortInMem();
+        _writeFile( _cur , file );
+        _cur->clear();
+        _files.push_back( file );
+    }
+
+    void BSONObjExternalSorter::_writeFile( InMemory * data , const string& file ){
         ofstream out;
         out.open( file.c_str() , ios_base::out | ios_base::binary );
         assertStreamGood( 10051 ,  (string)"couldn't open file: " + file , out );
         
         int num = 0;
-        for ( InMemory::iterator i=_cur->begin(); i != _cur->end(); ++i ){
+        for ( InMemory::iterator i=data->begin(); i != data->end(); ++i ){
             Data p = *i;
             out.write( p.first.objdata() , p.first.objsize() );
             out.write( (char*)(&p.second) , sizeof( DiskLoc ) );
             num++;
         }
         
-        _cur->clear();
-        
-        _files.push_back( file );
         out.close();
 
         log(2) << "Added file: " << file << " with " << num << "objects for external sort" << endl;
     }
+
+    /* runs on a _pool thread */
+    void BSONObjExternalSorter::_sortAndWrite( InMemory * data , string file ){
+        string err;
+        try {
+            // not _sortInMem: its qsort comparator is shared, and checks for interrupt
+            data->sort( MyCmp( _order , false ) );
+            _writeFile( data , file );
+        }
+        catch ( std::exception& e ){
+            err = e.what();
+            if ( err.empty() )
+                err = "unknown error";
+        }
+        delete data;
+
+        scoped_lock lk( _bgMutex );
+        if ( _bgError.empty() )
+            _bgError = err;
+        _bgPending--;
+        _bgChanged.notify_all();
+    }
+
+    void BSONObjExternalSorter::_waitForBackgroundSorts(){
+        if ( ! _pool.get() )
+            return;
+        scoped_lock lk( _bgMutex );
+        while ( _bgPending > 0 )
+            _bgChanged.wait( lk.boost() );
+        uassert( 13438 , "external sort failed: " + _bgError , _bgError.empty() );
+    }
     
     // ---------------------------------
 
-    BSONObjExternalSorter::Iterator::Iterator( BSONObjExternalSorter * sorter ) :
-        _cmp( sorter->_order ) , _in( 0 ){
+    BSONObjExternalSorter::Iterator::Iterator( BSONObjExternalSorter * sorter , bool readAhead ) :
+        _cmp( sorter->_order , ! readAhead ) , _in( 0 ) , _batch( 0 ) , _batchPos( 0 ) , _done( false ) , _stop( false ){
         
         for ( list<string>::iterator i=sorter->_files.begin(); i!=sorter->_files.end(); i++ ){
-            _files.push_back( new FileIterator( *i ) );
-            _stash.push_back( pair<Data,bool>( Data( BSONObj() , DiskLoc() ) , false ) );
+            FileIterator * f = new FileIterator( *i );
+            _files.push_back( f );
+            if ( f->more() )
+                _heap.push_back( HeapEntry( f->next() , _files.size() - 1 ) );
         }
+        make_heap( _heap.begin() , _heap.end() , HeapCmp( _cmp ) );
         
         if ( _files.size() == 0 && sorter->_cur ){
             _in = sorter->_cur;
             _it = sorter->_cur->begin();
         }
-
+        else if ( readAhead ){
+            _readAheadThread.reset( new boost::thread( boost::bind( &BSONObjExternalSorter::Iterator::_readAhead , this ) ) );
+        }
         
     }
     
     BSONObjExternalSorter::Iterator::~Iterator(){
+        if ( _readAheadThread.get() ){
+            // unblock and wait for the read ahead thread; it stops after its current batch
+            _stop = true;
+            while ( ! _done ){
+                delete _batch;
+                _batch = _batches.blockingPop();
+                if ( ! _batch )
+                    _done = true;
+            }
+            _readAheadThread->join();
+        }
+        delete _batch;
+        
         for ( vector<FileIterator*>::iterator i=_files.begin(); i!=_files.end(); i++ )
             delete *i;
         _files.clear();
@@ -172,14 +251,27 @@ namespace mongo {
 
         if ( _in )
             return _it != _in->end();
+
+        if ( _readAheadThread.get() ){
+            while ( ! _batch || _batchPos >= _batch->size() ){
+                if ( _done )
+                    return false;
+                delete _batch;
+                _batch = 0;
+                _batchPos = 0;
+                // the merge thread can't check for interrupt, it has no Client
+                killCurrentOp.checkForInterrupt();
+                _batch = _batches.blockingPop();
+                if ( ! _batch ){
+                    _done = true;
+                    uassert( 13439 , "external sort merge failed: " + _error , _error.empty() );
+                    return false;
+                }
+            }
+            return true;
+        }
         
-        for ( vector<FileIterator*>::iterator i=_files.begin(); i!=_files.end(); i++ )
-            if ( (*i)->more() )
-                return true;
-        for ( vector< pair<Data,bool> >::iterator i=_stash.begin(); i!=_stash.end(); i++ )
-            if ( i->second )
-                return true;
-        return false;
+        return ! _heap.empty();
     }
         
     BSONObjExternalSorter::Data BSONObjExternalSorter::Iterator::next(){
@@ -189,30 +281,48 @@ namespace mongo {
             ++_it;
             return d;
         }
-        
-        Data best;
-        int slot = -1;
-        
-        for ( unsigned i=0; i<_stash.size(); i++ ){
 
-            if ( ! _stash[i].second ){
-                if ( _files[i]->more() )
-                    _stash[i] = pair<Data,bool>( _files[i]->next() , true );
-                else
-                    continue;
-            }
-            
-            if ( slot == -1 || _cmp( best , _stash[i].first ) == 0 ){
-                best = _stash[i].first;
-                slot = i;
-            }
-                
+        if ( _readAheadThread.get() ){
+            bool m = more();
+            assert( m );
+            return (*_batch)[ _batchPos++ ];
         }
+
+        return _mergeNext();
+    }
+
+    BSONObjExternalSorter::Data BSONObjExternalSorter::Iterator::_mergeNext(){
+        assert( ! _heap.empty() );
+        HeapCmp cmp( _cmp );
+        pop_heap( _heap.begin() , _heap.end() , cmp );
+        HeapEntry best = _heap.back();
+        _heap.pop_back();
         
-        assert( slot >= 0 );
-        _stash[slot].second = false;
+        FileIterator * f = _files[ best.second ];
+        if ( f->more() ){
+            _heap.push_back( HeapEntry( f->next() , best.second ) );
+            push_heap( _heap.begin() , _heap.end() , cmp );
+        }
 
-        return best;
+        return best.first;
+    }
+
+    void BSONObjExternalSorter::Iterator::_readAhead(){
+        try {
+            while ( ! _stop && ! _heap.empty() ){
+                vector<Data> * b = new vector<Data>();
+                b->reserve( ReadAheadBatchSize );
+                while ( b->size() < ReadAheadBatchSize && ! _heap.empty() )
+                    b->push_back( _mergeNext() );
+                _batches.boundedPush( b , ReadAheadBatches );
+            }
+        }
+        catch ( std::exception& e ){
+            _error = e.what();
+            if ( _error.empty() )
+                _error = "unknown error";
+        }
+        _batches.push( 0 );
     }
 
     // -----------------------------------
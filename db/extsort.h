@@ -23,6 +23,8 @@
 #include "namespace.h"
 #include "curop.h"
 #include "../util/array.h"
+#include "../util/queue.h"
+#include "../util/concurrency/thread_pool.h"
 
 namespace mongo {
 
@@ -37,6 +39,7 @@ namespace mongo {
 
     private:
         static BSONObj extSortOrder;
+        static mongo::mutex _extSortMutex; // guards extSortOrder
 
         static int extSortComp( const void *lv, const void *rv ){
             RARELY killCurrentOp.checkForInterrupt();
@@ -63,9 +66,12 @@ namespace mongo {
 
         class MyCmp {
         public:
-            MyCmp( const BSONObj & order = BSONObj() ) : _order( order ){}
+            /* checkInterrupt needs a Client, so must be false off the client's thread */
+            MyCmp( const BSONObj & order = BSONObj() , bool checkInterrupt = true ) : _order( order ) , _checkInterrupt( checkInterrupt ){}
             bool operator()( const Data &l, const Data &r ) const {
-                RARELY killCurrentOp.checkForInterrupt();
+                if ( _checkInterrupt ) {
+                    RARELY killCurrentOp.checkForInterrupt();
+                }
                 _compares++;
                 int x = l.first.woCompare( r.first , _order );
                 if ( x )
@@ -75,6 +81,7 @@ namespace mongo {
 
         private:
             BSONObj _order;
+            bool _checkInterrupt;
         };
 
     public:
@@ -84,23 +91,54 @@ namespace mongo {
         class Iterator : boost::noncopyable {
         public:
             
-            Iterator( BSONObjExternalSorter * sorter );
+            /* readAhead: merge the files on a separate thread, a batch ahead of the caller.
+               interrupt is then checked once a batch, on the caller's thread. */
+            Iterator( BSONObjExternalSorter * sorter , bool readAhead = false );
             ~Iterator();
             bool more();
             Data next();
             
         private:
+            typedef pair<Data,unsigned> HeapEntry; // next Data from _files[second]
+
+            /* std heaps put the greatest on top; we want the least */
+            class HeapCmp {
+            public:
+                HeapCmp( const MyCmp& cmp ) : _cmp( cmp ){}
+                bool operator()( const HeapEntry& l , const HeapEntry& r ) const {
+                    return _cmp( r.first , l.first );
+                }
+            private:
+                MyCmp _cmp;
+            };
+
+            Data _mergeNext();
+            void _readAhead();
+
             MyCmp _cmp;
             vector<FileIterator*> _files;
-            vector< pair<Data,bool> > _stash;
+            vector<HeapEntry> _heap;
             
             InMemory * _in;
             InMemory::iterator _it;
-            
+
+            enum { ReadAheadBatchSize = 1000 , ReadAheadBatches = 8 };
+            auto_ptr<boost::thread> _readAheadThread;
+            BlockingQueue< vector<Data>* > _batches; // 0 marks the end
+            vector<Data> * _batch;
+            unsigned _batchPos;
+            bool _done;
+            volatile bool _stop;
+            string _error; // written by the read ahead thread before it queues the end
         };
         
         BSONObjExternalSorter( const BSONObj & order = BSONObj() , long maxFileSize = 1024 * 1024 * 100 );
         ~BSONObjExternalSorter();
+
+        /* sort and write out each full in memory batch on one of nThreads background threads, so
+           add() can carry on meanwhile.  the memory budget (maxFileSize) is shared between the
+           batches in flight.  call before adding. */
+        void sortInBackground( int nThreads );
         
         void add( const BSONObj& o , const DiskLoc & loc );
         void add( const BSONObj& o , int a , int b ){
@@ -110,9 +148,9 @@ namespace mongo {
         /* call after adding values, and before fetching the iterator */
         void sort();
         
-        auto_ptr<Iterator> iterator(){
+        auto_ptr<Iterator> iterator( bool readAhead = false ){
             uassert( 10052 ,  "not sorted" , _sorted );
-            return auto_ptr<Iterator>( new Iterator( this ) );
+            return auto_ptr<Iterator>( new Iterator( this , readAhead ) );
         }
         
         int numFiles(){
@@ -132,6 +170,9 @@ namespace mongo {
         
         void sort( string file );
         void finishMap();
+        void _writeFile( InMemory * data , const string& file );
+        void _sortAndWrite( InMemory * data , string file );
+        void _waitForBackgroundSorts();
         
         BSONObj _order;
         long _maxFilesize;
@@ -144,6 +185,13 @@ namespace mongo {
         list<string> _files;
         bool _sorted;
 
+        auto_ptr<ThreadPool> _pool;
+        mongo::mutex _bgMutex; // guards the fields below
+        boost::condition _bgChanged;
+        int _bgPending;
+        int _bgMaxPending;
+        string _bgError;
+
         static unsigned long long _compares;
     };
 }
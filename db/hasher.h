@@ -0,0 +1,126 @@
+// hasher.h
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../pch.h"
+#include "jsobj.h"
+
+namespace mongo {
+
+    /* name of the hashed index plugin, and the value of a hashed field in a key pattern:
+       { a : "hashed" } */
+    const string HASHEDNAME = "hashed";
+
+    /* 64 bit hash of a field's value, used as the key of hashed indexes and hashed shard keys.
+       mongod and mongos have to agree on it, so it doesn't depend on the platform, and values
+       that compare equal hash equal: numbers hash by value whatever their type.  a missing
+       field hashes as null, as it is indexed as null.
+       header only, so mongos doesn't need the index code.
+    */
+    class BSONElementHasher {
+    public:
+        static long long hash64( const BSONElement& e ){
+            unsigned long long h = Basis;
+            _element( h , e );
+
+            // fnv alone leaves small inputs clustered; this is the murmur3 finalizer
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return (long long)h;
+        }
+
+    private:
+        enum { NumberCanonical = 1000 }; // stands in for the type of all numbers
+        static const unsigned long long Basis = 14695981039346656037ULL;
+        static const unsigned long long Prime = 1099511628211ULL;
+
+        static void _bytes( unsigned long long& h , const char * p , int len ){
+            for ( int i=0; i<len; i++ ){
+                h ^= (unsigned char)p[i];
+                h *= Prime;
+            }
+        }
+
+        /* little endian whatever the host is */
+        static void _word( unsigned long long& h , unsigned long long x ){
+            for ( int i=0; i<8; i++ ){
+                h ^= ( x >> ( 8 * i ) ) & 0xff;
+                h *= Prime;
+            }
+        }
+
+        static void _element( unsigned long long& h , const BSONElement& e ){
+            switch ( e.type() ){
+            case EOO:
+            case Undefined:
+            case jstNULL:
+                _word( h , jstNULL );
+                return;
+            case NumberInt:
+            case NumberLong:
+                _word( h , NumberCanonical );
+                _word( h , e.numberLong() );
+                return;
+            case NumberDouble: {
+                _word( h , NumberCanonical );
+                double d = e.number();
+                if ( d >= -9.2233720368547758e18 && d < 9.2233720368547758e18 && d == (double)(long long)d ){
+                    // integral, so it equals that long long
+                    _word( h , (long long)d );
+                }
+                else if ( d != d ){
+                    _word( h , 0x7ff8000000000000ULL ); // every NaN is the same
+                }
+                else {
+                    unsigned long long bits;
+                    memcpy( &bits , &d , sizeof( bits ) );
+                    _word( h , bits );
+                }
+                return;
+            }
+            case String:
+            case Symbol:
+                _word( h , String );
+                _bytes( h , e.valuestr() , e.valuestrsize() - 1 );
+                return;
+            case Object:
+            case Array: {
+                // field by field, so embedded numbers are canonical too
+                _word( h , e.type() );
+                BSONObjIterator i( e.embeddedObject() );
+                while ( i.more() ){
+                    BSONElement x = i.next();
+                    _bytes( h , x.fieldName() , strlen( x.fieldName() ) + 1 );
+                    _element( h , x );
+                }
+                return;
+            }
+            default:
+                // the rest have one representation per value; bson stores it little endian
+                _word( h , e.type() );
+                _bytes( h , e.value() , e.valuesize() );
+                return;
+            }
+        }
+    };
+
+}
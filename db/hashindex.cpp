@@ -0,0 +1,135 @@
+// hashindex.cpp
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "namespace.h"
+#include "jsobj.h"
+#include "index.h"
+#include "../util/unittest.h"
+#include "hasher.h"
+
+namespace mongo {
+
+    /**
+     * { a : "hashed" } indexes the hash of a, as a NumberLong, instead of a.
+     * spreads monotonic values (ObjectIds, dates) evenly over the key space, which is what a
+     * hashed shard key needs.  only equality queries can use it; keys are found by hashing the
+     * queried value, and documents still go through the matcher as hashes can collide.
+     */
+    class HashedIndexType : public IndexType {
+    public:
+        HashedIndexType( const IndexPlugin * plugin , const IndexSpec * spec )
+            : IndexType( plugin , spec ){
+            BSONObj key = spec->keyPattern;
+            uassert( 13444 , "hashed indexes can only have one field" , key.nFields() == 1 );
+            _field = key.firstElement().fieldName();
+        }
+
+        virtual void getKeys( const BSONObj &obj, BSONObjSetDefaultOrder &keys ) const {
+            BSONElement e = obj.getFieldDotted( _field.c_str() );
+            uassert( 13445 , "hashed indexes don't support arrays" , e.type() != Array );
+            keys.insert( hashKey( e ) );
+        }
+
+        virtual shared_ptr<Cursor> newCursor( const BSONObj& query , const BSONObj& order , int numWanted ) const {
+            uasserted( 13446 , "hashed indexes have no special queries" );
+            return shared_ptr<Cursor>();
+        }
+
+        /* only an equality on the field can be looked up */
+        virtual IndexSuitability suitability( const BSONObj& query , const BSONObj& order ) const {
+            BSONElement e = query.getFieldDotted( _field.c_str() );
+            switch ( e.type() ){
+            case EOO:
+            case Array:
+            case RegEx:
+                return USELESS;
+            case Object:
+                if ( e.embeddedObject().firstElement().getGtLtOp() != BSONObj::Equality )
+                    return USELESS;
+            default:
+                return HELPFUL;
+            }
+        }
+
+        virtual void fixBounds( BSONObj& start , BSONObj& end ) const {
+            BSONElement s = start.firstElement();
+            if ( start.woCompare( end , BSONObj() , false ) == 0 && s.type() != MinKey && s.type() != MaxKey ){
+                start = end = hashKey( s );
+                return;
+            }
+
+            // a range of values is spread all over the index
+            BSONObjBuilder b;
+            b.appendMinKey( "" );
+            start = b.obj();
+            BSONObjBuilder c;
+            c.appendMaxKey( "" );
+            end = c.obj();
+        }
+
+        static BSONObj hashKey( const BSONElement& e ){
+            BSONObjBuilder b;
+            b.append( "" , BSONElementHasher::hash64( e ) );
+            return b.obj();
+        }
+
+    private:
+        string _field;
+    };
+
+    class HashedIndexPlugin : public IndexPlugin {
+    public:
+        HashedIndexPlugin() : IndexPlugin( HASHEDNAME ){
+        }
+
+        virtual IndexType* generate( const IndexSpec* spec ) const {
+            return new HashedIndexType( this , spec );
+        }
+    } hashedIndexPlugin;
+
+    class HashedIndexUnitTest : public UnitTest {
+    public:
+        long long hash( const BSONObj& o ){
+            return BSONElementHasher::hash64( o.firstElement() );
+        }
+
+        void run(){
+            // equal values hash equal whatever their numeric type
+            assert( hash( BSON( "" << 5 ) ) == hash( BSON( "" << 5LL ) ) );
+            assert( hash( BSON( "" << 5 ) ) == hash( BSON( "" << 5.0 ) ) );
+            assert( hash( BSON( "" << BSON( "a" << 1 ) ) ) == hash( BSON( "" << BSON( "a" << 1.0 ) ) ) );
+            assert( hash( BSON( "" << 5 ) ) != hash( BSON( "" << 5.5 ) ) );
+            assert( hash( BSON( "" << 5 ) ) != hash( BSON( "" << "5" ) ) );
+
+            // missing is null
+            BSONObjBuilder b;
+            b.appendNull( "" );
+            assert( hash( BSONObj() ) == hash( b.obj() ) );
+
+            // neighbouring values don't land next to each other
+            assert( ( hash( BSON( "" << 1 ) ) >> 48 ) != ( hash( BSON( "" << 2 ) ) >> 48 ) );
+
+            // the key space is a contract between mongos and mongod; don't change this value
+            assert( hash( BSON( "" << 0 ) ) == 2783800711712362872LL );
+
+            log(1) << "hashedIndexUnitTest passed" << endl;
+        }
+    } hashedIndexUnitTest;
+
+}
@@ -77,8 +77,8 @@ namespace mongo {
         catch(DBException& ) { 
             log(2) << "IndexDetails::kill(): couldn't drop ns " << ns << endl;
         }
-        head.setInvalid();
-        info.setInvalid();
+        dur::writing( &head )->setInvalid();
+        dur::writing( &info )->setInvalid();
 
         // clean up in system.indexes.  we do this last on purpose.
         int n = removeFromSysIndexes(pns.c_str(), name.c_str());
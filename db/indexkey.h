@@ -50,6 +50,12 @@ namespace mongo {
         /** optional op : changes query to match what's in the index */
         virtual BSONObj fixKey( const BSONObj& in ) { return in; }
 
+        /** 
+         * optional op : changes the bounds a plain query plan took from the query's field ranges
+         * to bounds on the keys this index holds
+         */
+        virtual void fixBounds( BSONObj& start , BSONObj& end ) const {}
+
         /** optional op : compare 2 objects with regards to this index */
         virtual int compare( const BSONObj& l , const BSONObj& r ) const;        
 
@@ -38,6 +38,7 @@
 #endif
 #include "stats/counters.h"
 #include "background.h"
+#include "dur.h"
 
 namespace mongo {
 
@@ -360,8 +361,11 @@ namespace mongo {
                 mongo::log(1) << "note: not profiling because recursive read lock" << endl;
             }
             else {
-                mongolock lk(true);
-                if ( dbHolder.isLoaded( nsToDatabase( currentOp.getNS() ) , dbpath ) ){
+                // profile() writes <db>.system.profile, not the op's collection.  system namespaces
+                // have no locks of their own, so this takes the database lock.
+                string db = nsToDatabase( currentOp.getNS() );
+                mongolock lk(true, db + ".system.profile");
+                if ( dbHolder.isLoaded( db , dbpath ) ){
                     Client::Context c( currentOp.getNS() );
                     profile(ss.str().c_str(), ms);
                 }
@@ -412,6 +416,10 @@ namespace mongo {
 
         NamespaceDetailsTransient::clearForPrefix( prefix.c_str() );
 
+        // writes not yet committed are only in the files' private views
+        string files = database->fileName( 0 ).string();
+        dur::closingFiles( files.substr( 0 , files.size() - 1 ) );
+
         dbHolder.erase( db, path );
         delete database; // closes files
         ctx->clear();
@@ -445,7 +453,7 @@ namespace mongo {
             op.setQuery(query);
         }        
 
-        mongolock lk(1);
+        mongolock lk(1, ns);
 
         if ( ! broadcast && handlePossibleShardedMessage( m , 0 ) )
             return;
@@ -500,17 +508,20 @@ namespace mongo {
         int pass = 0;        
         bool exhaust = false;
         QueryResult* msgdata;
+        Timer awaitTime;
         while( 1 ) {
             try {
-                mongolock lk(false);
+                mongolock lk(false, ns);
                 Client::Context ctx(ns);
                 msgdata = processGetMore(ns, ntoreturn, cursorid, curop, pass, exhaust);
             }
-            catch ( GetMoreWaitException& ) { 
+            catch ( GetMoreWaitException& e ) { 
                 exhaust = false;
                 massert(13073, "shutting down", !inShutdown() );
                 pass++;
-                sleepmillis(2);
+                int left = AwaitDataMillis - awaitTime.millis();
+                if ( left <= 0 || ! cappedInsertNotifier.waitForInsert( ns , e.cappedVersion , left ) )
+                    pass = AwaitDataMaxPasses; // one last look, then return what there is
                 continue;
             }
             catch ( AssertionException& e ) {
@@ -732,6 +743,8 @@ namespace mongo {
         log() << "\t shutdown: waiting for fs preallocator..." << endl;
         theFileAllocator().waitUntilFinished();
         
+        dur::shutdown();
+
         log() << "\t shutdown: closing all files..." << endl;
         stringstream ss3;
         MemoryMappedFile::closeAllFiles( ss3 );
@@ -776,7 +789,10 @@ namespace mongo {
             uassert( 10310 ,  "Unable to acquire lock for lockfilepath: " + name,  0 );
         }
 
-        if ( oldFile ){
+        if ( oldFile && dur::haveJournal() ){
+            log() << "old lock file: " << name << ".  unclean shutdown, the journal will be replayed" << endl;
+        }
+        else if ( oldFile ){
             // we check this here because we want to see if we can get the lock
             // if we can't, then its probably just another mongod running
             cout << "************** \n" 
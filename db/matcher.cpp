@@ -393,11 +393,18 @@ namespace mongo {
         }
     }
     
+    /* whether the keys of an index with pattern key hold the value of field.  a plugin's field,
+       e.g. { a : "hashed" }, holds something else. */
+    static bool keyHoldsField( const BSONObj &key, const char *field ) {
+        BSONElement e = key.getField( field );
+        return !e.eoo() && e.type() != String;
+    }
+
     Matcher::Matcher( const Matcher &other, const BSONObj &key ) :
     where(0), constrainIndexKey_( key ), haveSize(), all(), hasArray(0), haveNeg(), _atomic(false), nRegex(0) {
         // do not include fields which would make keyMatch() false
         for( vector< ElementMatcher >::const_iterator i = other.basics.begin(); i != other.basics.end(); ++i ) {
-            if ( key.hasField( i->toMatch.fieldName() ) ) {
+            if ( keyHoldsField( key, i->toMatch.fieldName() ) ) {
                 switch( i->compareOp ) {
                     case BSONObj::opSIZE:
                     case BSONObj::opALL:
@@ -413,7 +420,7 @@ namespace mongo {
             }
         }
         for( int i = 0; i < other.nRegex; ++i ) {
-            if ( !other.regexs[ i ].isNot && key.hasField( other.regexs[ i ].fieldName ) ) {
+            if ( !other.regexs[ i ].isNot && keyHoldsField( key, other.regexs[ i ].fieldName ) ) {
                 regexs[ nRegex++ ] = other.regexs[ i ];
             }
         }
@@ -175,6 +175,8 @@ namespace mongo {
 
     void NamespaceDetails::addDeletedRec(DeletedRecord *d, DiskLoc dloc) {
 		BOOST_STATIC_ASSERT( sizeof(NamespaceDetails::Extra) <= sizeof(NamespaceDetails) );
+        dur::writing( this ); // the deleted lists, and the capped fields kept in them
+        dur::declareWriteIntent( d , Record::HeaderSize + 4 );
         {
             // defensive code: try to make us notice if we reference a deleted record
             (unsigned&) (((Record *) d)->data) = 0xeeeeeeee;
@@ -190,11 +192,11 @@ namespace mongo {
                 else {
                     DiskLoc i = cappedListOfAllDeletedRecords();
                     for (; !i.drec()->nextDeleted.isNull(); i = i.drec()->nextDeleted );
-                    i.drec()->nextDeleted = dloc;
+                    dur::writing( i.drec() )->nextDeleted = dloc;
                 }
             } else {
                 d->nextDeleted = cappedFirstDeletedInCurExtent();
-                cappedFirstDeletedInCurExtent() = dloc;
+                *dur::writing( &cappedFirstDeletedInCurExtent() ) = dloc;
                 // always compact() after this so order doesn't matter
             }
         } else {
@@ -235,7 +237,7 @@ namespace mongo {
         }
 
         /* split off some for further use. */
-        r->lengthWithHeaders = lenToAlloc;
+        dur::writing( r )->lengthWithHeaders = lenToAlloc;
 		DataFileMgr::grow(loc, lenToAlloc);
         DiskLoc newDelLoc = loc;
         newDelLoc.inc(lenToAlloc);
@@ -260,7 +262,9 @@ namespace mongo {
         int b = bucket(len);
         DiskLoc cur = deletedList[b];
         prev = &deletedList[b];
-        int extra = 5; // look for a better fit, a little.
+        // look for a better fit, a little.  with size classes, the best fit in the class we start
+        // in is worth the rest of the chain: whatever we leave is what that class has to reuse.
+        int extra = usePowerOf2Sizes() ? 30 : 5;
         int chain = 0;
         while ( 1 ) {
             {
@@ -270,7 +274,7 @@ namespace mongo {
                     " a:" << a << " b:" << b << " chain:" << chain << '\n';
                     sayDbContext();
                     if ( cur == *prev )
-                        prev->Null();
+                        dur::writing( prev )->Null();
                     cur.Null();
                 }
             }
@@ -293,6 +297,8 @@ namespace mongo {
                 bestmatchlen = r->lengthWithHeaders;
                 bestmatch = cur;
                 bestprev = prev;
+                if ( bestmatchlen == len )
+                    break; // can't do better
             }
             if ( bestmatchlen < 0x7fffffff && --extra <= 0 )
                 break;
@@ -316,8 +322,8 @@ namespace mongo {
 
         /* unlink ourself from the deleted list */
         {
-            DeletedRecord *bmr = bestmatch.drec();
-            *bestprev = bmr->nextDeleted;
+            DeletedRecord *bmr = dur::writing( bestmatch.drec() );
+            *dur::writing( bestprev ) = bmr->nextDeleted;
             bmr->nextDeleted.setInvalid(); // defensive.
             assert(bmr->extentOfs < bestmatch.getOfs());
         }
@@ -361,6 +367,93 @@ namespace mongo {
         return DiskLoc();
     }
 
+    static bool adjacentDeleted( const DiskLoc& a , const DiskLoc& b ) {
+        DeletedRecord *x = a.drec();
+        return a.a() == b.a() && a.getOfs() + x->lengthWithHeaders == b.getOfs() &&
+            x->extentOfs == b.drec()->extentOfs;
+    }
+
+    bool NamespaceDetails::coalesceDeleted() {
+        assert( !capped );
+        vector<DiskLoc> drecs;
+        for ( int b = 0; b < Buckets; b++ )
+            for ( DiskLoc i = deletedList[b]; !i.isNull(); i = i.drec()->nextDeleted )
+                drecs.push_back( i );
+        sort( drecs.begin(), drecs.end() );
+
+        bool any = false;
+        for ( unsigned i = 1; i < drecs.size() && !any; i++ )
+            any = adjacentDeleted( drecs[i-1], drecs[i] );
+        if ( !any )
+            return false;
+
+        // rebuild the lists from the merged records
+        dur::writing( this );
+        for ( int b = 0; b < Buckets; b++ )
+            deletedList[b].Null();
+        unsigned merged = 0;
+        for ( unsigned i = 0; i < drecs.size(); ) {
+            DiskLoc a = drecs[i];
+            DeletedRecord *d = dur::writing( a.drec() );
+            for ( i++; i < drecs.size() && adjacentDeleted( a, drecs[i] ); i++, merged++ )
+                d->lengthWithHeaders += drecs[i].drec()->lengthWithHeaders;
+            addDeletedRec( d, a );
+        }
+        log(1) << "coalesced " << merged << " of " << drecs.size() << " deleted records" << endl;
+        return true;
+    }
+
+    void NamespaceDetails::appendFreeSpaceStats(BSONObjBuilder& b, int scale, bool perExtent) {
+        // capped collections keep every deleted record on list 0; list 1 is a pointer into it
+        int nLists = capped ? 1 : Buckets;
+        long long records = 0;
+        long long size = 0;
+        int largest = 0;
+        BSONArrayBuilder classes;
+        map< DiskLoc, pair<long long,int> > byExtent; // free bytes and records
+        for ( int i = 0; i < nLists; i++ ) {
+            int n = 0;
+            for ( DiskLoc dl = deletedList[i]; !dl.isNull(); dl = dl.drec()->nextDeleted ) {
+                DeletedRecord *r = dl.drec();
+                n++;
+                size += r->lengthWithHeaders;
+                largest = std::max( largest, r->lengthWithHeaders );
+                if ( perExtent ) {
+                    pair<long long,int>& e = byExtent[ DiskLoc( dl.a(), r->extentOfs ) ];
+                    e.first += r->lengthWithHeaders;
+                    e.second++;
+                }
+            }
+            records += n;
+            classes.append( n );
+        }
+
+        int numExtents;
+        long long storage = storageSize( &numExtents );
+
+        BSONObjBuilder f( b.subobjStart( "freeSpace" ) );
+        f.appendNumber( "records", records );
+        f.appendNumber( "size", size / scale );
+        f.append( "largest", largest / scale );
+        f.append( "ratio", storage ? double( size ) / double( storage ) : 0.0 );
+        if ( !capped )
+            f.append( "byClass", classes.arr() ); // deleted list i holds [ bucketSizes[i-1], bucketSizes[i] )
+        if ( perExtent ) {
+            BSONArrayBuilder extents( f.subarrayStart( "byExtent" ) );
+            for ( DiskLoc i = firstExtent; !i.isNull(); i = i.ext()->xnext ) {
+                pair<long long,int> e = byExtent[ i ];
+                BSONObjBuilder x( extents.subobjStart() );
+                x.append( "loc", i.toString() );
+                x.append( "size", i.ext()->length / scale );
+                x.appendNumber( "free", e.first / scale );
+                x.append( "freeRecords", e.second );
+                x.done();
+            }
+            extents.done();
+        }
+        f.done();
+    }
+
     int n_complaints_cap = 0;
     void NamespaceDetails::maybeComplain( const char *ns, int len ) const {
         if ( ++n_complaints_cap < 8 ) {
@@ -381,14 +474,20 @@ namespace mongo {
 
     /* alloc with capped table handling. */
     DiskLoc NamespaceDetails::_alloc(const char *ns, int len) {
-        if ( !capped )
-            return __stdAlloc(len);
+        if ( !capped ) {
+            DiskLoc loc = __stdAlloc(len);
+            // before growing, see if the holes left by smaller classes add up to one
+            if ( loc.isNull() && usePowerOf2Sizes() && coalesceDeleted() )
+                loc = __stdAlloc(len);
+            return loc;
+        }
 
         return cappedAlloc(ns,len);
     }
 
     /* extra space for indexes when more than 10 */
     NamespaceDetails::Extra* NamespaceIndex::newExtra(const char *ns, int i, NamespaceDetails *d) {
+        dbMutex.assertWriteLockedDB( database_ );
         assert( i >= 0 && i <= 1 );
         Namespace n(ns);
         Namespace extra(n.extraName(i).c_str()); // throws userexception if ns name too long
@@ -409,19 +508,20 @@ namespace mongo {
         long ofs = e->ofsFrom(this);
         if( i == 0 ) {
             assert( extraOffset == 0 );
-            extraOffset = ofs;
+            *dur::writing( &extraOffset ) = ofs;
             assert( extra() == e );
         }
         else { 
             Extra *hd = extra();
             assert( hd->next(this) == 0 );
-            hd->setNext(ofs);
+            dur::writing( hd )->setNext(ofs);
         }
         return e;
     }
 
     /* you MUST call when adding an index.  see pdfile.cpp */
     IndexDetails& NamespaceDetails::addIndex(const char *thisns, bool resetTransient) {
+        dbMutex.assertWriteLockedDB( nsToDatabase( thisns ) );
         assert( nsdetails(thisns) == this );
 
         IndexDetails *id;
@@ -433,7 +533,8 @@ namespace mongo {
             id = &idx(nIndexes);
         }
 
-        nIndexes++;
+        (*dur::writing( &nIndexes ))++;
+        dur::writing( id );
         if ( resetTransient )
             NamespaceDetailsTransient::get_w(thisns).addedIndex();
         return *id;
@@ -441,18 +542,18 @@ namespace mongo {
 
     // must be called when renaming a NS to fix up extra
     void NamespaceDetails::copyingFrom(const char *thisns, NamespaceDetails *src) { 
-        extraOffset = 0; // we are a copy -- the old value is wrong.  fixing it up below.
+        *dur::writing( &extraOffset ) = 0; // we are a copy -- the old value is wrong.  fixing it up below.
         Extra *se = src->extra();
         int n = NIndexesBase;
         if( se ) {
             Extra *e = allocExtra(thisns, n);
             while( 1 ) {
                 n += NIndexesExtra;
-                e->copy(this, *se);
+                dur::writing( e )->copy(this, *se);
                 se = se->next(src);
                 if( se == 0 ) break;
                 Extra *nxt = allocExtra(thisns, n);
-                e->setNext( nxt->ofsFrom(this) );
+                dur::writing( e )->setNext( nxt->ofsFrom(this) );
                 e = nxt;
             } 
             assert( extraOffset );
@@ -496,6 +597,7 @@ namespace mongo {
 
     mongo::mutex NamespaceDetailsTransient::_qcMutex("qc");
     mongo::mutex NamespaceDetailsTransient::_isMutex("is");
+    mongo::mutex NamespaceDetailsTransient::_mapMutex("ndtmap");
     map< string, shared_ptr< NamespaceDetailsTransient > > NamespaceDetailsTransient::_map;
     typedef map< string, shared_ptr< NamespaceDetailsTransient > >::iterator ouriter;
 
@@ -515,6 +617,7 @@ namespace mongo {
 */
     void NamespaceDetailsTransient::clearForPrefix(const char *prefix) {
         assertInWriteLock();
+        scoped_lock lk( _mapMutex );
         vector< string > found;
         for( ouriter i = _map.begin(); i != _map.end(); ++i )
             if ( strncmp( i->first.c_str(), prefix, strlen( prefix ) ) == 0 )
@@ -628,7 +731,7 @@ namespace mongo {
 			int indexI = details->findIndexByName( oldIndexSpec.getStringField( "name" ) );
 			IndexDetails &indexDetails = details->idx(indexI);
 			string oldIndexNs = indexDetails.indexNamespace();
-			indexDetails.info = newIndexSpecLoc;
+			*dur::writing( &indexDetails.info ) = newIndexSpecLoc;
 			string newIndexNs = indexDetails.indexNamespace();
 			
 			BtreeBucket::renameIndexNamespace( oldIndexNs.c_str(), newIndexNs.c_str() );
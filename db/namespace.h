@@ -24,6 +24,7 @@
 #include "diskloc.h"
 #include "../util/hashtab.h"
 #include "../util/mmap.h"
+#include "dur.h"
 
 namespace mongo {
 
@@ -304,9 +305,14 @@ namespace mongo {
                  this isn't thread safe.  TODO
         */
         enum NamespaceFlags {
-            Flag_HaveIdIndex = 1 << 0 // set when we have _id index (ONLY if ensureIdIndex was called -- 0 if that has never been called)
+            Flag_HaveIdIndex = 1 << 0, // set when we have _id index (ONLY if ensureIdIndex was called -- 0 if that has never been called)
+            Flag_UsePowerOf2Sizes = 1 << 1, // records are allocated in power of 2 size classes.  see powerOf2Size()
+            Flag_CompressRecords = 1 << 2 // records may be stored compressed.  see Record::isCompressed()
         };
 
+        bool usePowerOf2Sizes() const { return ( flags & Flag_UsePowerOf2Sizes ) != 0; }
+        bool compressRecords() const { return ( flags & Flag_CompressRecords ) != 0; }
+
         IndexDetails& idx(int idxNo) {
             if( idxNo < NIndexesBase ) 
                 return _indexes[idxNo];
@@ -364,11 +370,11 @@ namespace mongo {
         }
         void setIndexIsMultikey(int i) { 
             dassert( i < NIndexesMax );
-            multiKeyIndexBits |= (((unsigned long long) 1) << i);
+            *dur::writing( &multiKeyIndexBits ) |= (((unsigned long long) 1) << i);
         }
         void clearIndexIsMultikey(int i) { 
             dassert( i < NIndexesMax );
-            multiKeyIndexBits &= ~(((unsigned long long) 1) << i);
+            *dur::writing( &multiKeyIndexBits ) &= ~(((unsigned long long) 1) << i);
         }
 
         /* add a new index.  does not add to system.indexes etc. - just to NamespaceDetails.
@@ -376,7 +382,7 @@ namespace mongo {
          */
         IndexDetails& addIndex(const char *thisns, bool resetTransient=true);
 
-        void aboutToDeleteAnIndex() { flags &= ~Flag_HaveIdIndex;  }
+        void aboutToDeleteAnIndex() { *dur::writing( &flags ) &= ~Flag_HaveIdIndex;  }
 
         /* returns index of the first index in which the field is present. -1 if not present. */
         int fieldIsIndexed(const char *fieldName);
@@ -384,12 +390,12 @@ namespace mongo {
         void paddingFits() {
             double x = paddingFactor - 0.01;
             if ( x >= 1.0 )
-                paddingFactor = x;
+                *dur::writing( &paddingFactor ) = x;
         }
         void paddingTooSmall() {
             double x = paddingFactor + 0.6;
             if ( x <= 2.0 )
-                paddingFactor = x;
+                *dur::writing( &paddingFactor ) = x;
         }
 
         //returns offset in indexes[]
@@ -440,9 +446,28 @@ namespace mongo {
             return Buckets-1;
         }
 
+        /* { usePowerOf2Sizes : true } collections: the size class for a record of len bytes,
+           headers included.  the classes are the deleted list bucket sizes, so a freed record
+           goes back to the list its class allocates from and is reused whole by the next record
+           of that class; what would have been padding is the room left in the class.
+        */
+        static int powerOf2Size(int len) {
+            for ( int i = 0; i < Buckets; i++ )
+                if ( bucketSizes[i] >= len )
+                    return bucketSizes[i];
+            return len;
+        }
+
         /* allocate a new record.  lenToAlloc includes headers. */
         DiskLoc alloc(const char *ns, int lenToAlloc, DiskLoc& extentLoc);
 
+        /* merges deleted records that are next to each other in an extent.  non-capped only.
+           @return true if any were merged */
+        bool coalesceDeleted();
+
+        /* collStats: the deleted lists by size class, and by extent if perExtent */
+        void appendFreeSpaceStats(BSONObjBuilder& b, int scale, bool perExtent);
+
         /* add a given record to the deleted chains for this NS */
         void addDeletedRec(DeletedRecord *d, DiskLoc dloc);
 
@@ -484,6 +509,8 @@ namespace mongo {
         string _ns;
         void reset();
         static std::map< string, shared_ptr< NamespaceDetailsTransient > > _map;
+        /* with per database locking, threads locking different dbs can touch _map at once */
+        static mongo::mutex _mapMutex;
     public:
         NamespaceDetailsTransient(const char *ns) : _ns(ns), _keysComputed(false), _qcWriteCount(){ }
         /* _get() is not threadsafe -- see get_inlock() comments */
@@ -568,6 +595,7 @@ namespace mongo {
     }; /* NamespaceDetailsTransient */
 
     inline NamespaceDetailsTransient& NamespaceDetailsTransient::_get(const char *ns) {
+        scoped_lock lk( _mapMutex );
         shared_ptr< NamespaceDetailsTransient > &t = _map[ ns ];
         if ( t.get() == 0 )
             t.reset( new NamespaceDetailsTransient(ns) );
@@ -594,6 +622,7 @@ namespace mongo {
 			add_ns( ns, details );
         }
 		void add_ns( const char *ns, const NamespaceDetails &details ) {
+            dbMutex.assertWriteLockedDB( database_ );
             init();
             Namespace n(ns);
             uassert( 10081 , "too many namespaces/collections", ht->put(n, details));
@@ -617,6 +646,7 @@ namespace mongo {
         }
 
         void kill_ns(const char *ns) {
+            dbMutex.assertWriteLockedDB( database_ );
             if ( !ht )
                 return;
             Namespace n(ns);
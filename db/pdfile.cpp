@@ -31,6 +31,7 @@ _ disallow system* manipulations from the database.
 #include "../util/hashtab.h"
 #include "../util/file_allocator.h"
 #include "../util/processinfo.h"
+#include "../util/lz.h"
 #include "btree.h"
 #include <algorithm>
 #include <list>
@@ -58,16 +59,19 @@ namespace mongo {
 
     const int MaxExtentSize = 0x7ff00000;
 
+    mongo::mutex BackgroundOperation::m("bgop");
     map<string, unsigned> BackgroundOperation::dbsInProg;
     set<string> BackgroundOperation::nsInProg;
 
     bool BackgroundOperation::inProgForDb(const char *db) {
         assertInWriteLock();
+        scoped_lock lk(m);
         return dbsInProg[db] != 0;
     }
 
     bool BackgroundOperation::inProgForNs(const char *ns) { 
         assertInWriteLock();
+        scoped_lock lk(m);
         return nsInProg.count(ns) != 0;
     }
 
@@ -83,6 +87,7 @@ namespace mongo {
 
     BackgroundOperation::BackgroundOperation(const char *ns) : _ns(ns) { 
         assertInWriteLock();
+        scoped_lock lk(m);
         dbsInProg[_ns.db]++;
         assert( nsInProg.count(_ns.ns()) == 0 );
         nsInProg.insert(_ns.ns());
@@ -90,11 +95,13 @@ namespace mongo {
 
     BackgroundOperation::~BackgroundOperation() { 
         assertInWriteLock();
+        scoped_lock lk(m);
         dbsInProg[_ns.db]--;
         nsInProg.erase(_ns.ns());
     }
 
     void BackgroundOperation::dump(stringstream& ss) {
+        scoped_lock lk(m);
         if( nsInProg.size() ) { 
             ss << "\n<b>Background Jobs in Progress</b>\n";
             for( set<string>::iterator i = nsInProg.begin(); i != nsInProg.end(); i++ )
@@ -114,6 +121,36 @@ namespace mongo {
     string pidfilepath;
 
     DataFileMgr theDataFileMgr;
+    CappedInsertNotifier cappedInsertNotifier;
+
+    void CappedInsertNotifier::notifyOfInsert( const char *ns ) {
+        scoped_lock lk( _mutex );
+        map< string , shared_ptr<Waiters> >::iterator i = _waiters.find( ns );
+        if ( i == _waiters.end() )
+            return; // no one has ever waited for this ns
+        i->second->version++;
+        i->second->changed.notify_all();
+    }
+
+    unsigned long long CappedInsertNotifier::getVersion( const char *ns ) {
+        scoped_lock lk( _mutex );
+        shared_ptr<Waiters>& w = _waiters[ ns ];
+        if ( ! w )
+            w.reset( new Waiters() );
+        return w->version;
+    }
+
+    bool CappedInsertNotifier::waitForInsert( const char *ns , unsigned long long version , int millis ) {
+        boost::system_time deadline = get_system_time() + boost::posix_time::milliseconds( millis );
+        scoped_lock lk( _mutex );
+        shared_ptr<Waiters> w = _waiters[ ns ];
+        assert( w ); // from getVersion
+        while ( w->version == version ) {
+            if ( ! w->changed.timed_wait( lk.boost() , deadline ) )
+                return w->version != version;
+        }
+        return true;
+    }
     DatabaseHolder dbHolder;
     int MAGIC = 0x1000;
 //    int curOp = -2;
@@ -145,7 +182,37 @@ namespace mongo {
     }
 
     BSONObj::BSONObj(const Record *r) {
-        init(r->data, false);
+        if ( r->isCompressed() )
+            init(r->decompress(), true); // our own copy, freed with the last BSONObj to share it
+        else
+            init(r->data, false);
+    }
+
+    bool Record::compress(const char *obj, int len, BufBuilder& b) {
+        if ( len < 128 )
+            return false;
+        b.reset();
+        b.appendNum( (int) 0 );
+        b.appendNum( len );
+        int n = lz::compress( obj, len, b.grow( lz::maxCompressedLength( len ) ) );
+        if ( 8 + n > len - len / 8 )
+            return false; // under 1/8 saved doesn't pay for decompressing on every read
+        *((int *) b.buf()) = -n;
+        b.setlen( 8 + n );
+        return true;
+    }
+
+    char* Record::decompress() const {
+        const int *h = (const int *) data;
+        char *p = 0;
+        if ( 8 - h[0] <= lengthWithHeaders - HeaderSize && h[1] >= 5 && h[1] <= 64 * 1024 * 1024 ) {
+            p = (char *) malloc( h[1] );
+            if ( p && lz::decompress( data + 8, -h[0], p, h[1] ) )
+                return p;
+        }
+        free( p );
+        msgasserted( 13458, "corrupt compressed record" );
+        return 0;
     }
 
     /*---------------------------------------------------------------------*/
@@ -167,6 +234,18 @@ namespace mongo {
             return false;
         }
 
+        bool powerOf2Sizes = options["usePowerOf2Sizes"].trueValue();
+        if ( powerOf2Sizes && options["capped"].trueValue() ) {
+            err = "usePowerOf2Sizes doesn't apply to capped collections";
+            return false;
+        }
+        bool compressRecords = options["compressRecords"].trueValue();
+        if ( compressRecords && options["capped"].trueValue() ) {
+            // the oplog and tailable cursors read capped records raw
+            err = "compressRecords doesn't apply to capped collections";
+            return false;
+        }
+
         log(1) << "create collection " << ns << ' ' << options << '\n';
 
         /* todo: do this only when we have allocated space successfully? or we could insert with a { ok: 0 } field
@@ -243,10 +322,15 @@ namespace mongo {
         if ( mx > 0 )
             d->max = mx;
 
+        if ( powerOf2Sizes )
+            *dur::writing( &d->flags ) |= NamespaceDetails::Flag_UsePowerOf2Sizes;
+        if ( compressRecords )
+            *dur::writing( &d->flags ) |= NamespaceDetails::Flag_CompressRecords;
+
         return true;
     }
 
-    /** { ..., capped: true, size: ..., max: ... }
+    /** { ..., capped: true, size: ..., max: ..., usePowerOf2Sizes: ..., compressRecords: ... }
         @param deferIdIndex - if not not, defers id index creation.  sets the bool value to true if we wanted to create the id index.
         @return true if successful
     */
@@ -360,17 +444,24 @@ namespace mongo {
         DiskLoc oldExtentLoc;
         NamespaceIndex *ni = nsindex(ns);
         NamespaceDetails *details = ni->details(ns);
-        if ( details ) {
+        if ( details && details->firstExtent.isNull() ) {
+            // compactCollection() empties the chain and refills it
+            assert( details->lastExtent.isNull() );
+            dur::writing( details );
+            details->firstExtent = details->lastExtent = eloc;
+        }
+        else if ( details ) {
             assert( !details->lastExtent.isNull() );
             assert( !details->firstExtent.isNull() );
-            e->xprev = details->lastExtent;
-            details->lastExtent.ext()->xnext = eloc;
+            dur::writing( details );
+            dur::writing( e )->xprev = details->lastExtent;
+            dur::writing( details->lastExtent.ext() )->xnext = eloc;
             assert( !eloc.isNull() );
             details->lastExtent = eloc;
         }
         else {
             ni->add_ns(ns, eloc, capped);
-            details = ni->details(ns);
+            details = dur::writing( ni->details(ns) );
         }
 
         details->lastExtentSize = e->length;
@@ -395,8 +486,8 @@ namespace mongo {
             return cc().database()->addAFile( 0, true )->createExtent(ns, approxSize, newCapped, loops+1);
         }
         int offset = header->unused.getOfs();
-        header->unused.setOfs( fileNo, offset + ExtentSize );
-        header->unusedLength -= ExtentSize;
+        dur::writing( &header->unused )->setOfs( fileNo, offset + ExtentSize );
+        *dur::writing( &header->unusedLength ) -= ExtentSize;
         loc.setOfs(fileNo, offset);
         Extent *e = _getExtent(loc);
         DiskLoc emptyLoc = e->init(ns, ExtentSize, fileNo, offset);
@@ -449,10 +540,11 @@ namespace mongo {
             if( best ) {
                 Extent *e = best;
                 // remove from the free list
+                dur::writing( f );
                 if( !e->xprev.isNull() )
-                    e->xprev.ext()->xnext = e->xnext;
+                    dur::writing( e->xprev.ext() )->xnext = e->xnext;
                 if( !e->xnext.isNull() )
-                    e->xnext.ext()->xprev = e->xprev;
+                    dur::writing( e->xnext.ext() )->xprev = e->xprev;
                 if( f->firstExtent == e->myLoc )
                     f->firstExtent = e->xnext;
                 if( f->lastExtent == e->myLoc )
@@ -472,10 +564,39 @@ namespace mongo {
 
     /*---------------------------------------------------------------------*/
 
+    static ProcessInfo recordPageCheck;
+
+    bool Record::likelyInPhysicalMemory() {
+        static bool supported = recordPageCheck.blockCheckSupported();
+        if ( ! supported )
+            return true;
+
+        // scans tend to read many records from one page in a row, so skip the syscall when we 
+        // just saw this page resident.  shared between threads and unsynchronized on purpose - 
+        // a stale answer only means we fault with the lock held, as we did before.
+        static const char * volatile lastResident = 0;
+        const char *page = (const char*) ( (size_t) this & ~( (size_t) 4095 ) );
+        if ( page == lastResident )
+            return true;
+        if ( ! recordPageCheck.blockInMemory( (char*) this ) )
+            return false;
+        lastResident = page;
+        return true;
+    }
+
+    void Record::touch() {
+        // only the header page: we can't read lengthWithHeaders here without risking the very
+        // fault we are trying to take outside the lock
+        MongoFile::touch( (const char*) this , HeaderSize );
+    }
+
+    /*---------------------------------------------------------------------*/
+
     DiskLoc Extent::reuse(const char *nsname) { 
 		/*TODOMMF - work to do when extent is freed. */
         log(3) << "reset extent was:" << nsDiagnostic.buf << " now:" << nsname << '\n';
         massert( 10360 ,  "Extent::reset bad magic value", magic == 0x41424344 );
+        dur::writing( this );
         xnext.Null();
         xprev.Null();
         nsDiagnostic = nsname;
@@ -501,6 +622,7 @@ namespace mongo {
 
     /* assumes already zeroed -- insufficient for block 'reuse' perhaps */
     DiskLoc Extent::init(const char *nsname, int _length, int _fileNo, int _offset) {
+        dur::writing( this );
         magic = 0x41424344;
         myLoc.setOfs(_fileNo, _offset);
         xnext.Null();
@@ -662,6 +784,29 @@ namespace mongo {
         log() << "  end freelist" << endl;
     }
 
+    void freeExtents(DiskLoc firstExt, DiskLoc lastExt) {
+        string s = cc().database()->name + ".$freelist";
+        NamespaceDetails *freeExtents = nsdetails(s.c_str());
+        if( freeExtents == 0 ) { 
+            string err;
+            _userCreateNS(s.c_str(), BSONObj(), err, 0);
+            freeExtents = nsdetails(s.c_str());
+            massert( 10361 , "can't create .$freelist", freeExtents);
+        }
+        dur::writing( freeExtents );
+        if( freeExtents->firstExtent.isNull() ) { 
+            freeExtents->firstExtent = firstExt;
+            freeExtents->lastExtent = lastExt;
+        }
+        else { 
+            DiskLoc a = freeExtents->firstExtent;
+            assert( a.ext()->xprev.isNull() );
+            dur::writing( a.ext() )->xprev = lastExt;
+            dur::writing( lastExt.ext() )->xnext = a;
+            freeExtents->firstExtent = firstExt;
+        }
+    }
+
     /* drop a collection/namespace */
     void dropNS(const string& nsToDrop) {
         NamespaceDetails* d = nsdetails(nsToDrop.c_str());
@@ -688,28 +833,10 @@ namespace mongo {
 
         // free extents
         if( !d->firstExtent.isNull() ) {
-            string s = cc().database()->name + ".$freelist";
-            NamespaceDetails *freeExtents = nsdetails(s.c_str());
-            if( freeExtents == 0 ) { 
-                string err;
-                _userCreateNS(s.c_str(), BSONObj(), err, 0);
-                freeExtents = nsdetails(s.c_str());
-                massert( 10361 , "can't create .$freelist", freeExtents);
-            }
-            if( freeExtents->firstExtent.isNull() ) { 
-                freeExtents->firstExtent = d->firstExtent;
-                freeExtents->lastExtent = d->lastExtent;
-            }
-            else { 
-                DiskLoc a = freeExtents->firstExtent;
-                assert( a.ext()->xprev.isNull() );
-                a.ext()->xprev = d->lastExtent;
-                d->lastExtent.ext()->xnext = a;
-                freeExtents->firstExtent = d->firstExtent;
-
-                d->firstExtent.setInvalid();
-                d->lastExtent.setInvalid();
-            }
+            freeExtents(d->firstExtent, d->lastExtent);
+            dur::writing( d );
+            d->firstExtent.setInvalid();
+            d->lastExtent.setInvalid();
         }
 
         // remove from the catalog hashtable
@@ -792,14 +919,14 @@ namespace mongo {
         /* remove ourself from the record next/prev chain */
         {
             if ( todelete->prevOfs != DiskLoc::NullOfs )
-                todelete->getPrev(dl).rec()->nextOfs = todelete->nextOfs;
+                dur::writing( todelete->getPrev(dl).rec() )->nextOfs = todelete->nextOfs;
             if ( todelete->nextOfs != DiskLoc::NullOfs )
-                todelete->getNext(dl).rec()->prevOfs = todelete->prevOfs;
+                dur::writing( todelete->getNext(dl).rec() )->prevOfs = todelete->prevOfs;
         }
 
         /* remove ourself from extent pointers */
         {
-            Extent *e = todelete->myExtent(dl);
+            Extent *e = dur::writing( todelete->myExtent(dl) );
             if ( e->firstRecord == dl ) {
                 if ( todelete->nextOfs == DiskLoc::NullOfs )
                     e->firstRecord.Null();
@@ -816,6 +943,7 @@ namespace mongo {
 
         /* add to the free list */
         {
+            dur::writing( d );
             d->nrecords--;
             d->datasize -= todelete->netLength();
             /* temp: if in system.indexes, don't reuse, and zero out: we want to be
@@ -824,10 +952,14 @@ namespace mongo {
                a lot of problems.
             */
             if ( strstr(ns, ".system.indexes") ) {
+                dur::declareWriteIntent( todelete , todelete->lengthWithHeaders );
                 memset(todelete, 0, todelete->lengthWithHeaders);
             }
             else {
-                DEV memset(todelete->data, 0, todelete->netLength()); // attempt to notice invalid reuse.
+                DEV {
+                    dur::declareWriteIntent( todelete->data , todelete->netLength() );
+                    memset(todelete->data, 0, todelete->netLength()); // attempt to notice invalid reuse.
+                }
                 d->addDeletedRec((DeletedRecord*)todelete, dl);
             }
         }
@@ -891,7 +1023,15 @@ namespace mongo {
         getIndexChanges(changes, *d, objNew, objOld, changedId);
         dupCheck(changes, *d, dl);
 
-        if ( toupdate->netLength() < objNew.objsize() ) {
+        const char *newData = objNew.objdata();
+        int newLen = objNew.objsize();
+        BufBuilder packed(0);
+        if ( d->compressRecords() && Record::compress( newData, newLen, packed ) ) {
+            newData = packed.buf();
+            newLen = packed.len();
+        }
+
+        if ( toupdate->netLength() < newLen ) {
             // doesn't fit.  reallocate -----------------------------------------------------
             uassert( 10003 , "E10003 failing update: objects in a capped ns cannot grow", !(d && d->capped));
             d->paddingTooSmall();
@@ -941,7 +1081,8 @@ namespace mongo {
         }
 
         //	update in place
-        memcpy(toupdate->data, objNew.objdata(), objNew.objsize());
+        dur::declareWriteIntent( toupdate->data , newLen );
+        memcpy(toupdate->data, newData, newLen);
         return dl;
     }
 
@@ -1018,106 +1159,264 @@ namespace mongo {
         }
     }
 
+    /* extracts index keys from a collection's records on several threads, for fastBuildIndexes.
+       workers walk extents directly (no cc(), so no DiskLoc::rec()); the caller, which holds the
+       write lock, consumes batches with next() and feeds the sorters.
+    */
+    class ParallelKeyExtractor : boost::noncopyable {
+    public:
+        struct Batch {
+            Batch( int nIndexes ) : keys( nIndexes ) , multikey( nIndexes , false ) , nDocs(0) , nKeys(0) {}
+            vector< vector< pair<BSONObj,DiskLoc> > > keys; // by position in specs
+            vector<bool> multikey;
+            int nDocs;
+            unsigned nKeys;
+        };
+
+        enum { BatchSize = 1000 , MaxQueuedBatches = 16 };
+
+        ParallelKeyExtractor( const vector<const IndexSpec*>& specs , NamespaceDetails * d , int nThreads ) 
+            : _specs( specs ) , _nThreads( nThreads ) , _running( nThreads ) , _stop( false ) ,
+              _errorMutex( "ParallelKeyExtractor" ) {
+            for ( DiskLoc el = d->firstExtent; ! el.isNull(); el = el.ext()->xnext )
+                _extents.push_back( el.ext() );
+            for ( int i=0; i<nThreads; i++ )
+                _threads.create_thread( boost::bind( &ParallelKeyExtractor::_work , this , i ) );
+        }
+
+        ~ParallelKeyExtractor(){
+            _stop = true;
+            while ( _running > 0 ){
+                Batch * b = _queue.blockingPop();
+                if ( b )
+                    delete b;
+                else
+                    _running--;
+            }
+            _threads.join_all();
+        }
+
+        /** @return a batch the caller deletes, or 0 when every record has been seen */
+        Batch * next(){
+            while ( _running > 0 ){
+                Batch * b = _queue.blockingPop();
+                if ( b )
+                    return b;
+                _running--;
+            }
+            uassert( 13436 , "index key extraction failed: " + _error , _error.empty() );
+            return 0;
+        }
+
+    private:
+        /* worker i takes extents i, i + nThreads, ... */
+        void _work( int i ){
+            try {
+                Batch * b = new Batch( _specs.size() );
+                for ( unsigned x = i; x < _extents.size() && ! _stop; x += _nThreads ){
+                    Extent * e = _extents[x];
+                    DiskLoc l = e->firstRecord;
+                    while ( ! l.isNull() && ! _stop ){
+                        Record * r = e->getRecord( l );
+                        BSONObj o( r );
+                        for ( unsigned j=0; j<_specs.size(); j++ ){
+                            BSONObjSetDefaultOrder keys;
+                            _specs[j]->getKeys( o , keys );
+                            if ( keys.size() > 1 )
+                                b->multikey[j] = true;
+                            for ( BSONObjSetDefaultOrder::iterator k=keys.begin(); k != keys.end(); k++ )
+                                b->keys[j].push_back( make_pair( *k , l ) );
+                            b->nKeys += keys.size();
+                        }
+                        b->nDocs++;
+                        if ( b->nKeys >= BatchSize ){
+                            _queue.boundedPush( b , MaxQueuedBatches );
+                            b = new Batch( _specs.size() );
+                        }
+                        l = r->nextOfs == DiskLoc::NullOfs ? DiskLoc() : DiskLoc( l.a() , r->nextOfs );
+                    }
+                }
+                if ( b->nDocs )
+                    _queue.push( b );
+                else
+                    delete b;
+            }
+            catch ( std::exception& e ){
+                scoped_lock lk( _errorMutex );
+                _error = e.what();
+                if ( _error.empty() )
+                    _error = "unknown error";
+                _stop = true;
+            }
+            _queue.push( 0 );
+        }
+
+        vector<const IndexSpec*> _specs;
+        vector<Extent*> _extents;
+        const int _nThreads;
+        int _running;          // workers that haven't pushed their end marker; consumer only
+        volatile bool _stop;
+        BlockingQueue<Batch*> _queue;
+        boost::thread_group _threads;
+        mongo::mutex _errorMutex;
+        string _error;
+    };
+
+    /* threads for key extraction and background sorting in a foreground index build */
+    static int indexBuildThreads( NamespaceDetails * d ){
+        if ( d->nrecords < 10000 )
+            return 0;
+        int n = boost::thread::hardware_concurrency();
+        return n > 4 ? 4 : n;
+    }
+
+    /* builds d's indexes idxNos, which have been added to d but are empty, from one scan of the
+       collection: each index gets its own external sorter and bottom up btree build.
+       @return number of records scanned
+    */
     // throws DBException
-    unsigned long long fastBuildIndex(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) {
+    unsigned long long fastBuildIndexes(const char *ns, NamespaceDetails *d, const vector<int>& idxNos) {
         assert( d->backgroundIndexBuildInProgress == 0 );
         CurOp * op = cc().curop();
 
         Timer t;
 
-        tlog() << "Buildindex " << ns << " idxNo:" << idxNo << ' ' << idx.info.obj().toString() << endl;
-
-        bool dupsAllowed = !idx.unique();
-        bool dropDups = idx.dropDups() || inDBRepair;
-        BSONObj order = idx.keyPattern();
+        const int nIdx = idxNos.size();
+        // the sorters split the memory a single sorter would use
+        long maxFileSize = 1024 * 1024 * 100 / nIdx;
+        if ( maxFileSize < 1024 * 1024 * 16 )
+            maxFileSize = 1024 * 1024 * 16;
 
-        idx.head.Null();
+        vector< shared_ptr<BSONObjExternalSorter> > sorters;
+        for ( int j=0; j<nIdx; j++ ) {
+            IndexDetails& idx = d->idx( idxNos[j] );
+            tlog() << "Buildindex " << ns << " idxNo:" << idxNos[j] << ' ' << idx.info.obj().toString() << endl;
+            dur::writing( &idx.head )->Null();
+            sorters.push_back( shared_ptr<BSONObjExternalSorter>( new BSONObjExternalSorter( idx.keyPattern() , maxFileSize ) ) );
+            sorters[j]->hintNumObjects( d->nrecords );
+        }
         
         if ( logLevel > 1 ) printMemInfo( "before index start" );
 
         /* get and sort all the keys ----- */
         unsigned long long n = 0;
-        shared_ptr<Cursor> c = theDataFileMgr.findAll(ns);
-        BSONObjExternalSorter sorter(order);
-        sorter.hintNumObjects( d->nrecords );
-        unsigned long long nkeys = 0;
+        vector<unsigned long long> nkeys( nIdx , 0 );
         ProgressMeterHolder pm( op->setMessage( "index: (1/3) external sort" , d->nrecords , 10 ) );
-        while ( c->ok() ) {
-            BSONObj o = c->current();
-            DiskLoc loc = c->currLoc();
-
-            BSONObjSetDefaultOrder keys;
-            idx.getKeysFromObject(o, keys);
-            int k = 0;
-            for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
-                if( ++k == 2 )
-                    d->setIndexIsMultikey(idxNo);
-                //cout<<"SORTER ADD " << i->toString() << ' ' << loc.toString() << endl;
-                sorter.add(*i, loc);
-                nkeys++;
+        int nThreads = indexBuildThreads( d );
+        if ( nThreads > 1 ) {
+            vector<const IndexSpec*> specs;
+            for ( int j=0; j<nIdx; j++ ) {
+                sorters[j]->sortInBackground( nThreads );
+                specs.push_back( &d->idx( idxNos[j] ).getSpec() );
             }
-            
-            c->advance();
-            n++;
-            pm.hit();
-            if ( logLevel > 1 && n % 10000 == 0 ){
-                printMemInfo( "\t iterating objects" );
+            ParallelKeyExtractor extractor( specs , d , nThreads );
+            while ( ParallelKeyExtractor::Batch * b = extractor.next() ) {
+                auto_ptr<ParallelKeyExtractor::Batch> batch( b );
+                for ( int j=0; j<nIdx; j++ ) {
+                    if ( b->multikey[j] )
+                        d->setIndexIsMultikey(idxNos[j]);
+                    vector< pair<BSONObj,DiskLoc> >& keys = b->keys[j];
+                    for ( unsigned i=0; i<keys.size(); i++ )
+                        sorters[j]->add( keys[i].first , keys[i].second );
+                    nkeys[j] += keys.size();
+                }
+                n += b->nDocs;
+                pm.hit( b->nDocs );
+                killCurrentOp.checkForInterrupt();
             }
+        }
+        else {
+            shared_ptr<Cursor> c = theDataFileMgr.findAll(ns);
+            while ( c->ok() ) {
+                BSONObj o = c->current();
+                DiskLoc loc = c->currLoc();
+
+                for ( int j=0; j<nIdx; j++ ) {
+                    BSONObjSetDefaultOrder keys;
+                    d->idx( idxNos[j] ).getKeysFromObject(o, keys);
+                    int k = 0;
+                    for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
+                        if( ++k == 2 )
+                            d->setIndexIsMultikey(idxNos[j]);
+                        //cout<<"SORTER ADD " << i->toString() << ' ' << loc.toString() << endl;
+                        sorters[j]->add(*i, loc);
+                        nkeys[j]++;
+                    }
+                }
+                
+                c->advance();
+                n++;
+                pm.hit();
+                if ( logLevel > 1 && n % 10000 == 0 ){
+                    printMemInfo( "\t iterating objects" );
+                }
 
-        };
+            };
+        }
         pm.finished();
 
-        if ( logLevel > 1 ) printMemInfo( "before final sort" );
-        sorter.sort();
-        if ( logLevel > 1 ) printMemInfo( "after final sort" );
-        
-        log(t.seconds() > 5 ? 0 : 1) << "\t external sort used : " << sorter.numFiles() << " files " << " in " << t.seconds() << " secs" << endl;
+        // a record can be a dup in more than one of the new unique indexes
+        set<DiskLoc> dupsToDrop;
 
-        list<DiskLoc> dupsToDrop;
+        for ( int j=0; j<nIdx; j++ ) {
+            IndexDetails& idx = d->idx( idxNos[j] );
+            BSONObjExternalSorter& sorter = *sorters[j];
+            bool dupsAllowed = !idx.unique();
+            bool dropDups = idx.dropDups() || inDBRepair;
 
-        /* build index --- */ 
-        {
-            BtreeBuilder btBuilder(dupsAllowed, idx);
-            BSONObj keyLast;
-            auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
-            assert( pm == op->setMessage( "index: (2/3) btree bottom up" , nkeys , 10 ) );
-            while( i->more() ) { 
-                RARELY killCurrentOp.checkForInterrupt();
-                BSONObjExternalSorter::Data d = i->next();
+            if ( logLevel > 1 ) printMemInfo( "before final sort" );
+            sorter.sort();
+            if ( logLevel > 1 ) printMemInfo( "after final sort" );
+            
+            log(t.seconds() > 5 ? 0 : 1) << "\t external sort used : " << sorter.numFiles() << " files " << " in " << t.seconds() << " secs" << endl;
 
-                try { 
-                    btBuilder.addKey(d.first, d.second);
-                }
-                catch( AssertionException& e ) { 
-                    if ( dupsAllowed ){
-                        // unknow exception??
-                        throw;
+            /* build index --- */ 
+            {
+                BtreeBuilder btBuilder(dupsAllowed, idx);
+                BSONObj keyLast;
+                // with background sorting there are always several files to merge; read ahead so the
+                // merge runs while addKey writes buckets
+                auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator( nThreads > 1 );
+                assert( pm == op->setMessage( "index: (2/3) btree bottom up" , nkeys[j] , 10 ) );
+                while( i->more() ) { 
+                    RARELY killCurrentOp.checkForInterrupt();
+                    BSONObjExternalSorter::Data d = i->next();
+
+                    try { 
+                        btBuilder.addKey(d.first, d.second);
                     }
-                    
-                    if( e.interrupted() )
-                        throw;
-
-                    if ( ! dropDups )
-                        throw;
-
-                    /* we could queue these on disk, but normally there are very few dups, so instead we 
-                       keep in ram and have a limit.
-                    */
-                    dupsToDrop.push_back(d.second);
-                    uassert( 10092 , "too may dups on index build with dropDups=true", dupsToDrop.size() < 1000000 );
+                    catch( AssertionException& e ) { 
+                        if ( dupsAllowed ){
+                            // unknow exception??
+                            throw;
+                        }
+                        
+                        if( e.interrupted() )
+                            throw;
+
+                        if ( ! dropDups )
+                            throw;
+
+                        /* we could queue these on disk, but normally there are very few dups, so instead we 
+                           keep in ram and have a limit.
+                        */
+                        dupsToDrop.insert(d.second);
+                        uassert( 10092 , "too may dups on index build with dropDups=true", dupsToDrop.size() < 1000000 );
+                    }
+                    pm.hit();
                 }
-                pm.hit();
+                pm.finished();
+                op->setMessage( "index: (3/3) btree-middle" );
+                log(t.seconds() > 10 ? 0 : 1 ) << "\t done building bottom layer, going to commit" << endl;
+                btBuilder.commit();
+                wassert( btBuilder.getn() == nkeys[j] || dropDups ); 
             }
-            pm.finished();
-            op->setMessage( "index: (3/3) btree-middle" );
-            log(t.seconds() > 10 ? 0 : 1 ) << "\t done building bottom layer, going to commit" << endl;
-            btBuilder.commit();
-            wassert( btBuilder.getn() == nkeys || dropDups ); 
+            sorters[j].reset(); // release its temp files before the next index's merge
         }
         
-        log(1) << "\t fastBuildIndex dupsToDrop:" << dupsToDrop.size() << endl;
+        log(1) << "\t fastBuildIndexes dupsToDrop:" << dupsToDrop.size() << endl;
 
-        for( list<DiskLoc>::iterator i = dupsToDrop.begin(); i != dupsToDrop.end(); i++ )
+        for( set<DiskLoc>::iterator i = dupsToDrop.begin(); i != dupsToDrop.end(); i++ )
             theDataFileMgr.deleteRecord( ns, i->rec(), *i, false, true );
 
         return n;
@@ -1189,10 +1488,12 @@ namespace mongo {
             assertInWriteLock();
             uassert( 13130 , "can't start bg index b/c in recursive lock (db.eval?)" , dbMutex.getState() == 1 );
             bgJobsInProgress.insert(d);
+            dur::writing( d );
             d->backgroundIndexBuildInProgress = 1;
             d->nIndexes--;
         }
         void done(const char *ns, NamespaceDetails *d) {
+            dur::writing( d );
             d->nIndexes++;
             d->backgroundIndexBuildInProgress = 0;
             NamespaceDetailsTransient::get_w(ns).addedIndex(); // clear query optimizer cache
@@ -1208,7 +1509,7 @@ namespace mongo {
             prep(ns.c_str(), d);
             assert( idxNo == d->nIndexes );
             try { 
-                idx.head = BtreeBucket::addBucket(idx);
+                dur::writing( &idx )->head = BtreeBucket::addBucket(idx);
                 n = addExistingToIndex(ns.c_str(), d, idx, idxNo);
             }
             catch(...) { 
@@ -1239,7 +1540,7 @@ namespace mongo {
 
         assert( !BackgroundOperation::inProgForNs(ns.c_str()) ); // should have been checked earlier, better not be...
         if( inDBRepair || !background ) {
-			n = fastBuildIndex(ns.c_str(), d, idx, idxNo);
+			n = fastBuildIndexes(ns.c_str(), d, vector<int>( 1 , idxNo ));
 			assert( !idx.head.isNull() );
 		}
 		else {
@@ -1282,6 +1583,7 @@ namespace mongo {
         if ( d == 0 || (d->flags & NamespaceDetails::Flag_HaveIdIndex) )
             return;
 
+        dur::writing( &d->flags );
         d->flags |= NamespaceDetails::Flag_HaveIdIndex;
 
         {
@@ -1361,7 +1663,7 @@ namespace mongo {
     /* note: if god==true, you may pass in obuf of NULL and then populate the returned DiskLoc 
              after the call -- that will prevent a double buffer copy in some cases (btree.cpp).
     */
-    DiskLoc DataFileMgr::insert(const char *ns, const void *obuf, int len, bool god, const BSONElement &writeId, bool mayAddIndex) {
+    DiskLoc DataFileMgr::insert(const char *ns, const void *obuf, int len, bool god, const BSONElement &writeId, bool mayAddIndex, bool deferIndexing) {
         bool wouldAddIndex = false;
         massert( 10093 , "cannot insert into reserved $ collection", god || nsDollarCheck( ns ) );
         uassert( 10094 , "invalid ns", strchr( ns , '.' ) > 0 );
@@ -1397,6 +1699,7 @@ namespace mongo {
             if ( !god )
                 ensureIdIndexForNewNs(ns);
         }
+        dur::writing( d );
         d->paddingFits();
 
         NamespaceDetails *tableToIndex = 0;
@@ -1431,9 +1734,29 @@ namespace mongo {
             BSONElementManipulator::lookForTimestamps( io );
         }
 
+        BufBuilder packed(0);
+        if ( d->compressRecords() && obuf ) {
+            const char *o = (const char *) obuf;
+            BufBuilder withId(0);
+            if ( addID ) {
+                withId.appendNum( *((int*) obuf) + newId->size() );
+                withId.appendBuf( newId->rawdata(), newId->size() );
+                withId.appendBuf( ((char *)obuf)+4, addID-4 );
+                o = withId.buf();
+            }
+            if ( Record::compress( o, len, packed ) ) {
+                obuf = packed.buf();
+                len = packed.len();
+                addID = 0;
+            }
+        }
+
         DiskLoc extentLoc;
         int lenWHdr = len + Record::HeaderSize;
-        lenWHdr = (int) (lenWHdr * d->paddingFactor);
+        if ( d->usePowerOf2Sizes() )
+            lenWHdr = NamespaceDetails::powerOf2Size( lenWHdr ); // the class leaves room to grow instead of padding
+        else
+            lenWHdr = (int) (lenWHdr * d->paddingFactor);
         if ( lenWHdr == 0 ) {
             // old datafiles, backward compatible here.
             assert( d->paddingFactor == 0 );
@@ -1474,6 +1797,7 @@ namespace mongo {
 
         Record *r = loc.rec();
         assert( r->lengthWithHeaders >= lenWHdr );
+        dur::declareWriteIntent( r , Record::HeaderSize + len );
         if( addID ) { 
             /* a little effort was made here to avoid a double copy when we add an ID */
             ((int&)*r->data) = *((int*) obuf) + newId->size();
@@ -1484,14 +1808,14 @@ namespace mongo {
             if( obuf )
                 memcpy(r->data, obuf, len);
         }
-        Extent *e = r->myExtent(loc);
+        Extent *e = dur::writing( r->myExtent(loc) );
         if ( e->lastRecord.isNull() ) {
             e->firstRecord = e->lastRecord = loc;
             r->prevOfs = r->nextOfs = DiskLoc::NullOfs;
         }
         else {
 
-            Record *oldlast = e->lastRecord.rec();
+            Record *oldlast = dur::writing( e->lastRecord.rec() );
             r->prevOfs = e->lastRecord.getOfs();
             r->nextOfs = DiskLoc::NullOfs;
             oldlast->nextOfs = loc.getOfs();
@@ -1513,7 +1837,7 @@ namespace mongo {
 
             int idxNo = tableToIndex->nIndexes;
             IndexDetails& idx = tableToIndex->addIndex(tabletoidxns.c_str(), !background); // clear transient info caches so they refresh; increments nIndexes
-            idx.info = loc;
+            *dur::writing( &idx.info ) = loc;
             try {
                 buildAnIndex(tabletoidxns, tableToIndex, idx, idxNo, background);
             } catch( DBException& e ) {
@@ -1546,9 +1870,9 @@ namespace mongo {
         }
 
         /* add this record to our indexes */
-        if ( d->nIndexes ) {
+        if ( d->nIndexes && !deferIndexing ) {
             try { 
-                BSONObj obj(r->data);
+                BSONObj obj(r);
                 indexRecord(d, obj, loc);
             } 
             catch( AssertionException& e ) { 
@@ -1568,10 +1892,182 @@ namespace mongo {
             }
         }
 
+        if ( d->capped )
+            cappedInsertNotifier.notifyOfInsert( ns );
+
         //	out() << "   inserted at loc:" << hex << loc.getOfs() << " lenwhdr:" << hex << lenWHdr << dec << ' ' << ns << endl;
         return loc;
     }
 
+    struct BatchKeyCmp {
+        BatchKeyCmp( const BSONObj& order ) : _order( order ) {}
+        bool operator()( const pair<BSONObj,DiskLoc>& l , const pair<BSONObj,DiskLoc>& r ) const {
+            int x = l.first.woCompare( r.first , _order , false );
+            return x ? x < 0 : l.second < r.second;
+        }
+        BSONObj _order;
+    };
+
+    int DataFileMgr::insertBatch(const char *ns, const vector<BSONObj>& objs, bool logForRepl) {
+        NamespaceDetails *d = nsdetails( ns );
+        massert( 13441 , "insertBatch can't be used on a capped collection or system.indexes" ,
+                 ( !d || !d->capped ) && !strstr( ns , ".system.indexes" ) );
+
+        vector<DiskLoc> locs;
+        set<DiskLoc> failed;
+        try {
+            for ( unsigned i=0; i<objs.size(); i++ ) {
+                const BSONObj& o = objs[i];
+                locs.push_back( insert( ns , o.objdata() , o.objsize() , false , BSONElement() , false , true ) );
+            }
+
+            d = nsdetails( ns );
+            for ( int idxNo = 0; idxNo < d->nIndexes; idxNo++ ) {
+                IndexDetails& idx = d->idx( idxNo );
+                bool dupsAllowed = !idx.unique();
+                BSONObj order = idx.keyPattern();
+                Ordering ordering = Ordering::make( order );
+
+                vector< pair<BSONObj,DiskLoc> > keys;
+                for ( unsigned i=0; i<locs.size(); i++ ) {
+                    if ( locs[i].isNull() || failed.count( locs[i] ) )
+                        continue;
+                    BSONObjSetDefaultOrder k;
+                    idx.getKeysFromObject( locs[i].obj() , k );
+                    if ( k.size() > 1 )
+                        d->setIndexIsMultikey( idxNo );
+                    for ( BSONObjSetDefaultOrder::iterator j=k.begin(); j != k.end(); j++ )
+                        keys.push_back( make_pair( *j , locs[i] ) );
+                }
+                sort( keys.begin() , keys.end() , BatchKeyCmp( order ) );
+
+                for ( unsigned i=0; i<keys.size(); i++ ) {
+                    if ( failed.count( keys[i].second ) )
+                        continue;
+                    try {
+                        idx.head.btree()->bt_insert( idx.head , keys[i].second , keys[i].first , ordering , dupsAllowed , idx );
+                    }
+                    catch ( AssertionException& e ) {
+                        if ( dupsAllowed ) {
+                            problem() << " caught assertion insertBatch " << idx.indexNamespace() << endl;
+                            continue;
+                        }
+                        log() << "insertBatch: skipping " << keys[i].second.obj()["_id"] << " in " << ns << ": " << e.what() << endl;
+                        failed.insert( keys[i].second );
+                    }
+                }
+            }
+        }
+        catch ( ... ) {
+            // none of the batch stays: its records would be missing from the indexes.  whatever keys
+            // made it in come out with the record.
+            for ( unsigned i=0; i<locs.size(); i++ )
+                if ( !locs[i].isNull() )
+                    deleteRecord( ns , locs[i].rec() , locs[i] , false , true );
+            throw;
+        }
+
+        // whatever keys of these made it into an index come out with the record
+        for ( set<DiskLoc>::iterator i = failed.begin(); i != failed.end(); i++ )
+            deleteRecord( ns , i->rec() , *i , false , true );
+
+        int n = 0;
+        for ( unsigned i=0; i<locs.size(); i++ ) {
+            if ( locs[i].isNull() || failed.count( locs[i] ) )
+                continue;
+            if ( logForRepl )
+                logOp( "i" , ns , locs[i].obj() );
+            n++;
+        }
+        return n;
+    }
+
+    int buildIndexes( const string& ns , const vector<BSONObj>& specs , bool logForRepl ) {
+        string indexesNS = cc().database()->name + ".system.indexes";
+        int nCreated = 0;
+
+        // background builds don't scan in one pass anyway; they go through the usual insert path
+        vector<BSONObj> foreground;
+        for ( unsigned i=0; i<specs.size(); i++ ) {
+            uassert( 13440 , "index spec is for a different collection: " + specs[i].toString() ,
+                     ns == specs[i].getStringField( "ns" ) );
+            if ( specs[i]["background"].trueValue() && !inDBRepair ) {
+                BSONObj spec = specs[i];
+                if ( ! theDataFileMgr.insertWithObjMod( indexesNS.c_str() , spec ).isNull() ) {
+                    nCreated++;
+                    if ( logForRepl )
+                        logOp( "i" , indexesNS.c_str() , spec );
+                }
+            }
+            else {
+                foreground.push_back( specs[i] );
+            }
+        }
+
+        NamespaceDetails *d = 0;
+        vector<int> idxNos;
+        for ( unsigned i=0; i<foreground.size(); i++ ) {
+            const BSONObj& spec = foreground[i];
+            string sourceNS;
+            NamespaceDetails *sourceCollection;
+            if ( ! prepareToBuildIndex( spec , false , sourceNS , sourceCollection ) )
+                continue;
+            d = sourceCollection;
+            DiskLoc loc = theDataFileMgr.insert( indexesNS.c_str() , spec.objdata() , spec.objsize() , false , BSONElement() , /*mayAddIndex*/false );
+            idxNos.push_back( d->nIndexes );
+            IndexDetails& idx = d->addIndex( ns.c_str() ); // increments nIndexes
+            *dur::writing( &idx.info ) = loc;
+        }
+        if ( idxNos.empty() )
+            return nCreated;
+
+        tlog() << "building " << idxNos.size() << " new indexes for " << ns << endl;
+        Timer t;
+        try {
+            assert( !BackgroundOperation::inProgForNs( ns.c_str() ) );
+            unsigned long long n = fastBuildIndexes( ns.c_str() , d , idxNos );
+            tlog() << "done for " << n << " records " << t.millis() / 1000.0 << "secs" << endl;
+        } catch( DBException& e ) {
+            // as for a single index in insert(): keep our error, dropIndexes overwrites it
+            LastError *le = lastError.get();
+            int savecode = 0;
+            string saveerrmsg;
+            if ( le ) {
+                savecode = le->code;
+                saveerrmsg = le->msg;
+            }
+            else {
+                savecode = e.getCode();
+                saveerrmsg = e.what();
+            }
+
+            // roll back all of them, last added first
+            vector<string> names;
+            for ( unsigned i=0; i<idxNos.size(); i++ )
+                names.push_back( d->idx( idxNos[i] ).indexName() );
+            for ( int i=names.size()-1; i>=0; i-- ) {
+                BSONObjBuilder b;
+                string errmsg;
+                bool ok = dropIndexes( d , ns.c_str() , names[i].c_str() , errmsg , b , true );
+                if( !ok ) {
+                    log() << "failed to drop index after an error building it: " << errmsg << ' ' << ns << ' ' << names[i] << endl;
+                }
+            }
+
+            assert( le && !saveerrmsg.empty() );
+            raiseError(savecode,saveerrmsg.c_str());
+            throw;
+        }
+
+        if ( logForRepl ) {
+            for ( unsigned i=0; i<idxNos.size(); i++ ) {
+                BSONObj spec = d->idx( idxNos[i] ).info.obj();
+                logOp( "i" , indexesNS.c_str() , spec );
+            }
+        }
+        return nCreated + idxNos.size();
+    }
+
     /* special version of insert for transaction logging -- streamlined a bit.
        assumes ns is capped and no indexes
     */
@@ -1590,21 +2086,25 @@ namespace mongo {
 
         Record *r = loc.rec();
         assert( r->lengthWithHeaders >= lenWHdr );
+        dur::declareWriteIntent( r , lenWHdr ); // the caller writes the data
 
-        Extent *e = r->myExtent(loc);
+        Extent *e = dur::writing( r->myExtent(loc) );
         if ( e->lastRecord.isNull() ) {
             e->firstRecord = e->lastRecord = loc;
             r->prevOfs = r->nextOfs = DiskLoc::NullOfs;
         }
         else {
-            Record *oldlast = e->lastRecord.rec();
+            Record *oldlast = dur::writing( e->lastRecord.rec() );
             r->prevOfs = e->lastRecord.getOfs();
             r->nextOfs = DiskLoc::NullOfs;
             oldlast->nextOfs = loc.getOfs();
             e->lastRecord = loc;
         }
 
-        d->nrecords++;
+        dur::writing( d )->nrecords++;
+
+        // the caller fills in r->data before it lets go of the write lock, which a woken getMore needs
+        cappedInsertNotifier.notifyOfInsert( ns );
 
         return r;
     }
@@ -1860,7 +2360,7 @@ namespace mongo {
     
     bool DatabaseHolder::closeAll( const string& path , BSONObjBuilder& result , bool force ){
         log() << "DatabaseHolder::closeAll path:" << path << endl;
-        dbMutex.assertWriteLocked();
+        dbMutex.assertWriteLockedGlobally();
         
         map<string,Database*>& m = _paths[path];
         _size -= m.size();
@@ -31,6 +31,7 @@
 #include "jsobjmanipulator.h"
 #include "namespace.h"
 #include "client.h"
+#include "dur.h"
 
 namespace mongo {
 
@@ -45,6 +46,14 @@ namespace mongo {
 
     /* low level - only drops this ns */
     void dropNS(const string& dropNs);
+
+    /* puts the extents firstExt..lastExt, linked by xnext, on the database's free list.
+       allocExtent() takes from there before it grows a file. */
+    void freeExtents(DiskLoc firstExt, DiskLoc lastExt);
+
+    /* rewrites a collection's records into new, densely packed extents and rebuilds its
+       indexes.  see compact.cpp */
+    bool compactCollection(const char *ns, string &errmsg, BSONObjBuilder &result);
     
     /* deletes this ns, indexes and cursors */
     void dropCollection( const string &name, string &errmsg, BSONObjBuilder &result ); 
@@ -119,7 +128,15 @@ namespace mongo {
         /** @param obj in value only for this version. */
         void insertNoReturnVal(const char *ns, BSONObj o, bool god = false);
 
-        DiskLoc insert(const char *ns, const void *buf, int len, bool god = false, const BSONElement &writeId = BSONElement(), bool mayAddIndex = true);
+        /** @param deferIndexing the caller adds the record's index keys itself; see insertBatch */
+        DiskLoc insert(const char *ns, const void *buf, int len, bool god = false, const BSONElement &writeId = BSONElement(), bool mayAddIndex = true, bool deferIndexing = false);
+
+        /** writes all of objs to ns first, then adds their keys to each index in key order, so the
+            btrees are walked in order rather than at random.  objects that violate a unique index
+            are removed again and skipped.  not for capped collections or system.indexes.
+            @return number of objects inserted
+        */
+        int insertBatch(const char *ns, const vector<BSONObj>& objs, bool logForRepl);
         void deleteRecord(const char *ns, Record *todelete, const DiskLoc& dl, bool cappedOK = false, bool noWarn = false);
         static shared_ptr<Cursor> findAll(const char *ns, const DiskLoc &startLoc = DiskLoc());
 
@@ -143,6 +160,36 @@ namespace mongo {
 
     extern DataFileMgr theDataFileMgr;
 
+    /* lets getMores of await data cursors sleep until something is appended to their capped
+       collection rather than polling.  each namespace someone has waited on has a version that
+       inserts bump; a waiter takes the version while it still holds the db lock, so an insert
+       between its last look and its wait can't be missed.
+    */
+    class CappedInsertNotifier : boost::noncopyable {
+    public:
+        CappedInsertNotifier() : _mutex( "CappedInsertNotifier" ) {}
+
+        /* called with the write lock held */
+        void notifyOfInsert( const char *ns );
+
+        /* call with the db lock held */
+        unsigned long long getVersion( const char *ns );
+
+        /* call with no db lock.  @return true if ns's version moved past version before millis passed */
+        bool waitForInsert( const char *ns , unsigned long long version , int millis );
+
+    private:
+        struct Waiters {
+            Waiters() : version(0) {}
+            unsigned long long version;
+            boost::condition changed;
+        };
+        mongo::mutex _mutex;
+        map< string , shared_ptr<Waiters> > _waiters;
+    };
+
+    extern CappedInsertNotifier cappedInsertNotifier;
+
 #pragma pack(1)
 
     class DeletedRecord {
@@ -179,6 +226,18 @@ namespace mongo {
         }
         //void setNewLength(int netlen) { lengthWithHeaders = netlen + HeaderSize; }
 
+        /* { compressRecords : true } collections store an object LZ compressed when that saves enough.
+           data is then int -(length of the block), int object size, the block.  a BSON size is never
+           negative, so the first int tells the forms apart.  BSONObj(const Record*) undoes it.
+        */
+        bool isCompressed() const { return *((const int *) data) < 0; }
+
+        /* @return false if it isn't worth it.  else b holds the compressed form of the len byte object. */
+        static bool compress(const char *obj, int len, BufBuilder& b);
+
+        /* a malloc'd copy of the object a compressed record holds */
+        char* decompress() const;
+
         /* use this when a record is deleted. basically a union with next/prev fields */
         DeletedRecord& asDeleted() {
             return *((DeletedRecord*) this);
@@ -190,6 +249,16 @@ namespace mongo {
         /* get the next record in the namespace, traversing extents as necessary */
         DiskLoc getNext(const DiskLoc& myLoc);
         DiskLoc getPrev(const DiskLoc& myLoc);
+
+        /* false if the page this record starts on is known not to be in ram (so reading it 
+           would fault).  true if resident or if the platform can't tell us.
+        */
+        bool likelyInPhysicalMemory();
+
+        /* page in the start of this record.  does not need the db lock; if the file has been 
+           closed in the meantime this is a no-op.
+        */
+        void touch();
     };
 
     /* extents are datafile regions where all the records within the region
@@ -300,6 +369,7 @@ namespace mongo {
 
         void init(int fileno, int filelength) {
             if ( uninitialized() ) {
+                dur::declareWriteIntent( this , reserved - (char *) this );
                 assert(filelength > 32768 );
                 assert( HeaderSize == 8192 );
                 fileLength = filelength;
@@ -482,13 +552,21 @@ namespace mongo {
 
     inline DeletedRecord* DataFileMgr::makeDeletedRecord(const DiskLoc& dl, int len) { 
         assert( dl.a() != -1 );
-        return (DeletedRecord*) cc().database()->getFile(dl.a())->makeRecord(dl, sizeof(DeletedRecord));
+        // the caller fills in the header
+        return dur::writing( (DeletedRecord*) cc().database()->getFile(dl.a())->makeRecord(dl, sizeof(DeletedRecord)) );
     }
     
     void ensureHaveIdIndex(const char *ns);
     
     bool dropIndexes( NamespaceDetails *d, const char *ns, const char *name, string &errmsg, BSONObjBuilder &anObjBuilder, bool maydeleteIdIndex );
 
+    /* create the indexes described by specs - system.indexes objects, all with ns as their "ns" -
+       building the foreground ones with a single scan of the collection.  specs for indexes that
+       already exist are skipped.  throws on failure, after dropping the indexes it added.
+       @return number of indexes created
+    */
+    int buildIndexes( const string& ns , const vector<BSONObj>& specs , bool logForRepl );
+
 
     /**
      * @return true if ns is ok
@@ -270,6 +270,14 @@ namespace mongo {
         return qr;
     }
 
+    /* the current index key, with the field names of the key pattern.  for an index only query
+       this stands in for the record. */
+    static BSONObj indexKeyObj( Cursor *c ) {
+        BSONObjBuilder b;
+        b.appendKeys( c->indexKeyPattern() , c->currKey() );
+        return b.obj();
+    }
+
     QueryResult* processGetMore(const char *ns, int ntoreturn, long long cursorid , CurOp& curop, int pass, bool& exhaust ) {
         exhaust = false;
         ClientCursor::Pointer p(cursorid);
@@ -320,8 +328,8 @@ namespace mongo {
                         if ( c->advance() )
                             continue;
 
-                        if( n == 0 && (queryOptions & QueryOption_AwaitData) && pass < 1000 ) {
-                            throw GetMoreWaitException();
+                        if( n == 0 && (queryOptions & QueryOption_AwaitData) && pass < AwaitDataMaxPasses ) {
+                            throw GetMoreWaitException( cappedInsertNotifier.getVersion( ns ) );
                         }
 
                         break;
@@ -348,7 +356,7 @@ namespace mongo {
                     }
                     else {
                         last = c->currLoc();
-                        BSONObj js = c->current();
+                        BSONObj js = cc->indexOnly ? indexKeyObj( c ) : c->current();
 
                         // show disk loc should be part of the main query, not in an $or clause, so this should be ok
                         fillQueryResultFromObj(b, cc->fields.get(), js, ( cc->pq.get() && cc->pq->showDiskLoc() ? &last : 0));
@@ -418,6 +426,12 @@ namespace mongo {
                 // TODO maybe we want to prevent recording the winning plan as well?
             }
         }
+
+        virtual Record* recordToFetch() {
+            if ( bc_ || ! matcher()->needRecord() )
+                return 0;
+            return c_->recordToFetch();
+        }
         
         virtual void next() {
             if ( !c_->ok() ) {
@@ -531,7 +545,7 @@ namespace mongo {
             b << "cursor" << c->toString() << "indexBounds" << c->prettyIndexBounds();
             b.done();
         }
-        void noteScan( Cursor *c, long long nscanned, long long nscannedObjects, int n, bool scanAndOrder, int millis, bool hint ) {
+        void noteScan( Cursor *c, long long nscanned, long long nscannedObjects, int n, const ScanAndOrder *so, bool indexOnly, int millis, bool hint ) {
             if ( _i == 1 ) {
                 _c.reset( new BSONArrayBuilder() );
                 *_c << _b->obj();
@@ -546,8 +560,12 @@ namespace mongo {
             _b->appendNumber( "nscannedObjects", nscannedObjects );
             *_b << "n" << n;
 
-            if ( scanAndOrder )
+            if ( so ) {
                 *_b << "scanAndOrder" << true;
+                so->appendStats( *_b );
+            }
+            if ( indexOnly )
+                *_b << "indexOnly" << true;
 
             *_b << "millis" << millis;
 
@@ -597,6 +615,7 @@ namespace mongo {
             _oldN(0),
             _chunkMatcher(shardingState.getChunkMatcher(pq.ns())),
             _inMemSort(false),
+            _indexOnly(false),
             _saveClientCursor(false),
             _wouldSaveClientCursor(false),
             _oplogReplay( pq.hasOption( QueryOption_OplogReplay) ),
@@ -619,7 +638,10 @@ namespace mongo {
 
             if ( qp().scanAndOrderRequired() ) {
                 _inMemSort = true;
-                _so.reset( new ScanAndOrder( _pq.getSkip() , _pq.getNumToReturn() , _pq.getOrder() ) );
+                _so.reset( new ScanAndOrder( _pq.getSkip() , _pq.getNumToReturn() , _pq.getOrder() , (long long) cmdLine.sortMemMB * 1024 * 1024 ) );
+            }
+            else if ( !_oplogReplay && !_pq.returnKey() && !matcher()->needRecord() ) {
+                _indexOnly = qp().indexOnly( _pq.getFields() );
             }
             
             if ( _pq.isExplain() ) {
@@ -650,6 +672,12 @@ namespace mongo {
                 }
             }
         }        
+
+        virtual Record* recordToFetch() {
+            if ( _findingStartCursor.get() || _indexOnly )
+                return 0;
+            return _c->recordToFetch();
+        }
         
         virtual void next() {
             if ( _findingStartCursor.get() ) {
@@ -685,7 +713,8 @@ namespace mongo {
                     _nscannedObjects++;
             }
             else {
-                _nscannedObjects++;
+                if ( !_indexOnly )
+                    _nscannedObjects++;
                 DiskLoc cl = _c->currLoc();
                 if ( _chunkMatcher && ! _chunkMatcher->belongsToMe( _c->currKey(), _c->currLoc() ) ){
                     // cout << "TEMP skipping un-owned chunk: " << _c->current() << endl;
@@ -697,8 +726,7 @@ namespace mongo {
                     // got a match.
                     
                     if ( _inMemSort ) {
-                        // note: no cursors for non-indexed, ordered results.  results must be fairly small.
-                        _so->add( _pq.returnKey() ? _c->currKey() : _c->current(), _pq.showDiskLoc() ? &cl : 0 );
+                        _so->add( _pq.returnKey() ? _c->currKey() : _c->current(), cl );
                     }
                     else if ( _ntoskip > 0 ) {
                         _ntoskip--;
@@ -719,7 +747,7 @@ namespace mongo {
                                 bb.done();
                             }
                             else {
-                                BSONObj js = _c->current();
+                                BSONObj js = _indexOnly ? indexKeyObj( _c.get() ) : _c->current();
                                 assert( js.isValid() );
                                 fillQueryResultFromObj( _buf , _pq.getFields() , js , (_pq.showDiskLoc() ? &cl : 0));
                             }
@@ -755,7 +783,13 @@ namespace mongo {
                 _n = _inMemSort ? _so->size() : _n;
             } 
             else if ( _inMemSort ) {
-                _so->fill( _buf, _pq.getFields() , _n );
+                bool mayKeepCursor = _pq.wantMore() && _pq.getNumToReturn() != 1 && useCursors;
+                shared_ptr<Cursor> rest = _so->fill( _buf, _pq, mayKeepCursor, _n );
+                if ( rest ) {
+                    // getMore continues from the ordered results rather than the scan
+                    _c = rest;
+                    _saveClientCursor = true;
+                }
             }
             
             if ( _pq.hasOption( QueryOption_CursorTailable ) && _pq.getNumToReturn() != 1 )
@@ -766,7 +800,7 @@ namespace mongo {
                 _saveClientCursor = true;
 
             if ( _pq.isExplain()) {
-                _eb.noteScan( _c.get(), _nscanned, _nscannedObjects, _n, scanAndOrderRequired(), _curop.elapsedMillis(), useHints && !_pq.getHint().eoo() );
+                _eb.noteScan( _c.get(), _nscanned, _nscannedObjects, _n, _so.get(), _indexOnly, _curop.elapsedMillis(), useHints && !_pq.getHint().eoo() );
             } else {
                 _response.appendData( _buf.buf(), _buf.len() );
                 _buf.decouple();
@@ -802,6 +836,7 @@ namespace mongo {
         }
 
         bool scanAndOrderRequired() const { return _inMemSort; }
+        bool indexOnly() const { return _indexOnly; }
         shared_ptr<Cursor> cursor() { return _c; }
         int n() const { return _oldN + _n; }
         long long nscanned() const { return _nscanned + _oldNscanned; }
@@ -827,6 +862,7 @@ namespace mongo {
         
         bool _inMemSort;
         auto_ptr< ScanAndOrder > _so;
+        bool _indexOnly; // build results from the index key; the record is never read
         
         shared_ptr<Cursor> _c;
         ClientCursor::CleanupPointer _cc;
@@ -908,7 +944,7 @@ namespace mongo {
             
         /* --- read lock --- */
 
-        mongolock lk(false);
+        mongolock lk(false, ns);
 
         Client::Context ctx( ns , dbpath , &lk );
 
@@ -1022,6 +1058,7 @@ namespace mongo {
             } else {
                 cursor->setMatcher( dqo.matcher() );
                 cc = new ClientCursor( queryOptions, cursor, ns );
+                cc->indexOnly = dqo.indexOnly();
             }
             cursorid = cc->cursorid;
             cc->query = jsobj.getOwned();
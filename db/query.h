@@ -74,7 +74,13 @@ namespace mongo {
     extern const int MaxBytesToReturnToClientAtOnce;
 
     // for an existing query (ie a ClientCursor), send back additional information.
-    struct GetMoreWaitException { };
+    /* thrown by processGetMore when an await data cursor has nothing yet; receivedGetMore waits
+       for an insert into the capped collection, with no lock, and retries */
+    struct GetMoreWaitException {
+        GetMoreWaitException( unsigned long long v ) : cappedVersion( v ) {}
+        unsigned long long cappedVersion; // cappedInsertNotifier version of the ns when we ran out
+    };
+    enum { AwaitDataMaxPasses = 1000 , AwaitDataMillis = 2000 };
 
     QueryResult* processGetMore(const char *ns, int ntoreturn, long long cursorid , CurOp& op, int pass, bool& exhaust);
     
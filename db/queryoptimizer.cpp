@@ -93,11 +93,13 @@ namespace mongo {
         }
 
         BSONObj idxKey = index_->keyPattern();
+        // keys of an index with a type aren't the fields' values, so they give no order
+        const bool typed = index_->getSpec().getType() != 0;
         BSONObjIterator o( order );
         BSONObjIterator k( idxKey );
         if ( !o.moreWithEOO() )
             scanAndOrderRequired_ = false;
-        while( o.moreWithEOO() ) {
+        while( !typed && o.moreWithEOO() ) {
             BSONElement oe = o.next();
             if ( oe.eoo() ) {
                 scanAndOrderRequired_ = false;
@@ -154,7 +156,8 @@ namespace mongo {
         if ( !scanAndOrderRequired_ &&
              ( optimalIndexedQueryCount == fbs.nNontrivialRanges() ) )
             optimal_ = true;
-        if ( exactIndexedQueryCount == fbs.nNontrivialRanges() &&
+        if ( !typed &&
+            exactIndexedQueryCount == fbs.nNontrivialRanges() &&
             orderFieldsUnindexed.size() == 0 &&
             exactIndexedQueryCount == index_->keyPattern().nFields() &&
             exactIndexedQueryCount == _originalQuery.nFields() ) {
@@ -203,7 +206,10 @@ namespace mongo {
             // we are sure to spec endKeyInclusive_
             return shared_ptr<Cursor>( new BtreeCursor( d, idxNo, *index_, _startKey, _endKey, endKeyInclusive_, direction_ >= 0 ? 1 : -1 ) );
         } else if ( index_->getSpec().getType() ) {
-            return shared_ptr<Cursor>( new BtreeCursor( d, idxNo, *index_, _frv->startKey(), _frv->endKey(), true, direction_ >= 0 ? 1 : -1 ) );            
+            BSONObj startKey = _frv->startKey();
+            BSONObj endKey = _frv->endKey();
+            index_->getSpec().getType()->fixBounds( startKey , endKey );
+            return shared_ptr<Cursor>( new BtreeCursor( d, idxNo, *index_, startKey, endKey, true, direction_ >= 0 ? 1 : -1 ) );            
         } else {
             return shared_ptr<Cursor>( new BtreeCursor( d, idxNo, *index_, _frv, direction_ >= 0 ? 1 : -1 ) );
         }
@@ -228,6 +234,15 @@ namespace mongo {
         return index_->keyPattern();
     }
     
+    bool QueryPlan::indexOnly( const FieldMatcher *fields ) const {
+        if ( !index_ || _type || !fields || index_->getSpec().getType() )
+            return false;
+        // multikey index keys are array elements, not the field's value
+        if ( d->isMultikey( idxNo ) )
+            return false;
+        return fields->coveredBy( index_->keyPattern() , fbs_ );
+    }
+
     void QueryPlan::registerSelf( long long nScanned ) const {
         if ( fbs_.matchPossible() ) {
             scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
@@ -505,15 +520,17 @@ namespace mongo {
     plans_( plans ) {
     }
     
-    void QueryPlanSet::Runner::mayYield( const vector< shared_ptr< QueryOp > > &ops ) {
+    void QueryPlanSet::Runner::mayYield( const vector< shared_ptr< QueryOp > > &ops , QueryOp &next ) {
         if ( plans_._mayYield ) {
-            if ( plans_._yieldSometimesTracker.ping() ) {
+            // if next is about to fault, yield now so the disk read happens without the lock
+            Record *rec = recordToFetch( next );
+            if ( plans_._yieldSometimesTracker.ping() || rec ) {
                 int micros = ClientCursor::yieldSuggest();
-                if ( micros > 0 ) {
+                if ( micros > 0 || rec ) {
                     for( vector< shared_ptr< QueryOp > >::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
                         prepareToYield( **i );
                     }
-                    ClientCursor::staticYield( micros );
+                    ClientCursor::staticYield( micros , rec );
                     for( vector< shared_ptr< QueryOp > >::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
                         recoverFromYield( **i );
                     }                        
@@ -553,8 +570,8 @@ namespace mongo {
             unsigned errCount = 0;
             bool first = true;
             for( vector< shared_ptr< QueryOp > >::iterator i = ops.begin(); i != ops.end(); ++i ) {
-                mayYield( ops );
                 QueryOp &op = **i;
+                mayYield( ops , op );
                 nextOp( op );
                 if ( op.complete() ) {
                     if ( first ) {
@@ -622,6 +639,12 @@ namespace mongo {
     void QueryPlanSet::Runner::recoverFromYield( QueryOp &op ) {
         GUARD_OP_EXCEPTION( op, if ( !op.error() ) { op.recoverFromYield(); } );
     }
+
+    Record* QueryPlanSet::Runner::recordToFetch( QueryOp &op ) {
+        Record *rec = 0;
+        GUARD_OP_EXCEPTION( op, if ( !op.error() ) { rec = op.recordToFetch(); } );
+        return rec;
+    }
     
     
     MultiPlanScanner::MultiPlanScanner( const char *ns,
@@ -736,7 +759,7 @@ namespace mongo {
                 return false;
             if ( strcmp( pe.fieldName(), ke.fieldName() ) != 0 )
                 return false;
-            if ( ( i == firstSignificantField ) && !( ( direction > 0 ) == ( pe.number() > 0 ) ) )
+            if ( ( i == firstSignificantField ) && !( ( direction > 0 ) == ( elementDirection( pe ) > 0 ) ) )
                 return false;
             ++i;
         }
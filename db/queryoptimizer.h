@@ -55,6 +55,10 @@ namespace mongo {
         shared_ptr<Cursor> newCursor( const DiskLoc &startLoc = DiskLoc() , int numWanted=0 ) const;
         shared_ptr<Cursor> newReverseCursor() const;
         BSONObj indexKey() const;
+        /* If true, every field fields asks for is in the index key and the query rules out its
+           being missing, so results can be built from the key without reading the record.  The
+           matcher must not need the record either. */
+        bool indexOnly( const FieldMatcher *fields ) const;
         bool willScanTable() const { return !index_ && fbs_.matchPossible(); }
         const char *ns() const { return fbs_.ns(); }
         NamespaceDetails *nsd() const { return d; }
@@ -113,6 +117,11 @@ namespace mongo {
         
         virtual void prepareToYield() { massert( 13335, "yield not supported", false ); }
         virtual void recoverFromYield() { massert( 13336, "yield not supported", false ); }
+
+        /** @return a record next() is about to read that isn't in ram, so the caller can yield
+                    and page it in first.  0 if there's none, or we can't tell.
+        */
+        virtual Record* recordToFetch() { return 0; }
         
         /** @return a copy of the inheriting class, which will be run with its own
                     query plan.  If multiple plan sets are required for an $or query,
@@ -206,13 +215,14 @@ namespace mongo {
         struct Runner {
             Runner( QueryPlanSet &plans, QueryOp &op );
             shared_ptr< QueryOp > run();
-            void mayYield( const vector< shared_ptr< QueryOp > > &ops );
+            void mayYield( const vector< shared_ptr< QueryOp > > &ops , QueryOp &next );
             QueryOp &op_;
             QueryPlanSet &plans_;
             static void initOp( QueryOp &op );
             static void nextOp( QueryOp &op );
             static void prepareToYield( QueryOp &op );
             static void recoverFromYield( QueryOp &op );
+            static Record* recordToFetch( QueryOp &op );
         };
         const char *ns;
         BSONObj _originalQuery;
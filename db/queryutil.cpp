@@ -500,6 +500,21 @@ namespace mongo {
         return temp.empty();
     }
     
+    bool FieldRange::includesNull() const {
+        BSONObjBuilder b;
+        b.appendNull( "" );
+        BSONObj o = b.obj();
+        BSONElement n = o.firstElement();
+        for( vector< FieldInterval >::const_iterator i = _intervals.begin(); i != _intervals.end(); ++i ) {
+            int l = i->_lower._bound.woCompare( n, false );
+            int u = i->_upper._bound.woCompare( n, false );
+            if ( ( l < 0 || ( l == 0 && i->_lower._inclusive ) ) &&
+                 ( u > 0 || ( u == 0 && i->_upper._inclusive ) ) )
+                return true;
+        }
+        return false;
+    }
+    
     BSONObj FieldRange::addObj( const BSONObj &o ) {
         _objData.push_back( o );
         return o;
@@ -862,6 +877,24 @@ namespace mongo {
         return _source;
     }
 
+    bool FieldMatcher::coveredBy( const BSONObj& keyPattern , const FieldRangeSet& frs ) const {
+        if ( _include || _special )
+            return false;
+        if ( _includeID && keyPattern["_id"].eoo() )
+            return false;
+        for ( FieldMap::const_iterator i = _fields.begin(); i != _fields.end(); ++i ){
+            const FieldMatcher& sub = *i->second;
+            if ( ! sub._include || sub._special || ! sub._fields.empty() )
+                return false;
+            if ( keyPattern[ i->first.c_str() ].eoo() )
+                return false;
+            // every record has an _id
+            if ( i->first != "_id" && frs.range( i->first.c_str() ).includesNull() )
+                return false;
+        }
+        return true;
+    }
+
     //b will be the value part of an array-typed BSONElement
     void FieldMatcher::appendArray( BSONObjBuilder& b , const BSONObj& a , bool nested) const {
         int skip  = nested ?  0 : _skip;
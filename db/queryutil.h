@@ -93,6 +93,8 @@ namespace mongo {
                   maxKey.firstElement().woCompare( max(), false ) != 0 );
         }
         bool empty() const { return _intervals.empty(); }
+        // true if null is in the range; the index key of a missing field is null
+        bool includesNull() const;
         void makeEmpty() { _intervals.clear(); }
 		const vector< FieldInterval > &intervals() const { return _intervals; }
         string getSpecial() const { return _special; }
@@ -537,6 +539,11 @@ namespace mongo {
 
         BSONObj getSpec() const;
         bool includeID() { return _includeID; }
+
+        /** @return true if this includes only top level fields of keyPattern (and excludes _id
+            unless it is one of them), and the query's ranges rule out each one being missing:
+            a missing field's key is null, which would come back as field : null */
+        bool coveredBy( const BSONObj& keyPattern , const FieldRangeSet& frs ) const;
     private:
 
         void add( const string& field, bool include );
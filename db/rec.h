@@ -51,7 +51,10 @@ public:
         theDataFileMgr._deleteRecord(nsdetails_notinline(ns), ns, d.rec(), d);
     }
 
-    VIRT void modified(DiskLoc d) { }
+    VIRT void modified(DiskLoc d) { 
+        Record *r = d.rec();
+        dur::declareWriteIntent( r->data , r->netLength() );
+    }
 
     VIRT void drop(const char *ns) { 
         dropNS(ns);
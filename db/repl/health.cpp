@@ -302,6 +302,8 @@ namespace mongo {
         return 0;
     }
 
+    void fillInitialSyncStatus(BSONObjBuilder& b);
+
     void ReplSetImpl::_summarizeStatus(BSONObjBuilder& b) const { 
         Member *m =_members.head();
         vector<BSONObj> v;
@@ -328,6 +330,7 @@ namespace mongo {
         b.appendTimeT("date", time(0));
         b.append("myState", box.getState().s);
         b.append("members", v);
+        fillInitialSyncStatus(b);
     }
 
 }
@@ -330,11 +330,12 @@ namespace mongo {
         void syncDoInitialSync();
         void _syncThread();
         void syncTail();
-        void syncApply(const BSONObj &o);
+        void syncApplyBatch(vector<BSONObj>& ops);
         void syncRollback(OplogReader& r);
         void syncFixUp(HowToFixUp& h, DBClientConnection*);
     public:
         void syncThread();
+        void syncApply(const BSONObj &o); // also called from the repl writer threads
     };
 
     class ReplSet : public ReplSetImpl { 
@@ -21,6 +21,7 @@
 #include "../oplogreader.h"
 #include "../../util/mongoutils/str.h"
 #include "../dbhelpers.h"
+#include "../pdfile.h"
 
 namespace mongo {
 
@@ -51,16 +52,416 @@ namespace mongo {
         }
     }
 
-    bool cloneFrom(const char *masterHost, string& errmsg, const string& fromdb, bool logForReplication, 
-				   bool slaveOk, bool useReplAuth, bool snapshot);
+    /* how many collections initial sync copies at once, each over its own connection to the
+       primary.  with --dblocks they are also loaded concurrently; otherwise the workers just
+       overlap the network with our inserts.
+    */
+    const int InitialSyncThreads = 4;
 
-    /* todo : progress metering to sethbmsg. */
-    static bool clone(const char *master, string db) {
-        string err;
-        return cloneFrom(master, err, db, false, 
-            /*slaveok later can be true*/ false, true, false);
+    /* what initial sync is doing, for replSetGetStatus */
+    class InitialSyncProgress {
+    public:
+        InitialSyncProgress() : _m("initialSyncProgress"), _active(false) { }
+
+        void start(unsigned nCollections) {
+            scoped_lock lk(_m);
+            _active = true;
+            _phase = "cloning";
+            _collections = nCollections;
+            _collectionsDone = 0;
+            _docs = _bytes = _ops = 0;
+            _timer.reset();
+        }
+        void phase(const char *p) {
+            scoped_lock lk(_m);
+            _phase = p;
+        }
+        void cloned(long long docs, long long bytes) {
+            scoped_lock lk(_m);
+            _docs += docs;
+            _bytes += bytes;
+        }
+        void collectionDone() {
+            scoped_lock lk(_m);
+            _collectionsDone++;
+        }
+        void applied() {
+            scoped_lock lk(_m);
+            _ops++;
+        }
+        void done() {
+            scoped_lock lk(_m);
+            _active = false;
+        }
+
+        void append(BSONObjBuilder& b) {
+            scoped_lock lk(_m);
+            if( !_active )
+                return;
+            double secs = _timer.millis() / 1000.0;
+            BSONObjBuilder s( b.subobjStart("initialSync") );
+            s.append("phase", _phase);
+            s.append("collections", _collections);
+            s.append("collectionsCloned", _collectionsDone);
+            s.appendNumber("docsCloned", _docs);
+            s.appendNumber("bytesCloned", _bytes);
+            s.appendNumber("opsApplied", _ops);
+            s.append("secs", secs);
+            if( secs > 0 ) {
+                s.append("docsPerSec", _docs / secs);
+                s.append("bytesPerSec", _bytes / secs);
+            }
+            s.done();
+        }
+
+    private:
+        mongo::mutex _m;
+        bool _active;
+        const char *_phase;
+        unsigned _collections;
+        unsigned _collectionsDone;
+        long long _docs;
+        long long _bytes;
+        long long _ops;
+        Timer _timer;
+    } initialSyncProgress;
+
+    void fillInitialSyncStatus(BSONObjBuilder& b) {
+        initialSyncProgress.append(b);
     }
 
+    extern bool inDBRepair;
+    void ensureIdIndexForNewNs(const char *ns);
+
+    /* copies every collection of the primary, largest first, with InitialSyncThreads workers.
+       each collection is read with an exhaust cursor and loaded without its indexes, which are
+       then built in one bulk pass over it.
+    */
+    class ParallelCloner : boost::noncopyable {
+    public:
+        ParallelCloner(const string& host) : _host(host), _m("ParallelCloner"), _indexMutex("initialSyncIndexes"),
+            _next(0), _nDone(0), _failed(false) { }
+
+        /* what the oplog tailer may do with an op */
+        enum Verdict { Skip, Apply, Abort };
+
+        /** list what to copy.  r is connected to the primary. */
+        void plan(OplogReader& r) {
+            list<string> dbs = r.conn()->getDatabaseNames();
+            for( list<string>::iterator d = dbs.begin(); d != dbs.end(); d++ ) {
+                string db = *d;
+                if( db == "local" )
+                    continue;
+
+                map<string,unsigned> byNs;
+                auto_ptr<DBClientCursor> c = r.conn()->query(db + ".system.namespaces", BSONObj());
+                while( c.get() && c->more() ) {
+                    BSONObj o = c->nextSafe();
+                    string ns = o["name"].str();
+                    /* as in Cloner::go(): system.users and system.js are copied, indexes are built */
+                    if( strstr(ns.c_str(), ".system.") && !legalClientSystemNS(ns, true) )
+                        continue;
+                    if( !nsDollarCheck(ns.c_str()) )
+                        continue;
+
+                    Collection x;
+                    x.ns = ns;
+                    x.options = o.getObjectField("options").getOwned();
+                    BSONObj stats;
+                    if( r.conn()->runCommand(db, BSON( "collStats" << ns.substr(db.size() + 1) ), stats) )
+                        x.size = stats["size"].numberLong();
+                    byNs[ns] = _collections.size();
+                    _collections.push_back(x);
+                }
+
+                c = r.conn()->query(db + ".system.indexes", BSONObj());
+                while( c.get() && c->more() ) {
+                    BSONObj o = c->nextSafe();
+                    map<string,unsigned>::iterator i = byNs.find( o.getStringField("ns") );
+                    if( i != byNs.end() && strcmp(o.getStringField("name"), "_id_") != 0 )
+                        _collections[i->second].indexes.push_back( o.getOwned() );
+                }
+            }
+
+            /* a big collection started last would leave the other workers idle at the end */
+            sort(_collections.begin(), _collections.end(), Collection::bigger);
+            for( unsigned i = 0; i < _collections.size(); i++ )
+                _index[ _collections[i].ns ] = i;
+        }
+
+        unsigned size() const { return _collections.size(); }
+
+        /** copy everything planned.  @return false and set errmsg if a collection failed */
+        bool go(string& errmsg) {
+            boost::thread_group threads;
+            for( int i = 0; i < InitialSyncThreads; i++ )
+                threads.create_thread( boost::bind(&ParallelCloner::worker, this) );
+            threads.join_all();
+
+            scoped_lock lk(_m);
+            errmsg = _err;
+            return !_failed;
+        }
+
+        /** what to do with an op on ns read from the primary's oplog.
+            ops on collections not copied yet are skipped as the copy will see them; ops on a
+            collection being copied wait for it.  anything else - commands, index builds, new
+            collections - waits for everything to be copied.
+        */
+        Verdict verdict(const string& ns) {
+            scoped_lock lk(_m);
+            map<string,unsigned>::iterator i = _index.find(ns);
+            while( 1 ) {
+                if( _failed )
+                    return Abort;
+                if( i == _index.end() ) {
+                    if( _nDone == _collections.size() )
+                        return Apply;
+                }
+                else {
+                    Collection::State s = _collections[i->second].state;
+                    if( s == Collection::Pending )
+                        return Skip;
+                    if( s == Collection::Done )
+                        return Apply;
+                }
+                _c.wait(lk.boost());
+            }
+        }
+
+        bool failed() {
+            scoped_lock lk(_m);
+            return _failed;
+        }
+
+    private:
+        struct Collection {
+            Collection() : size(0), state(Pending) { }
+            string ns;
+            BSONObj options;          // from system.namespaces
+            vector<BSONObj> indexes;  // from system.indexes, except _id_
+            long long size;           // bytes, from collStats
+            enum State { Pending, Cloning, Done } state;
+            static bool bigger(const Collection& a, const Collection& b) { return a.size > b.size; }
+        };
+
+        /* inserts a batch at a time under the collection's lock */
+        struct Batcher {
+            Batcher(const string& ns) : ns(ns), n(0), bytes(0) { }
+            void operator()(DBClientCursorBatchIterator& i) {
+                long long n0 = n, bytes0 = bytes;
+                {
+                    writelock lk(ns);
+                    Client::Context ctx(ns);
+                    while( i.moreInCurrentBatch() ) {
+                        BSONObj o = i.nextSafe();
+                        if( !o.valid() ) {
+                            log() << "replSet initial sync skipping corrupt object from " << ns << rsLog;
+                            continue;
+                        }
+                        try {
+                            theDataFileMgr.insertWithObjMod(ns.c_str(), o);
+                        }
+                        catch( UserException& e ) {
+                            log() << "replSet initial sync exception cloning object in " << ns << ' ' << e.what() << rsLog;
+                        }
+                        n++;
+                        bytes += o.objsize();
+                    }
+                }
+                initialSyncProgress.cloned(n - n0, bytes - bytes0);
+            }
+            string ns;
+            long long n;
+            long long bytes;
+        };
+
+        void worker() {
+            Client::initThread("initial sync clone");
+            cc().setReplWriter(); // we don't log what we copy
+            try {
+                OplogReader r;
+                uassert( 13449 , "initial sync couldn't connect to " + _host , r.connect(_host) );
+                while( 1 ) {
+                    Collection *x = 0;
+                    {
+                        scoped_lock lk(_m);
+                        if( _failed || _next == _collections.size() )
+                            break;
+                        x = &_collections[_next++];
+                        x->state = Collection::Cloning;
+                    }
+                    copy(r.conn(), *x);
+                    {
+                        scoped_lock lk(_m);
+                        x->state = Collection::Done;
+                        _nDone++;
+                    }
+                    _c.notify_all();
+                    initialSyncProgress.collectionDone();
+                }
+            }
+            catch( DBException& e ) {
+                fail( e.toString() );
+            }
+            catch( std::exception& e ) {
+                fail( e.what() );
+            }
+            cc().shutdown();
+        }
+
+        void fail(const string& err) {
+            {
+                scoped_lock lk(_m);
+                _failed = true;
+                _err = err;
+            }
+            _c.notify_all();
+        }
+
+        void copy(DBClientConnection *conn, Collection& x) {
+            const char *ns = x.ns.c_str();
+            log(1) << "replSet initial sync cloning " << ns << rsLog;
+            Timer t;
+
+            bool wantIdIndex = false;
+            {
+                writelock lk(x.ns);
+                Client::Context ctx(x.ns);
+                string err;
+                /* the _id index is deferred too, see below */
+                userCreateNS(ns, x.options, err, false, &wantIdIndex);
+            }
+
+            Batcher batcher(x.ns);
+            conn->query( boost::function<void(DBClientCursorBatchIterator &)>( boost::ref(batcher) ), x.ns, Query(), 0,
+                         QueryOption_NoCursorTimeout | QueryOption_SlaveOk );
+
+            /* index builds are serialized: they are disk bound anyway, and inDBRepair is global.  it
+               makes the _id build drop duplicates, which a copy that isn't a snapshot can have until
+               the oplog is applied.
+            */
+            scoped_lock idx(_indexMutex);
+            writelock lk(x.ns);
+            Client::Context ctx(x.ns);
+            if( wantIdIndex ) {
+                bool old = inDBRepair;
+                try {
+                    inDBRepair = true;
+                    ensureIdIndexForNewNs(ns);
+                    inDBRepair = old;
+                }
+                catch(...) {
+                    inDBRepair = old;
+                    throw;
+                }
+            }
+            if( !x.indexes.empty() )
+                buildIndexes(x.ns, x.indexes, false);
+
+            log() << "replSet initial sync cloned " << ns << ' ' << batcher.n << " objects " << t.millis() / 1000.0 << "secs" << rsLog;
+        }
+
+        const string _host;
+        vector<Collection> _collections;
+        map<string,unsigned> _index;  // ns -> position in _collections
+        mongo::mutex _m;              // guards what follows
+        mongo::mutex _indexMutex;
+        boost::condition _c;          // a collection is done, or we failed
+        unsigned _next;
+        unsigned _nDone;
+        bool _failed;
+        string _err;
+    };
+
+    /* applies the primary's oplog from the op initial sync starts at while cloning goes on, so
+       a long clone isn't followed by an equally long catch up, and ops are read before they roll
+       off the primary's oplog.  on any problem it just stops: the sync thread then carries on
+       from the last op applied, as it would have from where cloning started.
+    */
+    class OplogTailer : boost::noncopyable {
+    public:
+        OplogTailer(ReplSetImpl *rs, ParallelCloner& cloner, const string& host, const BSONObj& startOp) :
+            _rs(rs), _cloner(cloner), _host(host), _m("OplogTailer"), _lastApplied(startOp), _stopRequested(false) { }
+
+        void run() {
+            Client::initThread("initial sync oplog");
+            cc().setReplWriter();
+            try {
+                _run();
+            }
+            catch( DBException& e ) {
+                log() << "replSet initial sync stopped applying the oplog early: " << e.toString() << rsLog;
+            }
+            cc().shutdown();
+        }
+
+        /** stop once the op at t is applied, or when there is nothing more to read */
+        void stopAt(OpTime t) {
+            scoped_lock lk(_m);
+            _stopAt = t;
+            _stopRequested = true;
+        }
+
+        /** the clone is consistent as of this op; syncing continues after it */
+        BSONObj lastApplied() {
+            scoped_lock lk(_m);
+            return _lastApplied;
+        }
+
+    private:
+        bool stopping(bool caughtUp) {
+            scoped_lock lk(_m);
+            return _stopRequested && ( caughtUp || _stopAt <= _lastApplied["ts"]._opTime() );
+        }
+
+        void _run() {
+            OplogReader r;
+            if( !r.connect(_host) )
+                return;
+            OpTime start = lastApplied()["ts"]._opTime();
+            r.tailingQueryGTE(rsoplog, start);
+            if( !r.haveCursor() || !r.more() )
+                return;
+            // otherwise the primary's oplog already rolled past where we started
+            if( r.nextSafe()["ts"]._opTime() != start )
+                return;
+
+            while( !stopping(false) ) {
+                if( !r.more() ) {
+                    r.tailCheck();
+                    if( !r.haveCursor() || _cloner.failed() || stopping(true) )
+                        return;
+                    continue; // the cursor awaits data, so this doesn't spin
+                }
+
+                BSONObj op = r.nextSafe().getOwned();
+                const char *ns = op.getStringField("ns");
+                ParallelCloner::Verdict v = _cloner.verdict(ns);
+                if( v == ParallelCloner::Abort )
+                    return;
+                if( v == ParallelCloner::Apply ) {
+                    // commands and index builds reach beyond their namespace
+                    bool global = *op.getStringField("op") == 'c' || strstr(ns, ".system.");
+                    writelock lk( global ? "" : ns );
+                    _rs->syncApply(op);
+                    initialSyncProgress.applied();
+                }
+
+                scoped_lock lk(_m);
+                _lastApplied = op;
+            }
+        }
+
+        ReplSetImpl *_rs;
+        ParallelCloner& _cloner;
+        const string _host;
+        mongo::mutex _m;              // guards what follows
+        BSONObj _lastApplied;
+        OpTime _stopAt;
+        bool _stopRequested;
+    };
+
     void _logOpObjRS(const BSONObj& op);
 
     void ReplSetImpl::_syncDoInitialSync() { 
@@ -104,23 +505,21 @@ namespace mongo {
         dropAllDatabasesExceptLocal();
         sethbmsg("initial sync continues");
 
-        list<string> dbs = r.conn()->getDatabaseNames();
-        for( list<string>::iterator i = dbs.begin(); i != dbs.end(); i++ ) {
-            string db = *i;
-            if( db != "local" ) {
-                sethbmsg( str::stream() << "initial sync cloning db: " << db , 0);
-                bool ok;
-                {
-                    writelock lk(db);
-                    Client::Context ctx(db);
-                    ok = clone(masterHostname.c_str(), db);
-                }
-                if( !ok ) { 
-                    sethbmsg( str::stream() << "initial sync error clone of " << db << " failed sleeping 5 minutes" ,0);
-                    sleepsecs(300);
-                    return;
-                }
-            }
+        ParallelCloner cloner(masterHostname);
+        cloner.plan(r);
+        initialSyncProgress.start( cloner.size() );
+        sethbmsg( str::stream() << "initial sync cloning " << cloner.size() << " collections" , 0);
+
+        OplogTailer tailer(this, cloner, masterHostname, lastOp);
+        boost::thread tailing( boost::bind(&OplogTailer::run, &tailer) );
+
+        string errmsg;
+        if( !cloner.go(errmsg) ) {
+            tailing.join(); // quits as the cloner failed
+            initialSyncProgress.done();
+            sethbmsg( str::stream() << "initial sync error clone failed: " << errmsg << " sleeping 5 minutes" ,0);
+            sleepsecs(300);
+            return;
         }
 
         sethbmsg("initial sync query minValid",0);
@@ -129,6 +528,13 @@ namespace mongo {
            through the process.  we note that time point here. */
         BSONObj minValid = r.getLastOp(rsoplog);
 
+        sethbmsg("initial sync applying oplog",0);
+        initialSyncProgress.phase("applying oplog");
+        tailer.stopAt( minValid["ts"]._opTime() );
+        tailing.join();
+        BSONObj startingPoint = tailer.lastApplied();
+        initialSyncProgress.done();
+
         sethbmsg("initial sync clone done first write to oplog still pending",0);
         
         assert( !box.getState().primary() ); // wouldn't make sense if we were.
@@ -139,13 +545,13 @@ namespace mongo {
             cx.db()->flushFiles(true);
             
             Helpers::putSingleton("local.replset.minvalid", minValid);
-            // write an op from the primary to our oplog that existed when 
-            // we started cloning.  that will be our starting point.
+            // write an op from the primary to our oplog: the last one applied while cloning, or
+            // the one that existed when we started.  that will be our starting point.
             //
             // todo : handle case where lastOp on the primary has rolled back.  may have to just 
             //        reclone, but don't get stuck with manual error at least...
             //
-            _logOpObjRS(lastOp);
+            _logOpObjRS(startingPoint);
             cx.db()->flushFiles(true);
         }
 
@@ -19,6 +19,8 @@
 #include "../../client/dbclient.h"
 #include "rs.h"
 #include "../repl.h"
+#include "../oplog.h"
+#include "../cmdline.h"
 
 namespace mongo {
 
@@ -47,6 +49,182 @@ namespace mongo {
         applyOperation_inlock(o);
     }
 
+    /* max ops we apply before writing them to our oplog.  only what the primary has already sent
+       is batched, we never wait for a batch to fill. */
+    const unsigned ReplBatchSize = 1000;
+    const int ReplWriterThreads = 8;
+
+    static ThreadPool& replWriterPool() { 
+        static ThreadPool pool(ReplWriterThreads);
+        return pool;
+    }
+
+    static void initReplWriter() { 
+        if( currentClient.get() == 0 ) {
+            Client::initThread("repl writer");
+            cc().setReplWriter();
+        }
+    }
+
+    static void prefetchOps(vector<BSONObj> *ops, unsigned a, unsigned b) { 
+        initReplWriter();
+        pretouchN(*ops, a, b);
+    }
+
+    /* ops a partition can apply concurrently with the others: plain crud on a user collection, 
+       for a single document.  anything else (commands, index builds, ops without an _id) is 
+       applied on its own with everything before it finished first. 
+    */
+    static bool partitionable(const BSONObj& op, BSONElement& id) { 
+        const char *opType = op.getStringField("op");
+        const char *which;
+        if( *opType == 'i' || *opType == 'd' )
+            which = "o";
+        else if( *opType == 'u' )
+            which = "o2";
+        else
+            return false;
+        const char *ns = op.getStringField("ns");
+        if( *ns == 0 || strstr(ns, ".system.") || strchr(ns, '$') )
+            return false;
+        id = op.getObjectField(which)["_id"];
+        return !id.eoo();
+    }
+
+    /* true if ns's ops must all be applied in oplog order, not just each document's: a capped 
+       collection's natural order and rollover follow its inserts, and a unique index other than 
+       _id's can see a transient duplicate key when two documents' ops are reordered.  both can 
+       only change through a barrier op (create, system.indexes), so this holds until the next one.
+    */
+    static bool ordered(const string& ns) { 
+        writelock lk(ns);
+        Client::Context ctx(ns);
+        NamespaceDetails *d = nsdetails(ns.c_str());
+        if( d == 0 )
+            return false;
+        if( d->capped )
+            return true;
+        NamespaceDetails::IndexIterator i = d->ii();
+        while( i.more() ) { 
+            IndexDetails& idx = i.next();
+            if( idx.unique() && !idx.isIdIndex() )
+                return true;
+        }
+        return false;
+    }
+
+    /* ops on one document always hash to the same partition, so they are applied in oplog order. 
+       numbers are hashed by value as _id 1 and 1.0 are the same document.  if byNs, all of the 
+       namespace's ops go to one partition. */
+    static unsigned partitionOf(const BSONObj& op, const BSONElement& id, unsigned n, bool byNs) { 
+        unsigned h = 0;
+        for( const char *p = op.getStringField("ns"); *p; p++ )
+            h = h * 131 + *p;
+        if( byNs )
+            return h % n;
+        if( id.isNumber() ) { 
+            double d = id.number();
+            const char *p = (const char *) &d;
+            for( unsigned i = 0; i < sizeof(d); i++ )
+                h = h * 131 + p[i];
+        }
+        else {
+            const char *p = id.value();
+            for( int i = 0; i < id.valuesize(); i++ )
+                h = h * 131 + p[i];
+        }
+        return h % n;
+    }
+
+    struct ApplyStatus { 
+        ApplyStatus() : m("replApplyStatus") { }
+        mongo::mutex m;
+        string err;
+    };
+
+    static void applyPartition(ReplSetImpl *rs, vector<BSONObj> *ops, ApplyStatus *status) { 
+        initReplWriter();
+        try {
+            for( vector<BSONObj>::iterator i = ops->begin(); i != ops->end(); i++ ) {
+                writelock lk( i->getStringField("ns") );
+                rs->syncApply(*i);
+            }
+        }
+        catch( DBException& e ) { 
+            scoped_lock lk(status->m);
+            status->err = e.toString();
+        }
+        catch( std::exception& e ) { 
+            scoped_lock lk(status->m);
+            status->err = e.what();
+        }
+        ops->clear();
+    }
+
+    /** apply a batch of ops fetched from the primary, then write them all to our oplog.
+        lastOpTimeWritten only moves at the end, so if we fail part way the whole batch is 
+        fetched again - ops are idempotent.
+
+        with --dblocks the batch is split by namespace and _id (namespace only for capped
+        collections and those with a unique secondary index) and the partitions are applied 
+        concurrently on replWriterPool(), each op taking only its collection's lock.  otherwise
+        ops are applied one at a time under the global lock.  with --pretouch the documents are
+        first prefetched on the pool with pretouchN().
+    */
+    void ReplSetImpl::syncApplyBatch(vector<BSONObj>& ops) { 
+        ThreadPool& pool = replWriterPool();
+
+        if( cmdLine.pretouch ) { 
+            const unsigned m = 4;
+            for( unsigned a = 0; a < ops.size(); a += m ) { 
+                unsigned b = min( a + m, (unsigned) ops.size() ) - 1; // ops[a..b]
+                pool.schedule(prefetchOps, &ops, a, b);
+            }
+            pool.join();
+        }
+
+        if( !dbMutex.dbLocksEnabled() ) { 
+            for( vector<BSONObj>::iterator i = ops.begin(); i != ops.end(); i++ ) {
+                writelock lk("");
+                syncApply(*i);
+            }
+        }
+        else {
+            vector< vector<BSONObj> > parts(ReplWriterThreads);
+            map<string,bool> orderedNs; // since the last barrier
+            ApplyStatus status;
+            for( unsigned i = 0; i <= ops.size(); i++ ) { 
+                BSONElement id;
+                if( i < ops.size() && partitionable(ops[i], id) ) { 
+                    string ns = ops[i].getStringField("ns");
+                    map<string,bool>::iterator o = orderedNs.find(ns);
+                    if( o == orderedNs.end() )
+                        o = orderedNs.insert( make_pair(ns, ordered(ns)) ).first;
+                    parts[ partitionOf(ops[i], id, parts.size(), o->second) ].push_back( ops[i] );
+                    continue;
+                }
+                orderedNs.clear();
+
+                // a barrier (or the end): finish everything queued so far
+                for( unsigned j = 0; j < parts.size(); j++ ) {
+                    if( !parts[j].empty() )
+                        pool.schedule(applyPartition, this, &parts[j], &status);
+                }
+                pool.join();
+                uassert( 13425 , "replSet error applying batch: " + status.err , status.err.empty() );
+
+                if( i < ops.size() ) { 
+                    writelock lk("");
+                    syncApply(ops[i]);
+                }
+            }
+        }
+
+        writelock lk("");
+        for( vector<BSONObj>::iterator i = ops.begin(); i != ops.end(); i++ )
+            _logOpObjRS(*i);   /* with repl sets we write the ops to our oplog too */
+    }
+
     void ReplSetImpl::syncTail() { 
         // todo : locking vis a vis the mgr...
 
@@ -130,12 +308,11 @@ namespace mongo {
                 if( !r.more() )
                     break;
                 { 
-                    BSONObj o = r.nextSafe(); /* note we might get "not master" at some point */
-                    {
-                        writelock lk("");
-                        syncApply(o);
-                        _logOpObjRS(o);   /* with repl sets we write the ops to our oplog too: */                   
-                    }
+                    vector<BSONObj> ops;
+                    do {
+                        ops.push_back( r.nextSafe().getOwned() ); /* note we might get "not master" at some point */
+                    } while( ops.size() < ReplBatchSize && r.moreInCurrentBatch() );
+                    syncApplyBatch(ops);
                 }
             }
             r.tailCheck();
@@ -118,6 +118,7 @@ namespace mongo {
             Info& i = _slaves[ ident ];
             if ( i.loc ){
                 i.loc[0] = last;
+                _slaveMoved.notify_all();
                 return;
             }
             
@@ -129,12 +130,14 @@ namespace mongo {
                 i.owned = false;
                 i.loc = (OpTime*)res["syncedTo"].value();
                 i.loc[0] = last;
+                _slaveMoved.notify_all();
                 return;
             }
             
             i.owned = true;
             i.loc = new OpTime[1];
             i.loc[0] = last;
+            _slaveMoved.notify_all();
             _dirty = true;
             if ( ! _started ){
                 _started = true;
@@ -146,8 +149,37 @@ namespace mongo {
         bool opReplicatedEnough( OpTime op , int w ){
             if ( w <= 1 || ! replSettings.master )
                 return true;
-            w--; // now this is the # of slaves i need
             scoped_lock mylk(_mutex);
+            return _replicatedEnough_inlock( op , w );
+        }
+
+        bool waitForReplication( OpTime op , int w , int maxMillis ){
+            if ( w <= 1 || ! replSettings.master )
+                return true;
+
+            boost::system_time deadline = get_system_time();
+            deadline += boost::posix_time::milliseconds( maxMillis );
+
+            scoped_lock mylk(_mutex);
+            while ( ! _replicatedEnough_inlock( op , w ) ){
+                if ( inShutdown() )
+                    return false;
+
+                // wake up at least once a second to notice shutdown
+                boost::system_time next = get_system_time() + boost::posix_time::seconds( 1 );
+                if ( maxMillis > 0 ){
+                    if ( get_system_time() >= deadline )
+                        return false;
+                    if ( deadline < next )
+                        next = deadline;
+                }
+                _slaveMoved.timed_wait( mylk.boost() , next );
+            }
+            return true;
+        }
+
+        bool _replicatedEnough_inlock( OpTime op , int w ){
+            w--; // now this is the # of slaves i need
             for ( map<Ident,Info>::iterator i=_slaves.begin(); i!=_slaves.end(); i++){
                 OpTime s = *(i->second.loc);
                 if ( s < op ){
@@ -161,6 +193,7 @@ namespace mongo {
         
         // need to be careful not to deadlock with this
         mongo::mutex _mutex;
+        boost::condition _slaveMoved; // a slave's position changed, under _mutex
         map<Ident,Info> _slaves;
         bool _dirty;
         bool _started;
@@ -188,6 +221,10 @@ namespace mongo {
         return slaveTracking.opReplicatedEnough( op , w );
     }
 
+    bool waitForReplication( OpTime op , int w , int maxMillis ){
+        return slaveTracking.waitForReplication( op , w , maxMillis );
+    }
+
     void resetSlaveCache(){
         slaveTracking.reset();
     }
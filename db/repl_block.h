@@ -30,5 +30,11 @@ namespace mongo {
     
     void updateSlaveLocation( CurOp& curop, const char * ns , OpTime lastOp );
     bool opReplicatedEnough( OpTime op , int w );
+
+    /** blocks until op is on w servers (counting this one), or maxMillis pass if > 0.
+        woken by updateSlaveLocation rather than polling.
+        @return opReplicatedEnough( op , w )
+    */
+    bool waitForReplication( OpTime op , int w , int maxMillis );
     void resetSlaveCache();
 }
@@ -20,11 +20,14 @@
 
 #pragma once
 
+#include "cursor.h"
+#include "extsort.h"
+#include "query.h"
+
 namespace mongo {
 
     /* todo:
        _ handle compound keys with differing directions.  we don't handle this yet: neither here nor in indexes i think!!!
-       _ limit amount of data
     */
 
     /* see also IndexDetails::getKeysFromObject, which needs some merging with this. */
@@ -44,12 +47,6 @@ namespace mongo {
         }
     };
 
-    /* todo:
-       _ respect limit
-       _ check for excess mem usage
-       _ response size limit from runquery; push it up a bit.
-    */
-
     inline void fillQueryResultFromObj(BufBuilder& bb, FieldMatcher *filter, BSONObj& js, DiskLoc* loc=NULL) {
         if ( filter ) {
             BSONObjBuilder b( bb );
@@ -78,85 +75,259 @@ namespace mongo {
         }
     }
     
-    typedef multimap<BSONObj,BSONObj,BSONObjCmp> BestMap;
-    class ScanAndOrder {
-        BestMap best; // key -> full object
-        int startFrom;
-        int limit;   // max to send back.
-        KeyType order;
-        unsigned approxSize;
-
-        void _add(BSONObj& k, BSONObj o, DiskLoc* loc) {
-            if (!loc){
-                best.insert(make_pair(k,o));
-            } else {
-                BSONObjBuilder b;
-                b.appendElements(o);
-                b.append("$diskLoc", loc->toBSONObj());
-                best.insert(make_pair(k, b.obj()));
+    /* a match held in memory by ScanAndOrder: its sort key, the (owned) object to return, and
+       where it came from */
+    struct ScanAndOrderItem {
+        BSONObj key;
+        BSONObj obj;
+        DiskLoc loc;
+    };
+
+    /* orders items by sort key.  for the top-k heap the "largest" item is the worst one kept. */
+    class ScanAndOrderItemCmp {
+    public:
+        ScanAndOrderItemCmp( const BSONObj &order ) : _order( order ) {}
+        bool operator()( const ScanAndOrderItem &l , const ScanAndOrderItem &r ) const {
+            return l.key.woCompare( r.key , _order ) < 0;
+        }
+    private:
+        BSONObj _order;
+    };
+
+    /* serves the ordered results of a ScanAndOrder, so those that don't fit in the first reply
+       can be returned by getMore.  the objects are owned by the cursor (or live in the external
+       sorter's files) rather than read from the collection, so concurrent updates and deletes
+       can't invalidate them -- hence no refLoc().
+    */
+    class ScanAndOrderCursor : public Cursor {
+    public:
+        /* takes the contents of items, which must already be in order */
+        ScanAndOrderCursor( vector<ScanAndOrderItem> &items , int skip , int limit ) :
+            _pos( 0 ) , _left( limit > 0 ? limit : -1 ) {
+            _items.swap( items );
+            init( skip );
+        }
+
+        /* sorter holds { <sort key fields>..., obj : <object> } -> DiskLoc, and has been sort()ed */
+        ScanAndOrderCursor( auto_ptr<BSONObjExternalSorter> sorter , int skip , int limit ) :
+            _sorter( sorter ) , _pos( 0 ) , _left( limit > 0 ? limit : -1 ) {
+            _it = _sorter->iterator();
+            init( skip );
+        }
+
+        virtual bool ok() { return _ok; }
+        virtual Record* _current() {
+            massert( 13426 , "ScanAndOrderCursor results are not read from records" , false );
+            return 0;
+        }
+        virtual BSONObj current() { assert( ok() ); return _obj; }
+        virtual DiskLoc currLoc() { assert( ok() ); return _loc; }
+        virtual DiskLoc refLoc() { return DiskLoc(); }
+
+        virtual bool advance() {
+            if ( !_ok )
+                return false;
+            if ( _left > 0 && --_left == 0 ) {
+                _ok = false;
+                return false;
             }
+            fetch();
+            return _ok;
+        }
+
+        virtual bool getsetdup(DiskLoc loc) { return false; }
+        virtual bool supportGetMore() { return true; }
+        virtual bool supportYields() { return false; }
+        virtual string toString() { return "ScanAndOrderCursor"; }
+
+        // results were matched during the scan
+        virtual void setMatcher( shared_ptr< CoveredIndexMatcher > matcher ) {}
+
+    private:
+        void init( int skip ) {
+            fetch();
+            for ( int i = 0; i < skip && _ok; i++ )
+                fetch();
+            if ( _left == 0 )
+                _ok = false;
         }
 
-        void _addIfBetter(BSONObj& k, BSONObj o, BestMap::iterator i, DiskLoc* loc) {
-            const BSONObj& worstBestKey = i->first;
-            int c = worstBestKey.woCompare(k, order.pattern);
-            if ( c > 0 ) {
-                // k is better, 'upgrade'
-                best.erase(i);
-                _add(k, o, loc);
+        void fetch() {
+            _ok = false;
+            if ( _it.get() ) {
+                if ( !_it->more() )
+                    return;
+                BSONObjExternalSorter::Data d = _it->next();
+                BSONObjIterator i( d.first );
+                BSONElement e;
+                while ( i.more() )
+                    e = i.next();
+                _obj = e.embeddedObject();
+                _loc = d.second;
+            }
+            else {
+                if ( _pos >= _items.size() )
+                    return;
+                ScanAndOrderItem &i = _items[ _pos++ ];
+                _obj = i.obj;
+                _loc = i.loc;
+                // let go of results as they are returned
+                i.key = BSONObj();
+                i.obj = BSONObj();
             }
+            _ok = true;
         }
 
+        vector<ScanAndOrderItem> _items;
+        auto_ptr<BSONObjExternalSorter> _sorter;
+        auto_ptr<BSONObjExternalSorter::Iterator> _it;
+        unsigned _pos;
+        int _left; // results still to return, -1 for no limit
+        bool _ok;
+        BSONObj _obj;
+        DiskLoc _loc;
+    };
+
+    /* orders the matches of a query that has no index to provide its sort.
+       with a limit, only the best limit+skip matches are kept, in a heap.  once the matches
+       held take more than maxMemory bytes, they all go to an external sort on disk instead.
+    */
+    class ScanAndOrder {
     public:
-        ScanAndOrder(int _startFrom, int _limit, BSONObj _order) :
-                best( BSONObjCmp( _order ) ),
-                startFrom(_startFrom), order(_order) {
-            limit = _limit > 0 ? _limit + startFrom : 0x7fffffff;
-            approxSize = 0;
+        ScanAndOrder( int startFrom , int limit , BSONObj order , long long maxMemory ) :
+            _startFrom( startFrom ) , _limit( limit > 0 ? limit : 0 ) ,
+            _order( order ) , _cmp( order ) ,
+            _maxMemory( maxMemory ) , _memory( 0 ) , _peakMemory( 0 ) , _nSpilled( 0 ) {
+            _keep = _limit ? _limit + startFrom : 0x7fffffff;
         }
 
+        /* number of matches to be ordered, including those that will be skipped */
         int size() const {
-            return best.size();
+            if ( _sorter.get() )
+                return (int) min( _nSpilled , (long long) _keep );
+            return _items.size();
         }
 
-        void add(BSONObj o, DiskLoc* loc) {
+        bool spilled() const { return _sorter.get() != 0; }
+
+        void add( BSONObj o , const DiskLoc &loc ) {
             assert( o.isValid() );
-            BSONObj k = order.getKeyFromObject(o);
-            if ( (int) best.size() < limit ) {
-                approxSize += k.objsize();
-                uassert( 10128 ,  "too much key data for sort() with no index.  add an index or specify a smaller limit", approxSize < 1 * 1024 * 1024 );
-                _add(k, o, loc);
+            BSONObj k = _order.getKeyFromObject( o );
+            if ( _sorter.get() ) {
+                spill( k , o , loc );
                 return;
             }
-            BestMap::iterator i;
-            assert( best.end() != best.begin() );
-            i = best.end();
-            i--;
-            _addIfBetter(k, o, i, loc);
+
+            if ( (int) _items.size() >= _keep ) {
+                // heap is full: replace the worst match kept if o is better
+                ScanAndOrderItem &worst = _items.front();
+                if ( worst.key.woCompare( k , _order.pattern ) <= 0 )
+                    return;
+                _memory -= worst.key.objsize() + worst.obj.objsize();
+                pop_heap( _items.begin() , _items.end() , _cmp );
+                _items.pop_back();
+            }
+
+            // we may yield before the scan completes, so hold our own copy
+            ScanAndOrderItem i;
+            i.key = k;
+            i.obj = o.getOwned();
+            i.loc = loc;
+            _items.push_back( i );
+            if ( _limit )
+                push_heap( _items.begin() , _items.end() , _cmp );
+
+            _memory += k.objsize() + i.obj.objsize();
+            if ( _memory > _peakMemory )
+                _peakMemory = _memory;
+            if ( _memory > _maxMemory )
+                startSpilling();
         }
 
-        void _fill(BufBuilder& b, FieldMatcher *filter, int& nout, BestMap::iterator begin, BestMap::iterator end) {
+        /* scanning complete.  a cursor over the ordered results with skip and limit applied. */
+        ScanAndOrderCursor* results() {
+            if ( _sorter.get() ) {
+                _sorter->sort();
+                return new ScanAndOrderCursor( _sorter , _startFrom , _limit );
+            }
+            if ( _limit )
+                sort_heap( _items.begin() , _items.end() , _cmp );
+            else
+                stable_sort( _items.begin() , _items.end() , _cmp );
+            return new ScanAndOrderCursor( _items , _startFrom , _limit );
+        }
+
+        /* scanning complete.  stick the first batch of results in b, setting nout to the number
+           of objects.  if results remain and mayKeepCursor, returns a cursor for getMore to
+           continue from; otherwise everything up to the limit is returned now.
+        */
+        shared_ptr<Cursor> fill( BufBuilder& b , const ParsedQuery& pq , bool mayKeepCursor , int& nout ) {
+            shared_ptr<Cursor> c( results() );
             int n = 0;
-            int nFilled = 0;
-            for ( BestMap::iterator i = begin; i != end; i++ ) {
-                n++;
-                if ( n <= startFrom )
-                    continue;
-                BSONObj& o = i->second;
-                fillQueryResultFromObj(b, filter, o);
-                nFilled++;
-                if ( nFilled >= limit )
+            for ( ; c->ok(); c->advance() ) {
+                if ( mayKeepCursor && pq.enoughForFirstBatch( n , b.len() ) )
                     break;
+                BSONObj o = c->current();
+                DiskLoc loc = c->currLoc();
+                fillQueryResultFromObj( b , pq.getFields() , o , pq.showDiskLoc() ? &loc : 0 );
+                n++;
                 uassert( 10129 ,  "too much data for sort() with no index", b.len() < 4000000 ); // appserver limit
             }
-            nout = nFilled;
+            nout = n;
+            if ( mayKeepCursor && c->ok() )
+                return c;
+            return shared_ptr<Cursor>();
+        }
+
+        /* for explain() */
+        void appendStats( BSONObjBuilder &b ) const {
+            b.appendNumber( "scanAndOrderMemory" , _peakMemory );
+            if ( _sorter.get() ) {
+                b.append( "scanAndOrderSpilled" , true );
+                b.appendNumber( "scanAndOrderSpilledObjects" , _nSpilled );
+            }
+        }
+
+    private:
+        /* the sorter orders by key then object, so ties keep a stable (if arbitrary) order */
+        BSONObj sorterOrder() const {
+            BSONObjBuilder b;
+            b.appendElements( _order.pattern );
+            b.append( "obj" , 1 );
+            return b.obj();
+        }
+
+        void spill( const BSONObj &k , const BSONObj &o , const DiskLoc &loc ) {
+            BSONObjBuilder b( k.objsize() + o.objsize() + 16 );
+            b.appendElements( k );
+            b.append( "obj" , o );
+            _sorter->add( b.obj() , loc );
+            _nSpilled++;
         }
 
-        /* scanning complete. stick the query result in b for n objects. */
-        void fill(BufBuilder& b, FieldMatcher *filter, int& nout) {
-            _fill(b, filter, nout, best.begin(), best.end());
+        void startSpilling() {
+            log(1) << "scanAndOrder: " << _memory << " bytes of matches in memory, sorting on disk" << endl;
+            _sorter.reset( new BSONObjExternalSorter( sorterOrder() , (long) _maxMemory ) );
+            // the sorter's in memory array defaults to a million entries, too many for our budget
+            _sorter->hintNumObjects( _maxMemory / 128 );
+            for ( vector<ScanAndOrderItem>::iterator i = _items.begin(); i != _items.end(); ++i )
+                spill( i->key , i->obj , i->loc );
+            vector<ScanAndOrderItem> none;
+            _items.swap( none );
+            _memory = 0;
         }
 
+        int _startFrom;
+        int _limit;  // 0 for no limit
+        int _keep;   // max matches to keep: limit + startFrom
+        KeyType _order;
+        ScanAndOrderItemCmp _cmp;
+        vector<ScanAndOrderItem> _items; // a heap when there is a limit
+        long long _maxMemory;
+        long long _memory;
+        long long _peakMemory;
+        auto_ptr<BSONObjExternalSorter> _sorter;
+        long long _nSpilled;
     };
 
 } // namespace mongo
@@ -103,27 +103,107 @@ namespace mongo {
         }
     }
     
+    static Histogram::Options flushHistogramOptions( boost::uint32_t numBuckets ){
+        Histogram::Options opts;
+        opts.numBuckets = numBuckets;
+        opts.bucketSize = 1;
+        opts.exponential = true;
+        return opts;
+    }
+
     FlushCounters::FlushCounters()
-        : _total_time(0)
+        : _mutex( "FlushCounters" )
+        , _total_time(0)
         , _flushes(0)
+        , _last_time(0)
+        , _last_bytes(0)
         , _last()
+        , _millis( flushHistogramOptions( 20 ) )
+        , _megabytes( flushHistogramOptions( 24 ) )
+        , _regionMicros( flushHistogramOptions( 24 ) )
     {}
 
-    void FlushCounters::flushed(int ms){
+    void FlushCounters::flushedRegion( int micros ){
+        scoped_lock lk( _mutex );
+        _regionMicros.insert( micros );
+    }
+
+    void FlushCounters::flushed( int ms , long long bytes ){
+        scoped_lock lk( _mutex );
         _flushes++;
         _total_time += ms;
         _last_time = ms;
+        _last_bytes = bytes;
         _last = jsTime();
+        _millis.insert( ms );
+        _megabytes.insert( (boost::uint32_t) ( bytes / ( 1024 * 1024 ) ) );
     }
 
     void FlushCounters::append( BSONObjBuilder& b ){
+        scoped_lock lk( _mutex );
         b.appendNumber( "flushes" , _flushes );
         b.appendNumber( "total_ms" , _total_time );
         b.appendNumber( "average_ms" , (_flushes ? (_total_time / double(_flushes)) : 0.0) );
         b.appendNumber( "last_ms" , _last_time );
+        b.appendNumber( "last_bytes" , _last_bytes );
         b.append("last_finished", _last);
+        appendHistogram( b , "ms" , _millis );
+        appendHistogram( b , "mb" , _megabytes );
+        appendHistogram( b , "regionMicros" , _regionMicros );
+    }
+
+    void RecordFaultCounters::append( BSONObjBuilder& b ){
+        b.appendNumber( "withLock" , (long long) _withLock );
+        b.appendNumber( "withoutLock" , (long long) _withoutLock );
+    }
+
+    static Histogram::Options writeConcernHistogramOptions(){
+        Histogram::Options opts;
+        opts.numBuckets = 16;
+        opts.bucketSize = 1;
+        opts.exponential = true;
+        return opts;
     }
 
+    WriteConcernCounters::WriteConcernCounters()
+        : _mutex( "WriteConcernCounters" )
+        , _waitMillis( writeConcernHistogramOptions() )
+        , _waits(0)
+        , _timeouts(0)
+        , _totalMillis(0)
+    {}
+
+    void WriteConcernCounters::waited( int ms , bool timedOut ){
+        scoped_lock lk( _mutex );
+        _waitMillis.insert( ms );
+        _waits++;
+        _totalMillis += ms;
+        if ( timedOut )
+            _timeouts++;
+    }
+
+    void WriteConcernCounters::append( BSONObjBuilder& b ){
+        scoped_lock lk( _mutex );
+        b.appendNumber( "waits" , _waits );
+        b.appendNumber( "timeouts" , _timeouts );
+        b.appendNumber( "total_ms" , _totalMillis );
+        appendHistogram( b , "waitMillis" , _waitMillis );
+    }
+
+    void appendHistogram( BSONObjBuilder& b , const string& name , const Histogram& h ){
+        BSONObjBuilder sub( b.subobjStart( name ) );
+        boost::uint32_t n = h.getBucketsNum();
+        for ( boost::uint32_t i=0; i<n; i++ ){
+            if ( i + 1 == n ){
+                sub.appendNumber( "more" , (long long) h.getCount( i ) );
+                break;
+            }
+            stringstream ss;
+            ss << h.getBoundary( i );
+            sub.appendNumber( ss.str() , (long long) h.getCount( i ) );
+        }
+        sub.done();
+    }
 
     void GenericCounter::hit( const string& name , int count ){
         scoped_lock lk( _mutex );
@@ -146,4 +226,6 @@ namespace mongo {
     OpCounters globalOpCounters;
     IndexCounters globalIndexCounters;
     FlushCounters globalFlushCounters;
+    RecordFaultCounters globalRecordFaultCounters;
+    WriteConcernCounters globalWriteConcernCounters;
 }
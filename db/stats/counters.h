@@ -21,6 +21,7 @@
 #include "../jsobj.h"
 #include "../../util/message.h"
 #include "../../util/processinfo.h"
+#include "../../util/histogram.h"
 
 namespace mongo {
 
@@ -103,23 +104,80 @@ namespace mongo {
 
     extern IndexCounters globalIndexCounters;
 
+    /**
+     * background flushing of the data files.  a flush is a pass over all of them, made a region
+     * at a time and spread over --syncdelay; its ms are the time spent syncing, not sleeping
+     * between regions, and its bytes how much was mapped.  histograms are per flush in power of
+     * 2 ms and mb buckets, and per region in power of 2 microsecond buckets.
+     */
     class FlushCounters {
     public:
         FlushCounters();
 
-        void flushed(int ms);
+        void flushedRegion( int micros );
+
+        void flushed( int ms , long long bytes );
         
         void append( BSONObjBuilder& b );
 
     private:
+        mongo::mutex _mutex;
         long long _total_time;
         long long _flushes;
         int _last_time;
+        long long _last_bytes;
         Date_t _last;
+        Histogram _millis;
+        Histogram _megabytes;
+        Histogram _regionMicros;
     };
 
     extern FlushCounters globalFlushCounters;
 
+    /**
+     * records cursors found not to be in ram.
+     * withoutLock: we yielded and paged the record in with the db lock released
+     * withLock: couldn't yield, so the fault happened with the lock held
+     */
+    class RecordFaultCounters {
+    public:
+        void faultWithLock(){ _withLock++; }
+        void faultWithoutLock(){ _withoutLock++; }
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        AtomicUInt _withLock;
+        AtomicUInt _withoutLock;
+    };
+
+    extern RecordFaultCounters globalRecordFaultCounters;
+
+    /**
+     * getLastError waits for w.  waitMillis is a histogram of how long the waits took,
+     * in power of 2 ms buckets; timeouts are the ones that gave up at wtimeout.
+     */
+    class WriteConcernCounters {
+    public:
+        WriteConcernCounters();
+
+        void waited( int ms , bool timedOut );
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        mongo::mutex _mutex;
+        Histogram _waitMillis;
+        long long _waits;
+        long long _timeouts;
+        long long _totalMillis;
+    };
+
+    extern WriteConcernCounters globalWriteConcernCounters;
+
+    /** { <bucket upper bound> : count , ... , "more" : count } */
+    void appendHistogram( BSONObjBuilder& b , const string& name , const Histogram& h );
+
 
     class GenericCounter {
     public:
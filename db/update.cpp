@@ -811,7 +811,9 @@ namespace mongo {
             const BSONObj& onDisk = loc.obj();                    
             auto_ptr<ModSetState> mss = mods->prepare( onDisk );
                     
-            if( mss->canApplyInPlace() ) {
+            // a compressed record's onDisk is a copy, so it has to be written back whole
+            if( mss->canApplyInPlace() && ! d->compressRecords() ) {
+                dur::declareWriteIntent( r->data , r->netLength() );
                 mss->applyModsInPlace();                    
                 DEBUGUPDATE( "\t\t\t updateById doing in place update" );
                 /*if ( profile )
@@ -990,8 +992,11 @@ namespace mongo {
                 }
                     
                 auto_ptr<ModSetState> mss = useMods->prepare( onDisk );
+
+                // a compressed record's onDisk is a copy, so it has to be written back whole
+                bool inPlace = mss->canApplyInPlace() && ! d->compressRecords();
                     
-                bool indexHack = multi && ( modsIsIndexed || ! mss->canApplyInPlace() );
+                bool indexHack = multi && ( modsIsIndexed || ! inPlace );
                     
                 if ( indexHack ){
                     if ( cc.get() )
@@ -1000,7 +1005,8 @@ namespace mongo {
                         c->noteLocation();
                 }
                     
-                if ( modsIsIndexed <= 0 && mss->canApplyInPlace() ){
+                if ( modsIsIndexed <= 0 && inPlace ){
+                    dur::declareWriteIntent( r->data , r->netLength() );
                     mss->applyModsInPlace();// const_cast<BSONObj&>(onDisk) );
                     
                     DEBUGUPDATE( "\t\t\t doing in place update" );
@@ -21,8 +21,10 @@
 
 #include "dbtests.h"
 #include "../util/base64.h"
+#include "../util/lz.h"
 #include "../util/array.h"
 #include "../util/text.h"
+#include "../util/mmap.h"
 
 namespace BasicTests {
 
@@ -113,6 +115,51 @@ namespace BasicTests {
         }
     };
 
+    class LZTests {
+    public:
+        /* @return the compressed length */
+        int roundTrip( const string& s ){
+            vector<char> c( lz::maxCompressedLength( s.size() ) );
+            int n = lz::compress( s.data() , s.size() , &c[0] );
+            ASSERT( n <= lz::maxCompressedLength( s.size() ) );
+            vector<char> out( s.size() + 1 );
+            ASSERT( lz::decompress( &c[0] , n , &out[0] , s.size() ) );
+            ASSERT_EQUALS( s , string( &out[0] , s.size() ) );
+            // a block only decodes to its own length
+            ASSERT( ! lz::decompress( &c[0] , n , &out[0] , s.size() + 1 ) );
+            return n;
+        }
+
+        void run(){
+            roundTrip( "" );
+            roundTrip( "e" );
+            roundTrip( "eliot" );
+
+            string runs( 5000 , 'x' );
+            ASSERT( roundTrip( runs ) < 50 );
+
+            string repeats;
+            for ( int i = 0; i < 300; i++ )
+                repeats += "{ name : \"eliot\" , n : 17 } ";
+            ASSERT( roundTrip( repeats ) < (int) repeats.size() / 10 );
+
+            string noise;
+            unsigned x = 17;
+            for ( int i = 0; i < 70000; i++ ){
+                x = x * 1103515245 + 12345;
+                noise += (char) ( x >> 16 );
+            }
+            ASSERT( roundTrip( noise ) <= lz::maxCompressedLength( noise.size() ) );
+            roundTrip( noise + repeats + noise ); // matches farther back than an offset reaches
+
+            // garbage mustn't read or write out of bounds
+            vector<char> out( 100 );
+            ASSERT( ! lz::decompress( noise.data() , 200 , &out[0] , 100 ) );
+            char far[] = { 0x10 , 'a' , 0x05 , 0x00 };
+            ASSERT( ! lz::decompress( far , 4 , &out[0] , 100 ) );
+        }
+    };
+
     namespace stringbuildertests {
 #define SBTGB(x) ss << (x); sb << (x);
         
@@ -460,6 +507,77 @@ namespace BasicTests {
         }
     };
 
+    namespace FlushNextTests {
+
+        /* records what flushNext() syncs; other tests' data files are mapped too */
+        class FakeFile : public MongoFile {
+            class Range : public Flushable {
+            public:
+                Range( FakeFile *f , long offset , long n ) : _f( f ) , _offset( offset ) , _n( n ) {}
+                void flush() {
+                    // mmmutex is released by now, so a file can be mapped meanwhile
+                    FakeFile other( 1 );
+                    ASSERT_EQUALS( _f->synced , (long long) _offset );
+                    ASSERT( _n <= Region );
+                    _f->synced += _n;
+                }
+            private:
+                FakeFile *_f;
+                long _offset, _n;
+            };
+        public:
+            FakeFile( long len ) : len( len ) , synced( 0 ) { created(); }
+            ~FakeFile() { destroyed(); }
+            virtual long length() { return len; }
+            long len;
+            long long synced;
+        protected:
+            virtual void close() {}
+            virtual void flush( bool sync ) {}
+            virtual Flushable * prepareFlush() { return 0; }
+            virtual Flushable * prepareFlushRange( long offset , long n ) {
+                return new Range( this , offset , n );
+            }
+        public:
+            enum { Region = 1024 * 1024 };
+        };
+
+        /* a pass covers every file once, a region at a time */
+        class Pass {
+        public:
+            void run() {
+                FakeFile a( 5 * FakeFile::Region / 2 ) , b( 100 );
+                MongoFile::FlushCursor pos;
+                long n;
+                while ( MongoFile::flushNext( pos , FakeFile::Region , n ) )
+                    ;
+                ASSERT_EQUALS( (long long) a.len , a.synced );
+                ASSERT_EQUALS( (long long) b.len , b.synced );
+                ASSERT( pos.file == 0 );
+            }
+        };
+
+        /* a file closed part way through is left behind */
+        class Closed {
+        public:
+            void run() {
+                FakeFile a( 100 );
+                FakeFile * b = new FakeFile( 3 * FakeFile::Region );
+                MongoFile::FlushCursor pos;
+                long n;
+                while ( MongoFile::flushNext( pos , FakeFile::Region , n ) ) {
+                    if ( b && pos.file == b ) {
+                        delete b;
+                        b = 0;
+                    }
+                }
+                ASSERT( b == 0 );
+                ASSERT_EQUALS( (long long) a.len , a.synced );
+            }
+        };
+
+    } // namespace FlushNextTests
+
 
 
     class All : public Suite {
@@ -470,6 +588,7 @@ namespace BasicTests {
         void setupTests(){
             add< Rarely >();
             add< Base64Tests >();
+            add< LZTests >();
             
             add< stringbuildertests::simple1 >();
             add< stringbuildertests::simple2 >();
@@ -488,6 +607,9 @@ namespace BasicTests {
 
             add< StringSplitterTest >();
             add< IsValidUTF8Test >();
+
+            add< FlushNextTests::Pass >();
+            add< FlushNextTests::Closed >();
         }
     } myall;
     
@@ -18,6 +18,7 @@
 #include "../client/dbclient.h"
 #include "dbtests.h"
 #include "../db/concurrency.h"
+#include "../db/aggregate.h"
 
 using namespace mongo;
 
@@ -84,6 +85,135 @@ namespace CommandTests {
         };
     }
 
+    namespace Aggregate {
+        struct Base {
+            Base(){
+                db.dropCollection(ns());
+                for ( int i = 0; i < 10; i++ )
+                    db.insert(ns(), BSON( "a" << i % 2 << "x" << i ));
+            }
+            ~Base(){
+                db.dropCollection(ns());
+            }
+
+            const char* ns() { return "test.aggregate"; }
+
+            BSONObj fields() {
+                return BSON( "total" << BSON( "$sum" << "x" ) << "avg" << BSON( "$avg" << "x" ) <<
+                             "n" << BSON( "$count" << 1 ) << "lo" << BSON( "$min" << "x" ) <<
+                             "hi" << BSON( "$max" << "x" ) << "all" << BSON( "$push" << "x" ) );
+            }
+
+            DBDirectClient db;
+        };
+        struct Basic : Base {
+            void run(){
+                BSONObj result;
+                ASSERT( db.runCommand("test", BSON( "aggregate" << "aggregate" << "key" << BSON( "a" << 1 ) <<
+                                                    "query" << BSON( "x" << GT << 1 ) << "fields" << fields() ), result) );
+                ASSERT_EQUALS( 8 , result["count"].numberInt() );
+                ASSERT_EQUALS( 2 , result["keys"].numberInt() );
+                BSONObj odd = result["retval"].embeddedObject()["1"].embeddedObject();
+                ASSERT_EQUALS( 1 , odd["a"].numberInt() );
+                ASSERT_EQUALS( 24 , odd["total"].numberInt() );
+                ASSERT_EQUALS( 6.0 , odd["avg"].number() );
+                ASSERT_EQUALS( 4 , odd["n"].numberInt() );
+                ASSERT_EQUALS( 3 , odd["lo"].numberInt() );
+                ASSERT_EQUALS( 9 , odd["hi"].numberInt() );
+                ASSERT_EQUALS( 4 , odd["all"].embeddedObject().nFields() );
+            }
+        };
+        struct BadSpec : Base {
+            void run(){
+                BSONObj result;
+                ASSERT( !db.runCommand("test", BSON( "aggregate" << "aggregate" << "fields" << BSON( "t" << BSON( "$bogus" << "x" ) ) ), result) );
+                ASSERT( !db.runCommand("test", BSON( "aggregate" << "aggregate" << "key" << BSON( "a" << 1 ) << "fields" << BSON( "a" << BSON( "$sum" << "x" ) ) ), result) );
+            }
+        };
+        /* what mongos does with the partial results of each shard */
+        struct MergePartial : Base {
+            void run(){
+                BSONObj lowRes, highRes;
+                BSONObj cmd = BSON( "aggregate" << "aggregate" << "fields" << fields() << "partial" << true );
+                ASSERT( db.runCommand("test", BSON( "aggregate" << "aggregate" << "query" << BSON( "x" << LT << 5 ) << "fields" << fields() << "partial" << true ), lowRes) );
+                ASSERT( db.runCommand("test", BSON( "aggregate" << "aggregate" << "query" << BSON( "x" << GTE << 5 ) << "fields" << fields() << "partial" << true ), highRes) );
+                Aggregator agg( cmd );
+                agg.merge( lowRes );
+                agg.merge( highRes );
+                BSONObjBuilder b;
+                agg.append( b , false );
+                BSONObj result = b.obj();
+                ASSERT_EQUALS( 10 , result["count"].numberInt() );
+                ASSERT_EQUALS( 1 , result["keys"].numberInt() );
+                BSONObj all = result["retval"].embeddedObject()["0"].embeddedObject();
+                ASSERT_EQUALS( 45 , all["total"].numberInt() );
+                ASSERT_EQUALS( 4.5 , all["avg"].number() );
+                ASSERT_EQUALS( 10 , all["n"].numberInt() );
+                ASSERT_EQUALS( 0 , all["lo"].numberInt() );
+                ASSERT_EQUALS( 9 , all["hi"].numberInt() );
+                ASSERT_EQUALS( 10 , all["all"].embeddedObject().nFields() );
+            }
+        };
+    }
+
+    namespace CreateIndexes {
+        struct Base {
+            Base(){
+                db.dropCollection(ns());
+                for ( int i = 0; i < 100; i++ )
+                    db.insert(ns(), BSON( "a" << i << "b" << BSON_ARRAY( i << i + 1 ) << "c" << i % 3 ));
+            }
+            ~Base(){
+                db.dropCollection(ns());
+            }
+
+            const char* ns() { return "test.createindexes"; }
+
+            BSONObj index( const char * name , const BSONObj& key , bool unique = false ) {
+                return BSON( "key" << key << "name" << name << "unique" << unique );
+            }
+
+            DBDirectClient db;
+        };
+        struct Several : Base {
+            void run(){
+                BSONObj result;
+                ASSERT( db.runCommand("test", BSON( "createIndexes" << "createindexes" << "indexes" <<
+                                                    BSON_ARRAY( index( "a_1" , BSON( "a" << 1 ) , true ) <<
+                                                                index( "b_1" , BSON( "b" << 1 ) ) <<
+                                                                index( "c_1_a_-1" , BSON( "c" << 1 << "a" << -1 ) ) ) ), result) );
+                ASSERT_EQUALS( 3 , result["created"].numberInt() );
+                ASSERT_EQUALS( 4 , result["numIndexesAfter"].numberInt() );
+
+                ASSERT_EQUALS( 1U , db.count( ns() , BSON( "a" << 50 ) ) );
+                ASSERT_EQUALS( 2U , db.count( ns() , BSON( "b" << 50 ) ) );
+                ASSERT( db.findOne( ns() , Query( BSON( "b" << 100 ) ).hint( BSON( "b" << 1 ) ) )["a"].numberInt() == 99 );
+                ASSERT_EQUALS( 33U , db.count( ns() , BSON( "c" << 1 ) ) );
+
+                // existing ones are skipped
+                ASSERT( db.runCommand("test", BSON( "createIndexes" << "createindexes" << "indexes" <<
+                                                    BSON_ARRAY( index( "a_1" , BSON( "a" << 1 ) , true ) ) ), result) );
+                ASSERT_EQUALS( 0 , result["created"].numberInt() );
+            }
+        };
+        /* a failure in one index rolls back all of the batch */
+        struct DupKey : Base {
+            void run(){
+                BSONObj result;
+                ASSERT( !db.runCommand("test", BSON( "createIndexes" << "createindexes" << "indexes" <<
+                                                     BSON_ARRAY( index( "a_1" , BSON( "a" << 1 ) ) <<
+                                                                 index( "c_1" , BSON( "c" << 1 ) , true ) ) ), result) );
+                auto_ptr<DBClientCursor> c = db.getIndexes( ns() );
+                int n = 0;
+                while ( c->more() ) {
+                    c->next();
+                    n++;
+                }
+                ASSERT_EQUALS( 1 , n );
+            }
+        };
+    }
+
     class All : public Suite {
     public:
         All() : Suite( "commands" ){
@@ -92,6 +222,11 @@ namespace CommandTests {
         void setupTests(){
             add< FileMD5::Type0 >();
             add< FileMD5::Type2 >();
+            add< Aggregate::Basic >();
+            add< Aggregate::BadSpec >();
+            add< Aggregate::MergePartial >();
+            add< CreateIndexes::Several >();
+            add< CreateIndexes::DupKey >();
         }
         
     } all;
@@ -1223,6 +1223,38 @@ namespace JsobjTests {
             }
         };
 
+        class Background {
+        public:
+            void run(){
+                const int total = 20000;
+                BSONObjExternalSorter sorter( BSONObj() , 20000 );
+                sorter.sortInBackground( 3 );
+                for ( int i=0; i<total; i++ ){
+                    sorter.add( BSON( "x" << rand() % 10000 ) , 5  , i );
+                }
+
+                sorter.sort();
+                ASSERT( sorter.numFiles() > 2 );
+
+                auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator( true );
+                int num=0;
+                double prev = 0;
+                while ( i->more() ){
+                    pair<BSONObj,DiskLoc> p = i->next();
+                    num++;
+                    double cur = p.first["x"].number();
+                    ASSERT( cur >= prev );
+                    prev = cur;
+                }
+                ASSERT_EQUALS( total , num );
+
+                // abandoning a read ahead iterator part way must not hang
+                auto_ptr<BSONObjExternalSorter::Iterator> j = sorter.iterator( true );
+                ASSERT( j->more() );
+                j->next();
+            }
+        };
+
         class D1 {
         public:
             void run(){
@@ -1724,6 +1756,7 @@ namespace JsobjTests {
             add< external_sort::ByDiskLock >();
             add< external_sort::Big1 >();
             add< external_sort::Big2 >();
+            add< external_sort::Background >();
             add< external_sort::D1 >();
             add< CompatBSON >();
             add< CompareDottedFieldNamesTest >();
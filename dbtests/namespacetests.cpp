@@ -795,6 +795,74 @@ namespace NamespaceTests {
             }
         };
 
+        class PowerOf2Base : public Base {
+        protected:
+            virtual string spec() const {
+                return "{\"usePowerOf2Sizes\":true,\"size\":8192,\"$nExtents\":1}";
+            }
+            DiskLoc insert( int n ) {
+                BSONObj o = BSON( "a" << string( n, 'a' ) );
+                DiskLoc loc = theDataFileMgr.insert( ns(), o.objdata(), o.objsize() );
+                ASSERT( !loc.isNull() );
+                return loc;
+            }
+            void remove( const DiskLoc& loc ) {
+                theDataFileMgr.deleteRecord( ns(), loc.rec(), loc );
+            }
+        };
+
+        /* records get the whole size class, so a freed one fits the next record of its class */
+        class PowerOf2Sizes : public PowerOf2Base {
+        public:
+            void run() {
+                create();
+                ASSERT( nsd()->usePowerOf2Sizes() );
+                DiskLoc a = insert( 40 );
+                ASSERT_EQUALS( 128, a.rec()->lengthWithHeaders );
+                DiskLoc b = insert( 150 );
+                ASSERT_EQUALS( 256, b.rec()->lengthWithHeaders );
+                remove( a );
+                ASSERT( insert( 60 ) == a );
+                ASSERT_EQUALS( 1, nExtents() );
+            }
+        };
+
+        class CoalesceDeleted : public PowerOf2Base {
+        public:
+            void run() {
+                create();
+                DiskLoc l[ 3 ];
+                for ( int i = 0; i < 3; i++ )
+                    l[ i ] = insert( 40 );
+                remove( l[ 0 ] );
+                remove( l[ 1 ] );
+                ASSERT( nsd()->coalesceDeleted() );
+                ASSERT( !nsd()->coalesceDeleted() );
+                ASSERT_EQUALS( 256, l[ 0 ].drec()->lengthWithHeaders );
+                // an exact fit in its class, ahead of the rest of the extent
+                ASSERT( insert( 150 ) == l[ 0 ] );
+                ASSERT_EQUALS( 1, nExtents() );
+            }
+        };
+
+        class FreeSpaceStats : public PowerOf2Base {
+        public:
+            void run() {
+                create();
+                DiskLoc a = insert( 40 );
+                insert( 40 );
+                remove( a );
+                BSONObjBuilder b;
+                nsd()->appendFreeSpaceStats( b, 1, true );
+                BSONObj f = b.obj()[ "freeSpace" ].embeddedObject();
+                ASSERT_EQUALS( 2, f[ "records" ].numberInt() ); // a, and the rest of the extent
+                ASSERT_EQUALS( 1, f[ "byClass" ].embeddedObject()[ NamespaceDetails::bucket( 128 ) ].numberInt() );
+                BSONObj e = f[ "byExtent" ].embeddedObject()[ "0" ].embeddedObject();
+                ASSERT_EQUALS( f[ "size" ].numberLong(), e[ "free" ].numberLong() );
+                ASSERT_EQUALS( 2, e[ "freeRecords" ].numberInt() );
+            }
+        };
+
         // This isn't a particularly useful test, and because it doesn't clean up
         // after itself, /tmp/unittest needs to be cleared after running.
         //        class BigCollection : public Base {
@@ -856,6 +924,9 @@ namespace NamespaceTests {
             add< NamespaceDetailsTests::TwoExtent >();
             add< NamespaceDetailsTests::TruncateCapped >();
             add< NamespaceDetailsTests::Migrate >();
+            add< NamespaceDetailsTests::PowerOf2Sizes >();
+            add< NamespaceDetailsTests::CoalesceDeleted >();
+            add< NamespaceDetailsTests::FreeSpaceStats >();
             //            add< NamespaceDetailsTests::BigCollection >();
             add< NamespaceDetailsTests::Size >();
         }
@@ -22,6 +22,8 @@
 
 #include "../db/db.h"
 #include "../db/json.h"
+#include "../db/dbhelpers.h"
+#include "../util/file.h"
 
 #include "dbtests.h"
 
@@ -300,7 +302,192 @@ namespace PdfileTests {
                 ASSERT( 0 != o.getField( "a" ).date() );
             }
         };
+
+        class TouchRecord : public Base {
+        public:
+            void run() {
+                BSONObj o = BSON( "a" << 1 );
+                DiskLoc loc = theDataFileMgr.insertWithObjMod( ns(), o );
+                Record *r = loc.rec();
+                r->touch();
+                ASSERT( r->likelyInPhysicalMemory() );
+                ASSERT( MongoFile::touch( (const char*) r , Record::HeaderSize ) );
+                char notMapped[ 16 ];
+                ASSERT( !MongoFile::touch( notMapped , sizeof( notMapped ) ) );
+            }
+        };
+
+        class Batch : public Base {
+        public:
+            void run() {
+                BSONObj idx = BSON( "ns" << ns() << "key" << BSON( "a" << 1 ) << "name" << "a_1" << "unique" << true );
+                theDataFileMgr.insertWithObjMod( "unittests.system.indexes" , idx );
+
+                vector<BSONObj> objs;
+                for ( int i = 99; i >= 0; --i )
+                    objs.push_back( BSON( "_id" << i << "a" << i << "b" << BSON_ARRAY( i << -i ) ) );
+                objs.push_back( BSON( "_id" << 100 << "a" << 5 ) ); // dup in a_1
+                ASSERT_EQUALS( 100 , theDataFileMgr.insertBatch( ns() , objs , false ) );
+                ASSERT_EQUALS( 100 , nsd()->nrecords );
+
+                BSONObj res;
+                ASSERT( Helpers::findOne( ns() , BSON( "a" << 5 ) , res , true ) );
+                ASSERT_EQUALS( 5 , res["_id"].numberInt() );
+                ASSERT( !Helpers::findOne( ns() , BSON( "_id" << 100 ) , res , true ) );
+                ASSERT( Helpers::findOne( ns() , BSON( "_id" << 42 ) , res , true ) );
+            }
+        };
+
+        class BatchFails : public Base {
+        public:
+            void run() {
+                BSONObj idx = BSON( "ns" << ns() << "key" << BSON( "a" << 1 ) << "name" << "a_1" );
+                theDataFileMgr.insertWithObjMod( "unittests.system.indexes" , idx );
+
+                vector<BSONObj> objs;
+                for ( int i = 0; i < 10; ++i )
+                    objs.push_back( BSON( "_id" << i << "a" << i ) );
+                objs.push_back( BSON( "_id" << BSON_ARRAY( 10 ) << "a" << 10 ) ); // refused by insert()
+                ASSERT_EXCEPTION( theDataFileMgr.insertBatch( ns() , objs , false ) , UserException );
+
+                // nothing of the batch is left, so the collection and its indexes agree
+                ASSERT_EQUALS( 0 , nsd()->nrecords );
+                BSONObj res;
+                ASSERT( !Helpers::findOne( ns() , BSON( "a" << 5 ) , res , true ) );
+                ASSERT( !Helpers::findOne( ns() , BSON( "_id" << 5 ) , res , true ) );
+            }
+        };
+
+        class CappedNotify : public Base {
+        public:
+            void run() {
+                string err;
+                ASSERT( userCreateNS( ns(), fromjson( "{capped:true,size:2000}" ), err, false ) );
+                unsigned long long v = cappedInsertNotifier.getVersion( ns() );
+                ASSERT( !cappedInsertNotifier.waitForInsert( ns() , v , 1 ) );
+                BSONObj o = BSON( "a" << 1 );
+                theDataFileMgr.insertWithObjMod( ns(), o );
+                ASSERT( cappedInsertNotifier.waitForInsert( ns() , v , 1000 ) );
+                ASSERT( cappedInsertNotifier.getVersion( ns() ) != v );
+            }
+        };
     } // namespace Insert
+
+    namespace Journal {
+        class Base {
+        public:
+            Base() : _context( ns() ) , _journal( cmdLine.journal ) {
+                cmdLine.journal = true;
+            }
+            virtual ~Base() {
+                cmdLine.journal = _journal;
+                if ( !nsdetails( ns() ) )
+                    return;
+                string n( ns() );
+                dropNS( n );
+            }
+        protected:
+            static const char *ns() {
+                return "unittests.pdfiletests.Journal";
+            }
+            static Record *insert( const BSONObj& o ) {
+                BSONObj x = o;
+                return theDataFileMgr.insertWithObjMod( ns(), x ).rec();
+            }
+            /* a crash that left these bytes of the data file undone */
+            static void lose( Record *r , vector<char>& saved ) {
+                saved.assign( r->data , r->data + r->netLength() );
+                memset( r->data , 0 , r->netLength() );
+            }
+        private:
+            dblock lk_;
+            Client::Context _context;
+            bool _journal;
+        };
+
+        class RecoverInsert : public Base {
+        public:
+            void run() {
+                BSONObj o = BSON( "_id" << 1 << "a" << "journaled" );
+                Record *r = insert( o );
+                dur::_groupCommit();
+                vector<char> saved;
+                lose( r , saved );
+                dur::_recover();
+                ASSERT_EQUALS( o , BSONObj( r ) );
+            }
+        };
+
+        /* a commit that didn't make it to disk whole is not replayed, nor anything after it */
+        class TornCommit : public Base {
+        public:
+            void run() {
+                BSONObj a = BSON( "_id" << 1 );
+                BSONObj b = BSON( "_id" << 2 );
+                Record *ra = insert( a );
+                dur::_groupCommit();
+                Record *rb = insert( b );
+                dur::_groupCommit();
+
+                string name = ( boost::filesystem::path( dbpath ) / "journal" / "j._0" ).string();
+                {
+                    File f;
+                    f.open( name.c_str() );
+                    ASSERT( f.is_open() );
+                    char c;
+                    f.read( f.len() - 1 , &c , 1 );
+                    c = ~c;
+                    f.write( f.len() - 1 , &c , 1 );
+                }
+
+                vector<char> savedA, savedB;
+                lose( ra , savedA );
+                lose( rb , savedB );
+                dur::_recover();
+                ASSERT_EQUALS( a , BSONObj( ra ) );
+                ASSERT_EQUALS( 0 , rb->data[0] );
+                memcpy( rb->data , &savedB[0] , savedB.size() );
+            }
+        };
+
+        /* with private views a write gets to the file only once it's journaled */
+        class PrivateView : public Base {
+        public:
+            PrivateView() : _name( ( boost::filesystem::path( dbpath ) / "_privateview" ).string() ) {
+                vector<char> zeros( 4096 );
+                File f;
+                f.open( _name.c_str() );
+                f.write( 0 , &zeros[0] , zeros.size() );
+                MongoFile::usePrivateViews();
+            }
+            ~PrivateView() {
+                MongoFile::usePrivateViews( false );
+                boost::filesystem::remove( _name );
+            }
+            void run() {
+                MemoryMappedFile f;
+                long len = 4096;
+                char *p = (char *) f.map( _name.c_str() , len );
+                ASSERT( p );
+                dur::declareWriteIntent( p , 6 );
+                strcpy( p , "hello" );
+                ASSERT_EQUALS( 0 , inFile() );
+                dur::_groupCommit();
+                ASSERT_EQUALS( 'h' , inFile() );
+                ASSERT( MongoFile::remapPrivateViews() );
+                ASSERT_EQUALS( string( "hello" ) , p );
+            }
+        private:
+            char inFile() {
+                File f;
+                f.open( _name.c_str() , true );
+                char c = 1;
+                f.read( 0 , &c , 1 );
+                return c;
+            }
+            string _name;
+        };
+    } // namespace Journal
     
     class All : public Suite {
     public:
@@ -321,6 +508,13 @@ namespace PdfileTests {
             add< ScanCapped::FirstInExtent >();
             add< ScanCapped::LastInExtent >();
             add< Insert::UpdateDate >();
+            add< Insert::TouchRecord >();
+            add< Insert::Batch >();
+            add< Insert::BatchFails >();
+            add< Insert::CappedNotify >();
+            add< Journal::RecoverInsert >();
+            add< Journal::TornCommit >();
+            add< Journal::PrivateView >();
         }
     } myall;
 
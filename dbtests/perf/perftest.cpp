@@ -24,6 +24,8 @@
 #include "../../db/query.h"
 #include "../../db/queryoptimizer.h"
 #include "../../util/file_allocator.h"
+#include "../../util/message_server.h"
+#include "../../s/chunk.h"
 
 #include "../framework.h"
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -612,6 +614,84 @@ namespace Count {
 
 } // namespace Count
 
+namespace Compressed {
+
+    // an order with line items: the field names and most values repeat within the record
+    BSONObj order( int i ) {
+        BSONArrayBuilder items;
+        for( int j = 0; j < 6; ++j )
+            items.append( BSON( "sku" << 1000 + j << "qty" << i % 7 + j << "price" << 9.99 <<
+                                "desc" << "standard widget, boxed" << "status" << "shipped" ) );
+        return BSON( "_id" << i << "customer" << i % 1000 << "name" << "customer name" <<
+                     "status" << "shipped" << "items" << items.arr() );
+    }
+
+    // full scans, compared across the record layouts: the query matches nothing, so every record is read
+    class Base {
+    public:
+        Base( const string &ns, bool compress ) : ns_( ns ) {
+            if ( compress ) {
+                BSONObj info;
+                ASSERT( client_->runCommand( nsToDatabase( ns_ ), BSON( "create" << "perftest" << "compressRecords" << true ), info ) );
+            }
+            for( int i = 0; i < 100000; ++i )
+                client_->insert( ns_.c_str(), order( i ) );
+        }
+        void run() {
+            for( int i = 0; i < 5; ++i )
+                client_->findOne( ns_.c_str(), QUERY( "status" << "lost" ) );
+        }
+        string ns_;
+    };
+
+    class ScanUncompressed : public Base {
+    public:
+        ScanUncompressed() : Base( testNs( this ), false ) {}
+    };
+
+    class ScanCompressed : public Base {
+    public:
+        ScanCompressed() : Base( testNs( this ), true ) {}
+    };
+
+    // every record returned, so decompressed and sent
+    class GetAll : public Base {
+    public:
+        GetAll( const string &ns, bool compress ) : Base( ns, compress ) {}
+        void run() {
+            auto_ptr< DBClientCursor > c = client_->query( ns_.c_str(), BSONObj() );
+            int n = 0;
+            while( c->more() ) {
+                c->next();
+                ++n;
+            }
+            ASSERT_EQUALS( 100000, n );
+        }
+    };
+
+    class GetAllUncompressed : public GetAll {
+    public:
+        GetAllUncompressed() : GetAll( testNs( this ), false ) {}
+    };
+
+    class GetAllCompressed : public GetAll {
+    public:
+        GetAllCompressed() : GetAll( testNs( this ), true ) {}
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "compressed" ){}
+        void setupTests(){
+            add< ScanUncompressed >();
+            add< ScanCompressed >();
+            add< GetAllUncompressed >();
+            add< GetAllCompressed >();
+        }
+    } all;
+
+} // namespace Compressed
+
 namespace Plan {
 
     class Hint {
@@ -687,6 +767,218 @@ namespace Plan {
 
 } // namespace Plan
 
+namespace Connections {
+
+    // answers every message with a tiny reply, so all we time is the network layer
+    class EchoHandler : public MessageHandler {
+    public:
+        virtual void process( Message& m , AbstractMessagingPort* p ) {
+            Message reply;
+            reply.setData( opReply , "pong" );
+            p->reply( m , reply );
+        }
+        virtual void disconnected( AbstractMessagingPort* p ) {}
+    };
+
+    // one server per configuration, left running for the rest of the process
+    void startServer( int port , int workers ) {
+        static set< int > started;
+        if ( !started.insert( port ).second )
+            return;
+        static EchoHandler handler;
+        MessageServer::Options opts;
+        opts.port = port;
+        opts.ipList = "127.0.0.1";
+        opts.workers = workers;
+        MessageServer *server = createServer( opts , &handler );
+        boost::thread thr( boost::bind( &MessageServer::run , server ) );
+
+        MessagingPort p;
+        SockAddr addr( "127.0.0.1" , port );
+        for( int i = 0; i < 100 && !p.connect( addr ); ++i )
+            sleepmillis( 50 );
+    }
+
+    /* Conns connections driven by ClientThreads client threads, each doing round trips on
+       its connections in turn.  the total number of round trips is fixed so times compare 
+       across connection counts. */
+    template< int Workers , int Conns >
+    class Base {
+    public:
+        virtual ~Base() {
+            for( unsigned i = 0; i < _ports.size(); ++i )
+                delete _ports[ i ];
+        }
+        void run() {
+            boost::thread_group clients;
+            for( int i = 0; i < ClientThreads; ++i )
+                clients.create_thread( boost::bind( &Base::client , this , i ) );
+            clients.join_all();
+            ASSERT_EQUALS( TotalCalls / ClientThreads * ClientThreads , _calls );
+        }
+        Base() : _calls( 0 ) {
+            startServer( port() , Workers );
+            SockAddr addr( "127.0.0.1" , port() );
+            for( int i = 0; i < Conns; ++i ) {
+                MessagingPort *p = new MessagingPort();
+                ASSERT( p->connect( addr ) );
+                _ports.push_back( p );
+            }
+        }
+    private:
+        enum { ClientThreads = 8 , TotalCalls = 40000 };
+        static int port() { return 27950 + Workers; }
+        void client( int which ) {
+            int mine = 0;
+            for( int i = which; i < Conns; i += ClientThreads )
+                ++mine;
+            if ( mine == 0 )
+                return;
+            int calls = TotalCalls / ClientThreads;
+            for( int i = 0; i < calls; ++i ) {
+                MessagingPort *p = _ports[ which + ( i % mine ) * ClientThreads ];
+                Message toSend;
+                toSend.setData( dbMsg , "ping" );
+                Message response;
+                ASSERT( p->call( toSend , response ) );
+                _calls++;
+            }
+        }
+        vector< MessagingPort* > _ports;
+        AtomicUInt _calls;
+    };
+
+    // a thread per connection
+    class Threads50 : public Base< 0 , 50 > {};
+    class Threads400 : public Base< 0 , 400 > {};
+    // epoll + a pool of 8 workers
+    class Pool50 : public Base< 8 , 50 > {};
+    class Pool400 : public Base< 8 , 400 > {};
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "connections" ){}
+        void setupTests(){
+            add< Threads50 >();
+            add< Threads400 >();
+            add< Pool50 >();
+            add< Pool400 >();
+        }
+    } all;
+
+} // namespace Connections
+
+namespace Routing {
+
+    /* how fast mongos can route documents to chunks: 10000 chunks, a million lookups */
+    class Base {
+    public:
+        Base( const BSONObj& key ) : _key( key ) {}
+        virtual ~Base() {}
+        void run() {
+            int found = 0;
+            for( int i = 0; i < Lookups; ++i )
+                found += lookup( _docs[ i % _docs.size() ] );
+            ASSERT_EQUALS( (int)Lookups , found );
+        }
+    protected:
+        enum { Chunks = 10000 , Lookups = 1000000 };
+        void split( const vector< BSONObj >& points ) {
+            Shard s( "shard0" , "localhost:30000" );
+            BSONObj min = _key.globalMin();
+            for( unsigned i = 0; i <= points.size(); ++i ) {
+                BSONObj max = i < points.size() ? points[ i ] : _key.globalMax();
+                _chunks[ max ] = ChunkPtr( new Chunk( 0 , min , max , s ) );
+                min = max;
+            }
+            _table.build( _key , _chunks );
+        }
+        virtual int lookup( const BSONObj& doc ) {
+            return _table.find( doc ) ? 1 : 0;
+        }
+        ShardKeyPattern _key;
+        ChunkMap _chunks;
+        ChunkRoutingTable _table;
+        vector< BSONObj > _docs;
+    };
+
+    class Numbers : public Base {
+    public:
+        Numbers() : Base( BSON( "a" << 1 ) ) {
+            vector< BSONObj > points;
+            for( int i = 1; i < Chunks; ++i )
+                points.push_back( BSON( "a" << i * 100 ) );
+            split( points );
+            for( int i = 0; i < 10007; ++i )
+                _docs.push_back( BSON( "_id" << i << "a" << ( i * 7919 ) % ( Chunks * 100 ) << "b" << "foo" ) );
+        }
+    };
+
+    // what findChunk did before: extract the key and search the chunk map
+    class NumbersMap : public Numbers {
+        virtual int lookup( const BSONObj& doc ) {
+            return _chunks.upper_bound( _key.extractKey( doc ) ) != _chunks.end() ? 1 : 0;
+        }
+    };
+
+    class ObjectIds : public Base {
+    public:
+        ObjectIds() : Base( BSON( "_id" << 1 ) ) {
+            vector< OID > ids;
+            for( int i = 0; i < Chunks * 2; ++i ) {
+                OID o;
+                o.init();
+                ids.push_back( o );
+            }
+            sort( ids.begin() , ids.end() );
+            vector< BSONObj > points;
+            for( int i = 2; i < Chunks * 2; i += 2 )
+                points.push_back( BSON( "_id" << ids[ i ] ) );
+            split( points );
+            for( unsigned i = 0; i < ids.size(); i += 2 )
+                _docs.push_back( BSON( "_id" << ids[ ( i * 7919 ) % ids.size() ] << "b" << "foo" ) );
+        }
+    };
+
+    class ObjectIdsMap : public ObjectIds {
+        virtual int lookup( const BSONObj& doc ) {
+            return _chunks.upper_bound( _key.extractKey( doc ) ) != _chunks.end() ? 1 : 0;
+        }
+    };
+
+    class Compound : public Base {
+    public:
+        Compound() : Base( BSON( "a" << 1 << "b" << 1 ) ) {
+            vector< BSONObj > points;
+            for( int i = 1; i < Chunks; ++i )
+                points.push_back( BSON( "a" << i / 10 << "b" << i % 10 ) );
+            split( points );
+            for( int i = 0; i < 10007; ++i )
+                _docs.push_back( BSON( "_id" << i << "a" << ( i * 7919 ) % Chunks / 10 << "b" << i % 10 ) );
+        }
+    };
+
+    class CompoundMap : public Compound {
+        virtual int lookup( const BSONObj& doc ) {
+            return _chunks.upper_bound( _key.extractKey( doc ) ) != _chunks.end() ? 1 : 0;
+        }
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "routing" ){}
+        void setupTests(){
+            add< Numbers >();
+            add< NumbersMap >();
+            add< ObjectIds >();
+            add< ObjectIdsMap >();
+            add< Compound >();
+            add< CompoundMap >();
+        }
+    } all;
+
+} // namespace Routing
+
 int main( int argc, char **argv ) {
     logLevel = -1;
     client_ = new DBDirectClient();
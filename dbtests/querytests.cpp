@@ -1061,6 +1061,86 @@ namespace QueryTests {
         }
     };
     
+    class SortWithLimit : public CollectionBase {
+    public:
+        SortWithLimit() : CollectionBase( "sortwithlimit" ){}
+        void run(){
+            for( int i = 0; i < 1000; ++i )
+                insert( ns(), BSON( "_id" << i << "a" << ( i * 7 ) % 1000 ) );
+            auto_ptr< DBClientCursor > c = client().query( ns(), Query().sort( "a", -1 ), 5, 10 );
+            for( int i = 0; i < 5; ++i ) {
+                ASSERT( c->more() );
+                ASSERT_EQUALS( 989 - i, c->next()[ "a" ].numberInt() );
+            }
+            ASSERT( !c->more() );
+        }
+    };
+
+    class SortSpillsToDisk : public CollectionBase {
+    public:
+        SortSpillsToDisk() : CollectionBase( "sortspillstodisk" ), _oldSortMemMB( cmdLine.sortMemMB ){}
+        ~SortSpillsToDisk(){
+            cmdLine.sortMemMB = _oldSortMemMB;
+        }
+        void run(){
+            cmdLine.sortMemMB = 1;
+            string big( 1000, 'x' );
+            for( int i = 0; i < 3000; ++i )
+                insert( ns(), BSON( "a" << ( i * 7 ) % 3000 << "s" << big ) );
+            auto_ptr< DBClientCursor > c = client().query( ns(), Query().sort( "a" ) );
+            for( int i = 0; i < 3000; ++i ) {
+                ASSERT( c->more() );
+                ASSERT_EQUALS( i, c->next()[ "a" ].numberInt() );
+            }
+            ASSERT( !c->more() );
+            BSONObj explain = client().findOne( ns(), Query().sort( "a" ).explain() );
+            ASSERT( explain[ "scanAndOrderSpilled" ].trueValue() );
+        }
+    private:
+        int _oldSortMemMB;
+    };
+
+    class IndexOnly : public CollectionBase {
+    public:
+        IndexOnly() : CollectionBase( "indexonly" ){}
+        void run(){
+            for( int i = 0; i < 10; ++i )
+                insert( ns(), BSON( "a" << i << "b" << i * 2 ) );
+            client().ensureIndex( ns(), BSON( "a" << 1 ) );
+
+            BSONObj fields = BSON( "a" << 1 << "_id" << 0 );
+            auto_ptr< DBClientCursor > c = client().query( ns(), QUERY( "a" << GT << 5 ).hint( BSON( "a" << 1 ) ), 0, 0, &fields );
+            for( int i = 6; i < 10; ++i ) {
+                ASSERT( c->more() );
+                BSONObj o = c->next();
+                ASSERT_EQUALS( 1, o.nFields() );
+                ASSERT_EQUALS( i, o[ "a" ].numberInt() );
+            }
+            ASSERT( !c->more() );
+
+            BSONObj explain = client().findOne( ns(), QUERY( "a" << GT << 5 ).hint( BSON( "a" << 1 ) ).explain(), &fields );
+            ASSERT( explain[ "indexOnly" ].trueValue() );
+            ASSERT_EQUALS( 0, explain[ "nscannedObjects" ].numberInt() );
+
+            // _id and b aren't in the index
+            BSONObj withId = BSON( "a" << 1 );
+            explain = client().findOne( ns(), QUERY( "a" << GT << 5 ).hint( BSON( "a" << 1 ) ).explain(), &withId );
+            ASSERT( !explain[ "indexOnly" ].trueValue() );
+            BSONObj withB = BSON( "a" << 1 << "b" << 1 << "_id" << 0 );
+            explain = client().findOne( ns(), QUERY( "a" << GT << 5 ).hint( BSON( "a" << 1 ) ).explain(), &withB );
+            ASSERT( !explain[ "indexOnly" ].trueValue() );
+
+            // without a range ruling it out, a record missing a would come back from the key as a : null
+            insert( ns(), BSON( "b" << 100 ) );
+            explain = client().findOne( ns(), Query().hint( BSON( "a" << 1 ) ).explain(), &fields );
+            ASSERT( !explain[ "indexOnly" ].trueValue() );
+            c = client().query( ns(), Query().hint( BSON( "a" << 1 ) ), 0, 0, &fields );
+            BSONObj missing = c->next();
+            ASSERT_EQUALS( 0, missing.nFields() );
+            ASSERT_EQUALS( 10, c->itcount() );
+        }
+    };
+
     namespace parsedtests {
         class basic1 {
         public:
@@ -1176,6 +1256,9 @@ namespace QueryTests {
             add< FindingStart >();
             add< FindingStartPartiallyFull >();
             add< WhatsMyUri >();
+            add< SortWithLimit >();
+            add< SortSpillsToDisk >();
+            add< IndexOnly >();
             
             add< parsedtests::basic1 >();
             
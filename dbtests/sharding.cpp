@@ -21,6 +21,7 @@
 #include "dbtests.h"
 
 #include "../client/parallel.h"
+#include "../s/chunk.h"
 
 namespace ShardingTests {
 
@@ -43,6 +44,129 @@ namespace ShardingTests {
         };
     }
 
+    namespace routingtests {
+
+        /* chunks split at the given points, alternating between two shards */
+        class Base {
+        public:
+            Base( const BSONObj& key ) : _key( key ){}
+
+            void split( const vector<BSONObj>& points ){
+                Shard a( "shard0" , "localhost:30000" );
+                Shard b( "shard1" , "localhost:30001" );
+                BSONObj min = _key.globalMin();
+                for ( unsigned i=0; i<=points.size(); i++ ){
+                    BSONObj max = i < points.size() ? points[i] : _key.globalMax();
+                    ChunkPtr c( new Chunk( 0 , min , max , i % 2 ? b : a ) );
+                    _chunks[max] = c;
+                    min = max;
+                }
+                _table.build( _key , _chunks );
+            }
+
+            /* the table must agree with an upper_bound on the map */
+            void check( const BSONObj& doc ){
+                ChunkPtr c = _table.find( doc );
+                ChunkMap::iterator i = _chunks.upper_bound( _key.extractKey( doc ) );
+                ASSERT( i != _chunks.end() );
+                ASSERT( c );
+                ASSERT_EQUALS( i->second.get() , c.get() );
+            }
+
+            ShardKeyPattern _key;
+            ChunkMap _chunks;
+            ChunkRoutingTable _table;
+        };
+
+        class Numbers : public Base {
+        public:
+            Numbers() : Base( BSON( "x" << 1 ) ){}
+            void run(){
+                vector<BSONObj> points;
+                for ( int i=0; i<100; i++ )
+                    points.push_back( BSON( "x" << i * 10 ) );
+                split( points );
+                ASSERT_EQUALS( 101 , _table.size() );
+
+                for ( int i=-5; i<1005; i++ )
+                    check( BSON( "x" << i ) );
+                check( BSON( "x" << 25.5 ) );
+                check( BSON( "x" << 30LL ) );
+                check( BSON( "x" << -1e300 ) );
+                check( BSON( "x" << "a string sorts after numbers" ) );
+                check( _key.globalMin() );
+                check( BSON( "y" << 1 << "x" << 990 ) );
+            }
+        };
+
+        class ObjectIds : public Base {
+        public:
+            ObjectIds() : Base( BSON( "_id" << 1 ) ){}
+            void run(){
+                vector<OID> ids;
+                for ( int i=0; i<50; i++ ){
+                    OID o;
+                    o.init();
+                    ids.push_back( o );
+                }
+                sort( ids.begin() , ids.end() );
+
+                vector<BSONObj> points;
+                for ( unsigned i=0; i<ids.size(); i+=5 )
+                    points.push_back( BSON( "_id" << ids[i] ) );
+                split( points );
+
+                for ( unsigned i=0; i<ids.size(); i++ )
+                    check( BSON( "_id" << ids[i] ) );
+                check( BSON( "_id" << 5 ) );
+            }
+        };
+
+        class Compound : public Base {
+        public:
+            Compound() : Base( BSON( "a" << 1 << "b" << 1 ) ){}
+            void run(){
+                vector<BSONObj> points;
+                points.push_back( BSON( "a" << 1 << "b" << "m" ) );
+                {
+                    BSONObjBuilder b;
+                    b.append( "a" , 2 );
+                    b.appendMinKey( "b" );
+                    points.push_back( b.obj() );
+                }
+                points.push_back( BSON( "a" << "x" << "b" << 5 ) );
+                split( points );
+
+                check( BSON( "a" << 0 << "b" << "z" ) );
+                check( BSON( "a" << 1 << "b" << "a" ) );
+                check( BSON( "a" << 1 << "b" << "m" ) );
+                check( BSON( "a" << 2 << "b" << 0 ) );
+                check( BSON( "a" << "x" << "b" << 4 ) );
+                check( BSON( "a" << "x" << "b" << 5 ) );
+                check( BSON( "b" << 1 << "a" << "z" ) );
+
+                ASSERT( ! _table.find( BSON( "a" << 1 ) ) );
+            }
+        };
+
+        /* a string split point means numbers can't use the unpacked bounds */
+        class Mixed : public Base {
+        public:
+            Mixed() : Base( BSON( "x" << 1 ) ){}
+            void run(){
+                vector<BSONObj> points;
+                points.push_back( BSON( "x" << 10 ) );
+                points.push_back( BSON( "x" << "b" ) );
+                split( points );
+
+                check( BSON( "x" << 5 ) );
+                check( BSON( "x" << 15 ) );
+                check( BSON( "x" << "a" ) );
+                check( BSON( "x" << "c" ) );
+            }
+        };
+    }
+
     class All : public Suite {
     public:
         All() : Suite( "sharding" ){
@@ -50,6 +174,10 @@ namespace ShardingTests {
 
         void setupTests(){
             add< serverandquerytests::test1 >();
+            add< routingtests::Numbers >();
+            add< routingtests::ObjectIds >();
+            add< routingtests::Compound >();
+            add< routingtests::Mixed >();
         }
     } myall;
         
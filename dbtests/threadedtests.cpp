@@ -21,6 +21,8 @@
 #include "../bson/util/atomic_int.h"
 #include "../util/concurrency/mvar.h"
 #include "../util/concurrency/thread_pool.h"
+#include "../db/db.h"
+#include "../db/instance.h"
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
 
@@ -143,6 +145,95 @@ namespace ThreadedTests {
         }
     };
 
+    /**
+     * inserts from several threads, each into its own database, timed with the server wide
+     * lock and then with per database locks (--dblocks); then each into its own collection
+     * of one database, with database and with collection locks.  the speedup depends on the
+     * number of cores, so it is logged rather than asserted.
+     */
+    class DBLockScaling {
+        static const int nThreads = 4;
+        static const int nInserts = 5000;
+
+        static LockScope dbScope( const string& ns , bool write ){
+            return dbHolder.isLoaded( ns , dbpath ) ? ScopeDB : ScopeGlobal;
+        }
+
+        static LockScope collectionScope( const string& ns , bool write ){
+            Database * d = dbHolder.get( ns , dbpath );
+            if ( ! d )
+                return ScopeGlobal;
+            return d->namespaceIndex.details( ns.c_str() ) ? ScopeCollection : ScopeDB;
+        }
+
+        static string db( int i ){
+            stringstream ss;
+            ss << "unittests_dblocks" << i;
+            return ss.str();
+        }
+
+        static string ns( int i , bool oneDB ){
+            stringstream ss;
+            if ( oneDB )
+                ss << db( 0 ) << ".c" << i;
+            else
+                ss << db( i ) << ".c";
+            return ss.str();
+        }
+
+        void inserter( int i , bool oneDB ){
+            Client::initThread( "dblockscaling" );
+            {
+                DBDirectClient c;
+                string n = ns( i , oneDB );
+                for ( int j=0; j<nInserts; j++ )
+                    c.insert( n , BSON( "_id" << j << "s" << "abcdefghijklmnopqrstuvwxyz" ) );
+            }
+            cc().shutdown();
+        }
+
+        long long timed( LockScopeCheck check , bool oneDB ){
+            DBDirectClient c;
+            for ( int i=0; i<nThreads; i++ )
+                c.dropDatabase( db( i ) );
+            for ( int i=0; i<nThreads; i++ )
+                c.insert( ns( i , oneDB ) , BSON( "_id" << -1 ) ); // opens the db and creates the collection
+
+            dbMutex.enableDBLocks( check );
+            Timer t;
+            {
+                vector< shared_ptr< boost::thread > > threads;
+                for ( int i=0; i<nThreads; i++ )
+                    threads.push_back( shared_ptr< boost::thread >( new boost::thread( boost::bind( &DBLockScaling::inserter , this , i , oneDB ) ) ) );
+                for ( int i=0; i<nThreads; i++ )
+                    threads[i]->join();
+            }
+            long long ms = t.millis();
+            dbMutex.enableDBLocks( 0 );
+
+            for ( int i=0; i<nThreads; i++ )
+                ASSERT_EQUALS( (unsigned long long)( nInserts + 1 ) , c.count( ns( i , oneDB ) ) );
+            return ms;
+        }
+
+    public:
+        void run(){
+            long long global = timed( 0 , false );
+            long long perDB = timed( dbScope , false );
+            log() << "DBLockScaling " << nThreads << " threads x " << nInserts << " inserts, a db each: "
+                  << global << "ms with the server lock, " << perDB << "ms with database locks" << endl;
+
+            long long oneDB = timed( dbScope , true );
+            long long perCollection = timed( collectionScope , true );
+            log() << "DBLockScaling " << nThreads << " threads x " << nInserts << " inserts, a collection each: "
+                  << oneDB << "ms with the database lock, " << perCollection << "ms with collection locks" << endl;
+
+            DBDirectClient c;
+            for ( int i=0; i<nThreads; i++ )
+                c.dropDatabase( db( i ) );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "threading" ){
@@ -153,6 +244,7 @@ namespace ThreadedTests {
             add< MVarTest >();
             add< ThreadPoolTest >();
             add< LockTest >();
+            add< DBLockScaling >();
         }
     } myall;
 }
@@ -0,0 +1,31 @@
+// compact command
+
+t = db.jstests_compact;
+t.drop();
+
+t.ensureIndex( { a : 1 } );
+for( i = 0; i < 1000; ++i ) {
+    t.save( { _id : i, a : i, b : new Array( i % 100 + 1 ).toString() } );
+}
+t.remove( { _id : { $mod : [ 3, 0 ] } } );
+t.update( { _id : { $mod : [ 3, 1 ] } }, { $set : { b : new Array( 300 ).toString() } }, false, true );
+var before = t.stats();
+
+var res = db.runCommand( { compact : t.getName() } );
+assert.commandWorked( res );
+assert.eq( before.count, res.records );
+assert.eq( 2, res.nindexes );
+
+var after = t.stats();
+assert.eq( before.count, after.count );
+assert.eq( 2, after.nindexes );
+assert.lte( after.storageSize, before.storageSize );
+assert.eq( 1, t.find( { _id : 1 } ).itcount() );
+assert.eq( 0, t.find( { _id : 3 } ).itcount() );
+assert.eq( 1, t.find( { a : 2 } ).hint( { a : 1 } ).itcount() );
+assert( t.validate().valid );
+
+assert.commandFailed( db.runCommand( { compact : "jstests_compact_missing" } ) );
+db.createCollection( "jstests_compact_capped", { capped : true, size : 4096 } );
+assert.commandFailed( db.runCommand( { compact : "jstests_compact_capped" } ) );
+db.jstests_compact_capped.drop();
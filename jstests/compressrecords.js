@@ -0,0 +1,46 @@
+// { compressRecords : true } collections store records compressed, and read them back the same
+
+t = db.jstests_compressrecords;
+t.drop();
+u = db.jstests_compressrecords_plain;
+u.drop();
+
+db.createCollection( t.getName(), { compressRecords : true } );
+assert.eq( 4, t.stats().flags & 4, "flag" );
+t.ensureIndex( { a : 1 } );
+
+var big = new Array( 200 ).toString() + "abc";
+for( i = 0; i < 200; ++i ) {
+    var o = { _id : i, a : i, b : big, c : "x" };
+    t.save( o );
+    u.save( o );
+}
+assert.eq( 200, t.count() );
+assert.lt( t.stats().size, u.stats().size / 2, "not compressed" );
+
+assert.eq( big, t.findOne( { _id : 7 } ).b );
+assert.eq( 1, t.find( { a : 9 } ).hint( { a : 1 } ).itcount() );
+assert.eq( 200, t.find( { b : big } ).itcount() );
+
+// mods rewrite the record rather than change it in place
+t.update( { _id : 3 }, { $inc : { a : 1000 } } );
+assert.eq( 1003, t.findOne( { _id : 3 } ).a );
+assert.eq( 1, t.find( { a : 1003 } ).hint( { a : 1 } ).itcount() );
+t.update( {}, { $set : { c : "yy" } }, false, true );
+assert.eq( 200, t.find( { c : "yy" } ).itcount() );
+t.update( { _id : 5 }, { $set : { b : big + big + big } } );
+assert.eq( big + big + big, t.findOne( { _id : 5 } ).b );
+
+// too small to be worth compressing
+t.save( { _id : "small" } );
+assert.eq( "small", t.findOne( { _id : "small" } )._id );
+t.insert( { b : big, c : "noid" } );
+assert( t.findOne( { c : "noid" } )._id );
+
+assert( t.validate().valid );
+assert.commandWorked( db.runCommand( { compact : t.getName() } ) );
+assert.eq( 202, t.count() );
+assert.eq( 1003, t.findOne( { _id : 3 } ).a );
+
+assert.commandFailed( db.runCommand( { create : "jstests_compressrecords_capped", capped : true, size : 4096, compressRecords : true } ) );
+u.drop();
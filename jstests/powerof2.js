@@ -0,0 +1,26 @@
+// { usePowerOf2Sizes : true } collections reuse freed space by size class
+
+t = db.jstests_powerof2;
+t.drop();
+
+db.createCollection( t.getName(), { usePowerOf2Sizes : true } );
+assert.eq( 2, t.stats().flags & 2, "flag" );
+
+for( i = 0; i < 100; ++i ) {
+    t.save( { _id : i, a : new Array( 10 + i ).toString() } );
+}
+var s = db.runCommand( { collstats : t.getName(), verbose : true } );
+assert.eq( s.numExtents, s.freeSpace.byExtent.length );
+
+// churn in place of the deleted documents shouldn't grow the collection
+for( j = 0; j < 10; ++j ) {
+    t.remove( { _id : { $lt : 50 } } );
+    for( i = 0; i < 50; ++i ) {
+        t.save( { _id : i, a : new Array( 10 + ( i + j ) % 50 ).toString() } );
+    }
+}
+assert.eq( 100, t.count() );
+assert.lte( t.stats().storageSize, 2 * s.storageSize, "grew" );
+assert.lt( t.stats().freeSpace.ratio, 1 );
+
+assert.commandFailed( db.runCommand( { create : "jstests_powerof2_capped", capped : true, size : 4096, usePowerOf2Sizes : true } ) );
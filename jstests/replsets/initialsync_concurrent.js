@@ -0,0 +1,94 @@
+// initialsync_concurrent.js
+// a member added to a set clones the data while inserts, updates and deletes keep coming,
+// some to documents it is cloning, and ends up with what the primary has
+
+doTest = function( signal ) {
+
+    var replTest = new ReplSetTest( {name: 'initialSyncConcurrent', nodes: 1} );
+    var nodes = replTest.startSet();
+    replTest.initiate();
+    var master = replTest.getMaster();
+    var foo = master.getDB("foo");
+
+    // enough to take the new member a few seconds to clone, in collections with indexes
+    var N = 20000;
+    var pad = "";
+    while ( pad.length < 500 )
+        pad += "xxxxxxxxxx";
+    var colls = [ "a" , "b" , "c" ];
+    for ( var c=0; c<colls.length; c++ ) {
+        var coll = foo[colls[c]];
+        coll.ensureIndex( { x : 1 } );
+        for ( var i=0; i<N; i++ )
+            coll.insert( { _id : i , x : i % 100 , n : 0 , pad : pad } );
+    }
+    foo.c.ensureIndex( { x : 1 , _id : 1 } , { unique : true } );
+    var result = foo.runCommand( { getlasterror : 1 } );
+    assert( result['ok'] == 1 , "getlasterror failed" );
+
+    // writes all over the documents the new member is cloning, until told to stop
+    db = foo;
+    var join = startParallelShell(
+        "var foo = db.getSisterDB( 'foo' ); var N = " + N + "; var i = 0;" +
+        "while ( foo.done.count() == 0 ) {" +
+        "    var id = Math.floor( Math.random() * N );" +
+        "    foo.a.update( { _id : id } , { $inc : { n : 1 } , $set : { x : -1 } } );" +
+        "    foo.b.remove( { _id : id } );" +
+        "    foo.c.update( { _id : id } , { $set : { pad : 'moved' } } );" +
+        "    foo.b.insert( { _id : N + i , x : i % 100 , n : 0 } );" +
+        "    i++;" +
+        "    if ( i % 100 == 0 ) foo.getLastError();" +
+        "}" +
+        "foo.getLastError();" );
+
+    // add a second member
+    var second = replTest.add();
+    replTest.reInitiate();
+
+    // it reports its progress while it syncs
+    var admin = second.getDB("admin");
+    var progress = null;
+    assert.soon( function() {
+        var status = admin.runCommand( { replSetGetStatus : 1 } );
+        if ( status.initialSync )
+            progress = status.initialSync;
+        return progress != null;
+    } , "no initialSync in replSetGetStatus" , 60000 , 50 );
+    printjson( progress );
+    assert( progress.phase , "initialSync phase" );
+    assert.lte( colls.length , progress.collections , "collections to clone" );
+
+    // until it's done
+    assert.soon( function() {
+        var status = admin.runCommand( { replSetGetStatus : 1 } );
+        return status.myState == 2 && ! status.initialSync;
+    } , "second never became a secondary" , 300000 );
+
+    foo.done.insert( { _id : 1 } );
+    foo.getLastError();
+    join();
+
+    // then it has the same data and indexes as the primary
+    second.setSlaveOk();
+    var secondFoo = second.getDB("foo");
+    assert.soon( function() {
+        var a = foo.runCommand( "dbhash" );
+        var b = secondFoo.runCommand( "dbhash" );
+        if ( a.md5 == b.md5 )
+            return true;
+        printjson( a );
+        printjson( b );
+        return false;
+    } , "the secondary's data differs from the primary's" , 60000 );
+
+    for ( var c=0; c<colls.length; c++ ) {
+        assert.eq( foo[colls[c]].count() , secondFoo[colls[c]].count() , "count of " + colls[c] );
+        var want = foo[colls[c]].getIndexes().map( function( z ) { return tojson( z.key ) + " " + ( z.unique ? "u" : "" ); } ).sort();
+        var got = secondFoo[colls[c]].getIndexes().map( function( z ) { return tojson( z.key ) + " " + ( z.unique ? "u" : "" ); } ).sort();
+        assert.eq( tojson( want ) , tojson( got ) , "indexes of " + colls[c] );
+    }
+
+    replTest.stopSet( signal );
+}
+
+doTest( 15 );
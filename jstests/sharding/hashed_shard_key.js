@@ -0,0 +1,83 @@
+// hashed_shard_key.js
+// a collection sharded on { _id : "hashed" }: the pre-split, query routing, and moving a chunk
+
+s = new ShardingTest( "hashed_shard_key" , 2 , 0 , 1 );
+
+// take the balancer out of the equation
+s.config.settings.update( { _id: "balancer" }, { $set : { stopped: true } } , true );
+
+s.adminCommand( { enablesharding : "test" } );
+assert( s.admin.runCommand( { shardcollection : "test.data" , key : { _id : "hashed" } } ).ok , "shardcollection" );
+
+// an empty collection is split into 2 chunks per shard up front, alternating between the shards
+assert.eq( 4 , s.config.chunks.count( { ns : "test.data" } ) , "A1" );
+s.config.shards.find().forEach(
+    function( z ){
+        assert.eq( 2 , s.config.chunks.count( { ns : "test.data" , shard : z._id } ) , "A2 " + z._id );
+    }
+);
+
+db = s.getDB( "test" );
+
+N = 1000;
+for ( i=0; i<N; i++ )
+    db.data.insert( { _id : i , x : i % 10 } );
+db.getLastError();
+assert.eq( N , db.data.count() , "B1" );
+
+// direct counts on each shard
+function onShards(){
+    var a = [];
+    for ( var i=0; i<s._connections.length; i++ )
+        a.push( s._connections[i].getDB( "test" ).data.count() );
+    return a;
+}
+
+before = onShards();
+assert.eq( N , before[0] + before[1] , "B2" );
+// the hashes spread consecutive _ids over both shards
+assert.lt( N / 4 , before[0] , "B3" );
+assert.lt( N / 4 , before[1] , "B4" );
+
+// an equality goes to the one shard holding that hash, a range to all of them
+e = db.data.find( { _id : 17 } ).explain();
+assert.eq( 1 , e.numShards , "C1" );
+assert.eq( 1 , e.n , "C2" );
+e = db.data.find( { _id : { $in : [ 17 ] } } ).explain();
+assert.eq( 1 , e.numShards , "C3" );
+e = db.data.find( { _id : { $gte : 10 , $lt : 20 } } ).explain();
+assert.eq( 2 , e.numShards , "C4" );
+assert.eq( 10 , e.n , "C5" );
+e = db.data.find( { x : 3 } ).explain();
+assert.eq( 2 , e.numShards , "C6" );
+assert.eq( N / 10 , e.n , "C7" );
+
+for ( i=0; i<N; i+=37 )
+    assert.eq( i , db.data.findOne( { _id : i } )._id , "D1 " + i );
+assert.eq( 10 , db.data.find( { _id : { $gte : 10 , $lt : 20 } } ).itcount() , "D2" );
+
+// move the chunk holding _id 17.  its bounds are hashes, so the recipient has to hash each
+// document's _id to clone just that chunk
+e = db.data.find( { _id : 17 } ).explain();
+for ( name in e.shards )
+    fromIdx = name == s._connections[0].name ? 0 : 1;
+to = s.getOther( s._connections[fromIdx] );
+
+assert( s.admin.runCommand( { movechunk : "test.data" , find : { _id : 17 } , to : to.name } ).ok , "movechunk" );
+assert.eq( 4 , s.config.chunks.count( { ns : "test.data" } ) , "E1" );
+
+after = onShards();
+moved = before[fromIdx] - after[fromIdx];
+assert.lt( 0 , moved , "E2" );
+assert.eq( before[1-fromIdx] + moved , after[1-fromIdx] , "E3" );
+assert.eq( N , after[0] + after[1] , "E4" );
+assert.eq( N , db.data.count() , "E5" );
+assert.eq( N , db.data.find().itcount() , "E6" );
+
+e = db.data.find( { _id : 17 } ).explain();
+assert.eq( 1 , e.numShards , "F1" );
+assert( e.shards[ to.name ] , "F2" );
+for ( i=0; i<N; i+=37 )
+    assert.eq( i , db.data.findOne( { _id : i } )._id , "F3 " + i );
+
+s.stop();
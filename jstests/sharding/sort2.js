@@ -0,0 +1,67 @@
+// sort2.js
+// sorted queries with a limit, skip or small batches merged across shards
+
+s = new ShardingTest( "sort2" , 2 , 0 , 2 )
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.data" , key : { num : 1 } } );
+
+db = s.getDB( "test" );
+
+N = 1000;
+for ( i=0; i<N; i++ ){
+    // x runs the other way from num, so a sort on it interleaves the shards
+    db.data.insert( { _id : i , num : ( i * 7 ) % N , x : N - i } );
+}
+db.getLastError();
+
+s.adminCommand( { split : "test.data" , middle : { num : 333 } } )
+s.adminCommand( { split : "test.data" , middle : { num : 666 } } )
+s.adminCommand( { movechunk : "test.data" , find : { num : 500 } , to : s.getOther( s.getServer( "test" ) ).name } );
+assert.eq( 3 , s.config.chunks.find().itcount() , "A1" );
+
+function check( cursor , expected , msg ){
+    var a = cursor.toArray();
+    assert.eq( expected.length , a.length , msg + " length" );
+    for ( var i=0; i<a.length; i++ )
+        assert.eq( expected[i] , a[i].num , msg + " " + i );
+}
+
+function range( from , n , step ){
+    var a = [];
+    for ( var i=0; i<n; i++ )
+        a.push( from + i * step );
+    return a;
+}
+
+check( db.data.find().sort( { num : 1 } ).limit( 10 ) , range( 0 , 10 , 1 ) , "B1" );
+check( db.data.find().sort( { num : -1 } ).limit( 10 ) , range( N - 1 , 10 , -1 ) , "B2" );
+check( db.data.find().sort( { num : 1 } ).skip( 330 ).limit( 10 ) , range( 330 , 10 , 1 ) , "B3" );
+check( db.data.find().sort( { num : 1 } ).limit( -5 ) , range( 0 , 5 , 1 ) , "B4" );
+check( db.data.find().sort( { num : 1 } ).limit( 2 * N ) , range( 0 , N , 1 ) , "B5" );
+check( db.data.find( { num : { $gte : 600 } } ).sort( { num : 1 } ).limit( 100 ) , range( 600 , 100 , 1 ) , "B6" );
+
+// small batches, so the shards' cursors need getMores while merging
+check( db.data.find().sort( { num : 1 } ).batchSize( 7 ) , range( 0 , N , 1 ) , "C1" );
+check( db.data.find().sort( { num : -1 } ).skip( 10 ).batchSize( 3 ).limit( 500 ) , range( N - 11 , 500 , -1 ) , "C2" );
+
+// not on the shard key
+a = db.data.find().sort( { x : 1 } ).limit( 20 ).toArray();
+assert.eq( 20 , a.length , "D1" );
+for ( i=0; i<a.length; i++ )
+    assert.eq( i + 1 , a[i].x , "D2 " + i );
+
+a = db.data.find().sort( { x : -1 } ).skip( 5 ).batchSize( 4 ).toArray();
+assert.eq( N - 5 , a.length , "D3" );
+for ( i=1; i<a.length; i++ )
+    assert.gt( a[i-1].x , a[i].x , "D4 " + i );
+
+// abandoning a merge half way leaves mongos able to run the next one
+for ( i=0; i<20; i++ ){
+    c = db.data.find().sort( { num : 1 } ).batchSize( 5 );
+    for ( j=0; j<12; j++ )
+        c.next();
+}
+check( db.data.find().sort( { num : 1 } ).limit( 3 ) , range( 0 , 3 , 1 ) , "E1" );
+
+s.stop();
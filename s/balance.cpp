@@ -41,10 +41,46 @@ namespace mongo {
     }
 
     int Balancer::_moveChunks( const vector<CandidateChunkPtr>* candidateChunks ) {
-        int movedCount = 0;
+        AtomicUInt movedCount;
+
+        // a shard can only be in one migration at a time, either side. there is at most one 
+        // candidate per collection so those don't collide.
+        vector<CandidateChunkPtr> left = *candidateChunks;
+        while ( ! left.empty() ){
+            set<string> busy;
+            vector<CandidateChunkPtr> now;
+            vector<CandidateChunkPtr> later;
+            for ( vector<CandidateChunkPtr>::const_iterator it = left.begin(); it != left.end(); ++it ){
+                const CandidateChunk& chunkInfo = *it->get();
+                if ( busy.count( chunkInfo.from ) || busy.count( chunkInfo.to ) ){
+                    later.push_back( *it );
+                    continue;
+                }
+                busy.insert( chunkInfo.from );
+                busy.insert( chunkInfo.to );
+                now.push_back( *it );
+            }
 
-        for ( vector<CandidateChunkPtr>::const_iterator it = candidateChunks->begin(); it != candidateChunks->end(); ++it ){
-            const CandidateChunk& chunkInfo = *it->get();
+            if ( now.size() == 1 ){
+                _moveChunk( now[0] , &movedCount );
+            }
+            else {
+                log(1) << "moving " << now.size() << " chunks at once" << endl;
+                boost::thread_group threads;
+                for ( unsigned i=0; i<now.size(); i++ )
+                    threads.create_thread( boost::bind( &Balancer::_moveChunk , this , now[i] , &movedCount ) );
+                threads.join_all();
+            }
+
+            left.swap( later );
+        }
+
+        return movedCount;
+    }
+
+    void Balancer::_moveChunk( CandidateChunkPtr candidate , AtomicUInt* moved ){
+        try {
+            const CandidateChunk& chunkInfo = *candidate;
 
             DBConfigPtr cfg = grid.getDBConfig( chunkInfo.ns );
             assert( cfg );
@@ -63,21 +99,61 @@ namespace mongo {
                 if ( c->getMin().woCompare( chunkToMove["min"].Obj() ) ){
                     log() << "chunk mismatch after reload, ignoring will retry issue cm: " 
                           << c->getMin() << " min: " << chunkToMove["min"].Obj() << endl;
-                    continue;
+                    return;
                 }
             }
         
             string errmsg;
             if ( c->moveAndCommit( Shard::make( chunkInfo.to ) , errmsg ) ){
-                movedCount++;
-                continue;
+                (*moved)++;
+                return;
             }
 
             log() << "MOVE FAILED **** " << errmsg << "\n"
                   << "           from: " << chunkInfo.from << " to: " << chunkInfo.to << " chunk: " << chunkToMove << endl;
         }
+        catch ( std::exception& e ){
+            log() << "MOVE FAILED **** " << e.what() << " chunk: " << candidate->chunk << endl;
+        }
+    }
 
-        return movedCount;
+    double Balancer::_opsPerSec( const string& shard , const string& ns , long long ops ){
+        const string key = shard + " " + ns;
+        long long now = jsTime();
+        map< string , pair<long long,long long> >::iterator i = _lastOps.find( key );
+        double rate = -1;
+        if ( i != _lastOps.end() && now > i->second.second && ops >= i->second.first )
+            rate = ( ops - i->second.first ) * 1000.0 / ( now - i->second.second );
+        _lastOps[key] = make_pair( ops , now );
+        return rate;
+    }
+
+    /* bytes of ns on shard s, 0 if it has none */
+    static long long collectionSize( const Shard& s , const string& ns ){
+        string::size_type dot = ns.find( '.' );
+        BSONObj res;
+        ScopedDbConnection conn( s.getConnString() );
+        bool ok = conn->runCommand( ns.substr( 0 , dot ) , BSON( "collStats" << ns.substr( dot + 1 ) ) , res );
+        conn.done();
+        return ok ? res["size"].numberLong() : 0;
+    }
+
+    /* operations on each collection on shard s since it started, from top. false if it can't say */
+    static bool collectionOps( const Shard& s , map<string,long long>& ops ){
+        BSONObj res;
+        ScopedDbConnection conn( s.getConnString() );
+        bool ok = conn->runCommand( "admin" , BSON( "top" << 1 ) , res );
+        conn.done();
+        if ( ! ok || ! res["totals"].isABSONObj() )
+            return false;
+
+        BSONObjIterator i( res["totals"].Obj() );
+        while ( i.more() ){
+            BSONElement e = i.next();
+            if ( e.isABSONObj() )
+                ops[e.fieldName()] = e.Obj().getFieldDotted( "total.count" ).numberLong();
+        }
+        return true;
     }
     
     void Balancer::_ping(){
@@ -159,8 +235,8 @@ namespace mongo {
 
         //
         // 2. Get a list of all the shards that are participating in this balance round
-        // along with any maximum allowed quotas and current utilization. We get the
-        // latter by issuing db.serverStatus() (mem.mapped) to all shards.
+        // along with any maximum allowed quotas, current utilization and load. We get the
+        // latter by issuing db.serverStatus() (mem.mapped, opcounters) to all shards.
         //
         // TODO: skip unresponsive shards and mark information as stale.
         //
@@ -173,15 +249,27 @@ namespace mongo {
         }
 
         map< string, BSONObj > shardLimitsMap; 
+        map< string, map<string,long long> > shardOpsMap; // shard -> ns -> ops, for the shards top worked on
         for ( vector<Shard>::const_iterator it = allShards.begin(); it != allShards.end(); ++it ){
             const Shard& s = *it;
             ShardStatus status = s.getStatus();
 
-            BSONObj limitsObj = BSON( ShardFields::maxSize( s.getMaxSize() ) << 
-                                      ShardFields::currSize( status.mapped() ) <<
-                                      ShardFields::draining( s.isDraining()) );
+            BSONObjBuilder limits;
+            limits << ShardFields::maxSize( s.getMaxSize() );
+            limits << ShardFields::currSize( status.mapped() );
+            limits << ShardFields::draining( s.isDraining() );
+
+            shardLimitsMap[ s.getName() ] = limits.obj();
 
-            shardLimitsMap[ s.getName() ] = limitsObj;
+            // the shard's opcounters would count every collection's operations against each one
+            try {
+                map<string,long long> ops;
+                if ( collectionOps( s , ops ) )
+                    shardOpsMap[ s.getName() ] = ops;
+            }
+            catch ( std::exception& e ){
+                log() << "couldn't get operation counts on " << s.toString() << ": " << e.what() << endl;
+            }
         }
 
         //
@@ -205,13 +293,35 @@ namespace mongo {
                 continue;
             }
                 
+            // the same limits with how much of this collection each shard holds
+            map< string, BSONObj > collectionLimitsMap;
             for ( vector<Shard>::iterator i=allShards.begin(); i!=allShards.end(); ++i ){
                 // this just makes sure there is an entry in shardToChunksMap for every shard
                 Shard s = *i;
-                shardToChunksMap[s.getName()].size();
+                long long dataSize = 0;
+                if ( shardToChunksMap[s.getName()].size() ){
+                    try {
+                        dataSize = collectionSize( s , ns );
+                    }
+                    catch ( std::exception& e ){
+                        log() << "couldn't get size of " << ns << " on " << s.toString() << ": " << e.what() << endl;
+                    }
+                }
+
+                BSONObjBuilder b;
+                b.appendElements( shardLimitsMap[s.getName()] );
+                b << ShardFields::dataSize( dataSize );
+
+                map< string, map<string,long long> >::iterator ops = shardOpsMap.find( s.getName() );
+                if ( ops != shardOpsMap.end() ){
+                    double rate = _opsPerSec( s.getName() , ns , ops->second[ns] );
+                    if ( rate >= 0 )
+                        b << ShardFields::opsPerSec( rate );
+                }
+                collectionLimitsMap[s.getName()] = b.obj();
             }
 
-            CandidateChunk* p = _policy->balance( ns , shardLimitsMap , shardToChunksMap , _balancedLastTime );
+            CandidateChunk* p = _policy->balance( ns , collectionLimitsMap , shardToChunksMap , _balancedLastTime );
             if ( p ) candidateChunks->push_back( CandidateChunkPtr( p ) );
         }
     }
@@ -21,6 +21,7 @@
 #include "../pch.h"
 #include "../util/background.h"
 #include "../client/dbclient.h"
+#include "../bson/util/atomic_int.h"
 #include "balancer_policy.h"
 
 namespace mongo {
@@ -48,10 +49,22 @@ namespace mongo {
 
         /**
          * Execute the chunk migrations described in 'candidateChunks' and
-         * returns the number of chunks effectively moved.
+         * returns the number of chunks effectively moved. Migrations that share
+         * no shard run at the same time.
          */
         int _moveChunks( const vector<CandidateChunkPtr>* candidateChunks );
 
+        /**
+         * Moves one candidate chunk, counting it in 'moved' if it went. Doesn't throw.
+         */
+        void _moveChunk( CandidateChunkPtr chunkInfo , AtomicUInt* moved );
+
+        /**
+         * @return operations per second on 'ns' on 'shard' since the last time this was asked, 
+         * or a negative number the first time
+         */
+        double _opsPerSec( const string& shard , const string& ns , long long ops );
+
         /**
          * Check the health of the master configuration server
          */
@@ -69,6 +82,7 @@ namespace mongo {
         time_t          _started;          // time Balancer starte running
         int             _balancedLastTime; // number of moved chunks in last round
         BalancerPolicy* _policy;           // decide which chunks to move; owned here.
+        map< string , pair<long long,long long> > _lastOps; // shard + ns -> ( total ops , at millis )
 
         // non-copyable, non-assignable
 
@@ -28,6 +28,46 @@
 
 namespace mongo {
 
+    const double BalancerPolicy::LoadImbalanceThreshold = 0.3;
+
+    namespace {
+
+        /* one shard's part of a collection, as the policy sees it */
+        struct ShardLoad {
+            string shard;
+            double chunks;
+            double data;
+            double ops;
+            bool receiver; // not maxed out or draining
+        };
+
+        /* the shares of the totals that make up a load; a total of 0 means unknown */
+        struct LoadTotals {
+            double chunks;
+            double data;
+            double ops;
+
+            double load( double c , double d , double o ) const {
+                double sum = c / chunks;
+                int parts = 1;
+                if ( data > 0 ){
+                    sum += d / data;
+                    parts++;
+                }
+                if ( ops > 0 ){
+                    sum += o / ops;
+                    parts++;
+                }
+                return sum / parts;
+            }
+
+            double load( const ShardLoad& s ) const {
+                return load( s.chunks , s.data , s.ops );
+            }
+        };
+
+    }
+
     BalancerPolicy::ChunkInfo* BalancerPolicy::balance( const string& ns, 
                                                         const ShardToLimitsMap& shardToLimitsMap,  
                                                         const ShardToChunksMap& shardToChunksMap, 
@@ -35,6 +75,8 @@ namespace mongo {
         pair<string,unsigned> min("",numeric_limits<unsigned>::max());
         pair<string,unsigned> max("",0);
         vector<string> drainingShards;
+        vector<ShardLoad> loads;
+        LoadTotals totals = { 0 , 0 , 0 };
 	        
         for (ShardToChunksIter i = shardToChunksMap.begin(); i!=shardToChunksMap.end(); ++i ){
 
@@ -63,6 +105,18 @@ namespace mongo {
             if ( draining && (size > 0)){
                 drainingShards.push_back( shard );
             }
+
+            ShardLoad l;
+            l.shard = shard;
+            l.chunks = size;
+            l.data = shardLimits[ ShardFields::dataSize.name() ].number();
+            l.ops = shardLimits[ ShardFields::opsPerSec.name() ].number();
+            l.receiver = ! maxedOut && ! draining;
+            loads.push_back( l );
+            
+            totals.chunks += l.chunks;
+            totals.data += l.data;
+            totals.ops += l.ops;
         }
 
         // If there is no candidate chunk receiver -- they may have all been maxed out, 
@@ -81,18 +135,67 @@ namespace mongo {
             log(1) << "draining           : " << ! drainingShards.empty() << "(" << drainingShards.size() << ")" << endl;
         }
 
+        // The move that most lowers the sum of squared distances of the loads from their mean.
+        // A chunk is assumed to carry an even part of the collection's data and operations on its shard.
+        string bestFrom, bestTo;
+        double minLoad = numeric_limits<double>::max();
+        double maxLoad = 0;
+        string minLoadShard;
+        if ( totals.chunks > 0 ){
+            const double mean = 1.0 / loads.size();
+            double bestGain = 0;
+            for ( unsigned i=0; i<loads.size(); i++ ){
+                const ShardLoad& a = loads[i];
+                const double la = totals.load( a );
+                if ( la > maxLoad )
+                    maxLoad = la;
+                if ( a.receiver && la < minLoad ){
+                    minLoad = la;
+                    minLoadShard = a.shard;
+                }
+                if ( a.chunks == 0 )
+                    continue;
+
+                const double la2 = totals.load( a.chunks - 1 , a.data - a.data / a.chunks , a.ops - a.ops / a.chunks );
+                for ( unsigned j=0; j<loads.size(); j++ ){
+                    const ShardLoad& b = loads[j];
+                    if ( i == j || ! b.receiver )
+                        continue;
+
+                    const double lb = totals.load( b );
+                    const double lb2 = totals.load( b.chunks + 1 , b.data + a.data / a.chunks , b.ops + a.ops / a.chunks );
+                    const double gain = 
+                        ( la - mean ) * ( la - mean ) + ( lb - mean ) * ( lb - mean ) - 
+                        ( la2 - mean ) * ( la2 - mean ) - ( lb2 - mean ) * ( lb2 - mean );
+                    if ( gain > bestGain ){
+                        bestGain = gain;
+                        bestFrom = a.shard;
+                        bestTo = b.shard;
+                    }
+                }
+            }
+        }
+        log(1) << "load       : max " << maxLoad << " min " << minLoad << " on " << minLoadShard << endl;
+
         // Solving imbalances takes a higher priority than draining shards. Many shards can
         // be draining at once but we choose only one of them to cater to per round.
         const int imbalance = max.second - min.second;
         const int threshold = balancedLastTime ? 2 : 8;
+        // with only chunk counts to go on the count threshold alone decides, as it always has
+        const bool loadImbalanced = ( totals.data > 0 || totals.ops > 0 ) && minLoadShard.size() && 
+            maxLoad - minLoad >= LoadImbalanceThreshold / loads.size();
         string from, to;
-        if ( imbalance >= threshold ){
+        if ( ( imbalance >= threshold || loadImbalanced ) && bestFrom.size() ){
+            from = bestFrom;
+            to = bestTo;
+
+        } else if ( imbalance >= threshold ){
             from = max.first;
             to = min.first;
 
         } else if ( ! drainingShards.empty() ){
             from = drainingShards[ rand() % drainingShards.size() ];
-            to = min.first;
+            to = minLoadShard.size() ? minLoadShard : min.first;
 
         } else {
             // Everything is balanced here! 
@@ -283,12 +386,67 @@ namespace mongo {
             assert( c == NULL );
         }
 
+        void caseBalanceLoad(){
+            // same number of chunks, but shard0 holds most of the data
+            BalancerPolicy::ShardToChunksMap chunkMap;
+            vector<BSONObj> chunks;
+            for ( int i=0; i<8; i++ ){
+                chunks.push_back(BSON( "min" << BSON( "x" << i * 10 ) << "max" << BSON( "x" << i * 10 + 10 ) ));
+                if ( i == 3 ){
+                    chunkMap["shard0"] = chunks;
+                    chunks.clear();
+                }
+            }
+            chunkMap["shard1"] = chunks;
+
+            BalancerPolicy::ShardToLimitsMap limitsMap;
+            limitsMap["shard0"] = BSON( sf::maxSize(0LL) << sf::currSize(2LL) << sf::draining(false) << sf::dataSize(800LL) );
+            limitsMap["shard1"] = BSON( sf::maxSize(0LL) << sf::currSize(2LL) << sf::draining(false) << sf::dataSize(100LL) );
+
+            BalancerPolicy::ChunkInfo* c = NULL;
+            c = BalancerPolicy::balance( "ns", limitsMap, chunkMap, 0 );
+            assert( c != NULL );
+            assert( c->from == "shard0" );
+            assert( c->to == "shard1" );
+            delete c;
+
+            // once the data is even, nothing to do
+            limitsMap["shard0"] = BSON( sf::maxSize(0LL) << sf::currSize(2LL) << sf::draining(false) << sf::dataSize(400LL) );
+            limitsMap["shard1"] = BSON( sf::maxSize(0LL) << sf::currSize(2LL) << sf::draining(false) << sf::dataSize(400LL) );
+            c = BalancerPolicy::balance( "ns", limitsMap, chunkMap, 0 );
+            assert( c == NULL );
+        }
+
+        void caseBalanceSmallCountImbalance(){
+            // 5 and 3 chunks, nothing else known: below the threshold of a first round
+            BalancerPolicy::ShardToChunksMap chunkMap;
+            vector<BSONObj> chunks;
+            for ( int i=0; i<8; i++ ){
+                chunks.push_back(BSON( "min" << BSON( "x" << i * 10 ) << "max" << BSON( "x" << i * 10 + 10 ) ));
+                if ( i == 4 ){
+                    chunkMap["shard0"] = chunks;
+                    chunks.clear();
+                }
+            }
+            chunkMap["shard1"] = chunks;
+
+            BalancerPolicy::ShardToLimitsMap limitsMap;
+            limitsMap["shard0"] = BSON( sf::maxSize(0LL) << sf::currSize(2LL) << sf::draining(false) );
+            limitsMap["shard1"] = BSON( sf::maxSize(0LL) << sf::currSize(2LL) << sf::draining(false) );
+
+            BalancerPolicy::ChunkInfo* c = NULL;
+            c = BalancerPolicy::balance( "ns", limitsMap, chunkMap, 0 );
+            assert( c == NULL );
+        }
+
         void run(){
             caseSizeMaxedShard();
             caseDrainingShard();
             caseBalanceNormal();
             caseBalanceDraining();
             caseBalanceImpasse();
+            caseBalanceLoad();
+            caseBalanceSmallCountImbalance();
             log(1) << "policyObjUnitTest passed" << endl;
         }
     } policyObjUnitTest;
@@ -29,12 +29,19 @@ namespace mongo {
 
         /**
          * Returns a suggested chunk to move whithin a collection's shards, given information about
-         * space usage and number of chunks for that collection. If the policy doesn't recommend 
+         * space usage, load and number of chunks for that collection. If the policy doesn't recommend 
          * moving, it returns NULL.
          *
+         * Each shard's load is the average of its share of the collection's chunks, of the
+         * collection's data and of the operations on it, leaving out the last two when they are unknown.
+         * A move is picked when the chunk counts are off by more than a threshold or the loads 
+         * are off by more than LoadImbalanceThreshold of their mean, and it is the one that most 
+         * reduces the spread of the loads.
+         *
          * @param ns is the collections namepace.
-         * @param shardLimitMap is a map from shardId to an object that describes (for now) space 
-         * cap and usage. E.g.: { "maxSize" : <size_in_MB> , "usedSize" : <size_in_MB> }.
+         * @param shardLimitMap is a map from shardId to an object that describes space cap, usage
+         * and load. E.g.: { "maxSize" : <size_in_MB> , "usedSize" : <size_in_MB> , 
+         * "dataSize" : <bytes of ns> , "opsPerSec" : <operations on ns per second> }, the last two optional.
          * @param shardToChunksMap is a map from shardId to chunks that live there. A chunk's format
          * is { }. 
          * @param balancedLastTime is the number of chunks effectively moved in the last round.
@@ -45,6 +52,9 @@ namespace mongo {
         static ChunkInfo* balance( const string& ns, const ShardToLimitsMap& shardToLimitsMap,  
                                    const ShardToChunksMap& shardToChunksMap, int balancedLastTime );
 
+        /** loads further apart than this part of the mean load are worth a move even if the chunk counts are close */
+        static const double LoadImbalanceThreshold;
+
         // below exposed for testing purposes only -- treat it as private --
 
         static BSONObj pickChunk( const vector<BSONObj>& from, const vector<BSONObj>& to );
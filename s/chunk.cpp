@@ -65,16 +65,16 @@ namespace mongo {
     }
     
     bool Chunk::contains( const BSONObj& obj ) const{
-        return
-            _manager->getShardKey().compare( getMin() , obj ) <= 0 &&
-            _manager->getShardKey().compare( obj , getMax() ) < 0;
+        BSONObj k = _manager->getShardKey().extractKey( obj );
+        return k.woCompare( getMin() ) >= 0 && k.woCompare( getMax() ) < 0;
     }
 
     bool ChunkRange::contains(const BSONObj& obj) const {
-    // same as Chunk method
-        return 
-            _manager->getShardKey().compare( getMin() , obj ) <= 0 &&
-            _manager->getShardKey().compare( obj , getMax() ) < 0;
+        return containsKey( _manager->getShardKey().extractKey( obj ) );
+    }
+
+    bool ChunkRange::containsKey(const BSONObj& key) const {
+        return key.woCompare( getMin() ) >= 0 && key.woCompare( getMax() ) < 0;
     }
 
     bool Chunk::minIsInf() const {
@@ -94,6 +94,10 @@ namespace mongo {
         else if ( maxIsInf() ){
             sort = -1;
         }
+
+        // splitting off the last document at an end suits keys that grow; hashes don't
+        if ( _manager->getShardKey().isHashed() )
+            sort = 0;
         
         if ( sort ){
             ShardConnection conn( getShard().getConnString() , _manager->getns() );
@@ -140,7 +144,10 @@ namespace mongo {
         if (median == getMin()){
             Query q;
             q.minKey(_min).maxKey(_max);
-            q.sort(_manager->getShardKey().key());
+            if ( _manager->getShardKey().isHashed() )
+                q.hint(_manager->getShardKey().key()); // index order is hash order
+            else
+                q.sort(_manager->getShardKey().key());
 
             median = conn->findOne(_manager->getns(), q);
             median = _manager->getShardKey().extractKey( median );
@@ -251,6 +258,8 @@ namespace mongo {
                 ChunkPtr s = *it;
                 _manager->_chunkMap[s->getMax()] = s;
             }
+
+            _manager->_routing.build( _manager->_key , _manager->_chunkMap );
         }
         
         log(1) << "after split adjusted range: " << toString() << endl;
@@ -310,6 +319,7 @@ namespace mongo {
                                                   "min" << _min << 
                                                   "max" << _max << 
                                                   "shardId" << genID() <<
+                                                  "shardKeyPattern" << _manager->getShardKey().key() <<
                                                   "configdb" << configServer.modelServer()
                                                   ) ,
                                             res
@@ -318,7 +328,7 @@ namespace mongo {
         fromconn.done();
 
         if ( worked ){
-            _manager->_reload();
+            _manager->reload();
             return true;
         }
         
@@ -461,8 +471,8 @@ namespace mongo {
     
     bool Chunk::operator==( const Chunk& s ) const{
         return 
-            _manager->getShardKey().compare( _min , s._min ) == 0 &&
-            _manager->getShardKey().compare( _max , s._max ) == 0
+            _min.woCompare( s._min ) == 0 &&
+            _max.woCompare( s._max ) == 0
             ;
     }
 
@@ -571,6 +581,7 @@ namespace mongo {
             
             _chunkMap[c->getMax()] = c;
             _chunkRanges.reloadAll(_chunkMap);
+            _routing.build( _key , _chunkMap );
 
             _shards.insert(c->getShard());
 
@@ -585,21 +596,35 @@ namespace mongo {
         _shards.clear();
     }
     
-    void ChunkManager::_reload(){
+    void ChunkManager::reload(){
         rwlock lk( _lock , true );
         _reload_inlock();
     }
 
     void ChunkManager::_reload_inlock(){
+        // whoever reloads because a shard was stale (checkShardVersion) needs the next
+        // setShardVersion to go out again, changed chunks or not
+        _sequenceNumber = ++NextSequenceNumber;
+
+        if ( ! _chunkMap.empty() ){
+            if ( _reloadChanged_inlock() )
+                return;
+            chunkReloadStats.fellBack();
+        }
+
         int tries = 3;
         while (tries--){
+            Timer t;
             _chunkMap.clear();
             _chunkRanges.clear();
+            _routing.clear();
             _shards.clear();
             _load();
 
             if (_isValid()){
                 _chunkRanges.reloadAll(_chunkMap);
+                _routing.build( _key , _chunkMap );
+                chunkReloadStats.full( t.millis() , _chunkMap.size() );
                 return;
             }
 
@@ -634,6 +659,92 @@ namespace mongo {
         conn.done();
     }
 
+    /**
+     * every split or migrate gives the chunks it touches a lastmod higher than any before, and
+     * the chunks written replace exactly the ones they came from.  so loading the chunks newer
+     * than our version and swapping them in for what they overlap is enough.
+     * @return false if the result doesn't add up and a full reload is needed
+     */
+    bool ChunkManager::_reloadChanged_inlock(){
+        static Chunk temp(0);
+
+        Timer t;
+        ShardChunkVersion version = getVersion_inlock();
+
+        BSONObjBuilder b;
+        b.append( "ns" , _ns );
+        {
+            BSONObjBuilder lastmod( b.subobjStart( "lastmod" ) );
+            lastmod.appendTimestamp( "$gt" , version );
+            lastmod.done();
+        }
+
+        vector<ChunkPtr> changed;
+        unsigned long long total;
+        {
+            ScopedDbConnection conn( temp.modelServer() );
+
+            auto_ptr<DBClientCursor> cursor = conn->query( temp.getNS() , Query( b.obj() ).sort( "lastmod" , 1 ) );
+            while ( cursor->more() ){
+                BSONObj d = cursor->next();
+                if ( d["isMaxMarker"].trueValue() )
+                    continue;
+
+                ChunkPtr c( new Chunk( this ) );
+                c->unserialize( d );
+                changed.push_back( c );
+            }
+
+            total = conn->count( temp.getNS() , BSON( "ns" << _ns << "isMaxMarker" << BSON( "$ne" << true ) ) );
+            conn.done();
+        }
+
+        if ( changed.empty() ){
+            chunkReloadStats.incremental( t.millis() , 0 );
+            return total == _chunkMap.size();
+        }
+
+        BSONObj min = changed[0]->getMin();
+        BSONObj max = changed[0]->getMax();
+        for ( unsigned i=0; i<changed.size(); i++ ){
+            ChunkPtr c = changed[i];
+
+            ChunkMap::iterator j = _chunkMap.upper_bound( c->getMin() );
+            while ( j != _chunkMap.end() && j->second->getMin().woCompare( c->getMax() ) < 0 )
+                _chunkMap.erase( j++ );
+            _chunkMap[c->getMax()] = c;
+            _shards.insert( c->getShard() );
+
+            if ( c->getMin().woCompare( min ) < 0 )
+                min = c->getMin();
+            if ( c->getMax().woCompare( max ) > 0 )
+                max = c->getMax();
+        }
+
+        if ( total != _chunkMap.size() )
+            return false;
+
+        // only the seams around what changed can be wrong
+        if ( ! allOfType( MinKey , _chunkMap.begin()->second->getMin() ) || 
+             ! allOfType( MaxKey , prior( _chunkMap.end() )->second->getMax() ) )
+            return false;
+        for ( unsigned i=0; i<changed.size(); i++ ){
+            ChunkMap::iterator j = _chunkMap.find( changed[i]->getMax() );
+            if ( j != _chunkMap.begin() && prior( j )->second->getMax().woCompare( j->second->getMin() ) )
+                return false;
+            if ( boost::next( j ) != _chunkMap.end() && boost::next( j )->second->getMin().woCompare( j->second->getMax() ) )
+                return false;
+        }
+
+        _chunkRanges.reloadRange( _chunkMap , min , max );
+        _routing.build( _key , _chunkMap );
+
+        log(1) << "ChunkManager: " << _ns << " loaded " << changed.size() << " changed chunks since " 
+               << version << " in " << t.millis() << "ms" << endl;
+        chunkReloadStats.incremental( t.millis() , changed.size() );
+        return true;
+    }
+
     bool ChunkManager::_isValid() const {
 #define ENSURE(x) do { if(!(x)) { log() << "ChunkManager::_isValid failed: " #x << endl; return false; } } while(0)
 
@@ -666,34 +777,26 @@ namespace mongo {
     }
 
     ChunkPtr ChunkManager::findChunk( const BSONObj & obj , bool retry ){
-        BSONObj key = _key.extractKey(obj);
-        
         {
             rwlock lk( _lock , false ); 
             
-            BSONObj foo;
-            ChunkPtr c;
-            {
-                ChunkMap::iterator it = _chunkMap.upper_bound(key);
-                if (it != _chunkMap.end()){
-                    foo = it->first;
-                    c = it->second;
-                }
-            }
+            ChunkPtr c = _routing.find( obj );
             
             if ( c ){
-                if ( c->contains( obj ) )
-                    return c;
-                
-                PRINT(foo);
-                PRINT(*c);
-                PRINT(key);
-                
-                _reload_inlock();
-                massert(13141, "Chunk map pointed to incorrect chunk", false);
+                // the table is only built from a valid map, so this is a consistency check
+                DEV if ( ! c->contains( obj ) ){
+                    PRINT(*c);
+                    PRINT(obj);
+                    
+                    _reload_inlock();
+                    massert(13141, "Chunk map pointed to incorrect chunk", false);
+                }
+                return c;
             }
         }
 
+        BSONObj key = _key.extractKey(obj);
+
         if ( retry ){
             stringstream ss;
             ss << "couldn't find a chunk aftry retry which should be impossible extracted: " << key;
@@ -735,6 +838,27 @@ namespace mongo {
                     getAllShards(shards);
                     return;
                 }
+
+                if ( _key.isHashed() ){
+                    // values can be hashed, but a range of values is spread over every chunk
+                    if ( !range.inQuery() ){
+                        getAllShards(shards);
+                        return;
+                    }
+
+                    const vector<FieldInterval>& points = range.intervals();
+                    for ( vector<FieldInterval>::const_iterator it=points.begin(); it != points.end(); ++it ){
+                        BSONObjBuilder b;
+                        b.append( _key.key().firstElement().fieldName() , BSONElementHasher::hash64( it->_lower._bound ) );
+                        ChunkRangeMap::const_iterator c = _chunkRanges.upper_bound( b.obj() );
+                        assert( c != _chunkRanges.ranges().end() );
+                        shards.insert( c->second->getShard() );
+                    }
+
+                    if (fros.moreOrClauses())
+                        fros.popOrClause();
+                    continue;
+                }
             }
 
             BoundList ranges = frs->indexBounds(_key.key(), 1);
@@ -826,6 +950,7 @@ namespace mongo {
         // wipe my meta-data
         _chunkMap.clear();
         _chunkRanges.clear();
+        _routing.clear();
         _shards.clear();
 
         
@@ -966,6 +1091,41 @@ namespace mongo {
         soleChunk->multiSplit( splitPoints );
     }
 
+    void ChunkManager::presplitHashed( int numChunks , const vector<Shard>& shards ){
+        rwlock lk( _lock , true );
+
+        uassert( 13447 , "can only pre-split a hashed shard key" , _key.isHashed() );
+        uassert( 13448 , "can't pre-split already splitted collection" , _chunkMap.size() == 1 );
+        assert( numChunks > 1 && shards.size() );
+
+        const char * field = _key.key().firstElement().fieldName();
+        const unsigned long long step = numeric_limits<unsigned long long>::max() / numChunks;
+
+        BSONObj min = _chunkMap.begin()->second->getMin();
+        _chunkMap.clear();
+        _shards.clear();
+        for ( int i=0; i<numChunks; i++ ){
+            BSONObj max = _key.globalMax();
+            if ( i + 1 < numChunks ){
+                // hashes run from the smallest long long up
+                unsigned long long bound = (unsigned long long)numeric_limits<long long>::min() + ( i + 1 ) * step;
+                max = BSON( field << (long long)bound );
+            }
+
+            ChunkPtr c( new Chunk( this , min , max , shards[ i % shards.size() ] ) );
+            c->_markModified();
+            _chunkMap[max] = c;
+            _shards.insert( c->getShard() );
+            min = max;
+        }
+
+        _chunkRanges.reloadAll( _chunkMap );
+        _routing.build( _key , _chunkMap );
+        save_inlock();
+
+        log() << "pre-split " << _ns << " into " << numChunks << " chunks on " << _shards.size() << " shards" << endl;
+    }
+
     ShardChunkVersion ChunkManager::getVersionOnConfigServer() const {
         static Chunk temp(0);
         
@@ -1026,6 +1186,188 @@ namespace mongo {
         return ss.str();
     }
 
+    // -------  ChunkRoutingTable --------
+
+    /* numbers a double holds exactly, so comparing as doubles orders them the way BSON does */
+    static bool exactDouble( const BSONElement& e ){
+        switch ( e.type() ){
+        case NumberInt:
+            return true;
+        case NumberDouble: {
+            double d = e._numberDouble();
+            return d == d; // NaN sorts below every number
+        }
+        case NumberLong: {
+            const long long limit = 1LL << 53;
+            long long x = e._numberLong();
+            return x <= limit && x >= -limit;
+        }
+        default:
+            return false;
+        }
+    }
+
+    /* first i with key < a[i], or a.size().  the loop only moves base, which compiles to a 
+       conditional move rather than a branch the cpu has to guess */
+    template< class T >
+    static unsigned upperBound( const vector<T>& a , const T& key ){
+        if ( a.empty() )
+            return 0;
+        const T * base = &a[0];
+        unsigned n = a.size();
+        while ( n > 1 ){
+            unsigned half = n / 2;
+            base = ( key < base[half] ) ? base : base + half;
+            n -= half;
+        }
+        return ( base - &a[0] ) + ( key < *base ? 0 : 1 );
+    }
+
+    ChunkRoutingTable::OIDKey ChunkRoutingTable::oidKey( const OID& oid ){
+        const unsigned char * p = (const unsigned char*)oid.getData();
+        OIDKey k;
+        k.hi = 0;
+        for ( int i=0; i<8; i++ )
+            k.hi = ( k.hi << 8 ) | p[i];
+        k.lo = 0;
+        for ( int i=8; i<12; i++ )
+            k.lo = ( k.lo << 8 ) | p[i];
+        return k;
+    }
+
+    void ChunkRoutingTable::clear(){
+        _type = Empty;
+        _field.clear();
+        _chunks.clear();
+        _bounds.clear();
+        _numbers.clear();
+        _oids.clear();
+    }
+
+    void ChunkRoutingTable::build( const ShardKeyPattern& key , const ChunkMap& chunks ){
+        clear();
+        if ( chunks.empty() )
+            return;
+
+        _key = key;
+        _chunks.reserve( chunks.size() );
+        _bounds.reserve( chunks.size() );
+        for ( ChunkMap::const_iterator i=chunks.begin(); i!=chunks.end(); ++i ){
+            _chunks.push_back( i->second );
+            _bounds.push_back( i->second->getMax() );
+        }
+        _type = Generic;
+
+        // a hashed key's value has to be hashed first, which the generic path does
+        if ( _key.key().nFields() != 1 || _key.isHashed() )
+            return;
+        _field = _key.key().firstElement().fieldName();
+
+        // the last bound is MaxKey, which everything is below
+        bool numbers = true;
+        bool oids = true;
+        for ( unsigned i=0; i+1<_bounds.size(); i++ ){
+            BSONElement e = _bounds[i].firstElement();
+            numbers = numbers && exactDouble( e );
+            oids = oids && e.type() == jstOID;
+        }
+        
+        if ( numbers ){
+            _numbers.reserve( _bounds.size() );
+            for ( unsigned i=0; i+1<_bounds.size(); i++ )
+                _numbers.push_back( _bounds[i].firstElement().number() );
+            _type = Numbers;
+        }
+        else if ( oids ){
+            _oids.reserve( _bounds.size() );
+            for ( unsigned i=0; i+1<_bounds.size(); i++ )
+                _oids.push_back( oidKey( _bounds[i].firstElement().__oid() ) );
+            _type = ObjectIds;
+        }
+    }
+
+    ChunkPtr ChunkRoutingTable::find( const BSONObj& obj ) const {
+        if ( _type == Numbers || _type == ObjectIds ){
+            BSONElement e = obj.getFieldDotted( _field.c_str() );
+            if ( _type == Numbers && exactDouble( e ) )
+                return _chunks[ upperBound( _numbers , e.number() ) ];
+            if ( _type == ObjectIds && e.type() == jstOID )
+                return _chunks[ upperBound( _oids , oidKey( e.__oid() ) ) ];
+        }
+
+        if ( _type == Empty )
+            return ChunkPtr();
+        
+        return _findGeneric( obj );
+    }
+
+    ChunkPtr ChunkRoutingTable::_findGeneric( const BSONObj& obj ) const {
+        BSONObj key = _key.extractKey( obj );
+        if ( key.nFields() != _key.key().nFields() )
+            return ChunkPtr();
+
+        unsigned lo = 0;
+        unsigned hi = _bounds.size();
+        while ( lo < hi ){
+            unsigned mid = ( lo + hi ) / 2;
+            if ( key.woCompare( _bounds[mid] , BSONObj() , false ) < 0 )
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+
+        if ( lo == _bounds.size() )
+            return ChunkPtr();
+        return _chunks[lo];
+    }
+
+    // -------  ChunkReloadStats --------
+
+    ChunkReloadStats chunkReloadStats;
+
+    ChunkReloadStats::ChunkReloadStats() 
+        : _mutex( "ChunkReloadStats" ) , _full(0) , _fullMillis(0) , _fullChunks(0) , 
+          _incremental(0) , _incrementalMillis(0) , _incrementalChunks(0) , _fellBack(0) {
+    }
+
+    void ChunkReloadStats::full( int millis , int chunks ){
+        scoped_lock lk( _mutex );
+        _full++;
+        _fullMillis += millis;
+        _fullChunks += chunks;
+    }
+
+    void ChunkReloadStats::incremental( int millis , int changed ){
+        scoped_lock lk( _mutex );
+        _incremental++;
+        _incrementalMillis += millis;
+        _incrementalChunks += changed;
+    }
+
+    void ChunkReloadStats::fellBack(){
+        scoped_lock lk( _mutex );
+        _fellBack++;
+    }
+
+    void ChunkReloadStats::append( BSONObjBuilder& b ){
+        scoped_lock lk( _mutex );
+        {
+            BSONObjBuilder bb( b.subobjStart( "full" ) );
+            bb.appendNumber( "reloads" , _full );
+            bb.appendNumber( "totalMillis" , _fullMillis );
+            bb.appendNumber( "chunks" , _fullChunks );
+            bb.done();
+        }
+        {
+            BSONObjBuilder bb( b.subobjStart( "incremental" ) );
+            bb.appendNumber( "reloads" , _incremental );
+            bb.appendNumber( "totalMillis" , _incrementalMillis );
+            bb.appendNumber( "chunks" , _incrementalChunks );
+            bb.appendNumber( "fellBack" , _fellBack );
+            bb.done();
+        }
+    }
+
     void ChunkManager::_migrationNotification(Chunk* c){
         _chunkRanges.reloadRange(_chunkMap, c->getMin(), c->getMax());
         _shards.insert(c->getShard());
@@ -1069,8 +1411,8 @@ namespace mongo {
                 assert(max != _ranges.end());
                 assert(min == max);
                 assert(min->second->getShard() == chunk->getShard());
-                assert(min->second->contains( chunk->getMin() ));
-                assert(min->second->contains( chunk->getMax() ) || (min->second->getMax() == chunk->getMax()));
+                assert(min->second->containsKey( chunk->getMin() ));
+                assert(min->second->containsKey( chunk->getMax() ) || (min->second->getMax() == chunk->getMax()));
             }
             
         } catch (...) {
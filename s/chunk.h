@@ -178,6 +178,9 @@ namespace mongo {
         // clones of Chunk methods
         bool contains(const BSONObj& obj) const;
 
+        /** like contains, for a shard key rather than a document */
+        bool containsKey(const BSONObj& key) const;
+
         ChunkRange(ChunkMap::const_iterator begin, const ChunkMap::const_iterator end)
             : _manager(begin->second->getManager())
             , _shard(begin->second->getShard())
@@ -239,6 +242,50 @@ namespace mongo {
         ChunkRangeMap _ranges;
     };
 
+    /**
+     * what findChunk searches: the upper bounds of a collection's chunks in one sorted array.
+     * when the shard key is a single field and every bound is a number, or every bound is an 
+     * ObjectId, the bounds are also unpacked into a plain array that needs no BSON compares.
+     * rebuilt whenever the ChunkMap it came from changes.
+     */
+    class ChunkRoutingTable {
+    public:
+        ChunkRoutingTable() : _type( Empty ) {}
+
+        void build( const ShardKeyPattern& key , const ChunkMap& chunks );
+        void clear();
+
+        /** @return the chunk obj belongs in, or null if obj is missing shard key fields */
+        ChunkPtr find( const BSONObj& obj ) const;
+
+        int size() const { return _chunks.size(); }
+
+    private:
+        enum Type { Empty , Generic , Numbers , ObjectIds };
+
+        /* an ObjectId as two integers that compare the way its bytes do */
+        struct OIDKey {
+            unsigned long long hi;
+            unsigned lo;
+
+            bool operator<( const OIDKey& other ) const {
+                return hi < other.hi || ( hi == other.hi && lo < other.lo );
+            }
+        };
+        static OIDKey oidKey( const OID& oid );
+
+        ChunkPtr _findGeneric( const BSONObj& obj ) const;
+
+        Type _type;
+        ShardKeyPattern _key;
+        string _field;                // if the key has one field
+        
+        vector<ChunkPtr> _chunks;     // ordered by range
+        vector<BSONObj> _bounds;      // _chunks[i]->getMax()
+        vector<double> _numbers;      // Numbers: the bounds but the last, which is MaxKey
+        vector<OIDKey> _oids;         // ObjectIds: the bounds but the last, which is MaxKey
+    };
+
     /* config.sharding
          { ns: 'alleyinsider.fs.chunks' , 
            key: { ts : 1 } ,
@@ -264,6 +311,12 @@ namespace mongo {
         bool isUnique(){ return _unique; }
 
         void maybeChunkCollection();
+
+        /**
+         * splits the only chunk of a hashed collection into numChunks equal ranges of hashes,
+         * dealt out to shards in turn.  only for a collection that is still empty, as no data moves.
+         */
+        void presplitHashed( int numChunks , const vector<Shard>& shards );
         
         void getShardsForQuery( set<Shard>& shards , const BSONObj& query );
         void getAllShards( set<Shard>& all );
@@ -281,6 +334,12 @@ namespace mongo {
          * doesn't look at any local data
          */
         ShardChunkVersion getVersionOnConfigServer() const;
+
+        /**
+         * brings the chunks up to date with the config server, only loading those changed 
+         * since getVersion() when it can
+         */
+        void reload();
         
         /**
          * this is just an increasing number of how many ChunkManagers we have so we know if something has been updated
@@ -303,8 +362,8 @@ namespace mongo {
         
     private:
         
-        void _reload();
         void _reload_inlock();
+        bool _reloadChanged_inlock();
         void _load();
 
         void save_inlock();
@@ -320,6 +379,7 @@ namespace mongo {
 
         ChunkMap _chunkMap;
         ChunkRangeManager _chunkRanges;
+        ChunkRoutingTable _routing;
 
         set<Shard> _shards;
 
@@ -337,6 +397,33 @@ namespace mongo {
         bool _isValid() const;
     };
 
+    /**
+     * how much work ChunkManager reloads are doing.  a full reload reads every chunk of the 
+     * collection, an incremental one only those with a newer lastmod.
+     */
+    class ChunkReloadStats {
+    public:
+        ChunkReloadStats();
+
+        void full( int millis , int chunks );
+        void incremental( int millis , int changed );
+        void fellBack();
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        mongo::mutex _mutex;
+        long long _full;
+        long long _fullMillis;
+        long long _fullChunks;
+        long long _incremental;
+        long long _incrementalMillis;
+        long long _incrementalChunks;
+        long long _fellBack; // incremental reloads that didn't add up and became full ones
+    };
+
+    extern ChunkReloadStats chunkReloadStats;
+
     // like BSONObjCmp. for use as an STL comparison functor
     // key-order in "order" argument must match key-order in shardkey
     class ChunkCmp {
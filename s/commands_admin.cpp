@@ -130,6 +130,12 @@ namespace mongo {
                 }
 
                 result.append( "shardCursorType" , shardedCursorTypes.getObj() );
+
+                {
+                    BSONObjBuilder bb( result.subobjStart( "chunkReloads" ) );
+                    chunkReloadStats.append( bb );
+                    bb.done();
+                }
                 
                 {
                     BSONObjBuilder asserts( result.subobjStart( "asserts" ) );
@@ -297,10 +303,14 @@ namespace mongo {
         public:
             ShardCollectionCmd() : GridAdminCmd( "shardCollection" ){}
 
+            enum { MaxInitialChunks = 8192 };
+
             virtual void help( stringstream& help ) const {
                 help
                     << "Shard a collection.  Requires key.  Optional unique. Sharding must already be enabled for the database.\n"
-                    << "  { enablesharding : \"<dbname>\" }\n";
+                    << "  { enablesharding : \"<dbname>\" }\n"
+                    << "A key of { <field> : \"hashed\" } shards on the hash of one field; an empty collection is then\n"
+                    << "  split into numInitialChunks chunks up front (default 2 per shard).\n";
             }
 
             bool run(const string& , BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool){
@@ -327,9 +337,27 @@ namespace mongo {
                     return false;
                 }
 
-                BSONForEach(e, key){
-                    if (!e.isNumber() || e.number() != 1.0){
-                        errmsg = "shard keys must all be ascending";
+                ShardKeyPattern proposedKey( key );
+                if ( ! proposedKey.isHashed() ){
+                    BSONForEach(e, key){
+                        if (!e.isNumber() || e.number() != 1.0){
+                            errmsg = "shard keys must all be ascending";
+                            return false;
+                        }
+                    }
+                }
+                else if ( cmdObj["unique"].trueValue() ){
+                    errmsg = "hashed shard keys can't be unique";
+                    return false;
+                }
+
+                int numChunks = 0;
+                if ( proposedKey.isHashed() ){
+                    vector<Shard> shards;
+                    Shard::getAllShards( shards );
+                    numChunks = cmdObj["numInitialChunks"].isNumber() ? cmdObj["numInitialChunks"].numberInt() : 2 * (int)shards.size();
+                    if ( numChunks < 0 || numChunks > MaxInitialChunks ){
+                        errmsg = str::stream() << "numInitialChunks can't be more than " << MaxInitialChunks;
                         return false;
                     }
                 }
@@ -354,7 +382,6 @@ namespace mongo {
                 // We enforce both these conditions in what comes next.
 
                 {
-                    ShardKeyPattern proposedKey( key );
                     bool hasShardIndex = false;
 
                     ScopedDbConnection conn( config->getPrimary() );
@@ -390,17 +417,22 @@ namespace mongo {
                         return false;
                     }
 
-                    if ( ! hasShardIndex && ( conn->count( ns ) != 0 ) ){
+                    long long count = conn->count( ns );
+                    if ( ! hasShardIndex && count != 0 ){
                         errmsg = "please create an index over the sharding key before sharding.";
                         return false;
                     }
+
+                    // existing data is split as it grows, like any other key
+                    if ( count != 0 )
+                        numChunks = 0;
                 
                     conn.done();
                 }
 
                 tlog() << "CMD: shardcollection: " << cmdObj << endl;
 
-                config->shardCollection( ns , key , cmdObj["unique"].trueValue() );
+                config->shardCollection( ns , key , cmdObj["unique"].trueValue() , numChunks );
 
                 result << "collectionsharded" << ns;
                 return true;
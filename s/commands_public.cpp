@@ -24,6 +24,7 @@
 #include "../client/parallel.h"
 #include "../db/commands.h"
 #include "../db/query.h"
+#include "../db/aggregate.h"
 
 #include "config.h"
 #include "chunk.h"
@@ -684,6 +685,54 @@ namespace mongo {
             }
         } disinctCmd;
 
+        class AggregateCmd : public PublicGridCommand {
+        public:
+            AggregateCmd() : PublicGridCommand("aggregate"){}
+            virtual void help( stringstream &help ) const {
+                help << "{ aggregate : 'collection name' , key : { a : 1 } , query : {} , fields : { total : { $sum : 'x' } } }";
+            }
+            bool run(const string& dbName , BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool){
+                string collection = cmdObj.firstElement().valuestrsafe();
+                string fullns = dbName + "." + collection;
+
+                DBConfigPtr conf = grid.getDBConfig( dbName , false );
+
+                if ( ! conf || ! conf->isShardingEnabled() || ! conf->isSharded( fullns ) ){
+                    return passthrough( conf , cmdObj , result );
+                }
+
+                ChunkManagerPtr cm = conf->getChunkManager( fullns );
+                massert( 13435 ,  "how could chunk manager be null!" , cm );
+
+                Aggregator agg( cmdObj );
+
+                BSONObjBuilder shardCmd;
+                shardCmd.appendElements( cmdObj );
+                shardCmd.appendBool( "partial" , true );
+                BSONObj shardCmdObj = shardCmd.obj();
+
+                set<Shard> shards;
+                cm->getShardsForQuery( shards , getQuery( cmdObj ) );
+
+                for ( set<Shard>::iterator i=shards.begin(), end=shards.end() ; i != end; ++i ){
+                    ShardConnection conn( *i , fullns );
+                    BSONObj res;
+                    bool ok = conn->runCommand( conf->getName() , shardCmdObj , res );
+                    conn.done();
+
+                    if ( ! ok ){
+                        result.appendElements( res );
+                        return false;
+                    }
+
+                    agg.merge( res );
+                }
+
+                agg.append( result , cmdObj["partial"].trueValue() );
+                return true;
+            }
+        } aggregateCmd;
+
         class FileMD5Cmd : public PublicGridCommand {
         public:
             FileMD5Cmd() : PublicGridCommand("filemd5"){}
@@ -46,6 +46,8 @@ namespace mongo {
     BSONField<bool>      ShardFields::draining("draining");
     BSONField<long long> ShardFields::maxSize ("maxSize");
     BSONField<long long> ShardFields::currSize("currSize");
+    BSONField<long long> ShardFields::dataSize("dataSize");
+    BSONField<double>    ShardFields::opsPerSec("opsPerSec");
 
     OID serverID;
 
@@ -54,6 +56,9 @@ namespace mongo {
     DBConfig::CollectionInfo::CollectionInfo( DBConfig * db , const BSONObj& in ){
         _dirty = false;
         _dropped = in["dropped"].trueValue();
+        _epoch.clear();
+        if ( in["epoch"].type() == jstOID )
+            _epoch = in["epoch"].__oid();
         if ( in["key"].isABSONObj() )
             shard( db , in["_id"].String() , in["key"].Obj() , in["unique"].trueValue() );
     }
@@ -73,9 +78,12 @@ namespace mongo {
     void DBConfig::CollectionInfo::save( const string& ns , DBClientBase* conn ){
         BSONObj key = BSON( "_id" << ns );
         
+        _epoch.init();
+
         BSONObjBuilder val;
         val.append( "_id" , ns );
         val.appendDate( "lastmod" , time(0) );
+        val.append( "epoch" , _epoch );
         val.appendBool( "dropped" , _dropped );
         if ( _cm )
             _cm->getInfo( val );
@@ -84,6 +92,19 @@ namespace mongo {
         _dirty = false;
     }
 
+    bool DBConfig::CollectionInfo::sameCollection( const BSONObj& in ) const {
+        if ( ! _cm || in["dropped"].trueValue() || ! in["key"].isABSONObj() )
+            return false;
+        // lastmod only has seconds: a drop and reshard can keep it
+        if ( ! _epoch.isSet() || in["epoch"].type() != jstOID )
+            return false;
+        OID epoch = in["epoch"].__oid();
+        if ( epoch != _epoch )
+            return false;
+        return _cm->getShardKey().key().woCompare( in["key"].Obj() ) == 0 && 
+            _cm->isUnique() == in["unique"].trueValue();
+    }
+
 
     bool DBConfig::isSharded( const string& ns ){
         if ( ! _shardingEnabled )
@@ -118,7 +139,7 @@ namespace mongo {
         _save();
     }
     
-    ChunkManagerPtr DBConfig::shardCollection( const string& ns , ShardKeyPattern fieldsAndOrder , bool unique ){
+    ChunkManagerPtr DBConfig::shardCollection( const string& ns , ShardKeyPattern fieldsAndOrder , bool unique , int numInitialChunks ){
         uassert( 8042 , "db doesn't have sharding enabled" , _shardingEnabled );
         
         scoped_lock lk( _lock );
@@ -129,7 +150,20 @@ namespace mongo {
         log() << "enable sharding on: " << ns << " with shard key: " << fieldsAndOrder << endl;
 
         ci.shard( this , ns , fieldsAndOrder , unique );
-        ci.getCM()->maybeChunkCollection();
+        if ( fieldsAndOrder.isHashed() && numInitialChunks > 1 ){
+            // deal chunks out starting with the primary, which would have held the single chunk
+            vector<Shard> all;
+            Shard::getAllShards( all );
+            vector<Shard> shards;
+            shards.push_back( _primary );
+            for ( unsigned i=0; i<all.size(); i++ )
+                if ( all[i] != _primary )
+                    shards.push_back( all[i] );
+            ci.getCM()->presplitHashed( numInitialChunks , shards );
+        }
+        else {
+            ci.getCM()->maybeChunkCollection();
+        }
 
         _save();
         return ci.getCM();
@@ -227,14 +261,24 @@ namespace mongo {
         b.appendRegex( "_id" , (string)"^" + _name + "." );
         
 
+        // collections that are still sharded the same way keep their ChunkManager, so they
+        // only load the chunks that changed
+        vector<ChunkManagerPtr> toReload;
         auto_ptr<DBClientCursor> cursor = conn->query( ShardNS::collection ,b.obj() );
         while ( cursor->more() ){
             BSONObj o = cursor->next();
-            _collections[o["_id"].String()] = CollectionInfo( this , o );
+            CollectionInfo& ci = _collections[o["_id"].String()];
+            if ( ci.sameCollection( o ) )
+                toReload.push_back( ci.getCM() );
+            else
+                ci = CollectionInfo( this , o );
         }
         
         conn.done();        
 
+        for ( unsigned i=0; i<toReload.size(); i++ )
+            toReload[i]->reload();
+
         return true;
     }
 
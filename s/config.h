@@ -49,6 +49,10 @@ namespace mongo {
         static BSONField<bool> draining;
         static BSONField<long long> maxSize;
         static BSONField<long long> currSize;
+
+        // not stored, gathered by the balancer each round
+        static BSONField<long long> dataSize;   // bytes of the collection being balanced
+        static BSONField<double> opsPerSec;     // operations on that collection on the shard
     };
         
     class ConfigServer;
@@ -71,6 +75,7 @@ namespace mongo {
             CollectionInfo(){
                 _dirty = false;
                 _dropped = false;
+                _epoch.clear();
             }
             
             CollectionInfo( DBConfig * db , const BSONObj& in );
@@ -90,12 +95,19 @@ namespace mongo {
             bool wasDropped() const { return _dropped; }
             
             void save( const string& ns , DBClientBase* conn );
+
+            /** 
+             * @param in this collection's config.collections entry
+             * @return true if it still describes the collection _cm was made for 
+             */
+            bool sameCollection( const BSONObj& in ) const;
             
 
         private:
             ChunkManagerPtr _cm;
             bool _dirty;
             bool _dropped;
+            OID _epoch; // of the config.collections entry: new each time it is written, i.e. (un)sharded
         };
         
         typedef map<string,CollectionInfo> Collections;
@@ -121,7 +133,11 @@ namespace mongo {
         }
         
         void enableSharding();
-        ChunkManagerPtr shardCollection( const string& ns , ShardKeyPattern fieldsAndOrder , bool unique );
+        /**
+         * @param numInitialChunks for a hashed key on an empty collection, how many chunks to
+         *        spread over the shards up front.  0 or 1 starts with a single chunk.
+         */
+        ChunkManagerPtr shardCollection( const string& ns , ShardKeyPattern fieldsAndOrder , bool unique , int numInitialChunks = 0 );
         
         /**
          * @return whether or not the 'ns' collection is partitioned
@@ -38,6 +38,8 @@
 #include "../util/queue.h"
 #include "../util/unittest.h"
 
+#include "shardkey.h"
+
 #include "shard.h"
 #include "d_logic.h"
 #include "config.h"
@@ -74,6 +76,19 @@ namespace mongo {
             _b.appendNumber( s , _t.millis() );
             _t.reset();
         }
+
+        /* how much step moved, to go with its time.  bytes < 0 if not known */
+        void throughput( int step , long long docs , long long bytes , int millis ){
+            stringstream ss;
+            ss << "step" << step;
+            string s = ss.str();
+
+            _b.appendNumber( s + "docs" , docs );
+            if ( bytes >= 0 )
+                _b.appendNumber( s + "bytes" , bytes );
+            if ( millis > 0 )
+                _b.append( s + "docsPerSec" , docs * 1000.0 / millis );
+        }
         
         
     private:
@@ -142,12 +157,13 @@ namespace mongo {
         string ns;
         BSONObj min;
         BSONObj max;
+        BSONObj keyPattern; // empty if the mongos didn't send it
         set<CursorId> initial;
         void doRemove(){
             ShardForceModeBlock sf;
             writelock lk(ns);
             RemoveSaver rs(ns,"post-cleanup");
-            long long num = Helpers::removeRange( ns , min , max , true , false , &rs );
+            long long num = Helpers::removeRange( ns , min , max , true , false , &rs , keyPattern );
             log() << "moveChunk deleted: " << num << endl;
         }
     };
@@ -193,8 +209,9 @@ namespace mongo {
 
     };
 
-    bool isInRange( const BSONObj& obj , const BSONObj& min , const BSONObj& max ){
-        BSONObj k = obj.extractFields( min, true );
+    /* shardKey is needed for hashed keys, whose bounds are hashes rather than field values */
+    bool isInRange( const BSONObj& obj , const BSONObj& min , const BSONObj& max , const ShardKeyPattern * shardKey = 0 ){
+        BSONObj k = shardKey && shardKey->isHashed() ? shardKey->extractKey( obj ) : obj.extractFields( min, true );
 
         return k.woCompare( min ) >= 0 && k.woCompare( max ) < 0;
     }
@@ -209,7 +226,7 @@ namespace mongo {
             _inCriticalSection = false;
         }
 
-        void start( string ns , const BSONObj& min , const BSONObj& max ){
+        void start( string ns , const BSONObj& min , const BSONObj& max , const BSONObj& shardKeyPattern ){
             assert( ! _active );
             
             assert( ! min.isEmpty() );
@@ -219,6 +236,7 @@ namespace mongo {
             _ns = ns;
             _min = min;
             _max = max;
+            _shardKey.reset( shardKeyPattern.isEmpty() ? 0 : new ShardKeyPattern( shardKeyPattern ) );
             
             _deleted.clear();
             _reload.clear();
@@ -283,7 +301,7 @@ namespace mongo {
                 
             }
             
-            if ( ! isInRange( it , _min , _max ) )
+            if ( ! isInRange( it , _min , _max , _shardKey.get() ) )
                 return;
             
             scoped_lock lk( _mutex );
@@ -350,6 +368,7 @@ namespace mongo {
         string _ns;
         BSONObj _min;
         BSONObj _max;
+        scoped_ptr<ShardKeyPattern> _shardKey; // null if the mongos didn't send the pattern
 
         list<BSONObj> _reload;
         list<BSONObj> _deleted;
@@ -359,8 +378,8 @@ namespace mongo {
     } migrateFromStatus;
     
     struct MigrateStatusHolder {
-        MigrateStatusHolder( string ns , const BSONObj& min , const BSONObj& max ){
-            migrateFromStatus.start( ns , min , max );
+        MigrateStatusHolder( string ns , const BSONObj& min , const BSONObj& max , const BSONObj& shardKeyPattern ){
+            migrateFromStatus.start( ns , min , max , shardKeyPattern );
         }
         ~MigrateStatusHolder(){
             migrateFromStatus.done();
@@ -421,6 +440,9 @@ namespace mongo {
             BSONObj min  = cmdObj["min"].Obj();
             BSONObj max  = cmdObj["max"].Obj();
             BSONElement shardId = cmdObj["shardId"];
+            BSONObj shardKeyPattern; // older mongos don't send it
+            if ( cmdObj["shardKeyPattern"].type() == Object )
+                shardKeyPattern = cmdObj["shardKeyPattern"].Obj();
             
             if ( ns.empty() ){
                 errmsg = "need to specify namespace in command";
@@ -511,7 +533,7 @@ namespace mongo {
             timing.done(2);
             
             // 3.
-            MigrateStatusHolder statusHolder( ns , min , max );
+            MigrateStatusHolder statusHolder( ns , min , max , shardKeyPattern );
             {
                 dblock lk;
                 // this makes sure there wasn't a write inside the .cpp code we can miss
@@ -526,6 +548,7 @@ namespace mongo {
                                                   "from" << from <<
                                                   "min" << min <<
                                                   "max" << max <<
+                                                  "shardKeyPattern" << shardKeyPattern <<
                                                   "configServer" << configServer.modelServer()
                                                   ) , 
                                             res );
@@ -646,6 +669,7 @@ namespace mongo {
                 c.ns = ns;
                 c.min = min.getOwned();
                 c.max = max.getOwned();
+                c.keyPattern = shardKeyPattern.getOwned();
                 ClientCursor::find( ns , c.initial );
                 if ( c.initial.size() ){
                     log() << "forking for cleaning up chunk data" << endl;
@@ -697,6 +721,7 @@ namespace mongo {
             errmsg = "";
 
             numCloned = 0;
+            clonedBytes = 0;
             numCatchup = 0;
             numSteady = 0;
 
@@ -751,7 +776,7 @@ namespace mongo {
             { // 2. delete any data already in range
                 writelock lk( ns );
                 RemoveSaver rs( ns , "preCleanup" );
-                long long num = Helpers::removeRange( ns , min , max , true , false , &rs );
+                long long num = Helpers::removeRange( ns , min , max , true , false , &rs , shardKeyPattern );
                 if ( num )
                     log( LL_WARNING ) << "moveChunkCmd deleted data already in chunk # objects: " << num << endl;
 
@@ -761,21 +786,31 @@ namespace mongo {
             
             { // 3. initial bulk clone
                 state = CLONE;
-                auto_ptr<DBClientCursor> cursor = conn->query( ns , Query().minKey( min ).maxKey( max ) , /* QueryOption_Exhaust */ 0 );
-                while ( cursor->more() ){
-                    BSONObj o = cursor->next();
-                    {
-                        writelock lk( ns );
-                        Helpers::upsert( ns , o );
+                Timer t;
+                CloneBatcher batcher( this );
+                Query q = Query().minKey( min ).maxKey( max );
+                if ( ! shardKeyPattern.isEmpty() )
+                    q.hint( shardKeyPattern ); // a hashed key's bounds are only meaningful on its index
+                DBClientConnection * remote = dynamic_cast< DBClientConnection* >( conn.get() );
+                if ( remote ) {
+                    remote->query( boost::function<void(DBClientCursorBatchIterator &)>( boost::ref( batcher ) ) , ns , q , 0 , QueryOption_Exhaust );
+                }
+                else {
+                    auto_ptr<DBClientCursor> cursor = conn->query( ns , q );
+                    while ( cursor->more() ){
+                        DBClientCursorBatchIterator i( *cursor );
+                        batcher( i );
                     }
-                    numCloned++;
                 }
+                batcher.flush();
 
+                timing.throughput( 3 , numCloned , clonedBytes , t.millis() );
                 timing.done(3);
             }
             
             { // 4. do bulk of mods
                 state = CATCHUP;
+                Timer t;
                 while ( true ){
                     BSONObj res;
                     if ( ! conn->runCommand( "admin" , BSON( "_transferMods" << 1 ) , res ) ){
@@ -788,6 +823,7 @@ namespace mongo {
                     apply( res );
                 }
 
+                timing.throughput( 4 , numCatchup , -1 , t.millis() );
                 timing.done(4);
             }
             
@@ -818,6 +854,54 @@ namespace mongo {
             conn.done();
         }
 
+        /* receives the donor's documents a server batch at a time, and inserts them
+           cmdLine.migrateCloneBatch at a time under one write lock.  the range was emptied in
+           step 2, so these are inserts rather than upserts; that lets the index keys of a batch
+           go in sorted (DataFileMgr::insertBatch).  a document that won't go in fails the
+           migration, as the upsert it replaced did, so the donor keeps the chunk. */
+        class CloneBatcher {
+        public:
+            CloneBatcher( MigrateStatus * status ) : _status( status ) {}
+
+            void operator()( DBClientCursorBatchIterator& i ){
+                while ( i.moreInCurrentBatch() ){
+                    _batch.push_back( i.nextSafe().getOwned() );
+                    if ( (int)_batch.size() >= cmdLine.migrateCloneBatch )
+                        flush();
+                }
+            }
+
+            void flush(){
+                if ( _batch.empty() )
+                    return;
+
+                long long bytes = 0;
+                for ( unsigned i=0; i<_batch.size(); i++ )
+                    bytes += _batch[i].objsize();
+
+                int n;
+                {
+                    writelock lk( _status->ns );
+                    Client::Context ctx( _status->ns );
+                    n = theDataFileMgr.insertBatch( _status->ns.c_str() , _batch , true );
+                }
+                if ( n < (int)_batch.size() ){
+                    // the donor deletes the range once we commit, so these would be lost
+                    stringstream ss;
+                    ss << "migrate clone couldn't insert " << _batch.size() - n << " documents into " << _status->ns;
+                    uasserted( 13460 , ss.str() );
+                }
+
+                _status->numCloned += _batch.size();
+                _status->clonedBytes += bytes;
+                _batch.clear();
+            }
+
+        private:
+            MigrateStatus * _status;
+            vector<BSONObj> _batch;
+        };
+
         void status( BSONObjBuilder& b ){
             b.appendBool( "active" , active );
 
@@ -831,6 +915,7 @@ namespace mongo {
             {
                 BSONObjBuilder bb( b.subobjStart( "counts" ) );
                 bb.append( "cloned" , numCloned );
+                bb.append( "clonedBytes" , clonedBytes );
                 bb.append( "catchup" , numCatchup );
                 bb.append( "steady" , numSteady );
                 bb.done();
@@ -906,8 +991,10 @@ namespace mongo {
         
         BSONObj min;
         BSONObj max;
+        BSONObj shardKeyPattern;
         
         long long numCloned;
+        long long clonedBytes;
         long long numCatchup;
         long long numSteady;
 
@@ -944,6 +1031,7 @@ namespace mongo {
             migrateStatus.from = cmdObj["from"].String();
             migrateStatus.min = cmdObj["min"].Obj().getOwned();
             migrateStatus.max = cmdObj["max"].Obj().getOwned();
+            migrateStatus.shardKeyPattern = cmdObj["shardKeyPattern"].type() == Object ? cmdObj["shardKeyPattern"].Obj().getOwned() : BSONObj();
             
             boost::thread m( migrateThread );
             
@@ -989,6 +1077,12 @@ namespace mongo {
             assert( isInRange( BSON( "x" << 4 ) , min , max ) );
             assert( ! isInRange( BSON( "x" << 5 ) , min , max ) );
             assert( ! isInRange( BSON( "x" << 6 ) , min , max ) );
+
+            // hashed keys compare the hash of the field
+            ShardKeyPattern hashed( BSON( "x" << HASHEDNAME ) );
+            long long h = BSONElementHasher::hash64( BSON( "x" << 3 ).firstElement() );
+            assert( isInRange( BSON( "x" << 3 ) , BSON( "x" << h ) , BSON( "x" << h + 1 ) , &hashed ) );
+            assert( ! isInRange( BSON( "x" << 3 ) , BSON( "x" << h + 1 ) , BSON( "x" << h + 2 ) , &hashed ) );
         }
     } isInRangeTest;
 }
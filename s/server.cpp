@@ -76,6 +76,9 @@ namespace mongo {
 
         virtual void process( Message& m , AbstractMessagingPort* p ){
             assert( p );
+            // before anything looks up the client's state: with --workers this thread last served
+            // some other client
+            setClientId( p->getClientId() );
             Request r( m , p );
 
             LastError * le = lastError.startRequest( m , r.getClientId() );
@@ -86,7 +89,6 @@ namespace mongo {
             }
             try {
                 r.init();
-                setClientId( r.getClientId() );
                 r.process();
             }
             catch ( DBException& e ){
@@ -103,6 +105,7 @@ namespace mongo {
 
         virtual void disconnected( AbstractMessagingPort* p ){
             ClientInfo::disconnect( p->getClientId() );
+            ShardConnection::clientDisconnected( p->getClientId() );
             lastError.disconnect( p->getClientId() );
         }
     };
@@ -169,6 +172,7 @@ int main(int argc, char* argv[], char *envp[] ) {
         ( "upgrade" , "upgrade meta data version" )
         ( "chunkSize" , po::value<int>(), "maximum amount of data per chunk" )
         ( "ipv6", "enable IPv6 support (disabled by default)" )
+        ( "workers" , po::value<int>(), "handle connections with this many worker threads instead of one thread each (linux only)" )
         ;
     
 
@@ -281,6 +285,8 @@ int main(int argc, char* argv[], char *envp[] ) {
     MessageServer::Options opts;
     opts.port = cmdLine.port;
     opts.ipList = cmdLine.bind_ip;
+    if ( params.count( "workers" ) )
+        opts.workers = params["workers"].as<int>();
     start(opts);
 
     dbexit( EXIT_CLEAN );
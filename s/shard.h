@@ -231,8 +231,11 @@ namespace mongo {
          */
         bool runCommand( const string& db , const BSONObj& cmd , BSONObj& res );
 
-        /** checks all of my thread local connections for the version of this ns */
+        /** checks all of my client's connections for the version of this ns */
         static void checkMyConnectionVersions( const string &  ns );
+
+        /** the client is gone: its connections go back to the pool */
+        static void clientDisconnected( int clientId );
         
     private:
         void _init();
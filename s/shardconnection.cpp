@@ -145,9 +145,25 @@ namespace mongo {
 
         // -----
         
+        /* one per client connection, not per thread: getLastError has to find the shard connections
+           the client's last writes went out on, and with --workers a client's requests run on any
+           thread.  a client has one request in flight at a time, so only one thread uses its set.
+           threads that aren't serving a client (no client id) get one of their own.
+        */
         static thread_specific_ptr<ClientConnections> _perThread;
+        static map<int,ClientConnections*>& _perClient;
+        static mongo::mutex _perClientMutex;
 
         static ClientConnections* get(){
+            int clientId = getClientId();
+            if ( clientId ){
+                scoped_lock lk( _perClientMutex );
+                ClientConnections*& cc = _perClient[clientId];
+                if ( ! cc )
+                    cc = new ClientConnections();
+                return cc;
+            }
+
             ClientConnections* cc = _perThread.get();
             if ( ! cc ){
                 cc = new ClientConnections();
@@ -155,9 +171,24 @@ namespace mongo {
             }
             return cc;
         }
+
+        static void disconnect( int clientId ){
+            ClientConnections* cc = 0;
+            {
+                scoped_lock lk( _perClientMutex );
+                map<int,ClientConnections*>::iterator i = _perClient.find( clientId );
+                if ( i == _perClient.end() )
+                    return;
+                cc = i->second;
+                _perClient.erase( i );
+            }
+            delete cc; // hands the connections back to the pool
+        }
     };
 
     thread_specific_ptr<ClientConnections> ClientConnections::_perThread;
+    map<int,ClientConnections*>& ClientConnections::_perClient = *(new map<int,ClientConnections*>());
+    mongo::mutex ClientConnections::_perClientMutex("ClientConnections::_perClient");
 
     ShardConnection::ShardConnection( const Shard * s , const string& ns )
         : _addr( s->getConnString() ) , _ns( ns ) {
@@ -229,6 +260,11 @@ namespace mongo {
         return ok;
     }
 
+    void ShardConnection::clientDisconnected( int clientId ){
+        if ( clientId )
+            ClientConnections::disconnect( clientId );
+    }
+
     void ShardConnection::checkMyConnectionVersions( const string & ns ){
         ClientConnections::get()->checkVersions( ns );
     }
@@ -23,9 +23,12 @@
 
 namespace mongo {
 
-    ShardKeyPattern::ShardKeyPattern( BSONObj p ) : pattern( p.getOwned() ) {
+    ShardKeyPattern::ShardKeyPattern( BSONObj p ) : pattern( p.getOwned() ) , hashed( false ) {
         pattern.getFieldNames(patternfields);
 
+        if ( pattern.nFields() == 1 && pattern.firstElement().type() == String )
+            hashed = HASHEDNAME == pattern.firstElement().valuestr();
+
         BSONObjBuilder min;
         BSONObjBuilder max;
 
@@ -124,8 +127,25 @@ namespace mongo {
             assert( k.extractKey( fromjson("{a:1,sub:{b:2,c:3}}") ).woEqual(x) );
             assert( k.extractKey( fromjson("{sub:{b:2,c:3},a:1}") ).woEqual(x) );
         }
+        void hashedtest(){
+            ShardKeyPattern k( BSON( "a" << HASHEDNAME ) );
+            assert( k.isHashed() );
+            assert( ! ShardKeyPattern( BSON( "a" << 1 ) ).isHashed() );
+            assert( k.globalMin().firstElement().type() == MinKey );
+
+            BSONObj five = k.extractKey( BSON( "b" << 1 << "a" << 5 ) );
+            assert( five.firstElement().type() == NumberLong );
+            assert( five.woEqual( BSON( "a" << BSONElementHasher::hash64( BSON( "" << 5 ).firstElement() ) ) ) );
+            assert( five.woEqual( k.extractKey( BSON( "a" << 5.0 ) ) ) );
+            assert( ! five.woEqual( k.extractKey( BSON( "a" << 6 ) ) ) );
+
+            assert( k.hasShardKey( BSON( "a" << 5 ) ) );
+            assert( k.extractKey( BSON( "b" << 5 ) ).isEmpty() );
+        }
+
         void run(){
             extractkeytest();
+            hashedtest();
 
             ShardKeyPattern k( BSON( "key" << 1 ) );
             
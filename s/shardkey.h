@@ -19,6 +19,7 @@
 #pragma once
 
 #include "../client/dbclient.h"
+#include "../db/hasher.h"
 
 namespace mongo {
     
@@ -26,6 +27,9 @@ namespace mongo {
 
     /* A ShardKeyPattern is a pattern indicating what data to extract from the object to make the shard key from.
        Analogous to an index key pattern.
+
+       { a : "hashed" } shards on the hash of a, as a hashed index on a stores it: the key of
+       { a : 5 } is { a : NumberLong(<hash of 5>) }, and chunk ranges are ranges of hashes.
     */
     class ShardKeyPattern {
     public:
@@ -55,6 +59,7 @@ namespace mongo {
         }
 
         /** compare shard keys from the objects specified
+           (documents; for a hashed key, extracting from a key would hash it again)
            l < r negative
            l == r 0
            l > r positive
@@ -78,6 +83,9 @@ namespace mongo {
             return patternfields.count( key ) > 0;
         }
 
+        /** @return whether keys are hashes of a single field, { a : "hashed" } */
+        bool isHashed() const { return hashed; }
+
         /**
          * @return
          * true if 'this' is a prefix (not necessarily contained) of 'otherPattern'.
@@ -88,12 +96,23 @@ namespace mongo {
         BSONObj pattern;
         BSONObj gMin;
         BSONObj gMax;
+        bool hashed;
 
         /* question: better to have patternfields precomputed or not?  depends on if we use copy constructor often. */
         set<string> patternfields;
     };
 
     inline BSONObj ShardKeyPattern::extractKey(const BSONObj& from) const { 
+        if ( hashed ){
+            BSONElement e = pattern.firstElement();
+            BSONElement v = from.getFieldDotted( e.fieldName() );
+            if ( v.eoo() )
+                return BSONObj();
+            BSONObjBuilder b;
+            b.append( e.fieldName() , BSONElementHasher::hash64( v ) );
+            return b.obj();
+        }
+
         BSONObj k = from.extractFields(pattern);
         uassert(13334, "Shard Key must be less than 512 bytes", k.objsize() < 512);
         return k;
@@ -79,6 +79,17 @@ namespace mongo {
         dbcon.done();
     }
 
+    /* one message for all of v */
+    void Strategy::insert( const Shard& shard , const char * ns , const vector<BSONObj>& v ){
+        ShardConnection dbcon( shard , ns );
+        if ( dbcon.setVersion() ){
+            dbcon.done();
+            throw StaleConfigException( ns , "for insert" );
+        }
+        dbcon->insert( ns , v );
+        dbcon.done();
+    }
+
     class WriteBackListener : public BackgroundJob {
     protected:
         string name() { return "WriteBackListener"; }
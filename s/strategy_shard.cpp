@@ -121,6 +121,7 @@ namespace mongo {
         
         void _insert( Request& r , DbMessage& d, ChunkManagerPtr manager ){
             
+            vector<BSONObj> todo;
             while ( d.moreJSObjs() ){
                 BSONObj o = d.nextJsObj();
                 if ( ! manager->hasShardKey( o ) ){
@@ -141,30 +142,56 @@ namespace mongo {
                     }
                     
                 }
-                
-                bool gotThrough = false;
-                for ( int i=0; i<10; i++ ){
+                todo.push_back( o );
+            }
+
+            /* each pass sends one message per shard; objects whose shard turned out to have a
+               stale config are routed again with a reloaded ChunkManager on the next pass */
+            for ( int i=0; i<10 && ! todo.empty(); i++ ){
+                if ( i > 0 ){
+                    sleepmillis( i * 200 );
+                    r.reset();
+                    manager = r.getChunkManager();
+                }
+
+                // objects keep their relative order within a shard's batch
+                map< Shard , vector<BSONObj> > byShard;
+                map< Shard , map< ChunkPtr , long > > written;
+                try {
+                    for ( unsigned j=0; j<todo.size(); j++ ){
+                        ChunkPtr c = manager->findChunk( todo[j] );
+                        log(4) << "  server:" << c->getShard().toString() << " " << todo[j] << endl;
+                        byShard[ c->getShard() ].push_back( todo[j] );
+                        written[ c->getShard() ][ c ] += todo[j].objsize();
+                    }
+                }
+                catch ( StaleConfigException& ){
+                    log(1) << "retrying " << todo.size() << " inserts because of StaleConfigException" << endl;
+                    continue;
+                }
+
+                vector<BSONObj> stale;
+                for ( map< Shard , vector<BSONObj> >::iterator s = byShard.begin(); s != byShard.end(); ++s ){
+                    const vector<BSONObj>& objs = s->second;
                     try {
-                        ChunkPtr c = manager->findChunk( o );
-                        log(4) << "  server:" << c->getShard().toString() << " " << o << endl;
-                        insert( c->getShard() , r.getns() , o );
-                        
-                        r.gotInsert();
-                        c->splitIfShould( o.objsize() );
-                        gotThrough = true;
-                        break;
+                        insert( s->first , r.getns() , objs );
                     }
                     catch ( StaleConfigException& ){
-                        log(1) << "retrying insert because of StaleConfigException: " << o << endl;
-                        r.reset();
-                        manager = r.getChunkManager();
+                        log(1) << "retrying " << objs.size() << " inserts for " << s->first.toString() << " because of StaleConfigException" << endl;
+                        stale.insert( stale.end() , objs.begin() , objs.end() );
+                        continue;
                     }
-                    sleepmillis( i * 200 );
-                }
 
-                assert( gotThrough );
+                    for ( unsigned j=0; j<objs.size(); j++ )
+                        r.gotInsert();
+                    map< ChunkPtr , long >& chunks = written[ s->first ];
+                    for ( map< ChunkPtr , long >::iterator c = chunks.begin(); c != chunks.end(); ++c )
+                        c->first->splitIfShould( c->second );
+                }
+                todo.swap( stale );
+            }
 
-            }            
+            assert( todo.empty() );
         }
 
         void _update( Request& r , DbMessage& d, ChunkManagerPtr manager ){
@@ -35,8 +35,10 @@ public:
     bool _drop;
     bool _indexesLast;
     const char * _curns;
+    bool _curIsIndexes;
+    map< string , vector<BSONObj> > _indexes; // system.indexes entries by the collection they index
 
-    Restore() : BSONTool( "restore" ) , _drop(false){
+    Restore() : BSONTool( "restore" ) , _drop(false) , _curIsIndexes(false){
         add_options()
             ("drop" , "drop each collection before import" )
             ("indexesLast" , "wait to add indexes (faster if data isn't inserted in index order)" )
@@ -158,13 +160,45 @@ public:
         }
         
         _curns = ns.c_str();
+        _curIsIndexes = endsWith( _curns , ".system.indexes" );
         processFile( root );
+        if ( _curIsIndexes )
+            createIndexes();
     }
 
     virtual void gotObject( const BSONObj& obj ){
+        if ( _curIsIndexes ){
+            _indexes[ obj.getStringField( "ns" ) ].push_back( obj.getOwned() );
+            return;
+        }
         conn().insert( _curns , obj );
     }
 
+    /* one createIndexes per collection, so the server scans each collection once for all its
+       indexes.  servers without the command get the index entries inserted one at a time. */
+    void createIndexes(){
+        for ( map< string , vector<BSONObj> >::iterator i = _indexes.begin(); i != _indexes.end(); i++ ){
+            const string& ns = i->first;
+            string db = nsToDatabase( ns.c_str() );
+            
+            BSONObjBuilder cmd;
+            cmd.append( "createIndexes" , ns.substr( db.size() + 1 ) );
+            BSONArrayBuilder specs( cmd.subarrayStart( "indexes" ) );
+            for ( unsigned j=0; j<i->second.size(); j++ )
+                specs.append( i->second[j] );
+            specs.done();
+
+            BSONObj res;
+            if ( conn().runCommand( db , cmd.obj() , res ) )
+                continue;
+            
+            log(1) << "	 createIndexes failed for " << ns << ": " << res << endl;
+            for ( unsigned j=0; j<i->second.size(); j++ )
+                conn().insert( _curns , i->second[j] );
+        }
+        _indexes.clear();
+    }
+
     
 };
 
@@ -50,6 +50,11 @@ namespace mongo {
         void sort( int (*comp)(const void *, const void *) ){
             qsort( _data , _size , sizeof(T) , comp );
         }
+
+        template< class Cmp >
+        void sort( const Cmp& cmp ){
+            std::sort( _data , _data + _size , cmp );
+        }
         
         int size(){
             return _size;
@@ -0,0 +1,168 @@
+// intent_lock.h
+
+/*
+ *    Copyright (C) 2010 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "mutex.h"
+
+namespace mongo {
+
+    /**
+     * multiple granularity lock.  S and X behave like the shared and exclusive modes of an
+     * RWLock.  IS and IX are taken by threads that are about to lock something *below* this
+     * lock (e.g. one database) in shared or exclusive mode respectively.
+     *
+     *         IS  IX  S   X
+     *     IS  y   y   y   n
+     *     IX  y   y   n   n
+     *     S   y   n   y   n
+     *     X   n   n   n   n
+     *
+     * not recursive - callers track their own nesting.
+     * waiting X requests block new requests of any other mode so writers are not starved.
+     */
+    class IntentLock : boost::noncopyable {
+    public:
+        enum Mode { IS = 0 , IX = 1 , S = 2 , X = 3 , NModes = 4 };
+
+        IntentLock( const char * name ) : _name( name ) , _m( name ) , _waitingX(0) {
+            for ( int i=0; i<NModes; i++ ){
+                _n[i] = 0;
+                _waits[i] = 0;
+                _waitMicros[i] = 0;
+            }
+        }
+
+        void lock( Mode m ){
+            {
+                scoped_lock lk( _m );
+                if ( m == X )
+                    _waitingX++;
+                if ( ! _grantable( m ) ){
+                    unsigned long long start = curTimeMicros64();
+                    while ( ! _grantable( m ) )
+                        _c.wait( lk.boost() );
+                    _waited( m , start );
+                }
+                _granted( m );
+            }
+            _entered( m );
+        }
+
+        /** @return true if acquired within millis */
+        bool lock( Mode m , int millis ){
+            boost::system_time until = get_system_time();
+            until += boost::posix_time::milliseconds(millis);
+
+            {
+                scoped_lock lk( _m );
+                if ( m == X )
+                    _waitingX++;
+                if ( ! _grantable( m ) ){
+                    unsigned long long start = curTimeMicros64();
+                    while ( ! _grantable( m ) ){
+                        if ( ! _c.timed_wait( lk.boost() , until ) && ! _grantable( m ) ){
+                            if ( m == X ){
+                                _waitingX--;
+                                _c.notify_all();
+                            }
+                            _waited( m , start );
+                            return false;
+                        }
+                    }
+                    _waited( m , start );
+                }
+                _granted( m );
+            }
+            _entered( m );
+            return true;
+        }
+
+        void unlock( Mode m ){
+            {
+                scoped_lock lk( _m );
+                assert( _n[m] > 0 );
+                _n[m]--;
+            }
+#if defined(_DEBUG)
+            if ( m == X )
+                mutexDebugger.leaving( _name );
+#endif
+            _c.notify_all();
+        }
+
+        /** number of holders in mode m; for diagnostics only */
+        int holders( Mode m ) {
+            scoped_lock lk( _m );
+            return _n[m];
+        }
+
+        /** how many requests for mode m had to wait, and for how long in total */
+        void waitStats( Mode m , unsigned long long& waits , unsigned long long& micros ) {
+            scoped_lock lk( _m );
+            waits = _waits[m];
+            micros = _waitMicros[m];
+        }
+
+        static const char * modeName( Mode m ){
+            static const char * names[] = { "IS" , "IX" , "S" , "X" };
+            return names[m];
+        }
+
+    private:
+        bool _grantable( Mode m ) const {
+            if ( _n[X] )
+                return false;
+            switch ( m ){
+            case IS: return _waitingX == 0;
+            case IX: return _waitingX == 0 && _n[S] == 0;
+            case S:  return _waitingX == 0 && _n[IX] == 0;
+            case X:  return _n[IS] == 0 && _n[IX] == 0 && _n[S] == 0;
+            default: assert(false);
+            }
+            return false;
+        }
+
+        void _granted( Mode m ){
+            if ( m == X )
+                _waitingX--;
+            _n[m]++;
+        }
+
+        void _waited( Mode m , unsigned long long start ){
+            _waits[m]++;
+            _waitMicros[m] += curTimeMicros64() - start;
+        }
+
+        void _entered( Mode m ){
+#if defined(_DEBUG)
+            if ( m == X )
+                mutexDebugger.entering( _name );
+#endif
+        }
+
+        const char * _name;
+        mongo::mutex _m;
+        boost::condition _c;
+        int _n[NModes];
+        int _waitingX;
+        unsigned long long _waits[NModes];
+        unsigned long long _waitMicros[NModes];
+    };
+
+}
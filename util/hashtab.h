@@ -24,6 +24,7 @@
 
 #include "../pch.h"
 #include <map>
+#include "../db/dur.h"
 
 namespace mongo {
 
@@ -127,7 +128,7 @@ namespace mongo {
             bool found;
             int i = _find(k, found);
             if ( i >= 0 && found ) {
-                Node& n = nodes(i);
+                Node& n = *dur::writing( &nodes(i) );
                 n.k.kill();
                 n.setUnused();
             }
@@ -147,7 +148,7 @@ namespace mongo {
             int i = _find(k, found);
             if ( i < 0 )
                 return false;
-            Node& n = nodes(i);
+            Node& n = *dur::writing( &nodes(i) );
             if ( !found ) {
                 n.k = k;
                 n.hash = k.hash();
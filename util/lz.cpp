@@ -0,0 +1,151 @@
+// util/lz.cpp
+
+/*    Copyright 2010 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "pch.h"
+#include "lz.h"
+
+namespace mongo {
+    namespace lz {
+
+        enum { MinMatch = 4 , MaxOffset = 0xffff , HashBits = 12 };
+
+        typedef unsigned char byte;
+
+        static inline unsigned read32( const byte * p ) {
+            unsigned x;
+            memcpy( &x , p , 4 );
+            return x;
+        }
+
+        static inline unsigned hash( unsigned x ) {
+            return ( x * 2654435761U ) >> ( 32 - HashBits );
+        }
+
+        static inline byte * putLength( byte * out , size_t n ) {
+            for ( ; n >= 255; n -= 255 )
+                *out++ = 255;
+            *out++ = (byte) n;
+            return out;
+        }
+
+        /* @return false if the length runs past end */
+        static inline bool getLength( const byte *& in , const byte * end , size_t& n ) {
+            unsigned c;
+            do {
+                if ( in >= end )
+                    return false;
+                c = *in++;
+                n += c;
+            } while ( c == 255 );
+            return true;
+        }
+
+        /* a sequence; matchLen 0 for the last one */
+        static byte * put( byte * out , const byte * lit , size_t litLen , unsigned offset , size_t matchLen ) {
+            byte * token = out++;
+            size_t m = matchLen ? matchLen - MinMatch : 0;
+            *token = (byte) ( ( ( litLen < 15 ? litLen : 15 ) << 4 ) | ( m < 15 ? m : 15 ) );
+            if ( litLen >= 15 )
+                out = putLength( out , litLen - 15 );
+            memcpy( out , lit , litLen );
+            out += litLen;
+            if ( ! matchLen )
+                return out;
+            *out++ = (byte) offset;
+            *out++ = (byte) ( offset >> 8 );
+            if ( m >= 15 )
+                out = putLength( out , m - 15 );
+            return out;
+        }
+
+        int compress( const char * src , int len , char * dst ) {
+            const byte * in = (const byte *) src;
+            byte * out = (byte *) dst;
+            int table[ 1 << HashBits ];
+            for ( int i = 0; i < ( 1 << HashBits ); i++ )
+                table[i] = -1;
+
+            int anchor = 0;
+            int i = 0;
+            int misses = 0;
+            while ( i <= len - MinMatch ) {
+                unsigned x = read32( in + i );
+                unsigned h = hash( x );
+                int ref = table[h];
+                table[h] = i;
+                if ( ref < 0 || i - ref > MaxOffset || read32( in + ref ) != x ) {
+                    // skip faster through data that doesn't compress
+                    i += 1 + ( misses++ >> 5 );
+                    continue;
+                }
+                misses = 0;
+                int m = MinMatch;
+                while ( i + m < len && in[ ref + m ] == in[ i + m ] )
+                    m++;
+                out = put( out , in + anchor , i - anchor , i - ref , m );
+                i += m;
+                anchor = i;
+            }
+            out = put( out , in + anchor , len - anchor , 0 , 0 );
+            return (int) ( out - (byte *) dst );
+        }
+
+        bool decompress( const char * src , int len , char * dst , int outLen ) {
+            const byte * in = (const byte *) src;
+            const byte * end = in + len;
+            byte * out = (byte *) dst;
+            byte * oend = out + outLen;
+            while ( in < end ) {
+                unsigned token = *in++;
+
+                size_t lit = token >> 4;
+                if ( lit == 15 && ! getLength( in , end , lit ) )
+                    return false;
+                if ( lit > (size_t) ( end - in ) || lit > (size_t) ( oend - out ) )
+                    return false;
+                memcpy( out , in , lit );
+                out += lit;
+                in += lit;
+                if ( in == end )
+                    break; // the last sequence
+
+                if ( end - in < 2 )
+                    return false;
+                size_t offset = in[0] | ( in[1] << 8 );
+                in += 2;
+                size_t m = token & 15;
+                if ( m == 15 && ! getLength( in , end , m ) )
+                    return false;
+                m += MinMatch;
+                if ( offset == 0 || offset > (size_t) ( out - (byte *) dst ) || m > (size_t) ( oend - out ) )
+                    return false;
+                const byte * ref = out - offset;
+                if ( offset >= m ) {
+                    memcpy( out , ref , m );
+                    out += m;
+                }
+                else {
+                    // overlaps what it writes: a run
+                    for ( size_t k = 0; k < m; k++ )
+                        *out++ = *ref++;
+                }
+            }
+            return out == oend;
+        }
+
+    }
+}
@@ -0,0 +1,49 @@
+// util/lz.h
+
+/*    Copyright 2010 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+namespace mongo {
+
+    /* a fast LZ77 block codec, for small blocks such as records.  no entropy coding: it trades
+       ratio for speed, decompressing at memory speed, which is what reading records needs.
+
+       a block is a run of sequences:
+         token      : high 4 bits literal count, low 4 bits match length - 4.  15 means more follows,
+                      as bytes added on until one isn't 255.
+         literals
+         offset     : 2 bytes little endian, back from here.  absent in the last sequence, which
+                      ends the block.
+         match length bytes, if the token said so
+    */
+    namespace lz {
+
+        /** room compress() needs for len bytes */
+        inline int maxCompressedLength( int len ) {
+            return len + len / 255 + 16;
+        }
+
+        /** @return the length of the block written to out, which must have
+                    maxCompressedLength( len ) bytes */
+        int compress( const char * in , int len , char * out );
+
+        /** @return false, with out in any state, unless the block is well formed and comes to
+                    exactly outLen bytes */
+        bool decompress( const char * in , int len , char * out , int outLen );
+
+    }
+}
@@ -293,12 +293,12 @@ namespace mongo {
         ports.closeAll();
     }
 
-    MessagingPort::MessagingPort(int _sock, const SockAddr& _far) : sock(_sock), piggyBackData(0), farEnd(_far), _timeout() {
+    MessagingPort::MessagingPort(int _sock, const SockAddr& _far) : sock(_sock), piggyBackData(0), _partialLen(0), _partialGot(0), _partial(0), farEnd(_far), _timeout() {
         _logLevel = 0;
         ports.insert(this);
     }
 
-    MessagingPort::MessagingPort( int timeout, int ll ) {
+    MessagingPort::MessagingPort( int timeout, int ll ) : _partialLen(0), _partialGot(0), _partial(0) {
         _logLevel = ll;
         ports.insert(this);
         sock = -1;
@@ -316,6 +316,8 @@ namespace mongo {
     MessagingPort::~MessagingPort() {
         if ( piggyBackData )
             delete( piggyBackData );
+        if ( _partial )
+            free( _partial );
         shutdown();
         ports.erase(this);
     }
@@ -388,24 +390,8 @@ namespace mongo {
             recv( lenbuf, lft );
             
             if ( len < 16 || len > 16000000 ) { // messages must be large enough for headers
-                if ( len == -1 ) {
-                    // Endian check from the database, after connecting, to see what mode server is running in.
-                    unsigned foo = 0x10203040;
-                    send( (char *) &foo, 4, "endian" );
+                if ( _badLength( len ) )
                     goto again;
-                }
-                
-                if ( len == 542393671 ){
-                    // an http GET
-                    log(_logLevel) << "looks like you're trying to access db over http on native driver port.  please add 1000 for webserver" << endl;
-                    string msg = "You are trying to access MongoDB on the native driver port. For http diagnostic access, add 1000 to the port number\n";
-                    stringstream ss;
-                    ss << "HTTP/1.0 200 OK\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: " << msg.size() << "\r\n\r\n" << msg;
-                    string s = ss.str();
-                    send( s.c_str(), s.size(), "http" );
-                    return false;
-                }
-                log(_logLevel) << "bad recv() len: " << len << '\n';
                 return false;
             }
             
@@ -435,6 +421,91 @@ namespace mongo {
         }
     }
     
+    bool MessagingPort::_badLength( int len ) {
+        if ( len == -1 ) {
+            // Endian check from the database, after connecting, to see what mode server is running in.
+            unsigned foo = 0x10203040;
+            send( (char *) &foo, 4, "endian" );
+            return true;
+        }
+        
+        if ( len == 542393671 ){
+            // an http GET
+            log(_logLevel) << "looks like you're trying to access db over http on native driver port.  please add 1000 for webserver" << endl;
+            string msg = "You are trying to access MongoDB on the native driver port. For http diagnostic access, add 1000 to the port number\n";
+            stringstream ss;
+            ss << "HTTP/1.0 200 OK\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: " << msg.size() << "\r\n\r\n" << msg;
+            string s = ss.str();
+            send( s.c_str(), s.size(), "http" );
+            return false;
+        }
+        log(_logLevel) << "bad recv() len: " << len << '\n';
+        return false;
+    }
+
+#if !defined(_WIN32)
+    MessagingPort::RecvResult MessagingPort::recvNonBlocking( Message& m ) {
+        try {
+            while ( ! _partial ) {
+                int got = _recvAvailable( (char *) &_partialLen + _partialGot , 4 - _partialGot );
+                if ( got == 0 )
+                    return RecvMore;
+                _partialGot += got;
+                if ( _partialGot < 4 )
+                    continue;
+
+                if ( _partialLen < 16 || _partialLen > 16000000 ) { // messages must be large enough for headers
+                    if ( ! _badLength( _partialLen ) )
+                        return RecvClosed;
+                    _partialGot = 0;
+                    continue;
+                }
+
+                int z = (_partialLen+1023)&0xfffffc00;
+                assert(z>=_partialLen);
+                _partial = (MsgData *) malloc(z);
+                assert(_partial);
+                _partial->len = _partialLen;
+            }
+
+            while ( _partialGot < _partialLen ) {
+                int got = _recvAvailable( (char *) _partial + _partialGot , _partialLen - _partialGot );
+                if ( got == 0 )
+                    return RecvMore;
+                _partialGot += got;
+            }
+
+            m.setData( _partial , true );
+            _partial = 0;
+            _partialGot = 0;
+            return RecvMessage;
+
+        } catch ( const SocketException & e ) {
+            log(_logLevel + e.shouldPrint() ? 0 : 1 ) << "SocketException: " << e << endl;
+            return RecvClosed;
+        }
+    }
+
+    int MessagingPort::_recvAvailable( char *buf , int max ) {
+        while ( 1 ) {
+            int ret = ::recv( sock , buf , max , portRecvFlags | MSG_DONTWAIT );
+            if ( ret > 0 )
+                return ret;
+            if ( ret == 0 ) {
+                log(3) << "MessagingPort recv() conn closed? " << farEnd.toString() << endl;
+                throw SocketException( SocketException::CLOSED );
+            }
+            int e = errno;
+            if ( e == EINTR )
+                continue;
+            if ( e == EAGAIN || e == EWOULDBLOCK )
+                return 0;
+            log(_logLevel) << "MessagingPort recv() " << errnoWithDescription(e) << " " << farEnd.toString()<<endl;
+            throw SocketException( SocketException::RECV_ERROR );
+        }
+    }
+#endif
+
     void MessagingPort::reply(Message& received, Message& response) {
         say(/*received.from, */response, received.header()->id);
     }
@@ -28,6 +28,7 @@ namespace mongo {
     class Message;
     class MessagingPort;
     class PiggyBackData;
+    struct MsgData;
     typedef AtomicUInt MSGID;
 
     class Listener {
@@ -127,9 +128,32 @@ namespace mongo {
         void recv( char * data , int len );
         
         int unsafe_recv( char *buf, int max );
+
+        enum RecvResult { RecvMore , RecvMessage , RecvClosed };
+
+        /* like recv(Message&), but only reads what has already arrived.  a partly received 
+           message is kept in the port until the next call.  for servers that poll many ports 
+           from one thread; not supported on windows.
+           @return RecvMessage if m now holds a whole message, RecvMore if we need to wait for 
+                   more data, RecvClosed if the connection should be dropped
+        */
+        RecvResult recvNonBlocking( Message& m );
+
+        /* for registering with poll/epoll.  don't read from it directly. */
+        int getSocket() const { return sock; }
     private:
+        /* @return true if len was an endian probe and we should read the length again */
+        bool _badLength( int len );
+        /* like recv(char*,int) but returns how much was read, 0 if it would block */
+        int _recvAvailable( char *buf , int max );
+
         int sock;
         PiggyBackData * piggyBackData;
+
+        // recvNonBlocking() state
+        int _partialLen;
+        int _partialGot;
+        MsgData * _partial;
     public:
         SockAddr farEnd;
         int _timeout;
@@ -38,8 +38,10 @@ namespace mongo {
         struct Options {
             int port;                   // port to bind to
             string ipList;             // addresses to bind to
+            int workers;                // >0 : serve all connections from an epoll thread and this many 
+                                        //      worker threads instead of a thread each (linux only)
 
-            Options() : port(0), ipList(""){} 
+            Options() : port(0), ipList(""), workers(0){} 
         };
 
         virtual ~MessageServer(){}
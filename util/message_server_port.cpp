@@ -24,13 +24,16 @@
 
 #include "../db/cmdline.h"
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include "concurrency/thread_pool.h"
+#endif
+
 namespace mongo {
 
     namespace pms {
 
-        MessageHandler * handler;
-        
-        void threadRun( MessagingPort * inPort){
+        void threadRun( MessagingPort * inPort , MessageHandler * handler ){
             assert( inPort );
             
             setThreadName( "conn" );
@@ -70,15 +73,137 @@ namespace mongo {
             handler->disconnected( p.get() );
         }
 
+#if defined(__linux__)
+
+        /**
+         * serves every connection from one epoll thread plus a fixed pool of workers, instead of 
+         * a thread per connection.
+         *
+         * the epoll thread reads whatever has arrived on a socket (MessagingPort::recvNonBlocking)
+         * and when a whole message is there hands it to the pool, which calls 
+         * MessageHandler::process.  sockets are registered EPOLLONESHOT and only re-armed by the 
+         * worker once process() returns, so a connection never has more than one message in 
+         * flight: its requests are handled, and replied to, in the order they were sent.  
+         * replies are written by the worker with the normal blocking send.
+         */
+        class EventLoop : boost::noncopyable {
+        public:
+            EventLoop( MessageHandler * handler , int workers ) 
+                : _handler( handler ) , _pool( workers ) {
+                _epfd = epoll_create( 1024 );
+                massert( 13424 , str::stream() << "epoll_create failed: " << errnoWithDescription() , _epfd >= 0 );
+            }
+
+            void add( MessagingPort * p ){
+                Conn * c = new Conn( p );
+                _arm( c , EPOLL_CTL_ADD );
+            }
+
+            void run(){
+                setThreadName( "epoll" );
+                const int MaxEvents = 256;
+                struct epoll_event events[MaxEvents];
+                while ( ! inShutdown() ){
+                    int n = epoll_wait( _epfd , events , MaxEvents , 100 );
+                    if ( n < 0 ){
+                        int x = errno;
+                        if ( x == EINTR )
+                            continue;
+                        log() << "epoll_wait failed: " << errnoWithDescription(x) << endl;
+                        return;
+                    }
+                    for ( int i=0; i<n; i++ )
+                        _readable( (Conn*) events[i].data.ptr );
+                }
+            }
+
+        private:
+            struct Conn {
+                Conn( MessagingPort * p ) : port( p ){}
+                MessagingPort * port;
+                Message m;
+            };
+
+            void _arm( Conn * c , int op ){
+                struct epoll_event e;
+                memset( &e , 0 , sizeof(e) );
+                e.events = EPOLLIN | EPOLLONESHOT;
+                e.data.ptr = c;
+                if ( epoll_ctl( _epfd , op , c->port->getSocket() , &e ) ){
+                    log() << "epoll_ctl failed: " << errnoWithDescription() << ", closing connection" << endl;
+                    _close( c );
+                }
+            }
+
+            /** only called when c isn't armed, so nothing else is touching it */
+            void _readable( Conn * c ){
+                switch ( c->port->recvNonBlocking( c->m ) ){
+                case MessagingPort::RecvMore:
+                    _arm( c , EPOLL_CTL_MOD );
+                    break;
+                case MessagingPort::RecvMessage:
+                    _pool.schedule( &EventLoop::_process , this , c );
+                    break;
+                case MessagingPort::RecvClosed:
+                    if( !cmdLine.quiet )
+                        log() << "end connection " << c->port->farEnd.toString() << endl;
+                    _close( c );
+                    break;
+                }
+            }
+
+            void _process( Conn * c ){
+                setThreadName( "conn" );
+                try {
+                    _handler->process( c->m , c->port );
+                    c->m.reset();
+                    _arm( c , EPOLL_CTL_MOD );
+                    return;
+                }
+                catch ( const SocketException& ){
+                    log() << "unclean socket shutdown from: " << c->port->farEnd.toString() << endl;
+                }
+                catch ( const std::exception& e ){
+                    problem() << "uncaught exception (" << e.what() << ")(" << demangleName( typeid(e) ) <<") in PortMessageServer, closing connection" << endl;
+                }
+                catch ( ... ){
+                    problem() << "uncaught exception in PortMessageServer, closing connection" << endl;
+                }
+                _close( c );
+            }
+
+            void _close( Conn * c ){
+                if ( c->port->getSocket() >= 0 )
+                    epoll_ctl( _epfd , EPOLL_CTL_DEL , c->port->getSocket() , 0 );
+                _handler->disconnected( c->port );
+                c->port->shutdown();
+                delete c->port;
+                delete c;
+                connTicketHolder.release();
+            }
+
+            MessageHandler * _handler;
+            int _epfd;
+            ThreadPool _pool;
+        };
+
+#endif
+
     }
 
     class PortMessageServer : public MessageServer , public Listener {
     public:
-            PortMessageServer(  const MessageServer::Options& opts, MessageHandler * handler ) :
-            Listener( opts.ipList, opts.port ){
+        PortMessageServer(  const MessageServer::Options& opts, MessageHandler * handler ) :
+            Listener( opts.ipList, opts.port ) , _handler( handler ) {
             
-            uassert( 10275 ,  "multiple PortMessageServer not supported" , ! pms::handler );
-            pms::handler = handler;
+            if ( opts.workers > 0 ){
+#if defined(__linux__)
+                log() << "serving connections with " << opts.workers << " worker threads" << endl;
+                _loop.reset( new pms::EventLoop( handler , opts.workers ) );
+#else
+                log() << "warning: worker pool needs epoll, using a thread per connection" << endl;
+#endif
+            }
         }
         
         virtual void accepted(MessagingPort * p) {
@@ -94,8 +219,15 @@ namespace mongo {
                 return;
             }
 
+#if defined(__linux__)
+            if ( _loop.get() ){
+                _loop->add( p );
+                return;
+            }
+#endif
+
             try {
-                boost::thread thr( boost::bind( &pms::threadRun , p ) );
+                boost::thread thr( boost::bind( &pms::threadRun , p , _handler ) );
             }
             catch ( boost::thread_resource_error& ){
                 log() << "can't create new thread, closing connection" << endl;
@@ -108,9 +240,18 @@ namespace mongo {
         }
         
         void run(){
+#if defined(__linux__)
+            if ( _loop.get() )
+                boost::thread thr( boost::bind( &pms::EventLoop::run , _loop.get() ) );
+#endif
             initAndListen();
         }
 
+    private:
+        MessageHandler * _handler;
+#if defined(__linux__)
+        auto_ptr<pms::EventLoop> _loop;
+#endif
     };
 
 
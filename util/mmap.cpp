@@ -57,6 +57,9 @@ namespace mongo {
 
     static set<MongoFile*> mmfiles;
     static RWLock mmmutex("rw:mmmutex");
+    static unsigned long long nextFileId = 1; // under mmmutex
+
+    bool MongoFile::_privateViews = false;
 
     void MongoFile::destroyed() {
         rwlock lk( mmmutex , true );
@@ -133,8 +136,126 @@ namespace mongo {
         return seen.size();
     }
 
+    /*static*/ bool MongoFile::flushNext( FlushCursor& pos , long maxLen , long& flushed ){
+        flushed = 0;
+
+        // the sync happens after mmmutex is released, as in flushAll(): created() needs it
+        // exclusively, under the db write lock, and mustn't wait on the disk
+        auto_ptr<Flushable> f;
+        {
+            rwlock lk( mmmutex , false );
+            set<MongoFile*>::iterator i = mmfiles.lower_bound( pos.file );
+            if ( i != mmfiles.end() && *i == pos.file ){
+                if ( pos.offset >= (*i)->length() ){
+                    ++i;
+                    pos.offset = 0;
+                }
+            }
+            else {
+                // that file was closed; carry on with the next one
+                pos.offset = 0;
+            }
+            while ( i != mmfiles.end() && ! *i )
+                ++i;
+
+            if ( i == mmfiles.end() ){
+                pos = FlushCursor();
+                return false;
+            }
+
+            MongoFile * mmf = *i;
+            long len = std::min( maxLen , mmf->length() - pos.offset );
+            if ( len > 0 )
+                f.reset( mmf->prepareFlushRange( pos.offset , len ) );
+            pos.file = mmf;
+            pos.offset += std::max( len , 1L );
+            flushed = std::max( len , 0L );
+        }
+
+        if ( f.get() )
+            f->flush();
+        return true;
+    }
+
+    /*static*/ bool MongoFile::touch( const char *p , int len ){
+        // hold mmmutex so the file can't be unmapped out from under us: destroyed() needs
+        // it exclusively and happens before close()
+        rwlock lk( mmmutex , false );
+        for ( set<MongoFile*>::iterator i = mmfiles.begin(); i != mmfiles.end(); i++ ){
+            MongoFile * mmf = *i;
+            if ( ! mmf || ! mmf->_contains( p ) || ! mmf->_contains( p + len - 1 ) )
+                continue;
+            
+            const int pageSize = 4096;
+            volatile char x = 0;
+            for ( const char *q = p; q < p + len; q += pageSize )
+                x += *(volatile const char*)q;
+            x += *(volatile const char*)(p + len - 1);
+            return true;
+        }
+        return false;
+    }
+
+    /*static*/ bool MongoFile::locate( const char *p , string& filename , const char *& view , long& length , 
+                                       unsigned long long& fileId ){
+        rwlock lk( mmmutex , false );
+        for ( set<MongoFile*>::iterator i = mmfiles.begin(); i != mmfiles.end(); i++ ){
+            MongoFile * mmf = *i;
+            if ( ! mmf || ! mmf->_contains( p ) )
+                continue;
+            filename = mmf->_name();
+            view = mmf->_view();
+            length = mmf->length();
+            fileId = mmf->_fileId;
+            return true;
+        }
+        return false;
+    }
+
+    /*static*/ bool MongoFile::writeShared( unsigned long long fileId , long ofs , const char *p , unsigned len ){
+        // mmmutex keeps the file mapped while we copy
+        rwlock lk( mmmutex , false );
+        for ( set<MongoFile*>::iterator i = mmfiles.begin(); i != mmfiles.end(); i++ ){
+            MongoFile * mmf = *i;
+            if ( ! mmf || mmf->_fileId != fileId )
+                continue;
+            char * shared = mmf->_sharedView();
+            if ( ! shared || ofs + (long) len > mmf->length() )
+                return false;
+            if ( shared + ofs != p )
+                memcpy( shared + ofs , p , len );
+            return true;
+        }
+        return false;
+    }
+
+    /*static*/ bool MongoFile::remapPrivateViews(){
+        if ( ! _privateViews )
+            return true;
+        rwlock lk( mmmutex , false );
+        bool ok = true;
+        for ( set<MongoFile*>::iterator i = mmfiles.begin(); i != mmfiles.end(); i++ ){
+            MongoFile * mmf = *i;
+            if ( ! mmf || ! mmf->_view() || mmf->_view() == mmf->_sharedView() )
+                continue;
+            DEV {
+                // a write no one declared would be lost here
+                if ( memcmp( mmf->_view() , mmf->_sharedView() , mmf->length() ) ){
+                    long ofs = 0;
+                    while ( mmf->_view()[ofs] == mmf->_sharedView()[ofs] )
+                        ofs++;
+                    log() << "warning: undeclared write to " << mmf->_name() << " at " << ofs << endl;
+                }
+            }
+            if ( ! mmf->_remapPrivateView() )
+                ok = false;
+        }
+        return ok;
+    }
+
     void MongoFile::created(){
         rwlock lk( mmmutex , true );
+        _fileId = nextFileId++;
         mmfiles.insert(this);
     }
 
@@ -33,6 +33,13 @@ namespace mongo {
     protected:
         virtual void close() = 0;
         virtual void flush(bool sync) = 0;
+        /**
+         * like prepareFlush(), for [offset, offset+len) only.  default: the whole file once per 
+         * pass, at offset 0, and nothing (0) for the other ranges.
+         */
+        virtual Flushable * prepareFlushRange( long offset , long len ) { 
+            return offset == 0 ? prepareFlush() : 0;
+        }
         /**
          * returns a thread safe object that you can call flush on
          * Flushable has to fail nicely if the underlying object gets killed
@@ -46,6 +53,17 @@ namespace mongo {
         virtual void _lock() {}
         virtual void _unlock() {}
 
+        /** @return true if p is within the region currently mapped for this file */
+        virtual bool _contains( const char *p ) { return false; }
+
+        /** start of the mapping writers use, 0 if there is none */
+        virtual char * _view() { return 0; }
+        /** the mapping onto the file itself.  not _view() only with private views */
+        virtual char * _sharedView() { return _view(); }
+        /** maps the private view again from the file, at the same address.  @return false if that failed */
+        virtual bool _remapPrivateView() { return true; }
+        virtual string _name() { return ""; }
+
     public:
         virtual ~MongoFile() {}
         virtual long length() = 0;
@@ -55,9 +73,63 @@ namespace mongo {
         };
 
         static int flushAll( bool sync ); // returns n flushed
+
+        /** where flushNext() is in its pass over the mapped files */
+        struct FlushCursor {
+            FlushCursor() : file(0) , offset(0) {}
+            MongoFile * file; // only compared, never dereferenced: it may have been closed since
+            long offset;
+        };
+
+        /**
+         * sync the next region, at most maxLen bytes, of the mapped files and move pos past it.
+         * lets the data be flushed a little at a time instead of all at once.
+         * @param flushed set to the size of the region
+         * @return false, with pos reset, when the pass over all files is complete
+         */
+        static bool flushNext( FlushCursor& pos , long maxLen , long& flushed );
         static long long totalMappedLength();
         static void closeAllFiles( stringstream &message );
 
+        /**
+         * read a byte from each page of [p, p+len) so the os pages it in.  does nothing if p is 
+         * not within a file that is still mapped, so it is safe to call without the db lock.
+         * @return false if p wasn't in a mapped file
+         */
+        static bool touch( const char *p , int len );
+
+        /**
+         * find the mapped file p is in.  
+         * @param view set to the start of that file's mapping, and length to its length
+         * @param fileId set to a number for the file that no other file gets, even once it's closed
+         * @return false if p isn't within a file that is still mapped
+         */
+        static bool locate( const char *p , string& filename , const char *& view , long& length , 
+                            unsigned long long& fileId );
+
+        /**
+         * files mapped from now on are mapped twice: copy on write for the code that uses them, 
+         * so what it writes stays in memory, and shared, onto the file.  bytes get to the file
+         * only when copied to the shared view with writeShared(), which --journal does once they
+         * are in the journal.  set before mapping anything.
+         */
+        static void usePrivateViews( bool b = true ) { _privateViews = b; }
+        static bool privateViews() { return _privateViews; }
+
+        /**
+         * copies [p, p+len) to ofs in the shared view of file fileId.
+         * @return false if that file has been closed
+         */
+        static bool writeShared( unsigned long long fileId , long ofs , const char *p , unsigned len );
+
+        /**
+         * the private views keep their copy of every page written to.  this maps them again, at 
+         * the same addresses, to give that memory back.  call with the write lock, once all that 
+         * was written has been copied to the shared views.
+         * @return false if a view couldn't be mapped again: the process can't go on then
+         */
+        static bool remapPrivateViews();
+
         // Locking allows writes. Reads are always allowed
         static void lockAll();
         static void unlockAll();
@@ -66,6 +138,10 @@ namespace mongo {
         static bool exists(boost::filesystem::path p) {
             return boost::filesystem::exists(p);
         }
+
+    private:
+        static bool _privateViews;
+        unsigned long long _fileId; // set by created()
     };
 
 #ifndef _DEBUG
@@ -159,6 +235,7 @@ namespace mongo {
         void* map(const char *filename, long &length, int options = 0 );
 
         void flush(bool sync);
+        virtual Flushable * prepareFlushRange( long offset , long len );
         virtual Flushable * prepareFlush();
 
         /*void* viewOfs() {
@@ -175,6 +252,7 @@ namespace mongo {
         HANDLE fd;
         HANDLE maphandle;
         void *view;
+        void *_privateView; // 0 unless privateViews()
         long len;
         string _filename;
 
@@ -183,6 +261,16 @@ namespace mongo {
         virtual void _lock();
         virtual void _unlock();
 
+        virtual bool _contains( const char *p ) {
+            char *v = _view();
+            return v && p >= v && p < v + len;
+        }
+
+        virtual char * _view() { return (char*) ( _privateView ? _privateView : view ); }
+        virtual char * _sharedView() { return (char*) view; }
+        virtual bool _remapPrivateView();
+        virtual string _name() { return _filename; }
+
     };
 
     void printMemInfo( const char * where );    
@@ -26,6 +26,7 @@ namespace mongo {
         fd = 0;
         maphandle = 0;
         view = 0;
+        _privateView = 0;
         len = 0;
     }
 
@@ -44,6 +45,18 @@ namespace mongo {
 
     void MemoryMappedFile::flush(bool sync) {
     }
+
+    MemoryMappedFile::Flushable * MemoryMappedFile::prepareFlush() {
+        return 0;
+    }
+
+    MemoryMappedFile::Flushable * MemoryMappedFile::prepareFlushRange( long offset , long len ) {
+        return 0;
+    }
+
+    bool MemoryMappedFile::_remapPrivateView() {
+        return true;
+    }
     
     void MemoryMappedFile::_lock() {}
     void MemoryMappedFile::_unlock() {}
@@ -32,6 +32,7 @@ namespace mongo {
         fd = 0;
         maphandle = 0;
         view = 0;
+        _privateView = 0;
         len = 0;
         created();
     }
@@ -40,6 +41,9 @@ namespace mongo {
         if ( view )
             munmap(view, len);
         view = 0;
+        if ( _privateView )
+            munmap(_privateView, len);
+        _privateView = 0;
 
         if ( fd )
             ::close(fd);
@@ -92,11 +96,32 @@ namespace mongo {
         }
 #endif
 
+        if ( privateViews() ){
+            _privateView = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if ( _privateView == MAP_FAILED ) {
+                out() << "  mmap() of private view failed for " << filename << " len:" << length << " " << errnoWithDescription() << endl;
+                _privateView = 0;
+                return 0;
+            }
+        }
+
         DEV if (! dbMutex.info().isLocked()){
             _unlock();
         }
 
-        return view;
+        return _view();
+    }
+
+    bool MemoryMappedFile::_remapPrivateView() {
+        if ( ! _privateView )
+            return true;
+        // MAP_FIXED replaces the pages in place, so the view never goes away
+        void * p = mmap(_privateView, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, 0);
+        if ( p != _privateView ) {
+            problem() << "remapping private view of " << _filename << " failed " << errnoWithDescription() << endl;
+            return false;
+        }
+        return true;
     }
     
     void MemoryMappedFile::flush(bool sync) {
@@ -128,12 +153,18 @@ namespace mongo {
         return new PosixFlushable( view , fd , len );
     }
 
+    MemoryMappedFile::Flushable * MemoryMappedFile::prepareFlushRange( long offset , long len ){
+        // the kernel only writes the dirty pages, so a clean range is cheap
+        return new PosixFlushable( view ? (char*)view + offset : 0 , fd , len );
+    }
+
     void MemoryMappedFile::_lock() {
-        if (view) assert(mprotect(view, len, PROT_READ | PROT_WRITE) == 0);
+        if (_view()) assert(mprotect(_view(), len, PROT_READ | PROT_WRITE) == 0);
     }
 
     void MemoryMappedFile::_unlock() {
-        if (view) assert(mprotect(view, len, PROT_READ) == 0);
+        // only the view writers use: the journal copies into the shared one without the lock
+        if (_view()) assert(mprotect(_view(), len, PROT_READ) == 0);
     }
 
 } // namespace mongo
@@ -26,6 +26,7 @@ namespace mongo {
         fd = 0;
         maphandle = 0;
         view = 0;
+        _privateView = 0;
         len = 0;
         created();
     }
@@ -34,6 +35,9 @@ namespace mongo {
         if ( view )
             UnmapViewOfFile(view);
         view = 0;
+        if ( _privateView )
+            UnmapViewOfFile(_privateView);
+        _privateView = 0;
         if ( maphandle )
             CloseHandle(maphandle);
         maphandle = 0;
@@ -92,13 +96,36 @@ namespace mongo {
             out() << endl;
         }
         len = length;
-        return view;
+
+        if ( view && privateViews() ) {
+            _privateView = MapViewOfFile(maphandle, FILE_MAP_COPY, 0, 0, 0);
+            if ( _privateView == 0 ) {
+                out() << "MapViewOfFile (private) failed " << filename << " " << GetLastError() << endl;
+                return 0;
+            }
+        }
+        return _view();
+    }
+
+    bool MemoryMappedFile::_remapPrivateView() {
+        if ( ! _privateView )
+            return true;
+        // not atomic like MAP_FIXED, but no one is using the view: the caller has the write lock
+        UnmapViewOfFile(_privateView);
+        void * p = MapViewOfFileEx(maphandle, FILE_MAP_COPY, 0, 0, 0, _privateView);
+        if ( p != _privateView ) {
+            out() << "remapping private view of " << _filename << " failed " << GetLastError() << endl;
+            return false;
+        }
+        return true;
     }
 
     class WindowsFlushable : public MemoryMappedFile::Flushable {
     public:
-        WindowsFlushable( void * view , HANDLE fd , string filename )
-            : _view(view) , _fd(fd) , _filename(filename){
+        /* len 0 means the whole mapping.  the views are written to the file cache, which
+           flushFile then pushes to disk. */
+        WindowsFlushable( void * view , HANDLE fd , string filename , long len = 0 , bool flushFile = true )
+            : _view(view) , _fd(fd) , _filename(filename) , _len(len) , _flushFile(flushFile){
             
         }
         
@@ -106,12 +133,14 @@ namespace mongo {
             if (!_view || !_fd) 
                 return;
 
-            bool success = FlushViewOfFile(_view, 0); // 0 means whole mapping
+            bool success = FlushViewOfFile(_view, _len);
             if (!success){
                 int err = GetLastError();
                 out() << "FlushViewOfFile failed " << err << " file: " << _filename << endl;
             }
             
+            if ( !_flushFile )
+                return;
             success = FlushFileBuffers(_fd);
             if (!success){
                 int err = GetLastError();
@@ -122,7 +151,8 @@ namespace mongo {
         void * _view;
         HANDLE _fd;
         string _filename;
-        
+        long _len;
+        bool _flushFile;
     };
     
     void MemoryMappedFile::flush(bool sync) {
@@ -132,6 +162,11 @@ namespace mongo {
         f.flush();
     }
 
+    MemoryMappedFile::Flushable * MemoryMappedFile::prepareFlushRange( long offset , long len ){
+        // the file cache goes to disk once per file, with its last range
+        return new WindowsFlushable( view ? (char*)view + offset : 0 , fd , _filename , len , offset + len >= this->len );
+    }
+
     MemoryMappedFile::Flushable * MemoryMappedFile::prepareFlush(){
         return new WindowsFlushable( view , fd , _filename );
     }
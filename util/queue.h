@@ -36,6 +36,15 @@ namespace mongo {
             _queue.push( t );
             _condition.notify_one();
         }
+
+        /** push, first waiting while the queue holds maxSize or more items */
+        void boundedPush(T const& t, unsigned maxSize){
+            scoped_lock l( _lock );
+            while( _queue.size() >= maxSize )
+                _notFull.wait( l.boost() );
+            _queue.push( t );
+            _condition.notify_one();
+        }
         
         bool empty() const {
             scoped_lock l( _lock );
@@ -49,6 +58,7 @@ namespace mongo {
             
             t = _queue.front();
             _queue.pop();
+            _notFull.notify_one();
             
             return true;
         }
@@ -61,6 +71,7 @@ namespace mongo {
             
             T t = _queue.front();
             _queue.pop();
+            _notFull.notify_one();
             return t;    
         }
         
@@ -69,6 +80,7 @@ namespace mongo {
         
         mutable mongo::mutex _lock;
         boost::condition _condition;
+        boost::condition _notFull; // only waited on by boundedPush
     };
 
 }